@@ -0,0 +1,295 @@
+/*
+ * Pointer-chase buffers for queue-type injectors and diags.
+ *
+ * A chase buffer is one circular pointer chain visiting every 64-byte line of
+ * the buffer once, in a random order; word 0 of each line points to the next
+ * line. The buffer is exactly lines * 64 bytes (rounded up to 2 MB) and is
+ * backed by 2 MB pages where available.
+ *
+ * chase_attach(index, lines) returns the first element of chain <index>:
+ *   1. Shared file <CHASE_DIR>/smtcheck_chase.<lines>.<index>, where CHASE_DIR
+ *      defaults to /dev/hugepages if it is a hugetlbfs mount and /dev/shm
+ *      otherwise (CHASE_DIR="" disables sharing). The file is mapped read-only
+ *      at a fixed address, so its absolute pointers are valid in every process.
+ *      The first process builds it under flock() of <file>.lock; later launches
+ *      only map it. A stale file is replaced by building a new one under a
+ *      temporary name and rename()-ing it over the old one, so processes that
+ *      still map the old file keep valid pages.
+ *      CHASE_FILE<index> names the file directly instead (e.g. a hugetlbfs file
+ *      or /proc/<pid>/fd/<n> of an inherited memfd); it is built in place only
+ *      while it is empty.
+ *   2. Private anonymous memory, if the file or the fixed address is
+ *      unavailable.
+ *
+ * The permutation is a keyed Feistel network over the line indices with
+ * cycle-walking, so any position of the chain can be computed on its own and
+ * the chain is written by all CPUs of the affinity mask in parallel.
+ *
+ * Shared by diag/templates/ and profiling/profiling_server/injector_templates/
+ * (both compile with -I on this directory), so diags and injectors attach the
+ * same files.
+ */
+#ifndef CHASE_BUFFER_H
+#define CHASE_BUFFER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include <random>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT          26
+#endif
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE     0x100000
+#endif
+#ifndef HUGETLBFS_MAGIC
+#define HUGETLBFS_MAGIC         0x958458f6
+#endif
+
+#define CHASE_LINE_WORDS        8                       // 64-byte lines
+#define CHASE_PAGE_SIZE         (2ULL << 20)
+#define CHASE_BASE_ADDR         0x3e0000000000ULL       // fixed mapping of shared chain 0
+#define CHASE_BASE_STRIDE       (1ULL << 36)            // 64 GB between chains
+#define CHASE_MAX_THREADS       16
+
+#define CHASE_MAGIC             0x4553414843544d53ULL   // "SMTCHASE"
+#define CHASE_VERSION           1
+
+// Header in words 1..6 of line 0; the chain only uses word 0 of each line
+#define CHASE_HDR_MAGIC         1
+#define CHASE_HDR_VERSION       2
+#define CHASE_HDR_LINES         3
+#define CHASE_HDR_BASE          4
+#define CHASE_HDR_START         5
+#define CHASE_HDR_READY         6       // written last
+
+struct chase_perm {
+    uint64_t lines;
+    uint64_t half_bits;
+    uint64_t half_mask;
+    uint64_t key[4];
+};
+
+static inline uint64_t chase_mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Bijection on [0, lines): Feistel network on 2 * half_bits bits, cycle-walked into range
+static inline uint64_t chase_permute(const struct chase_perm *p, uint64_t x) {
+    do {
+        uint64_t l = x >> p->half_bits, r = x & p->half_mask;
+        for (int i = 0; i < 4; i++) {
+            uint64_t t = r;
+            r = l ^ (chase_mix(r ^ p->key[i]) & p->half_mask);
+            l = t;
+        }
+        x = (l << p->half_bits) | r;
+    } while (x >= p->lines);
+    return x;
+}
+
+static inline size_t chase_size(uint64_t lines) {
+    size_t size = lines * CHASE_LINE_WORDS * sizeof(uint64_t);
+    return (size + CHASE_PAGE_SIZE - 1) & ~(CHASE_PAGE_SIZE - 1);
+}
+
+// Writes the chain into buf (lines * 64 bytes); returns the first element
+static uint64_t *chase_build(uint64_t *buf, uint64_t lines) {
+    struct chase_perm p;
+    std::random_device rd;
+
+    p.lines = lines;
+    p.half_bits = 1;
+    while ((1ULL << (2 * p.half_bits)) < lines)
+        p.half_bits++;
+    p.half_mask = (1ULL << p.half_bits) - 1;
+    for (int i = 0; i < 4; i++)
+        p.key[i] = ((uint64_t)rd() << 32) | rd();
+
+    cpu_set_t mask;
+    int nr_threads = 1;
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+        nr_threads = CPU_COUNT(&mask);
+    if (nr_threads > CHASE_MAX_THREADS)
+        nr_threads = CHASE_MAX_THREADS;
+    if ((uint64_t)nr_threads > lines)
+        nr_threads = 1;
+
+    // Position s of the chain is line permute(s); each thread links a range of positions
+    auto link = [&](uint64_t begin, uint64_t end) {
+        uint64_t cur = chase_permute(&p, begin);
+        for (uint64_t s = begin; s < end; s++) {
+            uint64_t next = chase_permute(&p, (s + 1) % lines);
+            buf[cur * CHASE_LINE_WORDS] = (uint64_t)&buf[next * CHASE_LINE_WORDS];
+            cur = next;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nr_threads; t++)
+        threads.emplace_back(link, lines * t / nr_threads, lines * (t + 1) / nr_threads);
+    link(0, lines / nr_threads);
+    for (auto &thread : threads)
+        thread.join();
+
+    return &buf[chase_permute(&p, 0) * CHASE_LINE_WORDS];
+}
+
+static uint64_t *chase_private(uint64_t lines) {
+    size_t size = chase_size(lines);
+    void *buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+    if (buf == MAP_FAILED) {
+        buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        madvise(buf, size, MADV_HUGEPAGE);
+    }
+    return chase_build((uint64_t *)buf, lines);
+}
+
+static const char *chase_default_dir() {
+    struct statfs fs;
+    if (statfs("/dev/hugepages", &fs) == 0 && (unsigned long)fs.f_type == HUGETLBFS_MAGIC)
+        return "/dev/hugepages";
+    return "/dev/shm";
+}
+
+static bool chase_valid(const uint64_t *hdr, uint64_t lines, uint64_t base) {
+    return hdr[CHASE_HDR_READY] == 1 && hdr[CHASE_HDR_MAGIC] == CHASE_MAGIC &&
+           hdr[CHASE_HDR_VERSION] == CHASE_VERSION && hdr[CHASE_HDR_LINES] == lines &&
+           hdr[CHASE_HDR_BASE] == base;
+}
+
+// Maps an existing chain at base; NULL if absent or stale, sets *busy if base is taken
+static uint64_t *chase_map_file(const char *path, size_t size, uint64_t lines, uint64_t base, bool *busy) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    void *ptr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == size)
+        ptr = mmap((void *)base, size, PROT_READ, MAP_SHARED | MAP_FIXED_NOREPLACE | MAP_POPULATE, fd, 0);
+    close(fd);
+
+    if (ptr == MAP_FAILED)
+        return NULL;
+    if (ptr != (void *)base) {
+        munmap(ptr, size);
+        *busy = true;
+        return NULL;
+    }
+    if (!chase_valid((uint64_t *)ptr, lines, base)) {
+        munmap(ptr, size);
+        return NULL;
+    }
+    return (uint64_t *)ptr;
+}
+
+// Sizes the empty file fd and builds the chain into it at base; hugetlbfs reserves the pages at mmap() time
+static uint64_t *chase_build_file(int fd, size_t size, uint64_t lines, uint64_t base) {
+    if (ftruncate(fd, size) != 0)
+        return NULL;
+
+    void *ptr = mmap((void *)base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    if (ptr != (void *)base) {
+        if (ptr != MAP_FAILED)
+            munmap(ptr, size);
+        return NULL;
+    }
+
+    uint64_t *buf = (uint64_t *)ptr;
+    buf[CHASE_HDR_START] = (uint64_t)chase_build(buf, lines);
+    buf[CHASE_HDR_MAGIC] = CHASE_MAGIC;
+    buf[CHASE_HDR_VERSION] = CHASE_VERSION;
+    buf[CHASE_HDR_LINES] = lines;
+    buf[CHASE_HDR_BASE] = base;
+    __atomic_store_n(&buf[CHASE_HDR_READY], 1, __ATOMIC_RELEASE);
+    mprotect(buf, size, PROT_READ);
+    return buf;
+}
+
+// Maps (or builds, under flock) the shared chain; NULL if sharing is unavailable
+static uint64_t *chase_shared(int index, uint64_t lines) {
+    char var[32], path[256], lock_path[272], tmp_path[288];
+    uint64_t base = CHASE_BASE_ADDR + (uint64_t)index * CHASE_BASE_STRIDE;
+    size_t size = chase_size(lines);
+    bool in_place, busy = false;
+
+    snprintf(var, sizeof(var), "CHASE_FILE%d", index);
+    in_place = getenv(var) && *getenv(var);
+    if (in_place) {
+        snprintf(path, sizeof(path), "%s", getenv(var));
+    }
+    else {
+        const char *dir = getenv("CHASE_DIR") ? getenv("CHASE_DIR") : chase_default_dir();
+        if (!*dir)
+            return NULL;
+        snprintf(path, sizeof(path), "%s/smtcheck_chase.%llu.%d", dir, (unsigned long long)lines, index);
+    }
+
+    // A given file (e.g. a memfd) is its own lock; a named file is replaced, so it gets a lock file
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", path);
+    int lock_fd = open(in_place ? path : lock_path, O_RDWR | O_CREAT, 0666);
+    if (lock_fd < 0)
+        return NULL;
+    flock(lock_fd, LOCK_EX);
+
+    // Map a valid file, else build one; if the address is taken in this process, leave the file alone
+    uint64_t *buf = chase_map_file(path, size, lines, base, &busy);
+    if (!buf && !busy && in_place) {
+        struct stat st;
+        if (fstat(lock_fd, &st) == 0 && st.st_size == 0)
+            buf = chase_build_file(lock_fd, size, lines, base);
+        else
+            fprintf(stderr, "[WARNING] %s holds a different chase buffer\n", path);
+    }
+    else if (!buf && !busy) {
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+        int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (fd >= 0) {
+            buf = chase_build_file(fd, size, lines, base);
+            close(fd);
+            if (buf && rename(tmp_path, path) != 0) {
+                munmap(buf, size);
+                buf = NULL;
+            }
+            if (!buf)
+                unlink(tmp_path);
+        }
+    }
+
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+
+    return buf ? (uint64_t *)buf[CHASE_HDR_START] : NULL;
+}
+
+// First element of circular chain <index> over <lines> 64-byte lines
+static uint64_t *chase_attach(int index, uint64_t lines) {
+    uint64_t *start = chase_shared(index, lines);
+    if (!start) {
+        fprintf(stderr, "[WARNING] No shared chase buffer %d, building a private one\n", index);
+        start = chase_private(lines);
+    }
+    return start;
+}
+
+#endif // CHASE_BUFFER_H
@@ -0,0 +1,360 @@
+/*
+ * Measurement runtime shared by the diag and injector templates.
+ *
+ * measure_init() opens the template's events as one perf group: the first
+ * event leads, and the whole group is read with a single PERF_FORMAT_GROUP
+ * read(). Every read also returns time_enabled/time_running, so counts are
+ * scaled when the kernel multiplexed the group (the text output then carries
+ * a "Multiplex_scale:" line). MEASURE_NO_GROUP=1 opens the events as
+ * independent counters instead, each scaled on its own; use it when the
+ * group does not fit the PMU and is never scheduled.
+ *
+ * Environment:
+ *   MEASURE_CPU=<cpu>          pin the process before opening the events
+ *   MEASURE_WARMUP_MS=<ms>     discard the first <ms> of the run
+ *   MEASURE_REPEAT_MS=<ms>     also record one result per <ms> interval
+ *   MEASURE_OUTPUT=<path>      append results to <path>: one JSON object per
+ *                              line, or struct measure_record with
+ *                              MEASURE_FORMAT=binary
+ *   INJECTOR_PRESSURE_EVENT=<event>
+ *                              counted by measure_add_pressure() (injectors)
+ *
+ * The text printed by the templates is unchanged, so the diag parsers and
+ * measure_injector_single.py keep parsing stdout; MEASURE_OUTPUT is the
+ * machine-readable channel. Records of intervals carry rep >= 0, the record
+ * of the whole run (after warm-up) carries rep = -1.
+ *
+ * Diag and injector builds both compile with -I on this directory.
+ */
+#ifndef MEASURE_H
+#define MEASURE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <linux/perf_event.h>
+#include <perfmon/pfmlib.h>
+#include <perfmon/pfmlib_perf_event.h>
+
+#define MEASURE_MAX_EVENTS      8
+#define MEASURE_RECORD_MAGIC    0x5341454d      // "MEAS"
+
+// Scaled counts over one interval (rep >= 0) or the whole run (rep = -1)
+struct measure_result {
+    int rep;
+    int nr;
+    double elapsed;                             // seconds
+    double scale;                               // time_running / time_enabled
+    long long count[MEASURE_MAX_EVENTS];        // in measure_init()/measure_add() order
+};
+
+// MEASURE_FORMAT=binary record; counts past nr are zero
+struct measure_record {
+    uint32_t magic;
+    int32_t rep;
+    uint32_t nr;
+    uint32_t reserved;
+    double elapsed;
+    double scale;
+    int64_t count[MEASURE_MAX_EVENTS];
+};
+
+struct measure_sample {
+    struct timespec ts;
+    uint64_t enabled;
+    uint64_t running;
+    double value[MEASURE_MAX_EVENTS];
+};
+
+static struct {
+    int nr;
+    bool grouped;
+    const char *name[MEASURE_MAX_EVENTS];
+    int fd[MEASURE_MAX_EVENTS];
+    uint64_t id[MEASURE_MAX_EVENTS];
+    int out_fd;
+    bool binary;
+    long warmup_ms;
+    long repeat_ms;
+    bool warming;
+    int rep;
+    int pressure;                               // index of the pressure event, or -1
+    struct measure_sample base;                 // start of the measured run
+    struct measure_sample last;                 // start of the current interval
+} measure;
+
+static long measure_env_long(const char *var, long dflt) {
+    const char *val = getenv(var);
+    return val && *val ? atol(val) : dflt;
+}
+
+static int measure_open_event(const char *event, int plm, int group_fd) {
+    perf_event_attr attr;
+    pfm_perf_encode_arg_t encode;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // Group members follow the leader's enable state
+    attr.disabled = group_fd == -1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    if (measure.grouped)
+        attr.read_format |= PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+
+    memset(&encode, 0, sizeof(encode));
+    encode.attr = &attr;
+    encode.size = sizeof(encode);
+
+    int ret = pfm_get_os_event_encoding(event, plm, PFM_OS_PERF_EVENT_EXT, &encode);
+    if (ret != PFM_SUCCESS) {
+        fprintf(stderr, "Failed to get encoding for event %s(%d): %s\n", event, ret, pfm_strerror(ret));
+        return -1;
+    }
+    int fd = perf_event_open(&attr, 0, -1, group_fd, 0);
+    if (fd == -1)
+        fprintf(stderr, "Error opening leader[%s] %llx\n", event, attr.config);
+    return fd;
+}
+
+// Adds an event counted at privilege levels plm (PFM_PLM*) to the group;
+// returns its index, or -1 if it cannot be counted
+static int measure_add(const char *event, int plm) {
+    if (measure.nr == MEASURE_MAX_EVENTS)
+        return -1;
+
+    int leader = measure.grouped && measure.nr > 0 ? measure.fd[0] : -1;
+    int fd = measure_open_event(event, plm, leader);
+    if (fd == -1)
+        return -1;
+
+    measure.name[measure.nr] = event;
+    measure.fd[measure.nr] = fd;
+    if (measure.grouped)
+        ioctl(fd, PERF_EVENT_IOC_ID, &measure.id[measure.nr]);
+    return measure.nr++;
+}
+
+// Initializes libpfm, pins the process and opens events[0..nr) (exits on failure)
+static void measure_init(const char *const *events, int nr) {
+    int ret = pfm_initialize();
+    if (ret != PFM_SUCCESS) {
+        fprintf(stderr, "pfm_initialize failed: %s\n", pfm_strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+
+    long cpu = measure_env_long("MEASURE_CPU", -1);
+    if (cpu >= 0) {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(cpu, &mask);
+        if (sched_setaffinity(0, sizeof(mask), &mask) != 0) {
+            perror("sched_setaffinity");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    measure.grouped = measure_env_long("MEASURE_NO_GROUP", 0) == 0;
+    measure.warmup_ms = measure_env_long("MEASURE_WARMUP_MS", 0);
+    measure.repeat_ms = measure_env_long("MEASURE_REPEAT_MS", 0);
+    measure.out_fd = -1;
+    measure.pressure = -1;
+    const char *out = getenv("MEASURE_OUTPUT");
+    if (out && *out) {
+        const char *format = getenv("MEASURE_FORMAT");
+        measure.binary = format && strcmp(format, "binary") == 0;
+        measure.out_fd = open(out, O_WRONLY | O_CREAT | O_APPEND, 0666);
+        if (measure.out_fd == -1)
+            perror("MEASURE_OUTPUT");
+    }
+
+    for (int i = 0; i < nr; i++) {
+        if (measure_add(events[i], PFM_PLM3 | PFM_PLM0) != i)
+            exit(EXIT_FAILURE);
+    }
+}
+
+static void measure_snapshot(struct measure_sample *s) {
+    memset(s, 0, sizeof(*s));
+    clock_gettime(CLOCK_MONOTONIC, &s->ts);
+
+    if (measure.grouped) {
+        // { nr, time_enabled, time_running, { value, id }[nr] }
+        uint64_t buf[3 + 2 * MEASURE_MAX_EVENTS];
+        if (read(measure.fd[0], buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)))
+            return;
+        s->enabled = buf[1];
+        s->running = buf[2];
+        for (uint64_t k = 0; k < buf[0] && k < MEASURE_MAX_EVENTS; k++) {
+            for (int i = 0; i < measure.nr; i++) {
+                if (measure.id[i] == buf[4 + 2 * k])
+                    s->value[i] = (double)buf[3 + 2 * k];
+            }
+        }
+        return;
+    }
+
+    // Independent counters: scale each one by its own enabled/running times
+    for (int i = 0; i < measure.nr; i++) {
+        uint64_t buf[3];
+        if (read(measure.fd[i], buf, sizeof(buf)) != sizeof(buf))
+            continue;
+        s->value[i] = buf[2] ? (double)buf[0] * buf[1] / buf[2] : 0.0;
+        if (i == 0) {
+            s->enabled = buf[1];
+            s->running = buf[2];
+        }
+    }
+}
+
+static void measure_diff(const struct measure_sample *from, const struct measure_sample *to,
+                         int rep, struct measure_result *r) {
+    uint64_t enabled = to->enabled - from->enabled;
+    uint64_t running = to->running - from->running;
+
+    r->rep = rep;
+    r->nr = measure.nr;
+    r->elapsed = (to->ts.tv_sec - from->ts.tv_sec) + (to->ts.tv_nsec - from->ts.tv_nsec) / 1e9;
+    r->scale = enabled ? (double)running / enabled : 0.0;
+    for (int i = 0; i < MEASURE_MAX_EVENTS; i++) {
+        double delta = i < measure.nr ? to->value[i] - from->value[i] : 0.0;
+        if (measure.grouped)
+            delta = running ? delta * enabled / running : 0.0;
+        r->count[i] = (long long)(delta + 0.5);
+    }
+}
+
+static void measure_write(const struct measure_result *r) {
+    if (measure.out_fd == -1)
+        return;
+
+    if (measure.binary) {
+        struct measure_record rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.magic = MEASURE_RECORD_MAGIC;
+        rec.rep = r->rep;
+        rec.nr = r->nr;
+        rec.elapsed = r->elapsed;
+        rec.scale = r->scale;
+        for (int i = 0; i < r->nr; i++)
+            rec.count[i] = r->count[i];
+        ssize_t res = write(measure.out_fd, &rec, sizeof(rec));
+        (void)res;
+        return;
+    }
+
+    char line[1024];
+    int len = snprintf(line, sizeof(line), "{\"rep\": %d, \"elapsed\": %.6f, \"scale\": %.4f",
+                       r->rep, r->elapsed, r->scale);
+    for (int i = 0; i < r->nr && len < (int)sizeof(line); i++)
+        len += snprintf(line + len, sizeof(line) - len, ", \"%s\": %lld", measure.name[i], r->count[i]);
+    if (len < (int)sizeof(line) - 2) {
+        line[len++] = '}';
+        line[len++] = '\n';
+        ssize_t res = write(measure.out_fd, line, len);
+        (void)res;
+    }
+}
+
+// SIGALRM: end of the warm-up, or end of one repetition interval
+static void measure_tick(int signal) {
+    struct measure_sample now;
+    measure_snapshot(&now);
+
+    if (measure.warming) {
+        measure.warming = false;
+        measure.base = now;
+    }
+    else {
+        struct measure_result r;
+        measure_diff(&measure.last, &now, measure.rep++, &r);
+        measure_write(&r);
+    }
+    measure.last = now;
+}
+
+// Starts counting; call right before entering the kernel
+static void measure_start() {
+    int flags = measure.grouped ? PERF_IOC_FLAG_GROUP : 0;
+    for (int i = 0; i < (measure.grouped ? 1 : measure.nr); i++) {
+        ioctl(measure.fd[i], PERF_EVENT_IOC_RESET, flags);
+        ioctl(measure.fd[i], PERF_EVENT_IOC_ENABLE, flags);
+    }
+    measure_snapshot(&measure.base);
+    measure.last = measure.base;
+
+    measure.warming = measure.warmup_ms > 0;
+    long first_ms = measure.warming ? measure.warmup_ms : measure.repeat_ms;
+    if (first_ms > 0) {
+        struct itimerval timer;
+        signal(SIGALRM, measure_tick);
+        timer.it_value.tv_sec = first_ms / 1000;
+        timer.it_value.tv_usec = first_ms % 1000 * 1000;
+        timer.it_interval.tv_sec = measure.repeat_ms / 1000;
+        timer.it_interval.tv_usec = measure.repeat_ms % 1000 * 1000;
+        setitimer(ITIMER_REAL, &timer, NULL);
+    }
+}
+
+// Stops counting and returns the whole run (after warm-up); also written to MEASURE_OUTPUT
+static void measure_stop(struct measure_result *r) {
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_REAL, &off, NULL);
+
+    int flags = measure.grouped ? PERF_IOC_FLAG_GROUP : 0;
+    for (int i = 0; i < (measure.grouped ? 1 : measure.nr); i++)
+        ioctl(measure.fd[i], PERF_EVENT_IOC_DISABLE, flags);
+
+    struct measure_sample now;
+    measure_snapshot(&now);
+    measure_diff(&measure.base, &now, -1, r);
+    measure_write(r);
+
+    if (r->scale == 0.0 && measure.grouped)
+        fprintf(stderr, "[WARNING] Event group was never scheduled; retry with MEASURE_NO_GROUP=1\n");
+}
+
+// "<event>: <count>" per event, plus the multiplexing scale when counts were scaled
+static void measure_print(const struct measure_result *r) {
+    for (int i = 0; i < r->nr; i++)
+        printf("%s: %lld\n", measure.name[i], r->count[i]);
+    if (r->scale > 0.0 && r->scale < 0.999)
+        printf("Multiplex_scale: %.4f\n", r->scale);
+}
+
+// Adds the resource-specific event named by INJECTOR_PRESSURE_EVENT
+// (tools/machine_data.PRESSURE_EVENT) to the group; call after measure_init()
+static void measure_add_pressure() {
+    const char *event = getenv("INJECTOR_PRESSURE_EVENT");
+    if (!event || !*event)
+        return;
+
+    measure.pressure = measure_add(event, PFM_PLM3);
+    if (measure.pressure < 0)
+        fprintf(stderr, "[WARNING] Pressure event %s unavailable\n", event);
+}
+
+// Achieved pressure: pressure events per 1000 instructions
+static void measure_print_pressure(const struct measure_result *r, long long insts) {
+    if (measure.pressure < 0)
+        return;
+    printf("Pressure: %.4f\n", insts > 0 ? 1000.0 * r->count[measure.pressure] / insts : 0.0);
+}
+
+static void measure_close() {
+    for (int i = measure.nr - 1; i >= 0; i--)
+        close(measure.fd[i]);
+    if (measure.out_fd != -1)
+        close(measure.out_fd);
+}
+
+#endif // MEASURE_H
@@ -28,7 +28,7 @@ if __name__ == "__main__":
     with open(code_name, "w") as code_file:
         code_file.write(template)
     
-    result = subprocess.run(["g++", "-o", bin_name, code_name, "-lpfm"], capture_output=True, text=True)
+    result = subprocess.run(["g++", "-I../common", "-o", bin_name, code_name, "-lpfm"], capture_output=True, text=True)
     if result.returncode != 0:
         print(f"[ERROR] returncode={result.returncode}")
         print(result.stderr)
\ No newline at end of file
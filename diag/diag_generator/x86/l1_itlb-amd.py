@@ -48,7 +48,7 @@ def generator(args):
     with open(code_name, "w") as file:
         file.write(base)
     
-    result = subprocess.run(["g++", "-o", bin_name, code_name, template_file, "-lpfm"], capture_output=True, text=True)
+    result = subprocess.run(["g++", "-I../common", "-o", bin_name, code_name, template_file, "-lpfm"], capture_output=True, text=True)
     return result.returncode, result.stderr, (window_size, num_entries)
 
 if __name__ == "__main__":
@@ -79,7 +79,7 @@ def generator(args):
     with open(code_name, "w") as code_file:
         code_file.write(code)
     
-    result = subprocess.run(["g++", "-o", bin_name, code_name, "-lpfm"], capture_output=True, text=True)
+    result = subprocess.run(["g++", "-I../common", "-o", bin_name, code_name, "-lpfm", "-lpthread"], capture_output=True, text=True)
     return result.returncode, result.stderr, num_ops
     
 if __name__ == "__main__":
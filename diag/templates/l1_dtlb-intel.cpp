@@ -11,10 +11,7 @@
 #include <random>
 #include <algorithm>
 #include <csignal>
-#include <sys/ioctl.h>
-#include <linux/perf_event.h>
-#include <perfmon/pfmlib.h>
-#include <perfmon/pfmlib_perf_event.h>
+#include "measure.h"
 
 // Constants
 #define EVENT_COUNT 4
@@ -28,47 +25,30 @@ static const char* event_list[EVENT_COUNT] = {
     "MEM_INST_RETIRED.ALL_LOADS"
 };
 
-// Global variables
-pfm_pmu_info_t pinfo;
-struct timespec start, end;
-long long count_arr[EVENT_COUNT];
-perf_event_attr pe_arr[EVENT_COUNT];
-pfm_perf_encode_arg_t encodes[EVENT_COUNT];
-int fd_arr[EVENT_COUNT];
-char* name[EVENT_COUNT];
-
 uint64_t* RandomArray0;
 
 // Signal handler for SIGINT and SIGSEGV
 void sigint_handler(int signal) {
-    // Disable and read performance counters
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    for (int i = 0; i < EVENT_COUNT; i++) {
-        ioctl(fd_arr[i], PERF_EVENT_IOC_DISABLE, 0);
-        ssize_t res = read(fd_arr[i], &count_arr[i], sizeof(count_arr[i]));
-    }
+    // Stop the event group and read the scaled counts
+    struct measure_result result;
+    measure_stop(&result);
 
     printf("\n[%d] Measuring instruction count for this printf\n", signal);
     
-    long long cycles = count_arr[0];
-    long long insts = count_arr[1];
-    long long dtlb_miss = count_arr[2];
-    long long load_insts = count_arr[3];
+    long long cycles = result.count[0];
+    long long insts = result.count[1];
+    long long dtlb_miss = result.count[2];
+    long long load_insts = result.count[3];
     
-    for (int i = 0; i < EVENT_COUNT; i++) {
-        printf("%s: %lld\n", event_list[i], count_arr[i]);
-    }
+    measure_print(&result);
     
-    double elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double elapsed_time = result.elapsed;
     printf("Elapsed_time: %.6f seconds\n", elapsed_time);
     printf("IPC: %.4f\n", (double)insts / (double)cycles);
     printf("DTLB_MISS_RATE: %.4f\n", (double)dtlb_miss / (double)load_insts);
     printf("Average_Frequency: %.4lf GHz\n", (double)(cycles)/elapsed_time/pow(10, 9));
     
-    // Close file descriptors
-    for (int i = 0; i < EVENT_COUNT; i++) {
-        close(fd_arr[i]);
-    }
+    measure_close();
 
     exit(0);
 }
@@ -105,12 +85,7 @@ static uint64_t* init_array(uint64_t* array, int num_sets, int num_ways, int str
 
 // Diagnostic function
 static void diag(uint64_t* arr0){
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    for(int i=0; i<EVENT_COUNT; i++)
-    {
-        ioctl(fd_arr[i], PERF_EVENT_IOC_RESET, 0);
-        ioctl(fd_arr[i], PERF_EVENT_IOC_ENABLE, 0);
-    }
+    measure_start();
 
         asm volatile(
     "movq %[RandomArray0], %%r13"
@@ -130,8 +105,6 @@ static bool is_power_of_two(int x) {
 }
 
 int main(int argc, char **argv) {
-    int ret;
-    
     int use_hugepage = atoi(argv[1]); // 0: no hugepage, 1: hugepage
     int stride = atoi(argv[2]); // stride in bytes
     int num_sets = atoi(argv[3]);
@@ -156,49 +129,12 @@ int main(int argc, char **argv) {
     signal(SIGINT, sigint_handler);
     signal(SIGSEGV, sigint_handler);
 
-    // Initialize performance monitoring library
-    ret = pfm_initialize();
-    if (ret != PFM_SUCCESS) {
-        fprintf(stderr, "pfm_initialize failed: %s\n", pfm_strerror(ret));
-        return EXIT_FAILURE;
-    }
-
     // Initialize random array
     uint64_t* start_ptr = init_array(RandomArray0, num_sets, num_ways, stride);
     printf("Array initialization is done.\n");
     
-    // Set up performance event attributes
-    for (int i = 0; i < EVENT_COUNT; i++) {
-        memset(&pe_arr[i], 0, sizeof(pe_arr[i]));
-        pe_arr[i].size = sizeof(pe_arr[i]);
-        pe_arr[i].disabled = 1;
-        pe_arr[i].exclude_kernel = 1;
-        pe_arr[i].exclude_hv = 1;
-
-        encodes[i].attr = &pe_arr[i];
-        encodes[i].fstr = &name[i];
-        encodes[i].size = sizeof(encodes[i]);
-    }
-    
-    memset(&pinfo, 0, sizeof(pinfo));
-
-    // Get encoding for events and open performance counters
-    for (int i = 0; i < EVENT_COUNT; i++) {   
-        ret = pfm_get_os_event_encoding(event_list[i], PFM_PLM3 | PFM_PLM0, 
-                                        PFM_OS_PERF_EVENT_EXT, &encodes[i]);
-        if (ret != PFM_SUCCESS) {
-            fprintf(stderr, "Failed to get encoding for event %d(%d): %s\n",
-                    i, ret, pfm_strerror(ret));
-            exit(1);
-        }
-        
-        fd_arr[i] = perf_event_open(encodes[i].attr, 0, -1, -1, 0);
-        if (fd_arr[i] == -1) {
-            fprintf(stderr, "Error opening leader[%s] %llx\n", 
-                    event_list[i], pe_arr[i].config);
-            exit(EXIT_FAILURE);
-        }
-    }
+    // Open the event group
+    measure_init(event_list, EVENT_COUNT);
 
     printf("perf ok\n");
     
@@ -8,10 +8,13 @@ To add a new resource:
 1. Create a generator script at: injector_generator/{isa}/{resource}.py
 2. The script receives (code_dir, injector_dir, sample_points, extra_data)
 3. Generate injector binaries at different pressure levels
+4. Build each body as a runtime kernel too (x86/runtime_kernel.py), so it is
+   linked into injector/injector_runtime
 """
 
 import os
 import sys
+import glob
 import subprocess
 from tools import machine_data
 
@@ -94,6 +97,91 @@ def get_extra_data(feature):
         return "0"
 
 
+def check_runtime_link(kernel_objs):
+    """
+    Link the runtime against one kernel of each generator type on its own.
+
+    A kernel object that cannot be linked (e.g. a symbol localized out of a
+    discarded COMDAT group) fails the full link without saying which generator
+    produced it; this names the failing generators instead.
+
+    Args:
+        kernel_objs: Kernel objects, code/<feature>/<name>.kernel.o
+
+    Returns:
+        List of features whose kernel failed to link
+    """
+    samples = dict()    # feature -> first kernel object
+    for obj in kernel_objs:
+        samples.setdefault(os.path.basename(os.path.dirname(obj)), obj)
+
+    runtime_obj = "injector/injector_runtime.check.o"
+    check_bin = "injector/injector_runtime.check"
+    result = subprocess.run(
+        ["g++", "-O2", "-Iinjector_templates", "-I../../common", "-c", "-o", runtime_obj,
+         "injector_templates/injector_runtime.cpp"],
+        capture_output=True,
+        text=True,
+        check=False,
+    )
+    if result.returncode != 0:
+        print(f"[ERROR] Failed to compile injector_runtime, returncode={result.returncode}")
+        print(result.stderr)
+        return list(samples)
+
+    failed_features = []
+    for feature, obj in sorted(samples.items()):
+        result = subprocess.run(
+            ["g++", "-o", check_bin, runtime_obj, obj, "-lpfm", "-lpthread"],
+            capture_output=True,
+            text=True,
+            check=False,
+        )
+        if result.returncode != 0:
+            print(f"[ERROR] Runtime kernel {obj} ({feature}) does not link")
+            print(result.stderr)
+            failed_features.append(feature)
+
+    os.system(f"rm -f {runtime_obj} {check_bin}")
+    return failed_features
+
+
+def link_runtime():
+    """
+    Link every kernel object into the persistent injector runtime.
+    
+    The runtime (injector_templates/injector_runtime.cpp) keeps one process per
+    sibling core and switches between these kernels on command.
+    
+    Returns:
+        True if injector/injector_runtime was linked
+    """
+    kernel_objs = sorted(glob.glob("code/*/*.kernel.o"))
+    if not kernel_objs:
+        print("[WARNING] No runtime kernels found, skipping injector_runtime.")
+        return False
+
+    failed_features = check_runtime_link(kernel_objs)
+    if failed_features:
+        print(f"[ERROR] Runtime kernels fail to link for: {', '.join(failed_features)}")
+        return False
+
+    result = subprocess.run(
+        ["g++", "-O2", "-Iinjector_templates", "-I../../common", "-o", "injector/injector_runtime",
+         "injector_templates/injector_runtime.cpp"] + kernel_objs + ["-lpfm", "-lpthread"],
+        capture_output=True,
+        text=True,
+        check=False,
+    )
+    if result.returncode != 0:
+        print(f"[ERROR] Failed to link injector_runtime, returncode={result.returncode}")
+        print(result.stderr)
+        return False
+
+    print(f"[INFO] Linked injector_runtime with {len(kernel_objs)} kernels.")
+    return True
+
+
 def run_generator(isa):
     """
     Generate injector binaries for all target resources.
@@ -136,6 +224,8 @@ def run_generator(isa):
 
     if failed_features:
         print(f"[ERROR] Failed to generate injectors for: {', '.join(failed_features)}")
+
+    link_runtime()
     
     return failed_features
 
@@ -1,6 +1,8 @@
 import sys
 import subprocess
 
+from runtime_kernel import build_kernel
+
 block = """\
 MainLoop:
     asm volatile ("addps %xmm0, %xmm1");
@@ -24,8 +26,12 @@ def generator(code_gen_dir, bin_dir):
     with open(code_name, "w") as code_file:
         code_file.write(code)
     
-    result = subprocess.run(["g++", "-o", bin_name, code_name, "-lpfm"], capture_output=True, text=True)
-    return result.returncode, result.stderr
+    result = subprocess.run(["g++", "-Iinjector_templates", "-I../../common", "-o", bin_name, code_name, "-lpfm"], capture_output=True, text=True)
+    if result.returncode != 0:
+        return result.returncode, result.stderr
+
+    # Same body as a kernel of the persistent injector runtime
+    return build_kernel([code_name], code_gen_dir, "fp_port.0")
     
 if __name__ == "__main__":
     code_gen_dir = sys.argv[1]
@@ -10,6 +10,7 @@ and fill the issue queue to specified pressure levels.
 
 import sys
 import subprocess
+from runtime_kernel import build_kernel
 from multiprocessing import Pool, cpu_count
 
 # Number of base operations already in the template (movq instruction)
@@ -83,8 +84,13 @@ def generator(args):
         code_file.write(code)
     
     # Compile with g++ and link against libpfm4
-    result = subprocess.run(["g++", "-o", bin_name, code_name, "-lpfm"], capture_output=True, text=True)
-    return result.returncode, result.stderr, num_ops
+    result = subprocess.run(["g++", "-Iinjector_templates", "-I../../common", "-o", bin_name, code_name, "-lpfm", "-lpthread"], capture_output=True, text=True)
+    if result.returncode != 0:
+        return result.returncode, result.stderr, num_ops
+
+    # Same body as a kernel of the persistent injector runtime
+    returncode, stderr = build_kernel([code_name], code_gen_dir, f"int_isq.{num_ops}")
+    return returncode, stderr, num_ops
     
 
 if __name__ == "__main__":
@@ -11,6 +11,8 @@ multiple registers to control the number of conflicting cache ways.
 import sys
 import os
 
+from runtime_kernel import build_kernel
+
 # Assembly template for L1 dcache stress test
 # Loads 4 different pointers into registers for multi-way access
 base = """\
@@ -129,7 +131,12 @@ if __name__ == "__main__":
             f.write(code)
 
         # Compile with cache configuration macros
-        os.system(f"g++ -D USE_HUGEPAGE={use_hugepage} -D NUM_ENTRIES={num_entries} -D NUM_REGISTERS={num_registers} -D SHIFT_BITS=6 -o {bin_name} {code_name} -lpfm")
+        os.system(f"g++ -Iinjector_templates -I../../common -D USE_HUGEPAGE={use_hugepage} -D NUM_ENTRIES={num_entries} -D NUM_REGISTERS={num_registers} -D SHIFT_BITS=6 -o {bin_name} {code_name} -lpfm")
+        returncode, stderr = build_kernel([code_name], code_gen_dir, f"l1_dcache.{num_registers}",
+                                          [f"USE_HUGEPAGE={use_hugepage}", f"NUM_ENTRIES={num_entries}", "SHIFT_BITS=6"])
+        if returncode != 0:
+            print(f"[ERROR] kernel l1_dcache.{num_registers}, returncode={returncode}")
+            print(stderr)
         
     # Generate special low/high contention injectors for baseline measurements
     for special_type in ["low", "high"]:
@@ -143,4 +150,9 @@ if __name__ == "__main__":
             code = gen_code(template, max(sample_points), num_entries, False)
         with open(code_name, "w") as f:
             f.write(code)
-        os.system(f"g++ -D USE_HUGEPAGE={use_hugepage} -D NUM_ENTRIES={num_entries} -D NUM_REGISTERS={num_registers} -D SHIFT_BITS=6 -o {bin_name} {code_name} -lpfm")
\ No newline at end of file
+        os.system(f"g++ -Iinjector_templates -I../../common -D USE_HUGEPAGE={use_hugepage} -D NUM_ENTRIES={num_entries} -D NUM_REGISTERS={num_registers} -D SHIFT_BITS=6 -o {bin_name} {code_name} -lpfm")
+        returncode, stderr = build_kernel([code_name], code_gen_dir, f"l1_dcache.{special_type}",
+                                          [f"USE_HUGEPAGE={use_hugepage}", f"NUM_ENTRIES={num_entries}", "SHIFT_BITS=6"])
+        if returncode != 0:
+            print(f"[ERROR] kernel l1_dcache.{special_type}, returncode={returncode}")
+            print(stderr)
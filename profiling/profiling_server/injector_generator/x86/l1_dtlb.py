@@ -26,6 +26,8 @@ Command Line Arguments:
 import os
 import sys
 
+from runtime_kernel import build_kernel
+
 # Base assembly template: loads 4 pointers into registers and initializes loop
 base = """\
     asm volatile(
@@ -145,7 +147,12 @@ if __name__ == "__main__":
         with open(code_name, "w") as f:
             f.write(code)
         
-        os.system(f"g++ -D USE_HUGEPAGE={use_hugepage} -D NUM_ENTRIES={num_entries} -D NUM_REGISTERS={num_registers} -D SHIFT_BITS=12 -o {bin_name} {code_name} -lpfm")
+        os.system(f"g++ -Iinjector_templates -I../../common -D USE_HUGEPAGE={use_hugepage} -D NUM_ENTRIES={num_entries} -D NUM_REGISTERS={num_registers} -D SHIFT_BITS=12 -o {bin_name} {code_name} -lpfm")
+        returncode, stderr = build_kernel([code_name], code_gen_dir, f"l1_dtlb.{num_registers}",
+                                          [f"USE_HUGEPAGE={use_hugepage}", f"NUM_ENTRIES={num_entries}", "SHIFT_BITS=12"])
+        if returncode != 0:
+            print(f"[ERROR] kernel l1_dtlb.{num_registers}, returncode={returncode}")
+            print(stderr)
     
     # Generate special low/high pressure injectors for profiling
     for special_type in ["low", "high"]:
@@ -160,4 +167,9 @@ if __name__ == "__main__":
         with open(code_name, "w") as f:
             f.write(code)
         
-        os.system(f"g++ -D USE_HUGEPAGE={use_hugepage} -D NUM_ENTRIES={num_entries} -D NUM_REGISTERS={num_registers} -D SHIFT_BITS=12 -o {bin_name} {code_name} -lpfm")
\ No newline at end of file
+        os.system(f"g++ -Iinjector_templates -I../../common -D USE_HUGEPAGE={use_hugepage} -D NUM_ENTRIES={num_entries} -D NUM_REGISTERS={num_registers} -D SHIFT_BITS=12 -o {bin_name} {code_name} -lpfm")
+        returncode, stderr = build_kernel([code_name], code_gen_dir, f"l1_dtlb.{special_type}",
+                                          [f"USE_HUGEPAGE={use_hugepage}", f"NUM_ENTRIES={num_entries}", "SHIFT_BITS=12"])
+        if returncode != 0:
+            print(f"[ERROR] kernel l1_dtlb.{special_type}, returncode={returncode}")
+            print(stderr)
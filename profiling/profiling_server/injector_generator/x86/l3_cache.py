@@ -1,6 +1,8 @@
 import os
 import sys
 
+from runtime_kernel import build_kernel
+
 base = """\
     asm volatile(
     "movq %[ptr0], %%r8"
@@ -88,7 +90,12 @@ if __name__ == "__main__":
         with open(code_name, "w") as f:
             f.write(code)
         
-        os.system(f"g++ -D USE_HUGEPAGE={use_hugepage} -D NUM_ENTRIES={num_entries} -D NUM_REGISTERS={num_registers} -D SHIFT_BITS=6 -o {bin_name} {code_name} -lpfm")
+        os.system(f"g++ -Iinjector_templates -I../../common -D USE_HUGEPAGE={use_hugepage} -D NUM_ENTRIES={num_entries} -D NUM_REGISTERS={num_registers} -D SHIFT_BITS=6 -o {bin_name} {code_name} -lpfm")
+        returncode, stderr = build_kernel([code_name], code_gen_dir, f"l3_cache.{num_registers}",
+                                          [f"USE_HUGEPAGE={use_hugepage}", f"NUM_ENTRIES={num_entries}", "SHIFT_BITS=6"])
+        if returncode != 0:
+            print(f"[ERROR] kernel l3_cache.{num_registers}, returncode={returncode}")
+            print(stderr)
         
     
     for special_type in ["low", "high"]:
@@ -101,4 +108,9 @@ if __name__ == "__main__":
         with open(code_name, "w") as f:
             f.write(code)
         
-        os.system(f"g++ -D USE_HUGEPAGE={use_hugepage} -D NUM_ENTRIES={num_entries} -D NUM_REGISTERS={num_registers} -D SHIFT_BITS=6 -o {bin_name} {code_name} -lpfm")
\ No newline at end of file
+        os.system(f"g++ -Iinjector_templates -I../../common -D USE_HUGEPAGE={use_hugepage} -D NUM_ENTRIES={num_entries} -D NUM_REGISTERS={num_registers} -D SHIFT_BITS=6 -o {bin_name} {code_name} -lpfm")
+        returncode, stderr = build_kernel([code_name], code_gen_dir, f"l3_cache.{special_type}",
+                                          [f"USE_HUGEPAGE={use_hugepage}", f"NUM_ENTRIES={num_entries}", "SHIFT_BITS=6"])
+        if returncode != 0:
+            print(f"[ERROR] kernel l3_cache.{special_type}, returncode={returncode}")
+            print(stderr)
@@ -1,5 +1,6 @@
 import sys
 import subprocess
+from runtime_kernel import build_kernel
 from multiprocessing import Pool, cpu_count
 
 base_op_nums = 1 # movq (%r13), %r13
@@ -49,8 +50,13 @@ def generator(args):
     with open(code_name, "w") as code_file:
         code_file.write(code)
     
-    result = subprocess.run(["g++", "-o", bin_name, code_name, "-lpfm"], capture_output=True, text=True)
-    return result.returncode, result.stderr, num_ops
+    result = subprocess.run(["g++", "-Iinjector_templates", "-I../../common", "-o", bin_name, code_name, "-lpfm", "-lpthread"], capture_output=True, text=True)
+    if result.returncode != 0:
+        return result.returncode, result.stderr, num_ops
+
+    # Same body as a kernel of the persistent injector runtime
+    returncode, stderr = build_kernel([code_name], code_gen_dir, f"load_lsq.{num_ops}")
+    return returncode, stderr, num_ops
     
 if __name__ == "__main__":
     code_gen_dir = sys.argv[1]
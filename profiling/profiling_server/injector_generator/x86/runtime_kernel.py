@@ -0,0 +1,74 @@
+"""
+Runtime Kernel Builder
+
+Compiles a generated injector source a second time, with -DINJ_KERNEL, into a
+relocatable kernel object next to the source (<code_dir>/<name>.kernel.o).
+injector_generator.py links every kernel object into injector/injector_runtime,
+the persistent injector that switches pressure without restarting
+(see injector_templates/injector_runtime.h).
+
+The strong global definitions of a kernel object are made local, so the
+template globals (ptr_arr, fd_arr, diag_start, ...) of different kernels never
+collide; the runtime finds each kernel through its descriptor in section
+inj_kernels. Weak and COMDAT definitions (inline and template instances, e.g.
+std::thread from chase_buffer.h) stay global: the linker keeps one copy of each
+group, and a localized member would point into a discarded section.
+"""
+
+import subprocess
+
+# nm -P types of strong global definitions (text, data, bss, rodata, small data)
+STRONG_GLOBAL_TYPES = set("TDBRGS")
+
+
+def strong_globals(obj_name):
+    """
+    List the strong global symbols an object defines.
+
+    Args:
+        obj_name: Object file to inspect
+
+    Returns:
+        Tuple of (return_code, stderr, symbol names)
+    """
+    result = subprocess.run(["nm", "--defined-only", "-P", obj_name], capture_output=True, text=True)
+    if result.returncode != 0:
+        return result.returncode, result.stderr, []
+
+    symbols = []
+    for line in result.stdout.splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[1] in STRONG_GLOBAL_TYPES:
+            symbols.append(fields[0])
+    return 0, "", symbols
+
+
+def build_kernel(sources, code_gen_dir, name, defines=()):
+    """
+    Compile injector source(s) into a kernel object for injector_runtime.
+
+    Args:
+        sources: Generated source files (a .cpp, or a .s plus its template)
+        code_gen_dir: Directory for generated source files
+        name: Mode name, the injector file name without ".injector"
+        defines: Macro definitions used for the standalone injector ("NAME=VALUE")
+
+    Returns:
+        Tuple of (return_code, stderr)
+    """
+    obj_name = f"{code_gen_dir}/{name}.kernel.o"
+    cmd = ["g++", "-r", "-nostdlib", "-DINJ_KERNEL", f'-DINJ_KERNEL_NAME="{name}"', "-Iinjector_templates", "-I../../common"]
+    cmd += [f"-D{define}" for define in defines]
+    cmd += ["-o", obj_name] + list(sources)
+
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        return result.returncode, result.stderr
+
+    returncode, stderr, symbols = strong_globals(obj_name)
+    if returncode != 0 or not symbols:
+        return returncode, stderr
+
+    cmd = ["objcopy"] + [f"--localize-symbol={symbol}" for symbol in symbols] + [obj_name]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    return result.returncode, result.stderr
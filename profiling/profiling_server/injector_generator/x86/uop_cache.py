@@ -34,6 +34,7 @@ Command Line Arguments:
 import sys
 import random
 import subprocess
+from runtime_kernel import build_kernel
 from multiprocessing import Pool, cpu_count
 
 
@@ -112,8 +113,13 @@ def generator(code_gen_dir, bin_dir, window_size, num_sets, num_ways):
     with open(code_name, "w") as file:
         file.write(base)
     
-    result = subprocess.run(["g++", "-o", bin_name, code_name, template_file, "-lpfm"], capture_output=True, text=True)
-    return result.returncode, result.stderr, (window_size, num_ways)
+    result = subprocess.run(["g++", "-Iinjector_templates", "-I../../common", "-o", bin_name, code_name, template_file, "-lpfm"], capture_output=True, text=True)
+    if result.returncode != 0:
+        return result.returncode, result.stderr, (window_size, num_ways)
+
+    # Same code as a kernel of the persistent injector runtime
+    returncode, stderr = build_kernel([code_name, template_file], code_gen_dir, f"uop_cache.{num_ways}")
+    return returncode, stderr, (window_size, num_ways)
 
 
 if __name__ == "__main__":
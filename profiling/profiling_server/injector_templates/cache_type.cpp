@@ -11,10 +11,10 @@
 #include <random>
 #include <algorithm>
 #include <csignal>
-#include <sys/ioctl.h>
-#include <linux/perf_event.h>
-#include <perfmon/pfmlib.h>
-#include <perfmon/pfmlib_perf_event.h>
+#include "measure.h"
+#ifdef INJ_KERNEL
+#include "injector_runtime.h"
+#endif
 
 #ifndef NUM_ENTRIES
 #define NUM_ENTRIES     0
@@ -40,16 +40,11 @@ static const char* event_list[EVENT_COUNT] = {
     "instructions"
 };
 
-// Global variables
-pfm_pmu_info_t pinfo;
-struct timespec start, end;
-long long count_arr[EVENT_COUNT];
-perf_event_attr pe_arr[EVENT_COUNT];
-pfm_perf_encode_arg_t encodes[EVENT_COUNT];
-int fd_arr[EVENT_COUNT];
-char* name[EVENT_COUNT];
-
+#ifdef INJ_KERNEL
+uint64_t*   ptr_arr[INJ_CACHE_REGIONS];
+#else
 uint64_t*   ptr_arr[NUM_REGISTERS];
+#endif
 uint64_t    set_index[NUM_ENTRIES];
 
 void cache_init ();
@@ -57,6 +52,15 @@ void run_diag();
 void setup_perf();
 void sigint_handler(int signal);
 
+#ifdef INJ_KERNEL
+// Runtime entry: the regions come from injector_runtime instead of cache_init()
+static void inj_enter(const struct inj_env *env) {
+    for (int i = 0; i < INJ_CACHE_REGIONS; i++)
+        ptr_arr[i] = env->cache[i];
+    run_diag();
+}
+INJ_REGISTER(inj_enter, INJ_KIND_CACHE, NUM_ENTRIES, SHIFT_BITS, USE_HUGEPAGE);
+#else
 int main(int argc, char *argv[]){
     printf("%d, %d, %d\n", NUM_ENTRIES, NUM_REGISTERS, SHIFT_BITS);
     cache_init();
@@ -64,6 +68,7 @@ int main(int argc, char *argv[]){
     run_diag();
 	return 0;
 }
+#endif
 
 void cache_init() {
     for(int i=0; i<NUM_REGISTERS; i++) {
@@ -84,89 +89,42 @@ void cache_init() {
 
 // Signal handler for SIGINT and SIGSEGV
 void sigint_handler(int signal) {
-    // Disable and read performance counters
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    for (int i = 0; i < EVENT_COUNT; i++) {
-        ioctl(fd_arr[i], PERF_EVENT_IOC_DISABLE, 0);
-        ssize_t res = read(fd_arr[i], &count_arr[i], sizeof(count_arr[i]));
-    }
+    // Stop the event group and read the scaled counts
+    struct measure_result result;
+    measure_stop(&result);
 
     printf("\n[%d] Measuring instruction count for this printf\n", signal);
     
-    long long cycles = count_arr[0];
-    long long insts = count_arr[1];
+    long long cycles = result.count[0];
+    long long insts = result.count[1];
     
-    for (int i = 0; i < EVENT_COUNT; i++) {
-        printf("%s: %lld\n", event_list[i], count_arr[i]);
-    }
+    measure_print(&result);
     
-    double elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double elapsed_time = result.elapsed;
     printf("Elapsed_time: %.6f seconds\n", elapsed_time);
     printf("IPC: %.4f\n", (double)insts / (double)cycles);
     printf("Average_Frequency: %.4lf GHz\n", (double)(cycles)/elapsed_time/pow(10, 9));
+    measure_print_pressure(&result, insts);
     
-    // Close file descriptors
-    for (int i = 0; i < EVENT_COUNT; i++) {
-        close(fd_arr[i]);
-    }
+    measure_close();
 
     exit(0);
 }
 
 void setup_perf() {
-    int ret;
-
     // Register signal handlers
     signal(SIGINT, sigint_handler);
     signal(SIGSEGV, sigint_handler);
 
-    // Initialize performance monitoring library
-    ret = pfm_initialize();
-    if (ret != PFM_SUCCESS) {
-        fprintf(stderr, "pfm_initialize failed: %s\n", pfm_strerror(ret));
-        exit(EXIT_FAILURE);
-    }
-
-    // Set up performance event attributes
-    for (int i = 0; i < EVENT_COUNT; i++) {
-        memset(&pe_arr[i], 0, sizeof(pe_arr[i]));
-        pe_arr[i].size = sizeof(pe_arr[i]);
-        pe_arr[i].disabled = 1;
-        pe_arr[i].exclude_kernel = 1;
-        pe_arr[i].exclude_hv = 1;
-
-        encodes[i].attr = &pe_arr[i];
-        encodes[i].fstr = &name[i];
-        encodes[i].size = sizeof(encodes[i]);
-    }
-    
-    memset(&pinfo, 0, sizeof(pinfo));
+    // Open the event group
+    measure_init(event_list, EVENT_COUNT);
 
-    // Get encoding for events and open performance counters
-    for (int i = 0; i < EVENT_COUNT; i++) {   
-        ret = pfm_get_os_event_encoding(event_list[i], PFM_PLM3 | PFM_PLM0, 
-                                        PFM_OS_PERF_EVENT_EXT, &encodes[i]);
-        if (ret != PFM_SUCCESS) {
-            fprintf(stderr, "Failed to get encoding for event %d(%d): %s\n",
-                    i, ret, pfm_strerror(ret));
-            exit(EXIT_FAILURE);
-        }
-        
-        fd_arr[i] = perf_event_open(encodes[i].attr, 0, -1, -1, 0);
-        if (fd_arr[i] == -1) {
-            fprintf(stderr, "Error opening leader[%s] %llx\n", 
-                    event_list[i], pe_arr[i].config);
-            exit(EXIT_FAILURE);
-        }
-    }
+    measure_add_pressure();
 }
 
 void run_diag() {
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    for(int i=0; i<EVENT_COUNT; i++)
-    {
-        ioctl(fd_arr[i], PERF_EVENT_IOC_RESET, 0);
-        ioctl(fd_arr[i], PERF_EVENT_IOC_ENABLE, 0);
-    }
+#ifndef INJ_KERNEL
+    measure_start();
+#endif
 // Insert point
 }
\ No newline at end of file
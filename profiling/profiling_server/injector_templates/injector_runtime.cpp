@@ -0,0 +1,660 @@
+/*
+ * Persistent multi-mode injector.
+ *
+ * Usage: injector_runtime <ctl_path> [settle_window_ms] [settle_tolerance] [duty_period_us]
+ *
+ * Links every kernel object built by the generators (see injector_runtime.h),
+ * prepares all their memory once, and runs the selected kernel on a dedicated
+ * thread. The profiling server writes a command into the control block at
+ * <ctl_path>; the controller thread redirects the kernel thread with SIGUSR1
+ * (the handler siglongjmps back to the dispatcher), then watches the kernel's
+ * own cycles/instructions until two consecutive windows agree within the
+ * tolerance and acknowledges the command. Switching pressure therefore costs
+ * no fork/exec, no page faults and no cold start.
+ *
+ * Intensities below 1 are duty cycles: a per-thread timer interrupts the kernel
+ * at the end of each burst and the SIGALRM handler waits out the gap with
+ * tpause (or pause) before returning into the kernel. The controller learns the
+ * kernel's full-speed instruction rate once per mode, then steers the duty
+ * cycle until the achieved rate matches the requested fraction of it.
+ *
+ * Each mode can also count a resource-specific event, named by the environment
+ * variable INJECTOR_PRESSURE_EVENT_<feature> (a libpfm event string), and
+ * reports it per 1000 kernel instructions with every acknowledgement so the
+ * server can check the pressure the kernel actually achieves.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <csignal>
+#include <vector>
+#include <algorithm>
+#include <cpuid.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/perf_event.h>
+#include <perfmon/pfmlib.h>
+#include <perfmon/pfmlib_perf_event.h>
+
+#include "injector_runtime.h"
+#include "chase_buffer.h"
+
+#define CHASE_CACHELINES    (1ULL << 20)    // same chains as queue_type.cpp
+#define MAP_HUGE_2MB        (21 << MAP_HUGE_SHIFT)
+
+#define SETTLE_MIN_MS       10      // ignore the first window after a switch
+#define SETTLE_WINDOW_MS    20
+#define SETTLE_TOLERANCE    0.02
+#define SETTLE_TIMEOUT_MS   1000
+#define CMD_POLL_MS         100
+
+#define DUTY_PERIOD_US      1000    // burst + gap
+#define DUTY_GAIN           0.8     // duty correction per unit of intensity error
+#define INTENSITY_TOLERANCE 0.02    // absolute, on the achieved intensity
+
+extern "C" const struct inj_kernel __start_inj_kernels[];
+extern "C" const struct inj_kernel __stop_inj_kernels[];
+
+// Cache regions are shared by kernels with the same geometry
+struct cache_regions {
+    uint32_t num_entries;
+    uint32_t shift_bits;
+    uint32_t use_hugepage;
+    uint64_t *base[INJ_CACHE_REGIONS];
+};
+
+static std::vector<const struct inj_kernel *> kernels;
+static std::vector<struct inj_env> envs;
+static std::vector<struct cache_regions> regions;
+static uint64_t *chase_arr[2];           // first elements of the shared chains
+
+static struct inj_ctl *ctl;
+static long settle_window_ms = SETTLE_WINDOW_MS;
+static double settle_tolerance = SETTLE_TOLERANCE;
+static long duty_period_us = DUTY_PERIOD_US;
+
+// Kernel thread state
+static int active_mode = INJ_MODE_IDLE;     // futex word while idle
+static uint32_t switch_gen;                 // bumped by the controller per switch
+static uint32_t running_gen;                // switch_gen seen by the dispatcher
+static sigjmp_buf dispatch_env;
+static pthread_t kernel_thread;
+static pid_t kernel_tid;
+static int kernel_ready;                    // dispatch_env is valid
+static int perf_leader = -1;
+static int perf_insts = -1;
+static int perf_pressure = -1;              // group member for the active mode's event
+static int pressure_mode = INJ_MODE_IDLE;   // mode whose event perf_pressure counts
+
+// Per mode: pressure event encoding, valid if pressure_name[mode] is set
+static std::vector<struct perf_event_attr> pressure_attr;
+static std::vector<const char *> pressure_name;
+
+// Duty cycling
+static timer_t duty_timer;
+static uint64_t gap_ticks;                  // TSC ticks per gap, read by the handler
+static double tsc_per_ns;
+static bool has_waitpkg;
+static std::vector<double> full_rate;       // per mode: instructions/ns at intensity 1, 0 = unknown
+static std::vector<double> duty_scale;      // per mode: calibrated duty / intensity
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static long futex(void *addr, int op, uint32_t val, const struct timespec *timeout) {
+    return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+// =========================
+// Memory
+// =========================
+static uint64_t *map_region(size_t size, bool hugepage) {
+    void *ptr = MAP_FAILED;
+    if (hugepage) {
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB | MAP_POPULATE, -1, 0);
+        if (ptr == MAP_FAILED)
+            fprintf(stderr, "[WARNING] No 2MB pages for %zu bytes, using base pages\n", size);
+    }
+    if (ptr == MAP_FAILED)
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ptr == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    memset(ptr, 0, size);
+    return (uint64_t *)ptr;
+}
+
+static struct cache_regions *get_regions(const struct inj_kernel *k) {
+    for (auto &r : regions) {
+        if (r.num_entries == k->num_entries && r.shift_bits == k->shift_bits && r.use_hugepage == k->use_hugepage)
+            return &r;
+    }
+
+    struct cache_regions r = { k->num_entries, k->shift_bits, k->use_hugepage, {} };
+    size_t size = (size_t)k->num_entries << k->shift_bits;
+    for (int i = 0; i < INJ_CACHE_REGIONS; i++)
+        r.base[i] = map_region(size, k->use_hugepage);
+    regions.push_back(r);
+    return &regions.back();
+}
+
+static void setup_kernels() {
+    for (const struct inj_kernel *k = __start_inj_kernels; k < __stop_inj_kernels; k++)
+        kernels.push_back(k);
+    std::sort(kernels.begin(), kernels.end(),
+              [](const struct inj_kernel *a, const struct inj_kernel *b) { return strcmp(a->name, b->name) < 0; });
+
+    if (kernels.size() > INJ_MAX_MODES) {
+        fprintf(stderr, "[WARNING] %zu kernels, only the first %d are exposed\n", kernels.size(), INJ_MAX_MODES);
+        kernels.resize(INJ_MAX_MODES);
+    }
+
+    // Reserved so region pointers stay valid while get_regions() appends
+    regions.reserve(kernels.size());
+    envs.assign(kernels.size(), inj_env());
+
+    for (size_t m = 0; m < kernels.size(); m++) {
+        const struct inj_kernel *k = kernels[m];
+        struct inj_env *env = &envs[m];
+
+        if (k->kind == INJ_KIND_CACHE) {
+            struct cache_regions *r = get_regions(k);
+            for (int i = 0; i < INJ_CACHE_REGIONS; i++)
+                env->cache[i] = r->base[i];
+        }
+        else if (k->kind == INJ_KIND_QUEUE) {
+            if (!chase_arr[0]) {
+                for (int i = 0; i < 2; i++)
+                    chase_arr[i] = chase_attach(i, CHASE_CACHELINES);
+            }
+            env->chase[0] = chase_arr[0];
+            env->chase[1] = chase_arr[1];
+        }
+    }
+}
+
+// =========================
+// Kernel thread
+// =========================
+static void switch_handler(int signal) {
+    siglongjmp(dispatch_env, 1);
+}
+
+static void *kernel_main(void *arg) {
+    kernel_tid = syscall(SYS_gettid);
+
+    // Every switch lands here with SIGUSR1 unblocked again (savemask = 1)
+    if (sigsetjmp(dispatch_env, 1) == 0)
+        __atomic_store_n(&kernel_ready, 1, __ATOMIC_RELEASE);
+
+    for (;;) {
+        uint32_t gen = __atomic_load_n(&switch_gen, __ATOMIC_ACQUIRE);
+        int mode = __atomic_load_n(&active_mode, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&running_gen, gen, __ATOMIC_RELEASE);
+
+        if (mode == INJ_MODE_IDLE) {
+            futex(&active_mode, FUTEX_WAIT_PRIVATE, (uint32_t)mode, NULL);
+            continue;
+        }
+        kernels[mode]->enter(&envs[mode]);     // never returns
+    }
+    return NULL;
+}
+
+static void switch_mode(int mode) {
+    uint32_t gen = __atomic_load_n(&switch_gen, __ATOMIC_RELAXED) + 1;
+
+    __atomic_store_n(&active_mode, mode, __ATOMIC_RELEASE);
+    __atomic_store_n(&switch_gen, gen, __ATOMIC_RELEASE);
+    futex(&active_mode, FUTEX_WAKE_PRIVATE, 1, NULL);
+    pthread_kill(kernel_thread, SIGUSR1);
+
+    // The dispatcher records the generation before entering the new kernel
+    while (__atomic_load_n(&running_gen, __ATOMIC_ACQUIRE) != gen)
+        usleep(50);
+}
+
+// =========================
+// Duty cycle
+// =========================
+static inline uint64_t rdtsc() {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// tpause %ecx in C0.1 until the TSC deadline (or the OS limit); encoded for old assemblers
+static inline void tpause(uint64_t deadline) {
+    asm volatile(".byte 0x66, 0x0f, 0xae, 0xf1"
+                 : : "c"(1), "a"((uint32_t)deadline), "d"((uint32_t)(deadline >> 32)) : "cc");
+}
+
+// End of a burst: runs on the kernel thread, which resumes the kernel on return
+static void gap_handler(int signal) {
+    uint64_t deadline = rdtsc() + __atomic_load_n(&gap_ticks, __ATOMIC_RELAXED);
+
+    while (rdtsc() < deadline) {
+        if (has_waitpkg)
+            tpause(deadline);
+        else
+            asm volatile("pause");
+    }
+}
+
+static void setup_duty() {
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        has_waitpkg = ecx & (1U << 5);
+
+    uint64_t t0 = now_ns(), c0 = rdtsc();
+    usleep(10000);
+    tsc_per_ns = (double)(rdtsc() - c0) / (double)(now_ns() - t0);
+
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGALRM;
+    sev._sigev_un._tid = kernel_tid;
+    if (timer_create(CLOCK_MONOTONIC, &sev, &duty_timer) != 0) {
+        perror("timer_create");
+        exit(EXIT_FAILURE);
+    }
+
+    full_rate.assign(kernels.size(), 0);
+    duty_scale.assign(kernels.size(), 1.0);
+}
+
+static struct timespec ns_to_ts(uint64_t ns) {
+    struct timespec ts = { (time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL) };
+    return ts;
+}
+
+static double clamp_duty(double duty) {
+    return duty < INJ_INTENSITY_MIN ? INJ_INTENSITY_MIN : duty > 1.0 ? 1.0 : duty;
+}
+
+// duty >= 1 disarms the timer: the kernel runs flat out
+static void set_duty(double duty) {
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    if (duty < 1.0) {
+        uint64_t period = duty_period_us * 1000ULL;
+        uint64_t burst = (uint64_t)(period * duty);
+
+        __atomic_store_n(&gap_ticks, (uint64_t)((period - burst) * tsc_per_ns), __ATOMIC_RELAXED);
+        its.it_value = ns_to_ts(burst ? burst : 1);
+        its.it_interval = ns_to_ts(period);
+    }
+    timer_settime(duty_timer, 0, &its, NULL);
+}
+
+// =========================
+// Steady-state detection
+// =========================
+static void setup_perf() {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    perf_leader = perf_event_open(&attr, kernel_tid, -1, -1, 0);
+
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 0;
+    if (perf_leader >= 0)
+        perf_insts = perf_event_open(&attr, kernel_tid, -1, perf_leader, 0);
+
+    if (perf_leader < 0 || perf_insts < 0) {
+        fprintf(stderr, "[WARNING] perf_event_open failed, acknowledging without settling\n");
+        if (perf_leader >= 0)
+            close(perf_leader);
+        perf_leader = -1;
+    }
+}
+
+// Encodes INJECTOR_PRESSURE_EVENT_<feature> for every mode; <feature> is the name up to the first '.'
+static void setup_pressure_events() {
+    pressure_attr.assign(kernels.size(), perf_event_attr());
+    pressure_name.assign(kernels.size(), NULL);
+
+    int ret = pfm_initialize();
+    if (ret != PFM_SUCCESS) {
+        fprintf(stderr, "[WARNING] pfm_initialize failed: %s, no pressure events\n", pfm_strerror(ret));
+        return;
+    }
+
+    for (size_t m = 0; m < kernels.size(); m++) {
+        char var[INJ_MODE_NAME_MAX + 32];
+        snprintf(var, sizeof(var), "INJECTOR_PRESSURE_EVENT_%.*s",
+                 (int)strcspn(kernels[m]->name, "."), kernels[m]->name);
+
+        const char *event = getenv(var);
+        if (!event || !*event)
+            continue;
+
+        struct perf_event_attr *attr = &pressure_attr[m];
+        pfm_perf_encode_arg_t encode;
+
+        memset(attr, 0, sizeof(*attr));
+        memset(&encode, 0, sizeof(encode));
+        encode.attr = attr;
+        encode.size = sizeof(encode);
+        ret = pfm_get_os_event_encoding(event, PFM_PLM3, PFM_OS_PERF_EVENT_EXT, &encode);
+        if (ret != PFM_SUCCESS) {
+            fprintf(stderr, "[WARNING] %s: %s: %s\n", kernels[m]->name, event, pfm_strerror(ret));
+            continue;
+        }
+        attr->size = sizeof(*attr);
+        attr->exclude_kernel = 1;
+        attr->exclude_hv = 1;
+        pressure_name[m] = event;
+    }
+}
+
+// Swaps the group's third member for mode's event; the leader is disabled here
+static void attach_pressure(int mode) {
+    if (mode == pressure_mode)
+        return;
+
+    if (perf_pressure >= 0)
+        close(perf_pressure);
+    perf_pressure = -1;
+    pressure_mode = mode;
+
+    if (perf_leader < 0 || !pressure_name[mode])
+        return;
+    perf_pressure = perf_event_open(&pressure_attr[mode], kernel_tid, -1, perf_leader, 0);
+    if (perf_pressure < 0)
+        fprintf(stderr, "[WARNING] %s: cannot open %s\n", kernels[mode]->name, pressure_name[mode]);
+}
+
+static bool read_perf(uint64_t *cycles, uint64_t *insts, uint64_t *events) {
+    struct { uint64_t nr; uint64_t values[3]; } data;
+
+    if (read(perf_leader, &data, sizeof(data)) < (ssize_t)(3 * sizeof(uint64_t)))
+        return false;
+    *cycles = data.values[0];
+    *insts = data.values[1];
+    *events = data.nr > 2 ? data.values[2] : 0;
+    return true;
+}
+
+// Sleeps until deadline; false as soon as a newer command is posted
+static bool wait_no_command(uint32_t seq, uint64_t deadline) {
+    for (;;) {
+        if (__atomic_load_n(&ctl->cmd_seq, __ATOMIC_ACQUIRE) != seq)
+            return false;
+
+        uint64_t now = now_ns();
+        if (now >= deadline)
+            return true;
+
+        struct timespec ts = { (time_t)((deadline - now) / 1000000000ULL), (long)((deadline - now) % 1000000000ULL) };
+        futex(&ctl->cmd_seq, FUTEX_WAIT, seq, &ts);
+    }
+}
+
+struct perf_sample {
+    uint64_t ns;
+    uint64_t cycles;
+    uint64_t insts;
+    uint64_t events;
+};
+
+// Sleeps until deadline, then reads the kernel counters; false if superseded or unreadable
+static bool sample_at(uint32_t seq, uint64_t deadline, struct perf_sample *s) {
+    if (!wait_no_command(seq, deadline))
+        return false;
+    s->ns = now_ns();
+    return read_perf(&s->cycles, &s->insts, &s->events);
+}
+
+struct settle_result {
+    double ipc;
+    double intensity;
+    double duty;
+    double pressure;
+};
+
+/*
+ * Runs mode at the requested intensity and waits for steady state.
+ * Full speed settles when two consecutive windows agree on the instruction
+ * rate; that rate becomes the mode's reference. Lower intensities then adjust
+ * the duty cycle until rate / reference is within INTENSITY_TOLERANCE.
+ * Gap instructions (one tpause, or a few per pause) are counted too but are
+ * negligible next to the kernel's.
+ * The pressure event, if the mode has one, is reported for the last window.
+ *
+ * Returns INJ_ACK_* flags, or 0 if command seq was superseded before settling.
+ */
+static uint32_t wait_steady(uint32_t seq, int mode, double target, struct settle_result *res) {
+    uint64_t start = now_ns();
+    struct perf_sample s0, s1;
+    bool calibrating = target >= 1.0 || full_rate[mode] == 0;
+    double duty = calibrating ? 1.0 : clamp_duty(target * duty_scale[mode]);
+    double last = 0;
+    uint32_t flags = 0;
+
+    res->ipc = 0;
+    if (perf_leader < 0) {
+        duty = clamp_duty(target);
+        set_duty(duty);
+        res->intensity = duty;
+        res->duty = duty;
+        return wait_no_command(seq, start + SETTLE_MIN_MS * 1000000ULL) ? INJ_ACK_TIMEOUT | INJ_ACK_OPEN_LOOP : 0;
+    }
+
+    set_duty(duty);
+    attach_pressure(mode);
+    ioctl(perf_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(perf_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    if (!sample_at(seq, start + SETTLE_MIN_MS * 1000000ULL, &s0))
+        goto out;
+
+    for (;;) {
+        if (!sample_at(seq, now_ns() + settle_window_ms * 1000000ULL, &s1))
+            break;
+
+        double rate = (double)(s1.insts - s0.insts) / (double)(s1.ns - s0.ns);
+        res->ipc = s1.cycles > s0.cycles ? (double)(s1.insts - s0.insts) / (double)(s1.cycles - s0.cycles) : 0;
+        res->duty = duty;
+        res->pressure = s1.insts > s0.insts ? 1000.0 * (s1.events - s0.events) / (s1.insts - s0.insts) : 0;
+
+        if (calibrating) {
+            res->intensity = 1.0;
+            if (last > 0 && fabs(rate - last) <= settle_tolerance * last) {
+                full_rate[mode] = rate;
+                if (target >= 1.0) {
+                    flags = INJ_ACK_STEADY;
+                    break;
+                }
+                // Reference known: continue at the calibrated duty cycle
+                calibrating = false;
+                duty = clamp_duty(target * duty_scale[mode]);
+                set_duty(duty);
+            }
+            last = rate;
+        }
+        else {
+            res->intensity = rate / full_rate[mode];
+            if (fabs(res->intensity - target) <= INTENSITY_TOLERANCE) {
+                duty_scale[mode] = duty / target;
+                flags = INJ_ACK_STEADY;
+                break;
+            }
+            duty = clamp_duty(duty + DUTY_GAIN * (target - res->intensity));
+            set_duty(duty);
+        }
+
+        if (now_ns() - start >= SETTLE_TIMEOUT_MS * 1000000ULL) {
+            flags = INJ_ACK_TIMEOUT;
+            break;
+        }
+        s0 = s1;
+    }
+
+out:
+    // The counters stay off while the server measures the workload
+    ioctl(perf_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    if (flags && perf_pressure >= 0)
+        flags |= INJ_ACK_PRESSURE;
+    return flags;
+}
+
+// =========================
+// Control block
+// =========================
+static void setup_ctl(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0 || ftruncate(fd, sizeof(struct inj_ctl)) < 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    ctl = (struct inj_ctl *)mmap(NULL, sizeof(struct inj_ctl), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ctl == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(ctl, 0, sizeof(*ctl));
+    ctl->magic = INJ_CTL_MAGIC;
+    ctl->version = INJ_CTL_VERSION;
+    ctl->cmd_mode = INJ_MODE_IDLE;
+    ctl->cmd_intensity = 1.0;
+    ctl->cur_mode = INJ_MODE_IDLE;
+}
+
+static void serve() {
+    uint32_t handled = 0;
+
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&ctl->cmd_seq, __ATOMIC_ACQUIRE);
+        if (seq == handled) {
+            struct timespec ts = { 0, CMD_POLL_MS * 1000000L };
+            futex(&ctl->cmd_seq, FUTEX_WAIT, seq, &ts);
+            continue;
+        }
+
+        uint64_t start = now_ns();
+        int mode = ctl->cmd_mode;
+        double intensity = ctl->cmd_intensity;
+        uint32_t cmd_flags = ctl->cmd_flags;
+        uint32_t flags = 0;
+        struct settle_result res = { 0, 0, 0, 0 };
+
+        handled = seq;
+        if (mode < INJ_MODE_IDLE || mode >= (int)kernels.size()) {
+            fprintf(stderr, "[WARNING] Unknown mode %d\n", mode);
+            mode = INJ_MODE_IDLE;
+            flags |= INJ_ACK_BAD_MODE;
+        }
+
+        if (!(intensity > 0) || intensity > 1.0)
+            intensity = 1.0;
+        else if (intensity < INJ_INTENSITY_MIN)
+            intensity = INJ_INTENSITY_MIN;
+
+        if (mode != INJ_MODE_IDLE && (cmd_flags & INJ_CMD_RECALIBRATE)) {
+            full_rate[mode] = 0;
+            duty_scale[mode] = 1.0;
+        }
+
+        // The new kernel starts flat out; wait_steady() applies the duty cycle
+        set_duty(1.0);
+        switch_mode(mode);
+        if (mode == INJ_MODE_IDLE) {
+            flags |= INJ_ACK_STEADY;
+        }
+        else {
+            uint32_t settled = wait_steady(seq, mode, intensity, &res);
+            if (!settled)
+                continue;   // superseded: the newer command is acknowledged instead
+            flags |= settled;
+        }
+
+        ctl->cur_mode = mode;
+        ctl->ack_flags = flags;
+        ctl->settle_ns = now_ns() - start;
+        ctl->ipc = res.ipc;
+        ctl->intensity = res.intensity;
+        ctl->duty = res.duty;
+        ctl->pressure = res.pressure;
+        __atomic_store_n(&ctl->ack_seq, seq, __ATOMIC_RELEASE);
+        futex(&ctl->ack_seq, FUTEX_WAKE, INT32_MAX, NULL);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <ctl_path> [settle_window_ms] [settle_tolerance] [duty_period_us]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (argc > 2)
+        settle_window_ms = atol(argv[2]);
+    if (argc > 3)
+        settle_tolerance = atof(argv[3]);
+    if (argc > 4)
+        duty_period_us = atol(argv[4]);
+
+    setup_ctl(argv[1]);
+    setup_kernels();
+
+    ctl->nr_modes = kernels.size();
+    for (size_t m = 0; m < kernels.size(); m++)
+        snprintf(ctl->modes[m], INJ_MODE_NAME_MAX, "%s", kernels[m]->name);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = switch_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+    sa.sa_handler = gap_handler;
+    sigaction(SIGALRM, &sa, NULL);
+
+    // The controller never runs a kernel
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGALRM);
+    if (pthread_create(&kernel_thread, NULL, kernel_main, NULL) != 0) {
+        perror("pthread_create");
+        return EXIT_FAILURE;
+    }
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    while (!__atomic_load_n(&kernel_ready, __ATOMIC_ACQUIRE))
+        usleep(100);
+    setup_perf();
+    setup_duty();
+    setup_pressure_events();
+
+    printf("%u modes, ctl %s\n", ctl->nr_modes, argv[1]);
+    fflush(stdout);
+    __atomic_store_n(&ctl->ready, 1, __ATOMIC_RELEASE);
+
+    serve();
+    return 0;
+}
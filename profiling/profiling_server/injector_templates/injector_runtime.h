@@ -0,0 +1,92 @@
+/*
+ * Persistent injector runtime: kernel registration and control block.
+ *
+ * Every generated injector source is also compiled with -DINJ_KERNEL into a
+ * kernel object (injector_generator/x86/runtime_kernel.py). The template then
+ * drops main() and registers an entry point with INJ_REGISTER instead; the
+ * entry never returns. injector_runtime links all kernel objects, keeps one
+ * process per sibling core, and switches kernels on commands written to a
+ * shared control block (tools/injector_runtime.py mirrors the layout).
+ */
+#ifndef INJECTOR_RUNTIME_H
+#define INJECTOR_RUNTIME_H
+
+#include <stdint.h>
+
+// Kernel kinds: which memory the runtime prepares for the entry
+#define INJ_KIND_PORT       0   // registers only
+#define INJ_KIND_CACHE      1   // INJ_CACHE_REGIONS buffers of num_entries << shift_bits bytes
+#define INJ_KIND_QUEUE      2   // two pointer-chasing chains
+#define INJ_KIND_UOP        3   // code only
+
+#define INJ_CACHE_REGIONS   4   // cache bodies load ptr_arr[0..3] whatever the pressure
+
+// Memory handed to an entry; prepared once at startup, so switching never faults
+struct inj_env {
+    uint64_t *cache[INJ_CACHE_REGIONS];
+    uint64_t *chase[2];
+};
+
+struct inj_kernel {
+    const char *name;           // "<feature>.<pressure>", the injector file name
+    uint32_t kind;
+    uint32_t num_entries;       // cache kind: lines (or pages) per region
+    uint32_t shift_bits;        // cache kind: log2 of the stride
+    uint32_t use_hugepage;      // cache kind: 2 MB pages for the regions
+    void (*enter)(const struct inj_env *env);
+} __attribute__((aligned(8)));
+
+// One descriptor per kernel object, collected by the linker into section inj_kernels
+#define INJ_REGISTER(fn, kind, entries, shift, hugepage)                        \
+    __attribute__((used, section("inj_kernels")))                              \
+    static const struct inj_kernel inj_kernel_desc = {                          \
+        INJ_KERNEL_NAME, (kind), (entries), (shift), (hugepage), (fn) }
+
+// =========================
+// Control block (shared file, one per runtime)
+// =========================
+#define INJ_CTL_MAGIC       0x434A4E49U     // "INJC"
+#define INJ_CTL_VERSION     3
+#define INJ_MAX_MODES       128
+#define INJ_MODE_NAME_MAX   48
+#define INJ_MODE_IDLE       (-1)            // kernel thread blocked: the sibling stays idle
+#define INJ_INTENSITY_MIN   0.01            // smaller cmd_intensity is clamped up
+
+// inj_ctl.cmd_flags
+#define INJ_CMD_RECALIBRATE 0x1     // forget the mode's full-speed rate and duty calibration
+
+// inj_ctl.ack_flags
+#define INJ_ACK_STEADY      0x1     // IPC settled within the tolerance
+#define INJ_ACK_TIMEOUT     0x2     // acknowledged after the settle timeout
+#define INJ_ACK_BAD_MODE    0x4     // cmd_mode out of range; now idle
+#define INJ_ACK_OPEN_LOOP   0x8     // no counters: duty cycle = cmd_intensity, uncalibrated
+#define INJ_ACK_PRESSURE    0x10    // pressure is valid (the mode has a pressure event)
+
+struct inj_ctl {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nr_modes;
+    uint32_t ready;         // set once modes[] is filled and the kernel thread runs
+
+    // Written by the server: cmd_mode, cmd_flags and cmd_intensity first, then cmd_seq + 1 (futex word)
+    uint32_t cmd_seq;
+    int32_t  cmd_mode;      // index into modes[] or INJ_MODE_IDLE
+    uint32_t cmd_flags;     // INJ_CMD_*
+    uint32_t _rsvd0;
+    double   cmd_intensity; // (0, 1]: fraction of the kernel's full-speed instruction rate
+
+    // Written by the runtime: results first, then ack_seq = cmd_seq (futex word)
+    uint32_t ack_seq;
+    int32_t  cur_mode;
+    uint32_t ack_flags;
+    uint32_t _rsvd1;
+    uint64_t settle_ns;     // command to acknowledgement
+    double   ipc;           // kernel IPC over the last settle window
+    double   intensity;     // achieved instruction rate / full-speed rate
+    double   duty;          // fraction of each duty period spent in the kernel
+    double   pressure;      // pressure events per 1000 kernel instructions, last window
+
+    char     modes[INJ_MAX_MODES][INJ_MODE_NAME_MAX];
+};
+
+#endif // INJECTOR_RUNTIME_H
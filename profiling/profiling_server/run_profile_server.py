@@ -12,6 +12,7 @@ from tools.config import *
 from tools.global_variable_generator import *
 from tools import DBManager
 from tools import perf_counter
+from tools import injector_runtime
 
 # =============================================================================
 # Constants
@@ -29,6 +30,8 @@ perf_counters = dict()     # core_id -> PerfCounter
 request_queue = None
 injector_info_list = []    # list of InjectorInfo
 llc_diag_core_ids = None
+injector_runtimes = dict() # injector_core -> InjectorRuntime (empty: one process per window)
+pressure_references = dict() # injector path -> single-run pressure (tools/injector_pressure.txt)
 
 # =============================================================================
 # Data Classes
@@ -47,6 +50,7 @@ class JobState:
         warmup_done: Whether warmup iterations are complete
         warmup_count: Number of warmup iterations completed
         current_injector_idx: Index of current injector in the list
+        pressure_retries: Windows of the current injector rejected for pressure drift
     """
     workload_core: int
     injector_core: int
@@ -56,6 +60,7 @@ class JobState:
     warmup_done: bool = False
     warmup_count: int = 0
     current_injector_idx: int = 0
+    pressure_retries: int = 0
 
 
 @dataclass
@@ -68,11 +73,13 @@ class CoreProcessInfo:
         process: Subprocess handle
         process_type: Either "workload" or "injector"
         should_terminate: Flag to mark process for termination
+        pressure_ok: False if the injector's achieved pressure drifted this window
     """
     global_jobid: int
     process: subprocess.Popen
     process_type: str  # "workload" or "injector"
     should_terminate: bool = False
+    pressure_ok: bool = True
 
 # =============================================================================
 # Classes
@@ -186,9 +193,98 @@ def load_injector_configs():
                 feature=parts[0],
                 pressure=int(parts[1]),
                 injector_dir=parts[2],
+                intensity=float(parts[3]) if len(parts) > 3 else 1.0,
             ))
 
 
+def start_injector_runtimes(injector_cores):
+    """Start one persistent injector runtime per sibling core, if it was built."""
+    global injector_runtimes
+
+    if not injector_runtime.is_available():
+        print("[Server] injector_runtime not found, spawning an injector per window")
+        return
+
+    for injector_core in injector_cores:
+        injector_runtimes[injector_core] = injector_runtime.InjectorRuntime(injector_core)
+
+
+def stop_injector_runtimes():
+    """Terminate all persistent injector runtimes."""
+    global injector_runtimes
+
+    for runtime in injector_runtimes.values():
+        runtime.close()
+    injector_runtimes.clear()
+
+
+def pressure_drifted(injector_dir, pressure):
+    """Whether an injector's achieved pressure left the tolerance around its single-run reference."""
+    reference = pressure_references.get(injector_dir)
+    if pressure is None or not reference:
+        return False
+    return abs(pressure - reference) > PRESSURE_DRIFT_TOLERANCE * reference
+
+
+def switch_injector_runtimes(core_to_mode, recalibrate=False):
+    """
+    Switch runtimes to new modes and wait until every one is in steady state.
+    
+    All commands are posted before waiting, so the runtimes settle in parallel.
+    A runtime whose achieved pressure drifts from the injector's single-run
+    reference is switched once more with recalibration.
+    
+    Args:
+        core_to_mode: injector_core -> (injector path, intensity), or None for idle
+        recalibrate: Whether the runtimes re-learn the modes' calibration
+    
+    Returns:
+        Set of injector cores whose pressure still drifts
+    """
+    global injector_runtimes
+
+    pending = []
+    for injector_core, mode in core_to_mode.items():
+        runtime = injector_runtimes[injector_core]
+        injector_dir, intensity = mode if mode else (None, 1.0)
+        name = injector_runtime.mode_name(injector_dir) if injector_dir else None
+        pending.append((injector_core, injector_dir, name, intensity, runtime.post(name, intensity, recalibrate)))
+
+    drifted = set()
+    for injector_core, injector_dir, name, intensity, seq in pending:
+        flags, settle_ns, ipc, achieved, pressure = injector_runtimes[injector_core].wait_ack(seq)
+        if name is None:
+            continue
+        if flags & injector_runtime.INJ_ACK_BAD_MODE:
+            print(f"[Warning] Injector runtime on core {injector_core} rejected mode {name}")
+        elif not flags & injector_runtime.INJ_ACK_STEADY:
+            print(f"[Warning] Injector {name}@{intensity:.2f} on core {injector_core} not steady after "
+                  f"{settle_ns / 1e6:.1f} ms (IPC={ipc:.4f}, intensity={achieved:.3f})")
+        if pressure_drifted(injector_dir, pressure):
+            print(f"[Warning] Injector {name}@{intensity:.2f} on core {injector_core} pressure {pressure:.4f}, "
+                  f"reference {pressure_references[injector_dir]:.4f}")
+            drifted.add(injector_core)
+
+    if drifted and not recalibrate:
+        return switch_injector_runtimes({core: core_to_mode[core] for core in drifted}, recalibrate=True)
+    return drifted
+
+
+def load_pressure_references():
+    """Load the single-run injector pressures written by setup.py, if any."""
+    global pressure_references
+    pressure_references = {}
+
+    config_path = "tools/injector_pressure.txt"
+    if not os.path.exists(config_path):
+        return
+    with open(config_path, "r") as f:
+        for line in f.read().strip().split("\n"):
+            if line:
+                injector_dir, pressure = line.split(",")
+                pressure_references[injector_dir] = float(pressure)
+
+
 # =============================================================================
 # Performance Measurement Functions
 # =============================================================================
@@ -250,6 +346,13 @@ def run_l3_injector(core_to_process, busy_cores):
     l3_injector_path = "injector/l3_cache/l3_cache.high.injector"
     print("[Server] Running L3 injector")
 
+    if injector_runtimes:
+        core_to_mode = {get_sibling_core(cid): (l3_injector_path, 1.0) for cid in llc_diag_core_ids}
+        switch_injector_runtimes(core_to_mode)
+        measure_ipc_for_duration(busy_cores, SAMPLING_TIME)
+        switch_injector_runtimes(dict.fromkeys(core_to_mode))
+        return
+
     for workload_core in llc_diag_core_ids:
         injector_core = get_sibling_core(workload_core)
         process = subprocess.Popen(
@@ -267,6 +370,7 @@ def run_injectors_for_profiling(active_jobs, core_to_process, busy_cores):
     global injector_info_list
     print("[Server] Running profile per core =>")
     
+    core_to_mode = {}
     for job_state in active_jobs.values():
         if not job_state.warmup_done or job_state.completed:
             continue
@@ -274,6 +378,18 @@ def run_injectors_for_profiling(active_jobs, core_to_process, busy_cores):
         injector_info = injector_info_list[job_state.current_injector_idx]
         injector_core = job_state.injector_core
 
+        if injector_runtimes:
+            core_to_mode[injector_core] = (injector_info.injector_dir, injector_info.intensity)
+            core_to_process[injector_core] = CoreProcessInfo(
+                global_jobid=job_state.global_jobid,
+                process=injector_runtimes[injector_core].process,
+                process_type="injector",
+                should_terminate=True,
+            )
+            continue
+
+        if injector_info.intensity < 1.0:
+            print(f"[Warning] {injector_info.injector_dir} runs at full intensity without injector_runtime")
         process = subprocess.Popen(
             ["/usr/bin/taskset", "-c", str(injector_core), injector_info.injector_dir, "0"],
             stdout=subprocess.DEVNULL,
@@ -286,6 +402,14 @@ def run_injectors_for_profiling(active_jobs, core_to_process, busy_cores):
             should_terminate=True,
         )
 
+    if injector_runtimes:
+        # The runtimes stay warm; idle them so the next window starts clean
+        for injector_core in switch_injector_runtimes(core_to_mode):
+            core_to_process[injector_core].pressure_ok = False
+        measure_ipc_for_duration(busy_cores, SAMPLING_TIME)
+        switch_injector_runtimes(dict.fromkeys(core_to_mode))
+        return
+
     measure_ipc_for_duration(busy_cores, SAMPLING_TIME)
     os.system(INJECTOR_KILL_CMD)
 
@@ -327,6 +451,21 @@ def process_normal_results(ipc_results, active_jobs, core_to_process, db_manager
     global injector_info_list
     completed_jobs = []
     jobs_to_advance = []
+
+    # Windows whose injector missed its pressure are repeated, up to PRESSURE_MAX_RETRIES
+    rejected_jobs = set()
+    for process_info in core_to_process.values():
+        if process_info.process_type != "injector" or process_info.pressure_ok:
+            continue
+        job_state = active_jobs.get(process_info.global_jobid)
+        if job_state is None or job_state.completed:
+            continue
+        if job_state.pressure_retries < PRESSURE_MAX_RETRIES:
+            job_state.pressure_retries += 1
+            rejected_jobs.add(job_state.global_jobid)
+            print(f"[Server] Rejecting window of global_jobid {job_state.global_jobid}: injector pressure drifted")
+        else:
+            print(f"[Warning] Accepting window of global_jobid {job_state.global_jobid} despite pressure drift")
     
     for core_id, ipc in ipc_results.items():
         if core_id not in core_to_process:
@@ -336,7 +475,7 @@ def process_normal_results(ipc_results, active_jobs, core_to_process, db_manager
         global_jobid = core_to_process[core_id].global_jobid
         job_state = active_jobs[global_jobid]
 
-        if job_state.completed:
+        if job_state.completed or global_jobid in rejected_jobs:
             continue
 
         injector_info = injector_info_list[job_state.current_injector_idx]
@@ -367,6 +506,7 @@ def process_normal_results(ipc_results, active_jobs, core_to_process, db_manager
     # Advance to next injector
     for job_state, core_id in jobs_to_advance:
         job_state.current_injector_idx += 1
+        job_state.pressure_retries = 0
         if job_state.current_injector_idx == len(injector_info_list):
             job_state.completed = True
             if job_state.l3_profiled:
@@ -528,6 +668,7 @@ def main(db_manager):
     print(f"[Server] Available cores: {available_cores}")
     available_cores = deque(available_cores)
     llc_diag_core_ids = tuple(available_cores)
+    start_injector_runtimes([get_sibling_core(cid) for cid in available_cores])
 
     # Main loop
     while True:
@@ -564,6 +705,7 @@ try:
         request_queue = RequestQueue()
         init_cpu_topology()
         load_injector_configs()
+        load_pressure_references()
         
         accept_thread = threading.Thread(target=run_accept_thread)
         accept_thread.start()
@@ -571,5 +713,6 @@ try:
 
 finally:
     running = False
+    stop_injector_runtimes()
     if db_manager:
         db_manager.close()
\ No newline at end of file
@@ -8,6 +8,7 @@ import glob
 import os
 
 injector_exec_dir = "tools/injector_exec_dir.txt"
+injector_pressure = "tools/injector_pressure.txt"
 
 def gen_injector_list():
     injectors = [injector for injector in sorted(glob.glob("injector/**/*.injector", recursive=True)) if "low" not in injector and "high" not in injector]
@@ -57,6 +58,12 @@ if __name__ == "__main__":
                 continue
             print(f"[INFO] Feature: {feature}, Run Type: {global_jobid}, Pressure: {pressure}, IPC: {IPC}, Injector Dir: {injector_dir}")
             file.write(f"{feature},{pressure},{injector_dir}\n")
+
+    # Reference pressure for the profiling server's drift check
+    with open(injector_pressure, "w") as file:
+        for injector_dir, achieved in measure_injector_single.single_pressure.items():
+            print(f"[INFO] Injector Dir: {injector_dir}, Pressure: {achieved:.4f}")
+            file.write(f"{injector_dir},{achieved}\n")
     
     measure_combination.measure()
     measure_combination.push_results()
\ No newline at end of file
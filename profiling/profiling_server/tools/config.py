@@ -15,4 +15,8 @@ NODE_NAME = "intel-gen11"                   # Unique identifier for this machine
 # Profiling parameters
 MAXIMUM_UTIL = 0.5      # Maximum CPU utilization ratio for profiling (0.0-1.0)
 WARMUP_COUNT = 6        # Number of warmup iterations before measurement
-SAMPLING_TIME = 10      # Duration of each measurement in seconds
\ No newline at end of file
+SAMPLING_TIME = 10      # Duration of each measurement in seconds
+
+# Injector self-verification (machine_data.PRESSURE_EVENT)
+PRESSURE_DRIFT_TOLERANCE = 0.25 # Max relative deviation from the single-run pressure
+PRESSURE_MAX_RETRIES = 2        # Rejected windows per injector before accepting anyway
\ No newline at end of file
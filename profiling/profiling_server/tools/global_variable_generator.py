@@ -22,10 +22,12 @@ class InjectorInfo:
         feature: Resource feature name (e.g., 'int_isq', 'l1_dcache')
         pressure: Pressure level (0=LOW, 1=MEDIUM, 2=HIGH for sequential types)
         injector_dir: Path to the compiled injector binary
+        intensity: Duty-cycled fraction of full speed (injector_runtime only)
     """
     feature: str
     pressure: int
     injector_dir: str
+    intensity: float = 1.0
 
 
 # =============================================================================
@@ -98,14 +100,15 @@ FEATURE_TYPE_TABLE = {
 # Injector Directory Configuration
 # =============================================================================
 # Load injector directory list from configuration file
-# Format: feature,pressure_level,path_to_injector
+# Format: feature,pressure_level,path_to_injector[,intensity]
 injector_directory_list = []
 with open("tools/injector_exec_dir.txt", "r") as f:
     lines = f.read().strip().split("\n")
     for line in lines:
-        feature, pressure, injector_dir = line.strip().split(",")
-        pressure = int(pressure)
-        injector_directory_list.append(InjectorInfo(feature=feature, pressure=pressure, injector_dir=injector_dir))
+        parts = line.strip().split(",")
+        intensity = float(parts[3]) if len(parts) > 3 else 1.0
+        injector_directory_list.append(InjectorInfo(feature=parts[0], pressure=int(parts[1]),
+                                                    injector_dir=parts[2], intensity=intensity))
 
 
 # =============================================================================
@@ -0,0 +1,226 @@
+"""
+Injector Runtime Client
+
+Python side of the persistent injector (injector_templates/injector_runtime.cpp).
+One runtime process is started per sibling core and kept for the lifetime of
+the profiling server; switching feature and pressure is a command written to
+its shared control block instead of a new injector process.
+
+The ctypes layout below mirrors struct inj_ctl in
+injector_templates/injector_runtime.h and must be kept in sync with it.
+
+Usage:
+    runtime = InjectorRuntime(core_id=1)
+    seq = runtime.post("l1_dcache.4", intensity=0.5)
+    flags, settle_ns, ipc, intensity, pressure = runtime.wait_ack(seq)
+    # ... measure the workload ...
+    runtime.wait_ack(runtime.post(None))    # back to idle
+    runtime.close()
+"""
+
+import ctypes
+import mmap
+import os
+import platform
+import subprocess
+import time
+
+from .machine_data import PRESSURE_EVENT
+
+# =========================
+# Control block constants
+# =========================
+INJECTOR_RUNTIME_PATH = "injector/injector_runtime"
+CTL_DIR = "/dev/shm"
+
+INJ_CTL_MAGIC = 0x434A4E49
+INJ_CTL_VERSION = 3
+INJ_MAX_MODES = 128
+INJ_MODE_NAME_MAX = 48
+INJ_MODE_IDLE = -1
+INJ_INTENSITY_MIN = 0.01
+
+INJ_ACK_STEADY = 0x1
+INJ_ACK_TIMEOUT = 0x2
+INJ_ACK_BAD_MODE = 0x4
+INJ_ACK_OPEN_LOOP = 0x8
+INJ_ACK_PRESSURE = 0x10
+
+INJ_CMD_RECALIBRATE = 0x1
+
+START_TIMEOUT = 120     # Seconds; the runtime prepares every kernel's memory first
+ACK_TIMEOUT = 5         # Seconds; the runtime gives up settling after 1 s
+
+# futex(2) on the shared cmd_seq word, so the runtime wakes immediately
+arch = platform.machine()
+if arch == "x86_64":
+    NR_FUTEX = 202
+elif arch in ("aarch64", "riscv64"):
+    NR_FUTEX = 98
+else:
+    raise RuntimeError(f"Unsupported architecture: {arch}")
+FUTEX_WAKE = 1
+
+libc = ctypes.CDLL(None, use_errno=True)
+
+
+class inj_ctl(ctypes.Structure):
+    """Mirror of struct inj_ctl (injector_runtime.h)."""
+    _fields_ = [
+        ("magic", ctypes.c_uint32),
+        ("version", ctypes.c_uint32),
+        ("nr_modes", ctypes.c_uint32),
+        ("ready", ctypes.c_uint32),
+        ("cmd_seq", ctypes.c_uint32),
+        ("cmd_mode", ctypes.c_int32),
+        ("cmd_flags", ctypes.c_uint32),
+        ("_rsvd0", ctypes.c_uint32),
+        ("cmd_intensity", ctypes.c_double),
+        ("ack_seq", ctypes.c_uint32),
+        ("cur_mode", ctypes.c_int32),
+        ("ack_flags", ctypes.c_uint32),
+        ("_rsvd1", ctypes.c_uint32),
+        ("settle_ns", ctypes.c_uint64),
+        ("ipc", ctypes.c_double),
+        ("intensity", ctypes.c_double),
+        ("duty", ctypes.c_double),
+        ("pressure", ctypes.c_double),
+        ("modes", (ctypes.c_char * INJ_MODE_NAME_MAX) * INJ_MAX_MODES),
+    ]
+
+
+def mode_name(injector_dir):
+    """Mode name of an injector binary path (e.g. injector/l2_cache/l2_cache.4.injector -> l2_cache.4)."""
+    name = os.path.basename(injector_dir)
+    return name[:-len(".injector")] if name.endswith(".injector") else name
+
+
+def is_available():
+    """Whether the injector generator produced the persistent runtime."""
+    return os.access(INJECTOR_RUNTIME_PATH, os.X_OK)
+
+
+class InjectorRuntime:
+    """
+    Persistent injector pinned to one logical core.
+
+    Attributes:
+        core_id: Logical core the runtime is pinned to
+        process: Subprocess handle of the runtime
+        modes: Mode name -> index into the control block's mode table
+    """
+
+    def __init__(self, core_id):
+        """
+        Start the runtime on core_id and wait until all kernels are prepared.
+
+        Args:
+            core_id: Logical core to pin the runtime to (the SMT sibling)
+
+        Raises:
+            RuntimeError: If the runtime exits or does not become ready
+        """
+        self.core_id = core_id
+        self.ctl_path = f"{CTL_DIR}/injector_runtime.{core_id}.ctl"
+        if os.path.exists(self.ctl_path):
+            os.remove(self.ctl_path)
+
+        # Each mode counts its feature's pressure event (see machine_data.PRESSURE_EVENT)
+        env = os.environ.copy()
+        for feature, event in PRESSURE_EVENT.items():
+            if event:
+                env[f"INJECTOR_PRESSURE_EVENT_{feature}"] = event
+
+        self.process = subprocess.Popen(
+            ["/usr/bin/taskset", "-c", str(core_id), INJECTOR_RUNTIME_PATH, self.ctl_path],
+            stdout=subprocess.DEVNULL,
+            stderr=subprocess.DEVNULL,
+            env=env,
+        )
+
+        deadline = time.monotonic() + START_TIMEOUT
+        while not os.path.exists(self.ctl_path) or os.path.getsize(self.ctl_path) < ctypes.sizeof(inj_ctl):
+            self._check_alive(deadline)
+            time.sleep(0.01)
+
+        fd = os.open(self.ctl_path, os.O_RDWR)
+        self.map = mmap.mmap(fd, ctypes.sizeof(inj_ctl), mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE)
+        os.close(fd)
+        self.ctl = inj_ctl.from_buffer(self.map)
+
+        while not self.ctl.ready:
+            self._check_alive(deadline)
+            time.sleep(0.01)
+
+        if self.ctl.magic != INJ_CTL_MAGIC or self.ctl.version != INJ_CTL_VERSION:
+            raise RuntimeError(f"Injector runtime on core {core_id}: control block version {self.ctl.version}")
+
+        self.modes = {self.ctl.modes[i].value.decode(): i for i in range(self.ctl.nr_modes)}
+        print(f"[Server] Injector runtime on core {core_id}: {len(self.modes)} modes")
+
+    def _check_alive(self, deadline):
+        if self.process.poll() is not None:
+            raise RuntimeError(f"Injector runtime on core {self.core_id} exited with {self.process.returncode}")
+        if time.monotonic() > deadline:
+            raise RuntimeError(f"Injector runtime on core {self.core_id} did not become ready")
+
+    def post(self, name, intensity=1.0, recalibrate=False):
+        """
+        Request a mode switch without waiting for it.
+
+        Args:
+            name: Mode name ("<feature>.<pressure>") or None for idle
+            intensity: Fraction of the kernel's full-speed instruction rate,
+                       in [INJ_INTENSITY_MIN, 1]; below 1 the kernel is duty-cycled
+            recalibrate: Re-learn the mode's full-speed rate and duty calibration
+
+        Returns:
+            Command sequence number to pass to wait_ack()
+
+        Raises:
+            KeyError: If the runtime has no kernel of that name
+        """
+        mode = INJ_MODE_IDLE if name is None else self.modes[name]
+        seq = (self.ctl.cmd_seq + 1) & 0xFFFFFFFF
+
+        # cmd_mode must be visible before cmd_seq; both are plain stores to
+        # the shared mapping, which x86 and the futex syscall keep ordered
+        self.ctl.cmd_mode = mode
+        self.ctl.cmd_intensity = intensity
+        self.ctl.cmd_flags = INJ_CMD_RECALIBRATE if recalibrate else 0
+        self.ctl.cmd_seq = seq
+        libc.syscall(ctypes.c_long(NR_FUTEX), ctypes.c_void_p(ctypes.addressof(self.ctl) + inj_ctl.cmd_seq.offset),
+                     ctypes.c_int(FUTEX_WAKE), ctypes.c_int(1), None, None, ctypes.c_int(0))
+        return seq
+
+    def wait_ack(self, seq, timeout=ACK_TIMEOUT):
+        """
+        Wait until the runtime acknowledged command seq.
+
+        Returns:
+            Tuple of (ack_flags, settle_ns, ipc, achieved intensity, pressure);
+            pressure is events per 1000 kernel instructions, or None without a pressure event
+
+        Raises:
+            RuntimeError: If the runtime exits or does not acknowledge in time
+        """
+        deadline = time.monotonic() + timeout
+        while self.ctl.ack_seq != seq:
+            self._check_alive(deadline)
+            time.sleep(0.001)
+        flags = self.ctl.ack_flags
+        pressure = self.ctl.pressure if flags & INJ_ACK_PRESSURE else None
+        return flags, self.ctl.settle_ns, self.ctl.ipc, self.ctl.intensity, pressure
+
+    def switch(self, name, intensity=1.0, timeout=ACK_TIMEOUT):
+        """Switch to a mode and wait for its acknowledgement."""
+        return self.wait_ack(self.post(name, intensity), timeout)
+
+    def close(self):
+        """Stop the runtime and remove its control block."""
+        self.ctl = None
+        self.map.close()
+        self.process.terminate()
+        self.process.wait()
+        if os.path.exists(self.ctl_path):
+            os.remove(self.ctl_path)
@@ -31,6 +31,26 @@ UOP_CACHE_NUM_SETS = 64     # Number of uop cache sets
 MEDIUM_RATIO = 0.8          # Medium pressure = MAX * MEDIUM_RATIO
 NODE_NAME = None            # Set at runtime by setup.py
 
+# =============================================================================
+# Pressure Events (libpfm event names)
+# =============================================================================
+# Resource-specific event each injector counts next to cycles and instructions.
+# The achieved pressure is reported per 1000 injector instructions and checked
+# against the single-run reference (PRESSURE_DRIFT_TOLERANCE in config.py).
+# None: no event on this machine tracks the resource well enough.
+PRESSURE_EVENT = {
+    "int_isq":     None,
+    "fp_isq":      None,
+    "load_isq":    "UOPS_DISPATCHED:PORT_2_3",     # Load ports
+    "int_port":    "UOPS_DISPATCHED:PORT_6",       # Integer-only ALU port
+    "fp_port":     "UOPS_DISPATCHED:PORT_0",
+    "l1_dcache":   "L1D:REPLACEMENT",
+    "l2_cache":    "L2_RQSTS:MISS",
+    "l3_cache":    "LONGEST_LAT_CACHE:MISS",
+    "l1_dtlb":     "DTLB_LOAD_MISSES:STLB_HIT",    # L1 DTLB misses served by the STLB
+    "uop_cache":   "IDQ:MITE_UOPS",                # Uops delivered by the legacy decoders
+}
+
 # =============================================================================
 # Resource Watermarks (Minimum Reserved Entries)
 # =============================================================================
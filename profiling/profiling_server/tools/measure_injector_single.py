@@ -16,6 +16,14 @@ def parse_IPC(output):
             return float(line[1])
     return 0.0
 
+def parse_pressure(output):
+    for line in output.split("\n"):
+        line = line.split(": ")
+
+        if line[0] == "Pressure":
+            return float(line[1])
+    return None
+
 # - global_jobid is defined as
 #   single: -1, low: -2, high: -3
 # - pressure is defined as
@@ -23,10 +31,15 @@ def parse_IPC(output):
 #   sequential_type => low: 0, medium: 1, high: 2
 #   parallel_type => low: 0, high: 1
 counter = dict()
+# Achieved pressure of each injector running alone: injector path -> events per 1000 instructions
+single_pressure = dict()
 def run_injector(injector, feature, output_file_name, core_id, global_jobid, single_output_metadata):
     global counter
+    env = os.environ.copy()
+    if machine_data.PRESSURE_EVENT.get(feature):
+        env["INJECTOR_PRESSURE_EVENT"] = machine_data.PRESSURE_EVENT[feature]
     result = subprocess.run(["timeout", "-s", "SIGINT", f"{machine_data.SAMPLING_INTERVAL}s", "taskset", "-c", str(core_id), injector],
-                            stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+                            stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True, env=env)
     injector_name = injector.split("/")[-1]
 
     if result.returncode == 124:
@@ -43,6 +56,10 @@ def run_injector(injector, feature, output_file_name, core_id, global_jobid, sin
     pressure = counter[(feature, global_jobid)]
     single_output_metadata.append((feature, global_jobid, pressure, parse_IPC(result.stdout), injector))
 
+    achieved = parse_pressure(result.stdout)
+    if global_jobid == -1 and achieved is not None:
+        single_pressure[injector] = achieved
+
     counter[(feature, global_jobid)] += 1
 
 def profile_injector(injector, feature, output_dir, core_ids, single_output_metadata):
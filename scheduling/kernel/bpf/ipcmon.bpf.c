@@ -0,0 +1,240 @@
+// SPDX-License-Identifier: GPL-2.0
+/**
+ * @file ipcmon.bpf.c
+ * @brief CO-RE eBPF backend for IPC monitoring of process groups and cgroups
+ *
+ * Alternative to the IPC_monitor kernel module that runs on any BTF-enabled
+ * kernel without an out-of-tree build. ipcmon_loader opens one cycles and one
+ * instructions counter per CPU and stores them in the perf event arrays below.
+ *
+ *  - tp_btf/sched_switch: classifies NEXT by PGID (then by default-hierarchy
+ *    cgroup and its ancestors), and on switch-out folds the counter delta of
+ *    the armed slot into a per-CPU accumulator; no locks, no shared writes
+ *  - perf_event (cpu-clock, publish_period_us): folds the running task's delta
+ *    so pinned workers that never switch out are still counted
+ *  - ipcmon_loader sums the per-CPU accumulators into the ABI v2 shared region
+ *
+ * Accumulators carry the slot generation; a CPU that still holds an older
+ * generation restarts from zero, and a fold for a generation older than the
+ * accumulator's is dropped.
+ */
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+
+#include "ipcmon_shared.h"
+
+char LICENSE[] SEC("license") = "GPL";
+
+/* Per-CPU hardware counters (fds installed by the loader, max_entries = nr CPUs) */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+    __uint(key_size, sizeof(__u32));
+    __uint(value_size, sizeof(__u32));
+} cycles_events SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+    __uint(key_size, sizeof(__u32));
+    __uint(value_size, sizeof(__u32));
+} instructions_events SEC(".maps");
+
+/* Tracking keys -> slot (maintained by the loader) */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_SLOTS);
+    __type(key, __s32);
+    __type(value, struct ipcmon_slot_ref);
+} pgid_slots SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, MAX_SLOTS);
+    __type(key, __u64);
+    __type(value, struct ipcmon_slot_ref);
+} cgroup_slots SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct ipcmon_ctl);
+} ctl SEC(".maps");
+
+/* Per-CPU slot totals, summed by the loader */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, MAX_SLOTS);
+    __type(key, __u32);
+    __type(value, struct ipcmon_acc);
+} slot_acc SEC(".maps");
+
+/* Slot armed on this CPU and the counters at the arm/fold point */
+struct cpu_state {
+    __u32 armed;
+    __u32 slot_idx;
+    __u32 gen;
+    __u32 switch_in;    /* switch-in not yet folded */
+    __u64 cycles;
+    __u64 instructions;
+    __u64 ns;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct cpu_state);
+} cpu_states SEC(".maps");
+
+struct sample {
+    __u64 cycles;
+    __u64 instructions;
+    __u64 ns;
+};
+
+static __always_inline bool read_counters(struct sample *s)
+{
+    struct bpf_perf_event_value v;
+
+    if (bpf_perf_event_read_value(&cycles_events, BPF_F_CURRENT_CPU, &v, sizeof(v)))
+        return false;
+    s->cycles = v.counter;
+    if (bpf_perf_event_read_value(&instructions_events, BPF_F_CURRENT_CPU, &v, sizeof(v)))
+        return false;
+    s->instructions = v.counter;
+    s->ns = bpf_ktime_get_ns();
+    return true;
+}
+
+/* Slot of @p: its PGID first, then its cgroup or the closest registered ancestor */
+static __always_inline int lookup_slot(struct task_struct *p, __u32 *gen)
+{
+    struct ipcmon_slot_ref *ref;
+    struct ipcmon_ctl *c;
+    struct cgroup *cgrp;
+    __u32 zero = 0;
+    __s32 pgid;
+    int depth;
+
+    pgid = BPF_CORE_READ(p, signal, pids[PIDTYPE_PGID], numbers[0].nr);
+    ref = bpf_map_lookup_elem(&pgid_slots, &pgid);
+    if (ref) {
+        *gen = ref->gen;
+        return ref->slot_idx;
+    }
+
+    c = bpf_map_lookup_elem(&ctl, &zero);
+    if (!c || !c->nr_cgroup_keys)
+        return -1;
+
+    cgrp = BPF_CORE_READ(p, cgroups, dfl_cgrp);
+    for (depth = 0; depth < IPCMON_CGROUP_MAX_DEPTH && cgrp; depth++) {
+        __u64 cgid = BPF_CORE_READ(cgrp, kn, id);
+
+        ref = bpf_map_lookup_elem(&cgroup_slots, &cgid);
+        if (ref) {
+            *gen = ref->gen;
+            return ref->slot_idx;
+        }
+        /* cgroup::self is the first member, so the parent css is the parent cgroup */
+        cgrp = (struct cgroup *)BPF_CORE_READ(cgrp, self.parent);
+    }
+    return -1;
+}
+
+/* Add the delta since the arm/fold point to this CPU's accumulator of the armed slot */
+static __always_inline void fold(struct cpu_state *st, const struct sample *now)
+{
+    struct ipcmon_acc *acc;
+    __u32 idx = st->slot_idx;
+
+    if (idx >= MAX_SLOTS)
+        return;
+    acc = bpf_map_lookup_elem(&slot_acc, &idx);
+    if (!acc)
+        return;
+
+    if (acc->gen != st->gen) {
+        if ((__s32)(st->gen - acc->gen) < 0)
+            return;     /* armed before the slot was reassigned */
+        acc->gen = st->gen;
+        acc->cycles = 0;
+        acc->instructions = 0;
+        acc->run_ns = 0;
+        acc->switch_ins = 0;
+    }
+
+    if (now->cycles >= st->cycles)
+        acc->cycles += now->cycles - st->cycles;
+    if (now->instructions >= st->instructions)
+        acc->instructions += now->instructions - st->instructions;
+    if (now->ns >= st->ns)
+        acc->run_ns += now->ns - st->ns;
+    acc->switch_ins += st->switch_in;
+    st->switch_in = 0;
+}
+
+SEC("tp_btf/sched_switch")
+int BPF_PROG(ipcmon_sched_switch, bool preempt, struct task_struct *prev,
+             struct task_struct *next)
+{
+    struct cpu_state *st;
+    struct sample now;
+    __u32 zero = 0, next_gen = 0;
+    int next_idx;
+
+    st = bpf_map_lookup_elem(&cpu_states, &zero);
+    if (!st)
+        return 0;
+
+    next_idx = lookup_slot(next, &next_gen);
+    if (!st->armed && next_idx < 0)
+        return 0;
+
+    if (!read_counters(&now)) {
+        st->armed = 0;
+        return 0;
+    }
+
+    /* 1) switch-out: fold PREV if it was monitored */
+    if (st->armed)
+        fold(st, &now);
+
+    /* 2) switch-in: arm NEXT if it is monitored, else disarm */
+    if (next_idx >= 0) {
+        st->armed = 1;
+        st->slot_idx = next_idx;
+        st->gen = next_gen;
+        st->switch_in = 1;
+        st->cycles = now.cycles;
+        st->instructions = now.instructions;
+        st->ns = now.ns;
+    } else {
+        st->armed = 0;
+    }
+    return 0;
+}
+
+SEC("perf_event")
+int ipcmon_publish_tick(struct bpf_perf_event_data *ctx)
+{
+    struct cpu_state *st;
+    struct sample now;
+    __u32 zero = 0;
+
+    st = bpf_map_lookup_elem(&cpu_states, &zero);
+    if (!st || !st->armed)
+        return 0;
+
+    if (!read_counters(&now))
+        return 0;
+
+    fold(st, &now);
+    st->cycles = now.cycles;
+    st->instructions = now.instructions;
+    st->ns = now.ns;
+    return 0;
+}
@@ -0,0 +1,677 @@
+/**
+ * @file ipcmon_loader.c
+ * @brief Loader, aggregator and registration CLI for the eBPF IPC monitor
+ *
+ * Usage:
+ *   ipcmon_loader run [-p publish_period_us] [-i interval_ms] [-H ewma_halflife_ms]
+ *   ipcmon_loader add <pgid> <global_jobid> <worker_num>
+ *   ipcmon_loader remove <pgid>
+ *   ipcmon_loader add-cgroup <cgroup_dir> <global_jobid> <worker_num>
+ *   ipcmon_loader remove-cgroup <cgroup_dir>
+ *
+ * "run" opens the per-CPU counters, loads and attaches ipcmon.bpf.o, creates
+ * the ABI v2 shared region as an mmap-able BPF array and pins everything under
+ * IPCMON_PIN_DIR. Every interval it sums the per-CPU accumulators of active
+ * slots into the region (seq protocol, monotonic totals, EWMA rates). The
+ * per-CPU publish tick is attached only while at least one slot is active.
+ *
+ * The other commands assign or release slots through the pinned maps, so
+ * processes other than the daemon can register workloads. Slot writes from
+ * both sides are serialized with flock(IPCMON_LOCK_PATH).
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include "ipcmon_shared.h"
+#include "ipcmon.skel.h"
+
+#define DEFAULT_PUBLISH_PERIOD_US   4000
+#define DEFAULT_INTERVAL_MS         10
+#define DEFAULT_EWMA_HALFLIFE_MS    200
+
+static volatile sig_atomic_t stop;
+
+/* Aggregator-private rate state per slot */
+struct rate_state {
+    __u32 gen;
+    __u64 ts;
+    __u64 cycles;
+    __u64 instructions;
+    __u64 run_ns;
+    double ewma_ipc;
+    double ewma_util;
+};
+
+static struct rate_state rates[MAX_SLOTS];
+
+static void on_signal(int sig)
+{
+    stop = 1;
+}
+
+static __u64 now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int lock_slots(void)
+{
+    int fd = open(IPCMON_LOCK_PATH, O_RDWR | O_CREAT, 0600);
+
+    if (fd < 0) {
+        perror("open " IPCMON_LOCK_PATH);
+        return -1;
+    }
+    if (flock(fd, LOCK_EX) < 0) {
+        perror("flock");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void unlock_slots(int fd)
+{
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+/* ---------- seq protocol (single writer under the slot lock) ---------- */
+
+static void seq_begin(__u32 *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void seq_end(__u32 *seq)
+{
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+}
+
+/* ---------- shared region ---------- */
+
+static struct ipc_shared *map_shared(int fd)
+{
+    void *p = mmap(NULL, sizeof(struct ipc_shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (p == MAP_FAILED) {
+        perror("mmap shared region");
+        return NULL;
+    }
+    return p;
+}
+
+static void init_shared(struct ipc_shared *sh, __u32 ewma_halflife_ms)
+{
+    int i;
+
+    memset(sh, 0, sizeof(*sh));
+    for (i = 0; i < MAX_SLOTS; i++) {
+        sh->slots[i].pgid = -1;
+        sh->active.idx[i] = -1;
+    }
+
+    sh->hdr.abi_version = IPC_ABI_VERSION;
+    sh->hdr.header_size = IPC_HDR_SIZE;
+    sh->hdr.slot_size = sizeof(struct pgid_slot_user);
+    sh->hdr.max_slots = MAX_SLOTS;
+    sh->hdr.ewma_halflife_ms = ewma_halflife_ms;
+    sh->hdr.total_size = sizeof(struct ipc_shared);
+    sh->hdr.active_off = offsetof(struct ipc_shared, active);
+    sh->hdr.slots_off = offsetof(struct ipc_shared, slots);
+    sh->hdr.event_set_off = offsetof(struct ipc_shared, event_set);
+    sh->hdr.slot_events_off = offsetof(struct ipc_shared, slot_events);
+    sh->hdr.pairs_off = offsetof(struct ipc_shared, pairs);
+    sh->hdr.tids_off = offsetof(struct ipc_shared, tids);
+    sh->hdr.keys_off = offsetof(struct ipc_shared, slot_keys);
+    sh->hdr.slot_smt_off = offsetof(struct ipc_shared, slot_smt);
+    sh->hdr.cores_off = offsetof(struct ipc_shared, cores);
+
+    /* header last: readers treat a valid magic as "layout initialized" */
+    __atomic_store_n(&sh->hdr.magic, IPC_ABI_MAGIC, __ATOMIC_RELEASE);
+}
+
+static void active_list_add(struct ipc_shared *sh, int idx)
+{
+    seq_begin(&sh->active.seq);
+    sh->active.idx[sh->active.nr_active] = idx;
+    sh->active.nr_active++;
+    sh->hdr.epoch++;
+    seq_end(&sh->active.seq);
+}
+
+/* Moves the last entry into the hole */
+static void active_list_remove(struct ipc_shared *sh, int idx)
+{
+    __u32 i, last = sh->active.nr_active - 1;
+
+    for (i = 0; i < sh->active.nr_active; i++) {
+        if (sh->active.idx[i] != idx)
+            continue;
+        seq_begin(&sh->active.seq);
+        sh->active.idx[i] = sh->active.idx[last];
+        sh->active.idx[last] = -1;
+        sh->active.nr_active = last;
+        sh->hdr.epoch++;
+        seq_end(&sh->active.seq);
+        return;
+    }
+}
+
+/* ---------- aggregation ---------- */
+
+static void update_rates(struct pgid_slot_user *s, struct rate_state *r, __u64 now,
+                         double halflife_ns)
+{
+    double dt, decay;
+
+    if (r->gen != s->gen || !r->ts) {
+        memset(r, 0, sizeof(*r));
+        r->gen = s->gen;
+        goto rebase;
+    }
+
+    dt = (double)(now - r->ts);
+    if (dt < 1e6)
+        return;
+
+    decay = exp2(-dt / halflife_ns);
+    if (s->cycles > r->cycles) {
+        double ipc = (double)(s->instructions - r->instructions) / (double)(s->cycles - r->cycles);
+        r->ewma_ipc = r->ewma_ipc ? r->ewma_ipc * decay + ipc * (1.0 - decay) : ipc;
+    }
+    r->ewma_util = r->ewma_util * decay + (double)(s->run_ns - r->run_ns) / dt * (1.0 - decay);
+
+rebase:
+    r->ts = now;
+    r->cycles = s->cycles;
+    r->instructions = s->instructions;
+    r->run_ns = s->run_ns;
+}
+
+/* Sum the per-CPU accumulators of every active slot into the shared region */
+static void aggregate(struct ipc_shared *sh, int acc_fd, int nr_cpus, double halflife_ns)
+{
+    struct ipcmon_acc *vals = calloc(nr_cpus, sizeof(*vals));
+    __u32 i;
+    int cpu;
+
+    if (!vals)
+        return;
+
+    for (i = 0; i < sh->active.nr_active; i++) {
+        __u32 idx = sh->active.idx[i];
+        struct pgid_slot_user *s = &sh->slots[idx];
+        __u64 c = 0, in = 0, r = 0, sw = 0;
+
+        if (bpf_map_lookup_elem(acc_fd, &idx, vals))
+            continue;
+        for (cpu = 0; cpu < nr_cpus; cpu++) {
+            if (vals[cpu].gen != s->gen)
+                continue;
+            c += vals[cpu].cycles;
+            in += vals[cpu].instructions;
+            r += vals[cpu].run_ns;
+            sw += vals[cpu].switch_ins;
+        }
+
+        /* keep published totals monotonic */
+        seq_begin(&s->seq);
+        if (c > s->cycles)
+            s->cycles = c;
+        if (in > s->instructions)
+            s->instructions = in;
+        if (r > s->run_ns)
+            s->run_ns = r;
+        if (sw > s->switch_ins)
+            s->switch_ins = sw;
+        update_rates(s, &rates[idx], now_ns(), halflife_ns);
+        s->ewma_ipc = (__u32)(rates[idx].ewma_ipc * EWMA_ONE);
+        s->ewma_util = (__u32)(rates[idx].ewma_util * EWMA_ONE);
+        seq_end(&s->seq);
+    }
+    free(vals);
+}
+
+/* ---------- run ---------- */
+
+static int perf_open(__u32 type, __u64 config, __u64 period, int cpu)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = type;
+    attr.config = config;
+    attr.size = sizeof(attr);
+    attr.sample_period = period;
+    return syscall(__NR_perf_event_open, &attr, -1, cpu, -1, 0);
+}
+
+/* Per-CPU perf events owned by "run"; the tick exists only while a slot is active */
+struct cpu_events {
+    int cycles_fd;
+    int instructions_fd;
+    struct bpf_link *tick;  /* owns the cpu-clock perf fd */
+};
+
+static void ticks_start(struct ipcmon_bpf *skel, struct cpu_events *ev, int nr_cpus,
+                        __u32 period_us)
+{
+    int cpu;
+
+    for (cpu = 0; cpu < nr_cpus; cpu++) {
+        int fd;
+
+        if (ev[cpu].cycles_fd < 0 || ev[cpu].tick)
+            continue;
+        fd = perf_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK, (__u64)period_us * 1000, cpu);
+        if (fd >= 0)
+            ev[cpu].tick = bpf_program__attach_perf_event(skel->progs.ipcmon_publish_tick, fd);
+        if (!ev[cpu].tick) {
+            fprintf(stderr, "ipcmon: no publish tick on cpu %d\n", cpu);
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+}
+
+static void ticks_stop(struct cpu_events *ev, int nr_cpus)
+{
+    int cpu;
+
+    for (cpu = 0; cpu < nr_cpus; cpu++) {
+        bpf_link__destroy(ev[cpu].tick);
+        ev[cpu].tick = NULL;
+    }
+}
+
+static int pin(int fd, const char *path)
+{
+    unlink(path);
+    if (bpf_obj_pin(fd, path)) {
+        fprintf(stderr, "ipcmon: failed to pin %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void unpin_all(void)
+{
+    unlink(IPCMON_PIN_SHARED);
+    unlink(IPCMON_PIN_PGIDS);
+    unlink(IPCMON_PIN_CGROUPS);
+    unlink(IPCMON_PIN_CTL);
+    rmdir(IPCMON_PIN_DIR);
+}
+
+static int cmd_run(int argc, char **argv)
+{
+    __u32 period_us = DEFAULT_PUBLISH_PERIOD_US;
+    __u32 interval_ms = DEFAULT_INTERVAL_MS;
+    __u32 halflife_ms = DEFAULT_EWMA_HALFLIFE_MS;
+    LIBBPF_OPTS(bpf_map_create_opts, shared_opts, .map_flags = BPF_F_MMAPABLE);
+    struct ipcmon_bpf *skel;
+    struct ipc_shared *sh = NULL;
+    struct cpu_events *ev = NULL;
+    int nr_cpus, cpu, opt, shared_fd = -1, ret = 1;
+    bool pinned = false, ticking = false;
+
+    while ((opt = getopt(argc, argv, "p:i:H:")) != -1) {
+        switch (opt) {
+        case 'p': period_us = strtoul(optarg, NULL, 0); break;
+        case 'i': interval_ms = strtoul(optarg, NULL, 0); break;
+        case 'H': halflife_ms = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: ipcmon_loader run [-p period_us] [-i interval_ms] [-H halflife_ms]\n");
+            return 1;
+        }
+    }
+    if (!interval_ms || !halflife_ms) {
+        fprintf(stderr, "ipcmon: interval and half-life must be positive\n");
+        return 1;
+    }
+
+    if (!access(IPCMON_PIN_SHARED, F_OK)) {
+        fprintf(stderr, "ipcmon: %s exists; another instance is running "
+                "(remove %s if it is stale)\n", IPCMON_PIN_SHARED, IPCMON_PIN_DIR);
+        return 1;
+    }
+
+    nr_cpus = libbpf_num_possible_cpus();
+    if (nr_cpus <= 0)
+        return 1;
+
+    skel = ipcmon_bpf__open_and_load();
+    if (!skel) {
+        fprintf(stderr, "ipcmon: failed to load BPF object\n");
+        return 1;
+    }
+
+    ev = calloc(nr_cpus, sizeof(*ev));
+    if (!ev)
+        goto out;
+
+    /* per-CPU counters read by the programs; the periodic fold tick is opened
+     * by the loop below only while a slot is active
+     */
+    for (cpu = 0; cpu < nr_cpus; cpu++) {
+        int cyc = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 0, cpu);
+        int ins = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0, cpu);
+
+        ev[cpu].cycles_fd = -1;
+        ev[cpu].instructions_fd = -1;
+        if (cyc < 0 || ins < 0) {
+            if (cyc >= 0)
+                close(cyc);
+            if (ins >= 0)
+                close(ins);
+            continue;   /* offline CPU */
+        }
+        bpf_map_update_elem(bpf_map__fd(skel->maps.cycles_events), &cpu, &cyc, BPF_ANY);
+        bpf_map_update_elem(bpf_map__fd(skel->maps.instructions_events), &cpu, &ins, BPF_ANY);
+        ev[cpu].cycles_fd = cyc;
+        ev[cpu].instructions_fd = ins;
+    }
+
+    if (ipcmon_bpf__attach(skel)) {
+        fprintf(stderr, "ipcmon: failed to attach sched_switch program\n");
+        goto out;
+    }
+
+    shared_fd = bpf_map_create(BPF_MAP_TYPE_ARRAY, "ipcmon_shared", sizeof(__u32),
+                               sizeof(struct ipc_shared), 1, &shared_opts);
+    if (shared_fd < 0) {
+        fprintf(stderr, "ipcmon: failed to create shared region: %s\n", strerror(errno));
+        goto out;
+    }
+    sh = map_shared(shared_fd);
+    if (!sh)
+        goto out;
+    init_shared(sh, halflife_ms);
+
+    /* the shared region is pinned without replacing it, so only one instance owns the pins */
+    mkdir(IPCMON_PIN_DIR, 0700);
+    if (bpf_obj_pin(shared_fd, IPCMON_PIN_SHARED)) {
+        fprintf(stderr, "ipcmon: failed to pin %s: %s\n", IPCMON_PIN_SHARED, strerror(errno));
+        goto out;
+    }
+    pinned = true;
+    if (pin(bpf_map__fd(skel->maps.pgid_slots), IPCMON_PIN_PGIDS) ||
+        pin(bpf_map__fd(skel->maps.cgroup_slots), IPCMON_PIN_CGROUPS) ||
+        pin(bpf_map__fd(skel->maps.ctl), IPCMON_PIN_CTL))
+        goto out;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    printf("ipcmon: running (publish_period_us=%u interval_ms=%u ewma_halflife_ms=%u)\n",
+           period_us, interval_ms, halflife_ms);
+
+    while (!stop) {
+        int lock;
+
+        usleep(interval_ms * 1000);
+        lock = lock_slots();
+        if (lock < 0)
+            break;
+        aggregate(sh, bpf_map__fd(skel->maps.slot_acc), nr_cpus, halflife_ms * 1e6);
+        if (period_us && !ticking && sh->active.nr_active) {
+            ticks_start(skel, ev, nr_cpus, period_us);
+            ticking = true;
+        } else if (ticking && !sh->active.nr_active) {
+            ticks_stop(ev, nr_cpus);
+            ticking = false;
+        }
+        unlock_slots(lock);
+    }
+    ret = 0;
+
+out:
+    if (ev) {
+        ticks_stop(ev, nr_cpus);
+        for (cpu = 0; cpu < nr_cpus; cpu++) {
+            if (ev[cpu].cycles_fd >= 0)
+                close(ev[cpu].cycles_fd);
+            if (ev[cpu].instructions_fd >= 0)
+                close(ev[cpu].instructions_fd);
+        }
+        free(ev);
+    }
+    if (pinned)
+        unpin_all();
+    if (sh)
+        munmap(sh, sizeof(*sh));
+    if (shared_fd >= 0)
+        close(shared_fd);
+    ipcmon_bpf__destroy(skel);
+    return ret;
+}
+
+/* ---------- registration ---------- */
+
+struct pinned {
+    int shared_fd;
+    int keys_fd;
+    int ctl_fd;
+    struct ipc_shared *sh;
+};
+
+static int open_pinned(struct pinned *p, __u32 key_type)
+{
+    p->shared_fd = bpf_obj_get(IPCMON_PIN_SHARED);
+    p->keys_fd = bpf_obj_get(key_type == IPC_KEY_CGROUP ? IPCMON_PIN_CGROUPS : IPCMON_PIN_PGIDS);
+    p->ctl_fd = bpf_obj_get(IPCMON_PIN_CTL);
+    if (p->shared_fd < 0 || p->keys_fd < 0 || p->ctl_fd < 0) {
+        fprintf(stderr, "ipcmon: pinned maps not found (is 'ipcmon_loader run' active?)\n");
+        return -1;
+    }
+    p->sh = map_shared(p->shared_fd);
+    return p->sh ? 0 : -1;
+}
+
+static void close_pinned(struct pinned *p)
+{
+    if (p->sh)
+        munmap(p->sh, sizeof(*p->sh));
+    if (p->shared_fd >= 0)
+        close(p->shared_fd);
+    if (p->keys_fd >= 0)
+        close(p->keys_fd);
+    if (p->ctl_fd >= 0)
+        close(p->ctl_fd);
+}
+
+static void adjust_cgroup_count(int ctl_fd, int delta)
+{
+    struct ipcmon_ctl c = {};
+    __u32 zero = 0;
+
+    bpf_map_lookup_elem(ctl_fd, &zero, &c);
+    c.nr_cgroup_keys += delta;
+    bpf_map_update_elem(ctl_fd, &zero, &c, BPF_ANY);
+}
+
+static int add_key(__u32 key_type, __u64 key, int global_jobid, int worker_num)
+{
+    struct pinned p = { -1, -1, -1, NULL };
+    struct ipcmon_slot_ref ref;
+    struct pgid_slot_user *s;
+    __s32 pgid = (__s32)key;
+    const void *k = key_type == IPC_KEY_CGROUP ? (const void *)&key : (const void *)&pgid;
+    int lock, idx, ret = 1;
+
+    if (open_pinned(&p, key_type))
+        goto out;
+    lock = lock_slots();
+    if (lock < 0)
+        goto out;
+
+    if (!bpf_map_lookup_elem(p.keys_fd, k, &ref)) {
+        fprintf(stderr, "ipcmon: key %llu already registered (slot %d)\n",
+                (unsigned long long)key, ref.slot_idx);
+        goto unlock;
+    }
+    for (idx = 0; idx < MAX_SLOTS; idx++) {
+        if (p.sh->slots[idx].key_type == IPC_KEY_NONE)
+            break;
+    }
+    if (idx == MAX_SLOTS) {
+        fprintf(stderr, "ipcmon: no free slot\n");
+        goto unlock;
+    }
+
+    s = &p.sh->slots[idx];
+    seq_begin(&s->seq);
+    s->gen++;
+    s->key_type = key_type;
+    s->pgid = key_type == IPC_KEY_PGID ? pgid : 0;
+    s->global_jobid = global_jobid;
+    s->worker_num = worker_num;
+    s->cycles = 0;
+    s->instructions = 0;
+    s->run_ns = 0;
+    s->switch_ins = 0;
+    s->ewma_ipc = 0;
+    s->ewma_util = 0;
+    p.sh->slot_keys[idx] = key;
+    seq_end(&s->seq);
+    active_list_add(p.sh, idx);
+
+    ref.slot_idx = idx;
+    ref.gen = s->gen;
+    if (bpf_map_update_elem(p.keys_fd, k, &ref, BPF_NOEXIST)) {
+        fprintf(stderr, "ipcmon: failed to insert key: %s\n", strerror(errno));
+        /* roll back: the slot must not stay claimed without a map entry */
+        active_list_remove(p.sh, idx);
+        seq_begin(&s->seq);
+        s->gen++;
+        s->key_type = IPC_KEY_NONE;
+        s->pgid = 0;
+        s->global_jobid = 0;
+        s->worker_num = 0;
+        p.sh->slot_keys[idx] = 0;
+        seq_end(&s->seq);
+        goto unlock;
+    }
+    if (key_type == IPC_KEY_CGROUP)
+        adjust_cgroup_count(p.ctl_fd, 1);
+
+    printf("ipcmon: added key %llu (slot=%d, gen=%u)\n", (unsigned long long)key, idx, ref.gen);
+    ret = 0;
+unlock:
+    unlock_slots(lock);
+out:
+    close_pinned(&p);
+    return ret;
+}
+
+static int remove_key(__u32 key_type, __u64 key)
+{
+    struct pinned p = { -1, -1, -1, NULL };
+    struct ipcmon_slot_ref ref;
+    struct pgid_slot_user *s;
+    __s32 pgid = (__s32)key;
+    const void *k = key_type == IPC_KEY_CGROUP ? (const void *)&key : (const void *)&pgid;
+    int lock, ret = 1;
+
+    if (open_pinned(&p, key_type))
+        goto out;
+    lock = lock_slots();
+    if (lock < 0)
+        goto out;
+
+    if (bpf_map_lookup_elem(p.keys_fd, k, &ref)) {
+        fprintf(stderr, "ipcmon: key %llu not registered\n", (unsigned long long)key);
+        goto unlock;
+    }
+    bpf_map_delete_elem(p.keys_fd, k);
+    if (key_type == IPC_KEY_CGROUP)
+        adjust_cgroup_count(p.ctl_fd, -1);
+    active_list_remove(p.sh, ref.slot_idx);
+
+    /* gen bump: per-CPU accumulators of the old generation are ignored from now on */
+    s = &p.sh->slots[ref.slot_idx];
+    seq_begin(&s->seq);
+    s->gen++;
+    s->key_type = IPC_KEY_NONE;
+    s->pgid = 0;
+    s->global_jobid = 0;
+    s->worker_num = 0;
+    p.sh->slot_keys[ref.slot_idx] = 0;
+    seq_end(&s->seq);
+
+    printf("ipcmon: removed key %llu (slot=%d)\n", (unsigned long long)key, ref.slot_idx);
+    ret = 0;
+unlock:
+    unlock_slots(lock);
+out:
+    close_pinned(&p);
+    return ret;
+}
+
+static int cgroup_id_of(const char *path, __u64 *cgid)
+{
+    struct stat st;
+
+    if (stat(path, &st) || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "ipcmon: %s is not a cgroup directory\n", path);
+        return -1;
+    }
+    *cgid = st.st_ino;
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: ipcmon_loader run [-p publish_period_us] [-i interval_ms] [-H ewma_halflife_ms]\n"
+            "       ipcmon_loader add <pgid> <global_jobid> <worker_num>\n"
+            "       ipcmon_loader remove <pgid>\n"
+            "       ipcmon_loader add-cgroup <cgroup_dir> <global_jobid> <worker_num>\n"
+            "       ipcmon_loader remove-cgroup <cgroup_dir>\n");
+}
+
+int main(int argc, char **argv)
+{
+    __u64 cgid;
+
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    if (!strcmp(argv[1], "run"))
+        return cmd_run(argc - 1, argv + 1);
+    if (!strcmp(argv[1], "add") && argc == 5)
+        return add_key(IPC_KEY_PGID, strtoul(argv[2], NULL, 0), atoi(argv[3]), atoi(argv[4]));
+    if (!strcmp(argv[1], "remove") && argc == 3)
+        return remove_key(IPC_KEY_PGID, strtoul(argv[2], NULL, 0));
+    if (!strcmp(argv[1], "add-cgroup") && argc == 5)
+        return cgroup_id_of(argv[2], &cgid) ? 1 :
+               add_key(IPC_KEY_CGROUP, cgid, atoi(argv[3]), atoi(argv[4]));
+    if (!strcmp(argv[1], "remove-cgroup") && argc == 3)
+        return cgroup_id_of(argv[2], &cgid) ? 1 : remove_key(IPC_KEY_CGROUP, cgid);
+
+    usage();
+    return 1;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file ipcmon_shared.h
+ * @brief Types shared by the eBPF IPC monitor program and its loader
+ *
+ * The user-visible region is the IPC_monitor shared-memory ABI v2 from
+ * include/ipcmon_abi.h, so readers attach to either backend unchanged; this
+ * backend leaves slot_smt, cores and the flight recorder zeroed. The BPF-map
+ * value types below are private to ipcmon.bpf.c and ipcmon_loader.c.
+ */
+
+#ifndef _IPCMON_SHARED_H
+#define _IPCMON_SHARED_H
+
+#include "ipcmon_abi.h"
+
+#define MAX_SLOTS           IPC_MAX_SLOTS
+
+#define EWMA_SHIFT          16
+#define EWMA_ONE            (1U << EWMA_SHIFT)
+
+/* Pinned objects (bpffs) */
+#define IPCMON_PIN_DIR      "/sys/fs/bpf/ipcmon"
+#define IPCMON_PIN_SHARED   IPCMON_PIN_DIR "/shared"
+#define IPCMON_PIN_PGIDS    IPCMON_PIN_DIR "/pgid_slots"
+#define IPCMON_PIN_CGROUPS  IPCMON_PIN_DIR "/cgroup_slots"
+#define IPCMON_PIN_CTL      IPCMON_PIN_DIR "/ctl"
+
+/* Serializes slot assignment (loader subcommands) against aggregation (run) */
+#define IPCMON_LOCK_PATH    "/run/ipcmon.lock"
+
+/* Deepest cgroup ancestor checked by the sched_switch program */
+#define IPCMON_CGROUP_MAX_DEPTH 16
+
+/* =========================
+ * BPF map values
+ * ========================= */
+
+/* pgid_slots / cgroup_slots value: slot armed for a matching task */
+struct ipcmon_slot_ref {
+    __s32 slot_idx;
+    __u32 gen;
+};
+
+/* slot_acc value (per CPU): totals of this CPU for slot generation gen */
+struct ipcmon_acc {
+    __u32 gen;
+    __u32 _rsvd;
+    __u64 cycles;
+    __u64 instructions;
+    __u64 run_ns;
+    __u64 switch_ins;
+};
+
+/* ctl value: lets sched_switch skip the cgroup walk while no cgroup is registered */
+struct ipcmon_ctl {
+    __u32 nr_cgroup_keys;
+    __u32 _rsvd;
+};
+
+#endif /* _IPCMON_SHARED_H */
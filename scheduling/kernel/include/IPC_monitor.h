@@ -3,8 +3,8 @@
  * @brief Header file for IPC Monitor kernel module API
  *
  * This header provides the interface for tracking Instructions Per Cycle (IPC)
- * of process groups (PGIDs). It is used by the runtime_monitor module to register
- * and unregister processes for performance monitoring.
+ * of process groups (PGIDs) or cgroups. It is used by the runtime_monitor module to
+ * register and unregister processes for performance monitoring.
  */
 
 #ifndef _IPC_MONITOR_H
@@ -37,4 +37,38 @@ int ipcmon_add_pgid(pid_t pgid, int global_jobid, int worker_num);
  */
 int ipcmon_remove_pgid(pid_t pgid);
 
+/**
+ * ipcmon_set_worker_num - Update the worker count of a registered process group
+ * @pgid: Process group ID
+ * @worker_num: New number of worker threads
+ *
+ * Republishes the slot and, if the count changed, bumps the shared header
+ * epoch and wakes poll()/read() waiters on /dev/IPC_monitor.
+ *
+ * Return: 0 on success, -ENOENT if PGID not found
+ */
+int ipcmon_set_worker_num(pid_t pgid, int worker_num);
+
+/**
+ * ipcmon_add_cgroup - Register a cgroup v2 for IPC monitoring
+ * @cgid: cgroup ID (inode number of the cgroup directory)
+ * @global_jobid: Global job identifier for the workload
+ * @worker_num: Number of worker threads in the cgroup
+ *
+ * Tasks are attributed to the slot when their default-hierarchy cgroup, or
+ * any of its ancestors, is @cgid. A registered PGID takes precedence.
+ *
+ * Return: 0 on success, -ENOMEM if no slots available or allocation fails,
+ * -EEXIST if already registered, -EINVAL for a zero ID
+ */
+int ipcmon_add_cgroup(u64 cgid, int global_jobid, int worker_num);
+
+/**
+ * ipcmon_remove_cgroup - Unregister a cgroup from IPC monitoring
+ * @cgid: cgroup ID to remove
+ *
+ * Return: 0 on success, -ENOENT if the cgroup is not registered
+ */
+int ipcmon_remove_cgroup(u64 cgid);
+
 #endif /* _IPC_MONITOR_H */
\ No newline at end of file
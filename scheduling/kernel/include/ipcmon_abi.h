@@ -0,0 +1,321 @@
+/**
+ * @file ipcmon_abi.h
+ * @brief IPC_monitor shared-memory ABI v2 and ioctl interface
+ *
+ * Layout of the region mapped from /dev/IPC_monitor (module/IPC_monitor.c)
+ * and from the eBPF backend's pinned array (bpf/ipcmon_loader.c): a header
+ * page (magic, ABI version, slot count, epoch, region offsets) followed by
+ * the regions it points to. Readers map the header page first, check
+ * magic/version, then map hdr.total_size bytes. The region and the flight
+ * recorder rings are read-only to userspace; the only reader-writable memory
+ * is the flight recorder tail array.
+ *
+ * Every seq-protected record uses the same protocol: even = stable snapshot,
+ * odd = writer in progress; readers retry until seq is even and unchanged.
+ *
+ * Included by the module, the eBPF program and loader, and job_mapper.cpp;
+ * python/smtcheck/c_struct.py mirrors it with ctypes.
+ */
+
+#ifndef _IPCMON_ABI_H
+#define _IPCMON_ABI_H
+
+#ifndef __VMLINUX_H__
+#include <linux/types.h>
+#include <linux/ioctl.h>
+#endif
+
+#define IPC_ABI_MAGIC       0x4D435049U     /* "IPCM" */
+#define IPC_ABI_VERSION     2
+#define IPC_HDR_SIZE        4096
+
+#define IPC_MAX_SLOTS       4096
+#define IPC_PAIR_TABLE_SIZE 8192
+#define IPC_TID_POOL_SIZE   8192
+
+/* Extra PMU events counted besides cycles/instructions (general-purpose counters
+ * per SMT thread on current x86 parts; cycles/instructions use fixed counters)
+ */
+#define IPC_MAX_EVENTS      4
+
+/* Physical cores tracked for SMT occupancy, and threads per core accounted */
+#define IPC_MAX_CORES       1024
+#define IPC_CORE_THREADS    2
+
+/* Slot key types (pgid_slot_user.key_type) */
+#define IPC_KEY_NONE        0
+#define IPC_KEY_PGID        1
+#define IPC_KEY_CGROUP      2
+
+/* Peer codes besides slot indexes (< IPC_MAX_SLOTS) */
+#define PEER_IDLE           0xFFFF  /* sibling idle, or no SMT sibling */
+#define PEER_OTHER          0xFFFE  /* sibling ran an unmonitored task */
+#define PEER_MIXED          0xFFFD  /* sibling occupant changed within the interval */
+
+/* Flight recorder: ring region (read-only) and reader tails (read-write)
+ * mapped at these file offsets
+ */
+#define IPC_TRACE_MAGIC             0x54435049U     /* "IPCT" */
+#define IPC_TRACE_MMAP_OFFSET       0x40000000UL
+#define IPC_TRACE_TAIL_MMAP_OFFSET  0x50000000UL
+
+/* =========================
+ * ioctl interface (/dev/IPC_monitor)
+ * ========================= */
+
+/* IPC_IOC_SET_EVENTS argument: type/config/config1 follow struct perf_event_attr;
+ * nr_events = 0 clears the set.
+ */
+struct ipc_event_spec {
+    __u32 type;
+    __u32 _rsvd;
+    __u64 config;
+    __u64 config1;
+};
+
+struct ipc_event_config {
+    __u32 nr_events;
+    __u32 _rsvd;
+    struct ipc_event_spec events[IPC_MAX_EVENTS];
+};
+
+/* IPC_IOC_ADD_CGROUP argument */
+struct ipc_cgroup_key {
+    __u64 cgid;         /* cgroup v2 ID (inode number of the cgroup directory) */
+    __s32 global_jobid;
+    __s32 worker_num;
+};
+
+/* IPC_IOC_SET_TID_MODE argument */
+struct ipc_tid_mode {
+    __s32 pgid;
+    __u32 enable;
+};
+
+#define IPC_IOC_MAGIC 'I'
+/* nr 0 was IPC_IOC_RESET_COUNTERS; counters are monotonic, readers keep baselines */
+#define IPC_IOC_SET_PUBLISH_PERIOD  _IOW(IPC_IOC_MAGIC, 1, __u32)
+#define IPC_IOC_SYNC_COUNTERS       _IO(IPC_IOC_MAGIC, 2)
+#define IPC_IOC_SET_EVENTS          _IOW(IPC_IOC_MAGIC, 3, struct ipc_event_config)
+#define IPC_IOC_SET_EWMA_HALFLIFE   _IOW(IPC_IOC_MAGIC, 4, __u32)
+#define IPC_IOC_SET_TID_MODE        _IOW(IPC_IOC_MAGIC, 5, struct ipc_tid_mode)
+#define IPC_IOC_ADD_CGROUP          _IOW(IPC_IOC_MAGIC, 6, struct ipc_cgroup_key)
+#define IPC_IOC_REMOVE_CGROUP       _IOW(IPC_IOC_MAGIC, 7, __u64)
+
+/* =========================
+ * Header (first page of the mapping)
+ * =========================
+ * Offsets are from the start of the region. epoch is bumped on every change
+ * of the active list and on worker count updates; poll()/read() on the device
+ * wake up when it changes.
+ */
+struct ipc_shared_header {
+    __u32 magic;
+    __u32 abi_version;
+    __u32 header_size;
+    __u32 slot_size;
+    __u32 max_slots;
+    __u32 ewma_halflife_ms;
+    __u64 total_size;
+    __u64 epoch;
+    __u64 active_off;
+    __u64 slots_off;
+    __u64 event_set_off;
+    __u64 slot_events_off;
+    __u64 pairs_off;
+    __u64 tids_off;
+    __u64 keys_off;
+    __u64 slot_smt_off;
+    __u64 cores_off;
+    __u64 trace_mmap_off;   /* file offset of the flight recorder, 0 if disabled */
+    __u64 trace_size;
+    __u64 trace_tail_mmap_off;  /* file offset of the reader tails, 0 if disabled */
+    __u64 trace_tail_size;
+};
+
+/* Dense list of active slot indexes (seq-protected) */
+struct ipc_active_list {
+    __u32 seq;
+    __u32 nr_active;
+    __s32 idx[IPC_MAX_SLOTS];
+} __attribute__((aligned(64)));
+
+/* =========================
+ * Snapshot slot
+ * =========================
+ * One cacheline per slot so writers of different PGIDs never share a line.
+ * cycles/instructions/run_ns/switch_ins only grow while gen is unchanged; a new
+ * gen means the slot was (re)assigned and readers must drop their baseline.
+ * ewma_ipc (IPC) and ewma_util (CPUs busy) are Q16 fixed point.
+ */
+struct pgid_slot_user {
+    __u32 seq;
+    __s32 pgid;
+    __s32 global_jobid;
+    __s32 worker_num;
+    __u64 cycles;
+    __u64 instructions;
+    __u32 gen;
+    __u32 ewma_ipc;
+    __u64 run_ns;
+    __u64 switch_ins;
+    __u32 ewma_util;
+    __u32 key_type;     /* IPC_KEY_*; the key itself is in slot_keys[] */
+} __attribute__((aligned(64)));
+
+/* Currently configured extra events (seq-protected) */
+struct ipc_event_set_user {
+    __u32 seq;
+    __u32 nr_events;
+    __u32 config_gen;
+    __u32 _rsvd;
+    struct ipc_event_spec events[IPC_MAX_EVENTS];
+};
+
+/* Per-slot extra event totals, covered by slots[idx].seq */
+struct pgid_events_user {
+    __u64 counts[IPC_MAX_EVENTS];
+};
+
+/* Co-run pair accumulator (seq-protected). own_gen == 0 marks a never-used
+ * entry; an entry whose own/peer gen no longer matches the slot is dead and
+ * gets reused. cycles/instructions are the OWN slot's counts while the sibling
+ * ran peer_slot.
+ */
+struct pair_entry_user {
+    __u32 seq;
+    __u16 own_slot;
+    __u16 peer_slot;    /* slot index or PEER_IDLE / PEER_OTHER / PEER_MIXED */
+    __u32 own_gen;
+    __u32 peer_gen;     /* 0 unless peer_slot is a slot index */
+    __s32 own_jobid;
+    __s32 peer_jobid;   /* -1 unless peer_slot is a slot index */
+    __u64 cycles;
+    __u64 instructions;
+};
+
+struct ipc_pair_table_user {
+    __u32 nr_entries;
+    __u32 _rsvd;
+    __u64 dropped;      /* pair deltas lost to a full probe window */
+    struct pair_entry_user entries[IPC_PAIR_TABLE_SIZE];
+};
+
+/* Per-tid sub-slot (seq-protected). tid == 0 marks a free entry;
+ * parent_slot/parent_gen name the PGID slot whose aggregate also includes it.
+ */
+struct tid_slot_user {
+    __u32 seq;
+    __s32 tid;
+    __s32 pgid;
+    __u16 parent_slot;
+    __u16 _rsvd;
+    __u32 parent_gen;
+    __u32 gen;
+    __u64 cycles;
+    __u64 instructions;
+    __u64 run_ns;
+    __u64 switch_ins;
+} __attribute__((aligned(64)));
+
+struct ipc_tid_table_user {
+    __u32 nr_entries;
+    __u32 nr_used;
+    __u64 dropped;      /* tids not tracked because the pool was full */
+    struct tid_slot_user entries[IPC_TID_POOL_SIZE];
+};
+
+/* Per-slot SMT split, covered by slots[idx].seq.
+ * solo: the SMT sibling was idle (or there is none); corun: it ran a task.
+ * Intervals in which the sibling changed occupant count in neither, so
+ * cycles - solo_cycles - corun_cycles is the mixed remainder.
+ */
+struct slot_smt_user {
+    __u64 solo_cycles;
+    __u64 solo_instructions;
+    __u64 solo_ns;
+    __u64 corun_cycles;
+    __u64 corun_instructions;
+    __u64 corun_ns;
+};
+
+/* Per-core SMT occupancy (seq-protected). busy_ns[n] is the time with n of
+ * the core's threads running a task; cpus[] beyond nr_cpus are -1.
+ */
+struct core_smt_user {
+    __u32 seq;
+    __u32 nr_cpus;
+    __s32 cpus[IPC_CORE_THREADS];
+    __u64 busy_ns[IPC_CORE_THREADS + 1];
+} __attribute__((aligned(64)));
+
+struct ipc_core_table_user {
+    __u32 nr_cores;
+    __u32 _rsvd;
+    struct core_smt_user entries[IPC_MAX_CORES];
+};
+
+struct ipc_shared {
+    union {
+        struct ipc_shared_header hdr;
+        __u8 hdr_page[IPC_HDR_SIZE];
+    };
+    struct ipc_active_list active;
+    struct pgid_slot_user slots[IPC_MAX_SLOTS];
+    struct ipc_event_set_user event_set;
+    struct pgid_events_user slot_events[IPC_MAX_SLOTS];
+    struct ipc_pair_table_user pairs;
+    struct ipc_tid_table_user tids;
+    __u64 slot_keys[IPC_MAX_SLOTS];             /* tracking key per slot (covered by slots[i].seq) */
+    struct slot_smt_user slot_smt[IPC_MAX_SLOTS];   /* covered by slots[i].seq */
+    struct ipc_core_table_user cores;
+};
+
+/* =========================
+ * Flight recorder (separate mapping at hdr.trace_mmap_off)
+ * =========================
+ * 64 bytes of ipc_trace_header, then one single-producer ring per possible
+ * CPU, written by that CPU only. The reader consumes [tail, head) and advances
+ * tail, which lives in its own writable mapping (hdr.trace_tail_mmap_off, one
+ * ipc_trace_tail per ring); a record that finds the ring full is dropped and
+ * counted. Timestamps are local_clock() nanoseconds.
+ */
+struct ipc_trace_record {
+    __u64 start_ns;
+    __u64 end_ns;
+    __u64 cycles;
+    __u64 instructions;
+    __u32 gen;          /* slot generation */
+    __u32 peer_gen;     /* 0 unless peer_slot is a slot index */
+    __u16 cpu;
+    __u16 slot;
+    __u16 peer_slot;    /* sibling occupant: slot index or PEER_IDLE / OTHER / MIXED */
+    __u16 flags;        /* IPC_TRACE_* */
+};
+
+#define IPC_TRACE_SWITCH_IN     0x1     /* interval began with a switch-in */
+
+struct ipc_trace_ring {
+    __u64 head;         /* written by the kernel */
+    __u64 dropped;
+    __u64 _rsvd0[6];
+    __u64 _rsvd1[8];    /* was the reader tail, see ipc_trace_tail */
+    struct ipc_trace_record records[];
+};
+
+/* Reader position of one ring, one cacheline each */
+struct ipc_trace_tail {
+    __u64 tail;         /* written by the reader */
+    __u64 _rsvd[7];
+};
+
+struct ipc_trace_header {
+    __u32 magic;
+    __u32 record_size;
+    __u32 nr_cpus;      /* rings, indexed by CPU id */
+    __u32 nr_records;   /* per ring, power of two */
+    __u64 ring_size;    /* bytes per ring, including its control block */
+    __u64 rings_off;    /* offset of ring 0 from the start of the mapping */
+};
+
+#endif /* _IPCMON_ABI_H */
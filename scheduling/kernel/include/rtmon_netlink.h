@@ -0,0 +1,59 @@
+/**
+ * @file rtmon_netlink.h
+ * @brief runtime_monitor netlink protocol (NETLINK_USER)
+ *
+ * Kernel -> user: one RTMON_MSG_EVENTS message per skb, carrying a
+ * struct rtmon_nl_batch followed by nr_events records of record_size bytes.
+ * Batches go to the PID set with RTMON_IOC_SET_DATA_LOADER_PID (unicast,
+ * retried on a full socket) and to the RTMON_NL_GROUP_EVENTS multicast group
+ * (best effort). Readers skip records of unknown type and ignore trailing
+ * bytes when record_size grows.
+ *
+ * User -> kernel: RTMON_MSG_ACK carries a struct rtmon_nl_batch with
+ * record_size = sizeof(__s32) and nr_events pgids whose profiling finished.
+ * A message of any other type whose payload is a single int is accepted as a
+ * legacy one-pgid ACK.
+ */
+
+#ifndef _RTMON_NETLINK_H
+#define _RTMON_NETLINK_H
+
+#include <linux/types.h>
+
+#define RTMON_NETLINK_PROTO     31
+#define RTMON_NL_VERSION        1
+
+/* nlmsg_type (above NLMSG_MIN_TYPE) */
+#define RTMON_MSG_EVENTS        0x10
+#define RTMON_MSG_ACK           0x11
+
+/* Multicast groups (bind with nl_groups = 1 << (group - 1)) */
+#define RTMON_NL_GROUP_EVENTS   1
+#define RTMON_NL_GROUPS         1
+
+/* Event types */
+#define RTMON_EV_LONG_RUNNING   1   /* threshold crossed or profile requested; arg = elapsed sec */
+#define RTMON_EV_EXITED         2   /* no live process left; entry removed */
+#define RTMON_EV_WORKERS        3   /* worker_num changed; value = new count */
+#define RTMON_EV_PROFILE_ACK    4   /* profiling ACK received */
+#define RTMON_EV_PROVISIONAL    5   /* early signature ready in the IPC_monitor slot; arg = elapsed sec */
+
+struct rtmon_nl_batch {
+    __u16 version;
+    __u16 record_size;
+    __u32 nr_events;
+    __u64 seq;          /* first event's sequence number */
+    __u64 dropped;      /* events lost to a full queue since load */
+};
+
+struct rtmon_nl_event {
+    __u16 type;
+    __u16 _rsvd;
+    __s32 pgid;
+    __s32 global_jobid;
+    __s32 value;
+    __u64 ts_ns;        /* ktime_get_ns() when queued */
+    __u64 arg;
+};
+
+#endif /* _RTMON_NETLINK_H */
@@ -0,0 +1,68 @@
+/**
+ * @file rtmon_status.h
+ * @brief runtime_monitor status table (read-only mmap of /dev/runtime_monitor)
+ *
+ * One header page followed by RTMON_STATUS_MAX fixed 64-byte records, one per
+ * tracked process group. A record is live while pgid != 0; entries[0..nr_used)
+ * covers every live record. Each record is written under the entry lock with
+ * the usual sequence protocol (odd seq: update in progress), so readers retry
+ * until seq is even and unchanged. hdr.epoch grows on every update.
+ *
+ * Times are CLOCK_MONOTONIC nanoseconds (time.monotonic_ns() in Python).
+ */
+
+#ifndef _RTMON_STATUS_H
+#define _RTMON_STATUS_H
+
+#include <linux/types.h>
+
+#define RTMON_STATUS_MAGIC      0x4E4D5452U     /* "RTMN" */
+#define RTMON_STATUS_VERSION    1
+#define RTMON_STATUS_HDR_SIZE   4096
+#define RTMON_STATUS_MAX        4096
+
+/* rtmon_status_entry.flags */
+#define RTMON_ST_LONG_RUNNING       0x01    /* threshold crossed (or ACK received) */
+#define RTMON_ST_PROFILE_DONE       0x02    /* profiling ACK received */
+#define RTMON_ST_IPCMON_REGISTERED  0x04    /* has an IPC_monitor slot */
+#define RTMON_ST_PROVISIONAL        0x08    /* registered before the ACK */
+#define RTMON_ST_SIGNATURE_SENT     0x10    /* RTMON_EV_PROVISIONAL emitted */
+#define RTMON_ST_REQUEST_PENDING    0x20    /* a long-running event is waiting to be queued */
+
+struct rtmon_status_header {
+    __u32 magic;
+    __u32 version;
+    __u32 header_size;
+    __u32 entry_size;
+    __u32 max_entries;
+    __u32 nr_used;              /* high-water mark of live records */
+    __u64 total_size;
+    __u64 entries_off;
+    __u64 epoch;
+    __u64 overflow;             /* groups tracked without a record (table full) */
+    __u32 long_running_threshold;
+    __u32 _rsvd;
+};
+
+struct rtmon_status_entry {
+    __u32 seq;
+    __u32 flags;
+    __s32 pgid;                 /* 0: free record */
+    __s32 global_jobid;
+    __s32 worker_num;
+    __u32 threshold_sec;        /* current threshold of this entry */
+    __u64 start_time_ns;
+    __u64 request_ns;           /* last long-running event queued, 0: none */
+    __u64 ack_ns;               /* profiling ACK, 0: none */
+    __u64 _rsvd;
+} __attribute__((aligned(64)));
+
+struct rtmon_status {
+    union {
+        struct rtmon_status_header hdr;
+        __u8 hdr_page[RTMON_STATUS_HDR_SIZE];
+    };
+    struct rtmon_status_entry entries[RTMON_STATUS_MAX];
+};
+
+#endif /* _RTMON_STATUS_H */
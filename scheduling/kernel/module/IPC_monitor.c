@@ -14,6 +14,46 @@
  *  - Remove-path safety: gen bump under slot lock + lock-protected slot clear (no data race)
  *  - Thread-safe slot allocator: global spinlock protects free_list/tail_index/free_count
  *  - Duplicate PGID add: re-check under hash lock right before publishing map
+ *  - Periodic publishing: a per-CPU hrtimer folds the running delta into the armed
+ *    slot every publish_period_us, so snapshots do not wait for a context switch;
+ *    the timers and the aggregation worker only run while a slot is active
+ *  - Per-CPU accumulation (percpu_accum=1): sched_switch adds into a CPU-local
+ *    partial per slot without taking the slot lock; a periodic worker (or
+ *    IPC_IOC_SYNC_COUNTERS) sums the partials into the shared snapshot. The
+ *    partials are allocated per active slot (alloc_percpu, so CPUs that come
+ *    online later are covered) and freed after a grace period on removal
+ *  - Cheap classification: a static key turns the sched_switch hook into a no-op
+ *    while no slot is active, and a PGID bitmap filter rejects unmonitored tasks
+ *    before the hash walk
+ *  - Configurable event set: IPC_IOC_SET_EVENTS adds up to IPC_MAX_EVENTS extra
+ *    PMU events per CPU; their multiplex-scaled deltas are attributed to slots
+ *    alongside cycles/instructions and published as per-slot event totals
+ *  - Co-runner attribution: each CPU publishes its occupant for the SMT sibling,
+ *    and every delta is also charged to the pair (own slot, sibling slot/idle/other)
+ *    in a shared pair table, giving measured co-run IPC for every observed pair
+ *  - Shared-memory ABI v2: a header page (magic, ABI version, slot count, epoch,
+ *    region offsets), 64-byte slots, and a dense seqlocked list of active slots
+ *  - Monotonic counters: slot counters are never reset; each slot publishes its
+ *    generation so readers keep their own baselines and compute deltas
+ *  - Rates: each slot also tracks run time and switch-ins, and maintains
+ *    exponentially weighted IPC and utilisation (configurable half-life)
+ *  - Per-thread mode: a PGID in tid mode also gets per-tid sub-slots, created on
+ *    switch-in from a bounded pool and reclaimed at thread exit
+ *  - Cgroup keys: a slot can track a cgroup v2 ID instead of a PGID; tasks are
+ *    matched on their default-hierarchy cgroup or any ancestor, so a container
+ *    is one slot
+ *  - SMT occupancy: each physical core accumulates the time with zero, one or
+ *    both siblings busy, and each slot splits its counts into solo (sibling
+ *    idle) and co-run (sibling busy) parts
+ *  - Flight recorder (trace_records > 0): every folded run interval is also
+ *    appended to a bounded per-CPU ring (mmap at IPC_TRACE_MMAP_OFFSET) that a
+ *    userspace recorder drains; records that find the ring full are counted
+ *  - Read-only mappings: the shared region and the trace rings are mapped
+ *    read-only and the kernel keeps its own active list and ring geometry;
+ *    only the trace reader tails (IPC_TRACE_TAIL_MMAP_OFFSET) are writable
+ *  - Change notification: poll()/read() on the device wake up whenever
+ *    hdr.epoch changes (slot added or removed, worker count updated), so
+ *    consumers can sleep instead of rescanning the active list on a timer
  */
 
 #include <linux/module.h>
@@ -26,6 +66,7 @@
 #include <linux/cdev.h>
 #include <linux/sched.h>
 #include <linux/sched/task.h>
+#include <linux/sched/clock.h>
 #include <linux/mm.h>
 #include <linux/vmalloc.h>
 #include <linux/pid.h>
@@ -38,15 +79,79 @@
 #include <linux/sched/signal.h>
 #include <linux/bitmap.h>
 #include <linux/atomic.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/topology.h>
+#include <linux/jump_label.h>
+#include <linux/hash.h>
+#include <linux/math64.h>
+#include <linux/jhash.h>
+#include <linux/cgroup.h>
+#include <linux/log2.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
 
 #include "IPC_monitor.h"
+#include "ipcmon_abi.h"
 
-#define MAX_SLOTS       4096
+#define MAX_SLOTS       IPC_MAX_SLOTS
 #define PGID_HASH_BITS  10
-
-/* ioctl command definitions */
-#define IPC_IOC_MAGIC 'I'
-#define IPC_IOC_RESET_COUNTERS _IO(IPC_IOC_MAGIC, 0)
+#define PGID_FILTER_BITS 16     /* 64K-bit prefilter: ~6% false positives at MAX_SLOTS */
+
+/* Pair table: open addressing over a power-of-two table in the shared region */
+#define PAIR_TABLE_SIZE     IPC_PAIR_TABLE_SIZE
+#define PAIR_MAX_PROBE      32
+#define PAIR_PENDING        4       /* per-CPU pair deltas buffered before the table */
+#define PAIR_FLUSH_FOLDS    16      /* flush the buffer at least every N folds */
+
+/* Per-tid sub-slot pool (tid mode) */
+#define TID_POOL_SIZE       IPC_TID_POOL_SIZE
+#define TID_HASH_BITS       11
+
+/* Flight recorder: upper bound on trace_records, offset of ring 0 */
+#define MAX_TRACE_RECORDS       (1U << 22)
+#define TRACE_RINGS_OFF         64
+
+/* Bounds for the publish period (100 us .. 1 s); 0 disables periodic publishing */
+#define MIN_PUBLISH_PERIOD_US   100U
+#define MAX_PUBLISH_PERIOD_US   1000000U
+
+/* EWMA rates: fixed point Q16, half-life bounds in ms, minimum sample interval */
+#define EWMA_SHIFT              16
+#define EWMA_ONE                (1U << EWMA_SHIFT)
+#define MAX_EWMA_HALFLIFE_MS    60000U
+#define RATE_MIN_INTERVAL_NS    (1 * NSEC_PER_MSEC)
+
+/* Periodic publish interval in microseconds (changeable via IPC_IOC_SET_PUBLISH_PERIOD) */
+static unsigned int publish_period_us = 4000;
+module_param(publish_period_us, uint, 0444);
+MODULE_PARM_DESC(publish_period_us,
+                 "Interval (us) at which running deltas are folded into slots (0 = switch-out only)");
+
+/* Accumulation design: per-CPU partials (1) or the locked shared slot (0) */
+static bool percpu_accum = true;
+module_param(percpu_accum, bool, 0444);
+MODULE_PARM_DESC(percpu_accum,
+                 "Accumulate into lock-free per-CPU partials and aggregate lazily (default: 1)");
+
+/* Half-life of the per-slot EWMA IPC/utilisation (changeable via IPC_IOC_SET_EWMA_HALFLIFE) */
+static unsigned int ewma_halflife_ms = 200;
+module_param(ewma_halflife_ms, uint, 0444);
+MODULE_PARM_DESC(ewma_halflife_ms, "Half-life (ms) of the per-slot EWMA IPC and utilisation");
+
+/* Flight recorder ring size per CPU (power of two, 0 = off) */
+static unsigned int trace_records;
+module_param(trace_records, uint, 0444);
+MODULE_PARM_DESC(trace_records,
+                 "Per-CPU flight recorder ring size in records (power of two, 0 = disabled)");
+
+/* Default tid mode for newly added PGIDs (per PGID via IPC_IOC_SET_TID_MODE) */
+static bool tid_mode;
+module_param(tid_mode, bool, 0444);
+MODULE_PARM_DESC(tid_mode, "Track per-tid sub-slots for newly added PGIDs (default: 0)");
 
 /* =========================
  * Kernel-internal slot
@@ -54,46 +159,105 @@
 struct pgid_slot {
     spinlock_t lock;
 
-    __s32 pgid;
+    __u32 key_type;
+    __u64 key;          /* PGID or cgroup ID */
+
+    __s32 pgid;         /* 0 for cgroup keys */
     __s32 global_jobid;
 
-    __u32 reset_flag;
     __u32 worker_num;
-
     __u32 gen;
-    __u32 _rsvd;
 
     __u64 cycles;
     __u64 instructions;
+
+    __u64 events[IPC_MAX_EVENTS];
+
+    __u64 run_ns;
+    __u64 switch_ins;
+
+    /* Event totals restart when the event set changes (published = sum - base) */
+    __u64 base_events[IPC_MAX_EVENTS];
+
+    struct slot_smt_user smt;
+
+    /* EWMA state: Q16 rates and the totals/time at the last rate sample */
+    __u32 ewma_ipc;
+    __u32 ewma_util;
+    __u64 rate_ts;
+    __u64 rate_cycles;
+    __u64 rate_instructions;
+    __u64 rate_run_ns;
 } __attribute__((aligned(64)));
 
 /* =========================
- * Userspace-visible snapshot slot (mmap region)
+ * Per-CPU partial accumulator (percpu_accum mode)
  * =========================
- * seq: even = stable snapshot, odd = writer in progress
+ * Written only by its own CPU with IRQs disabled; gen tags which slot
+ * incarnation the partial belongs to, so stale partials are ignored after reuse.
  */
-struct pgid_slot_user {
-    __u32 seq;
-    __s32 pgid;
-    __s32 global_jobid;
-    __s32 worker_num;
+struct slot_pcpu_acc {
+    __u32 gen;
+    __u32 _rsvd;
     __u64 cycles;
     __u64 instructions;
-} __attribute__((aligned(16)));
+    __u64 events[IPC_MAX_EVENTS];
+    __u64 run_ns;
+    __u64 switch_ins;
+    struct slot_smt_user smt;
+};
 
-struct ipc_shared {
-    atomic_t count;
-    unsigned long active_mask[BITS_TO_LONGS(MAX_SLOTS)];
-    struct pgid_slot_user slots[MAX_SLOTS];
+/* =========================
+ * PMU sample (per-CPU arm point and current reading)
+ * =========================
+ * ev_gen tags which event configuration ev[] was read under (0 = none).
+ */
+struct pmu_sample {
+    u64 ns;         /* local_clock() at the read */
+    u64 cycles;
+    u64 insts;
+    u64 ev[IPC_MAX_EVENTS];
+    u64 ev_enabled[IPC_MAX_EVENTS];
+    u64 ev_running[IPC_MAX_EVENTS];
+    u32 ev_gen;
+};
+
+struct pmu_delta {
+    u64 cycles;
+    u64 insts;
+    u64 ev[IPC_MAX_EVENTS];
+    u64 run_ns;
+    u64 switch_ins;
 };
 
 /* Userspace-shared region mapped via mmap */
 static struct ipc_shared *shared_mem;
 static size_t shared_mem_size;
 
+/* Flight recorder region (NULL when trace_records == 0), mapped read-only;
+ * the ring geometry is kept here since userspace only sees a copy of it
+ */
+static struct ipc_trace_header *trace_mem;
+static size_t trace_mem_size;
+static size_t trace_ring_size;
+
+/* Reader tails, one per ring: the only userspace-writable memory */
+static struct ipc_trace_tail *trace_tail_mem;
+static size_t trace_tail_mem_size;
+
 /* Kernel-internal slots (lock + metadata + gen + true counters) */
 static struct pgid_slot kslots[MAX_SLOTS];
 
+/* Active slots: bitmap for kernel-side iteration, dense list and position of
+ * each slot in it (all updated under pgid_hash_lock). shared_mem->active is a
+ * copy for readers and is never read back.
+ */
+static unsigned long active_mask[BITS_TO_LONGS(MAX_SLOTS)];
+static int active_idx[MAX_SLOTS];
+static u32 active_count;
+static int active_pos[MAX_SLOTS];
+static atomic_t nr_active;
+
 /* Slot allocation (indexes only) */
 static int tail_index;
 static int free_list[MAX_SLOTS];
@@ -106,30 +270,155 @@ static dev_t dev_no;
 static struct class *ipc_class;
 static struct device *ipc_device;
 
+/* poll()/read() waiters for hdr.epoch changes */
+static DECLARE_WAIT_QUEUE_HEAD(epoch_wq);
+
+/* Per-open state: last epoch returned by read() */
+struct ipc_file {
+    u64 seen_epoch;
+};
+
 /* PGID->slot mapping (RCU) */
 struct pgid_map {
-    pid_t pgid;
+    pid_t pgid;         /* IPC_KEY_PGID maps (pgid_hash) */
+    u64 cgid;           /* IPC_KEY_CGROUP maps (cgroup_hash) */
+    u32 key_type;
     int slot_idx;
     __u32 gen;
+    bool tid_mode;
+    struct slot_pcpu_acc __percpu *acc;     /* freed with the map after removal */
     struct hlist_node hnode;
     struct rcu_head rcu;
 };
 static DEFINE_HASHTABLE(pgid_hash, PGID_HASH_BITS);
-static DEFINE_SPINLOCK(pgid_hash_lock);
+static DEFINE_HASHTABLE(cgroup_hash, PGID_HASH_BITS);
+static DEFINE_SPINLOCK(pgid_hash_lock);     /* protects both hashes */
+
+/* tid->sub-slot mapping (RCU). Nodes come from a static pool (index == sub-slot)
+ * because they are created in sched_switch, where allocation is not allowed;
+ * reclaimed nodes return to the free list after a grace period.
+ */
+struct tid_map {
+    pid_t tid;
+    int parent_slot;
+    __u32 parent_gen;
+    struct hlist_node hnode;
+    struct rcu_head rcu;
+};
+static struct tid_map tid_nodes[TID_POOL_SIZE];
+static u32 tid_gen[TID_POOL_SIZE];
+static int tid_free[TID_POOL_SIZE];
+static int tid_free_count;
+static atomic_t nr_tids;
+static DEFINE_HASHTABLE(tid_hash, TID_HASH_BITS);
+static DEFINE_SPINLOCK(tid_lock);
+
+/* PGID prefilter: bit set iff some registered PGID hashes there (refcounted
+ * under pgid_hash_lock), so unmonitored tasks skip the bucket walk.
+ */
+static unsigned long pgid_filter[BITS_TO_LONGS(1 << PGID_FILTER_BITS)];
+static u16 pgid_filter_ref[1 << PGID_FILTER_BITS];
+
+/* Same for cgroup IDs, checked per ancestor level; the walk is skipped
+ * entirely while no cgroup key is registered.
+ */
+static unsigned long cgroup_filter[BITS_TO_LONGS(1 << PGID_FILTER_BITS)];
+static u16 cgroup_filter_ref[1 << PGID_FILTER_BITS];
+static int nr_cgroup_keys;
+
+/* Enabled while any slot is active; toggled from process context by a work item
+ * because ipcmon_add_pgid()/ipcmon_remove_pgid() may be called from atomic context.
+ */
+static DEFINE_STATIC_KEY_FALSE(ipcmon_active);
+static struct work_struct active_key_work;
+static DEFINE_MUTEX(active_key_lock);
 
 /* Per-CPU accounting state (initialized for CPU hotplug safety) */
 static DEFINE_PER_CPU(int, running_slot_idx) = -1;     /* -1 if none */
 static DEFINE_PER_CPU(u32, running_slot_gen) = 0;      /* expected gen */
-static DEFINE_PER_CPU(u64, running_start_cycles) = 0;
-static DEFINE_PER_CPU(u64, running_start_insts) = 0;
+static DEFINE_PER_CPU(struct pmu_sample, running_start);
+static DEFINE_PER_CPU(u32, running_switch_in);         /* switch-in not yet folded */
+static DEFINE_PER_CPU(int, running_tid_idx) = -1;      /* tid sub-slot, -1 if none */
+static DEFINE_PER_CPU(u32, running_tid_gen);
+
+/* Per-CPU co-runner state. occupant_word is written only by its own CPU and read
+ * by the SMT sibling: bits 0-15 peer code, 16-31 change count, 32-63 slot gen.
+ * running_peer_word is the sibling's word at the last arm/fold point.
+ */
+static DEFINE_PER_CPU(u64, occupant_word);
+static DEFINE_PER_CPU(int, sibling_cpu) = -1;
+static DEFINE_PER_CPU(u64, running_peer_word);
+
+struct pair_pending {
+    u16 own;
+    u16 peer;
+    u32 own_gen;
+    u32 peer_gen;
+    u32 used;
+    u64 cycles;
+    u64 insts;
+};
+
+struct pair_pending_set {
+    struct pair_pending e[PAIR_PENDING];
+    u32 folds;
+};
+static DEFINE_PER_CPU(struct pair_pending_set, pair_pending);
+static DEFINE_SPINLOCK(pair_table_lock);
+
+/* Per-core SMT occupancy. busy_mask/tracked have one bit per thread position;
+ * time is charged to hweight(busy_mask) while any thread is tracked.
+ */
+struct core_state {
+    spinlock_t lock;
+    u32 busy_mask;
+    u32 tracked;
+    u64 last_ns;
+};
+static struct core_state core_states[IPC_MAX_CORES];
+static DEFINE_PER_CPU(int, core_idx) = -1;     /* -1 if not tracked */
+static DEFINE_PER_CPU(int, core_pos);
+static DEFINE_PER_CPU(int, core_busy) = -1;    /* last state reported, -1 unknown */
+
+/* Per-CPU periodic publish timer, running only while a slot is active */
+static DEFINE_PER_CPU(struct hrtimer, publish_timer);
+static u64 publish_period_ns;
+static bool publish_armed;                  /* under publish_period_lock */
+static DEFINE_MUTEX(publish_period_lock);   /* serializes timer stop/start */
+
+static u64 ewma_halflife_ns;
+
+/* Per-CPU partial accumulators of each active slot (percpu_accum mode). NULL
+ * when the allocation failed: that slot then uses the locked path. Set and
+ * cleared under kslots[idx].lock; sched_switch reads it after the gen check.
+ */
+static struct slot_pcpu_acc __percpu *slot_acc[MAX_SLOTS];
+
+/* Periodic aggregation of per-CPU partials (and EWMA decay) into the shared snapshot */
+static struct delayed_work aggregate_work;
+static bool aggregate_stopping;
 
 /* Per-CPU PMU event handles */
 static DEFINE_PER_CPU(struct perf_event *, cpu_cycles_event);
 static DEFINE_PER_CPU(struct perf_event *, cpu_instructions_event);
 
-/* Tracepoint handle */
+/* Per-CPU extra events (IPC_IOC_SET_EVENTS). The hot path reads only the first
+ * nr_extra_events entries; reconfiguration sets it to 0 and waits for an RCU
+ * grace period before swapping the events.
+ */
+struct cpu_event_set {
+    struct perf_event *ev[IPC_MAX_EVENTS];
+};
+static DEFINE_PER_CPU(struct cpu_event_set, cpu_extra_events);
+static u32 nr_extra_events;
+static u32 event_config_gen;
+static DEFINE_MUTEX(event_config_lock);
+
+/* Tracepoint handles */
 static struct tracepoint *sched_switch_tracepoint;
 static bool sched_switch_registered;
+static struct tracepoint *sched_exit_tracepoint;
+static bool sched_exit_registered;
 
 /* ---------- helpers ---------- */
 
@@ -153,6 +442,7 @@ static inline u64 delta_u64_wrap(u64 cur, u64 prev)
 static inline void publish_snapshot_locked(int idx)
 {
     u32 s = READ_ONCE(shared_mem->slots[idx].seq);
+    int i;
 
     /* Mark writer in progress: odd */
     WRITE_ONCE(shared_mem->slots[idx].seq, s + 1);
@@ -161,14 +451,1073 @@ static inline void publish_snapshot_locked(int idx)
     WRITE_ONCE(shared_mem->slots[idx].cycles, kslots[idx].cycles);
     WRITE_ONCE(shared_mem->slots[idx].instructions, kslots[idx].instructions);
     WRITE_ONCE(shared_mem->slots[idx].pgid, kslots[idx].pgid);
+    WRITE_ONCE(shared_mem->slots[idx].key_type, kslots[idx].key_type);
+    WRITE_ONCE(shared_mem->slot_keys[idx], kslots[idx].key);
     WRITE_ONCE(shared_mem->slots[idx].global_jobid, kslots[idx].global_jobid);
     WRITE_ONCE(shared_mem->slots[idx].worker_num, kslots[idx].worker_num);
+    WRITE_ONCE(shared_mem->slots[idx].gen, kslots[idx].gen);
+    WRITE_ONCE(shared_mem->slots[idx].run_ns, kslots[idx].run_ns);
+    WRITE_ONCE(shared_mem->slots[idx].switch_ins, kslots[idx].switch_ins);
+    WRITE_ONCE(shared_mem->slots[idx].ewma_ipc, kslots[idx].ewma_ipc);
+    WRITE_ONCE(shared_mem->slots[idx].ewma_util, kslots[idx].ewma_util);
+    for (i = 0; i < IPC_MAX_EVENTS; i++)
+        WRITE_ONCE(shared_mem->slot_events[idx].counts[i], kslots[idx].events[i]);
+    WRITE_ONCE(shared_mem->slot_smt[idx].solo_cycles, kslots[idx].smt.solo_cycles);
+    WRITE_ONCE(shared_mem->slot_smt[idx].solo_instructions, kslots[idx].smt.solo_instructions);
+    WRITE_ONCE(shared_mem->slot_smt[idx].solo_ns, kslots[idx].smt.solo_ns);
+    WRITE_ONCE(shared_mem->slot_smt[idx].corun_cycles, kslots[idx].smt.corun_cycles);
+    WRITE_ONCE(shared_mem->slot_smt[idx].corun_instructions, kslots[idx].smt.corun_instructions);
+    WRITE_ONCE(shared_mem->slot_smt[idx].corun_ns, kslots[idx].smt.corun_ns);
 
     smp_wmb();  /* Ensure data writes are visible before seq completion */
     /* Publish complete: even */
     WRITE_ONCE(shared_mem->slots[idx].seq, s + 2);
 }
 
+/* 2^(-i/16) in Q16 */
+static const u32 pow2_neg_frac_q16[16] = {
+    65536, 62757, 60097, 57549, 55109, 52773, 50535, 48393,
+    46341, 44376, 42495, 40693, 38968, 37316, 35734, 34219,
+};
+
+/* Weight of the old EWMA value after @dt_ns: 2^(-dt/halflife) in Q16 */
+static u32 ewma_decay_q16(u64 dt_ns)
+{
+    u64 halflife = READ_ONCE(ewma_halflife_ns);
+    u64 q;
+
+    if (!halflife)
+        return 0;
+    q = div64_u64(dt_ns * 16, halflife);   /* exponent in 1/16 units */
+    if (q >= 16 * EWMA_SHIFT)
+        return 0;
+    return pow2_neg_frac_q16[q & 15] >> (q >> 4);
+}
+
+static inline u32 ewma_mix(u32 old, u64 sample, u32 decay)
+{
+    return (u32)((old * (u64)decay + sample * (EWMA_ONE - decay)) >> EWMA_SHIFT);
+}
+
+/* Fold the totals accumulated since the last rate sample into the EWMAs.
+ * Caller must hold kslots[idx].lock.
+ */
+static void update_rates_locked(int idx, u64 now)
+{
+    struct pgid_slot *ks = &kslots[idx];
+    u64 dt, dc, di, dr, ipc, util;
+    u32 decay;
+
+    if (!ks->rate_ts || now <= ks->rate_ts) {
+        if (!ks->rate_ts)
+            goto rebase;
+        return;
+    }
+
+    dt = now - ks->rate_ts;
+    if (dt < RATE_MIN_INTERVAL_NS)
+        return;
+
+    dc = ks->cycles - ks->rate_cycles;
+    di = ks->instructions - ks->rate_instructions;
+    dr = ks->run_ns - ks->rate_run_ns;
+    decay = ewma_decay_q16(dt);
+
+    /* IPC only has a sample when the slot actually ran */
+    if (dc) {
+        ipc = div64_u64(di << EWMA_SHIFT, dc);
+        ks->ewma_ipc = ks->ewma_ipc ? ewma_mix(ks->ewma_ipc, ipc, decay) : (u32)ipc;
+    }
+    util = div64_u64(dr << EWMA_SHIFT, dt);
+    ks->ewma_util = ewma_mix(ks->ewma_util, util, decay);
+
+rebase:
+    ks->rate_ts = now;
+    ks->rate_cycles = ks->cycles;
+    ks->rate_instructions = ks->instructions;
+    ks->rate_run_ns = ks->run_ns;
+}
+
+/* Read the local CPU's cycles/instructions and extra event counters.
+ * Must run on @cpu with IRQs disabled (sched_switch or hrtimer context).
+ */
+static bool read_cpu_counters(int cpu, struct pmu_sample *now)
+{
+    struct perf_event *ev_cycles = per_cpu(cpu_cycles_event, cpu);
+    struct perf_event *ev_inst   = per_cpu(cpu_instructions_event, cpu);
+    u32 nr = READ_ONCE(nr_extra_events);
+    u32 i;
+
+    if (!perf_event_is_valid(ev_cycles) || !perf_event_is_valid(ev_inst))
+        return false;
+
+    if (perf_event_read_local(ev_cycles, &now->cycles, NULL, NULL))
+        return false;
+    if (perf_event_read_local(ev_inst, &now->insts, NULL, NULL))
+        return false;
+    now->ns = local_clock();
+
+    /* Extra events may be multiplexed out (not ACTIVE); keep their times for scaling */
+    now->ev_gen = 0;
+    if (nr) {
+        smp_rmb();  /* Pairs with smp_wmb() in set_extra_events() */
+        for (i = 0; i < nr; i++) {
+            struct perf_event *ev = per_cpu(cpu_extra_events, cpu).ev[i];
+
+            if (!ev || perf_event_read_local(ev, &now->ev[i], &now->ev_enabled[i],
+                                             &now->ev_running[i]))
+                return true;    /* cycles/instructions are still valid */
+        }
+        now->ev_gen = READ_ONCE(event_config_gen);
+    }
+
+    return true;
+}
+
+/* Counter deltas between the arm point and @now; extra events are scaled by
+ * time_enabled/time_running of the interval to undo multiplexing.
+ */
+static void compute_delta(const struct pmu_sample *start, const struct pmu_sample *now,
+                          struct pmu_delta *d)
+{
+    int i;
+
+    d->cycles = delta_u64_wrap(now->cycles, start->cycles);
+    d->insts  = delta_u64_wrap(now->insts,  start->insts);
+    d->run_ns = now->ns > start->ns ? now->ns - start->ns : 0;
+    d->switch_ins = 0;
+
+    for (i = 0; i < IPC_MAX_EVENTS; i++)
+        d->ev[i] = 0;
+
+    if (!now->ev_gen || now->ev_gen != start->ev_gen)
+        return;
+
+    for (i = 0; i < IPC_MAX_EVENTS; i++) {
+        u64 raw = delta_u64_wrap(now->ev[i], start->ev[i]);
+        u64 enabled = now->ev_enabled[i] - start->ev_enabled[i];
+        u64 running = now->ev_running[i] - start->ev_running[i];
+
+        if (!running)
+            continue;   /* never scheduled in this interval: no information */
+        d->ev[i] = (running >= enabled) ? raw : mul_u64_u64_div_u64(raw, enabled, running);
+    }
+}
+
+/* ---------- co-runner pairs ---------- */
+
+#define OCC_CODE(w)     ((u16)((w) & 0xFFFF))
+#define OCC_GEN(w)      ((u32)((w) >> 32))
+
+/* Record what @cpu runs now; only a change bumps the change count. */
+static inline void update_occupant(int cpu, u16 code, u32 gen)
+{
+    u64 old = per_cpu(occupant_word, cpu);
+    u64 seq;
+
+    if (OCC_CODE(old) == code && OCC_GEN(old) == gen)
+        return;
+    seq = ((old >> 16) + 1) & 0xFFFF;
+    WRITE_ONCE(per_cpu(occupant_word, cpu), ((u64)gen << 32) | (seq << 16) | code);
+}
+
+static inline u64 read_sibling_occupant(int cpu)
+{
+    int sib = per_cpu(sibling_cpu, cpu);
+
+    if (sib < 0)
+        return PEER_IDLE;
+    return READ_ONCE(per_cpu(occupant_word, sib));
+}
+
+static inline bool pair_slot_stale(u16 slot, u32 gen)
+{
+    return slot < MAX_SLOTS && READ_ONCE(kslots[slot].gen) != gen;
+}
+
+/* Add one buffered pair delta to the shared table. Caller holds pair_table_lock. */
+static void pair_table_add_locked(const struct pair_pending *p)
+{
+    struct ipc_pair_table_user *pt = &shared_mem->pairs;
+    u32 h = jhash_3words(((u32)p->own << 16) | p->peer, p->own_gen, p->peer_gen, 0);
+    struct pair_entry_user *slot = NULL;
+    u32 probe, s;
+
+    for (probe = 0; probe < PAIR_MAX_PROBE; probe++) {
+        struct pair_entry_user *e = &pt->entries[(h + probe) & (PAIR_TABLE_SIZE - 1)];
+
+        if (e->own_gen == 0) {
+            /* Entries are never emptied, so the key cannot be further along */
+            if (!slot)
+                slot = e;
+            break;
+        }
+        if (e->own_slot == p->own && e->peer_slot == p->peer &&
+            e->own_gen == p->own_gen && e->peer_gen == p->peer_gen) {
+            slot = e;
+            goto add;
+        }
+        if (!slot && (pair_slot_stale(e->own_slot, e->own_gen) ||
+                      pair_slot_stale(e->peer_slot, e->peer_gen)))
+            slot = e;
+    }
+
+    if (!slot) {
+        WRITE_ONCE(pt->dropped, pt->dropped + 1);
+        return;
+    }
+
+    /* Claim an empty or dead entry for this pair */
+    s = READ_ONCE(slot->seq);
+    WRITE_ONCE(slot->seq, s + 1);
+    smp_wmb();
+    slot->own_slot = p->own;
+    slot->peer_slot = p->peer;
+    slot->own_gen = p->own_gen;
+    slot->peer_gen = p->peer_gen;
+    slot->own_jobid = READ_ONCE(kslots[p->own].global_jobid);
+    slot->peer_jobid = p->peer < MAX_SLOTS ? READ_ONCE(kslots[p->peer].global_jobid) : -1;
+    WRITE_ONCE(slot->cycles, 0);
+    WRITE_ONCE(slot->instructions, 0);
+    smp_wmb();
+    WRITE_ONCE(slot->seq, s + 2);
+
+add:
+    s = READ_ONCE(slot->seq);
+    WRITE_ONCE(slot->seq, s + 1);
+    smp_wmb();
+    WRITE_ONCE(slot->cycles, slot->cycles + p->cycles);
+    WRITE_ONCE(slot->instructions, slot->instructions + p->insts);
+    smp_wmb();
+    WRITE_ONCE(slot->seq, s + 2);
+}
+
+/* Move @cpu's buffered pair deltas into the shared table. IRQs disabled. */
+static void flush_pair_pending(int cpu)
+{
+    struct pair_pending_set *ps = &per_cpu(pair_pending, cpu);
+    int i;
+
+    ps->folds = 0;
+    for (i = 0; i < PAIR_PENDING; i++)
+        if (ps->e[i].used)
+            break;
+    if (i == PAIR_PENDING)
+        return;
+
+    spin_lock(&pair_table_lock);
+    for (i = 0; i < PAIR_PENDING; i++) {
+        if (!ps->e[i].used)
+            continue;
+        pair_table_add_locked(&ps->e[i]);
+        ps->e[i].used = 0;
+    }
+    spin_unlock(&pair_table_lock);
+}
+
+/* Charge @d to (own slot, sibling occupant over the interval) and re-base the
+ * sibling reference. Returns the peer code. Must run on @cpu with IRQs disabled.
+ */
+static u16 account_pair(int cpu, int idx, u32 gen, const struct pmu_delta *d)
+{
+    struct pair_pending_set *ps = &per_cpu(pair_pending, cpu);
+    u64 now_w = read_sibling_occupant(cpu);
+    u64 start_w = per_cpu(running_peer_word, cpu);
+    struct pair_pending *victim = NULL;
+    u16 peer = PEER_MIXED;
+    u32 peer_gen = 0;
+    int i;
+
+    per_cpu(running_peer_word, cpu) = now_w;
+
+    if (now_w == start_w) {
+        peer = OCC_CODE(now_w);
+        peer_gen = peer < MAX_SLOTS ? OCC_GEN(now_w) : 0;
+    }
+
+    for (i = 0; i < PAIR_PENDING; i++) {
+        struct pair_pending *e = &ps->e[i];
+
+        if (e->used && e->own == idx && e->peer == peer &&
+            e->own_gen == gen && e->peer_gen == peer_gen) {
+            e->cycles += d->cycles;
+            e->insts += d->insts;
+            goto out;
+        }
+        if (!e->used && !victim)
+            victim = e;
+    }
+
+    if (!victim) {
+        flush_pair_pending(cpu);
+        victim = &ps->e[0];
+    }
+    victim->own = idx;
+    victim->peer = peer;
+    victim->own_gen = gen;
+    victim->peer_gen = peer_gen;
+    victim->cycles = d->cycles;
+    victim->insts = d->insts;
+    victim->used = 1;
+
+out:
+    if (++ps->folds >= PAIR_FLUSH_FOLDS)
+        flush_pair_pending(cpu);
+    return peer;
+}
+
+/* Add @d to the solo or co-run part of @smt according to the sibling's
+ * occupant over the interval (@peer from account_pair()).
+ */
+static inline void smt_split_add(struct slot_smt_user *smt, u16 peer, const struct pmu_delta *d)
+{
+    if (peer == PEER_MIXED)
+        return;
+    if (peer == PEER_IDLE) {
+        WRITE_ONCE(smt->solo_cycles, smt->solo_cycles + d->cycles);
+        WRITE_ONCE(smt->solo_instructions, smt->solo_instructions + d->insts);
+        WRITE_ONCE(smt->solo_ns, smt->solo_ns + d->run_ns);
+    } else {
+        WRITE_ONCE(smt->corun_cycles, smt->corun_cycles + d->cycles);
+        WRITE_ONCE(smt->corun_instructions, smt->corun_instructions + d->insts);
+        WRITE_ONCE(smt->corun_ns, smt->corun_ns + d->run_ns);
+    }
+}
+
+/* ---------- flight recorder ---------- */
+
+static inline struct ipc_trace_ring *trace_ring(int cpu)
+{
+    return (struct ipc_trace_ring *)((char *)trace_mem + TRACE_RINGS_OFF +
+                                     (size_t)cpu * trace_ring_size);
+}
+
+/* Append the interval [@start, @now] of slot @idx to @cpu's ring. IRQs disabled. */
+static void trace_interval(int cpu, int idx, u32 gen, const struct pmu_sample *start,
+                           const struct pmu_sample *now, const struct pmu_delta *d, u16 peer)
+{
+    struct ipc_trace_ring *ring = trace_ring(cpu);
+    struct ipc_trace_record *r;
+    u64 head = ring->head;
+
+    /* tail is reader-written: only ever compared, never used as an index */
+    if (head - smp_load_acquire(&trace_tail_mem[cpu].tail) >= trace_records) {
+        WRITE_ONCE(ring->dropped, ring->dropped + 1);
+        return;
+    }
+
+    r = &ring->records[head & (trace_records - 1)];
+    r->start_ns = start->ns;
+    r->end_ns = now->ns;
+    r->cycles = d->cycles;
+    r->instructions = d->insts;
+    r->gen = gen;
+    r->peer_gen = peer < MAX_SLOTS ? OCC_GEN(per_cpu(running_peer_word, cpu)) : 0;
+    r->cpu = cpu;
+    r->slot = idx;
+    r->peer_slot = peer;
+    r->flags = d->switch_ins ? IPC_TRACE_SWITCH_IN : 0;
+    smp_store_release(&ring->head, head + 1);
+}
+
+/* ---------- SMT core occupancy ---------- */
+
+/* Charge the time since the last change to the core's current busy count.
+ * Caller holds core_states[c].lock.
+ */
+static void core_charge_locked(int c, u64 now)
+{
+    struct core_state *cs = &core_states[c];
+    struct core_smt_user *cu = &shared_mem->cores.entries[c];
+    u32 n, s;
+
+    if (cs->tracked && now > cs->last_ns) {
+        n = hweight32(cs->busy_mask);
+        s = READ_ONCE(cu->seq);
+        WRITE_ONCE(cu->seq, s + 1);
+        smp_wmb();
+        WRITE_ONCE(cu->busy_ns[n], cu->busy_ns[n] + (now - cs->last_ns));
+        smp_wmb();
+        WRITE_ONCE(cu->seq, s + 2);
+    }
+    cs->last_ns = now;
+}
+
+/* Record that @cpu now runs a task (1), idles (0) or is no longer tracked (-1).
+ * IRQs disabled; the core lock is only taken when the state changes.
+ */
+static void core_set_state(int cpu, int busy)
+{
+    int c = per_cpu(core_idx, cpu);
+    struct core_state *cs;
+    u32 bit;
+
+    if (c < 0 || per_cpu(core_busy, cpu) == busy)
+        return;
+    per_cpu(core_busy, cpu) = busy;
+
+    cs = &core_states[c];
+    bit = 1U << per_cpu(core_pos, cpu);
+    spin_lock(&cs->lock);
+    core_charge_locked(c, local_clock());
+    if (busy > 0)
+        cs->busy_mask |= bit;
+    else
+        cs->busy_mask &= ~bit;
+    if (busy >= 0)
+        cs->tracked |= bit;
+    else
+        cs->tracked &= ~bit;
+    spin_unlock(&cs->lock);
+}
+
+/* Publish timer: bring @cpu's core up to date, learning @cpu's state if unknown
+ * (a thread that has not switched since the hook was enabled).
+ */
+static void core_tick(int cpu)
+{
+    int c = per_cpu(core_idx, cpu);
+
+    if (c < 0)
+        return;
+    if (per_cpu(core_busy, cpu) < 0) {
+        core_set_state(cpu, !is_idle_task(current));
+        return;
+    }
+    spin_lock(&core_states[c].lock);
+    core_charge_locked(c, local_clock());
+    spin_unlock(&core_states[c].lock);
+}
+
+/* ---------- per-tid sub-slots ---------- */
+
+/* Add @d to a tid sub-slot. A thread runs on one CPU at a time, so sub-slots
+ * have a single writer and need no lock; gen rejects updates after reclaim.
+ */
+static void account_tid(int t, u32 gen, const struct pmu_delta *d)
+{
+    struct tid_slot_user *ts = &shared_mem->tids.entries[t];
+    u32 s;
+
+    if (READ_ONCE(tid_gen[t]) != gen)
+        return;
+
+    s = READ_ONCE(ts->seq);
+    WRITE_ONCE(ts->seq, s + 1);
+    smp_wmb();
+    WRITE_ONCE(ts->cycles, ts->cycles + d->cycles);
+    WRITE_ONCE(ts->instructions, ts->instructions + d->insts);
+    WRITE_ONCE(ts->run_ns, ts->run_ns + d->run_ns);
+    WRITE_ONCE(ts->switch_ins, ts->switch_ins + d->switch_ins);
+    smp_wmb();
+    WRITE_ONCE(ts->seq, s + 2);
+}
+
+static void tid_node_free_rcu(struct rcu_head *head)
+{
+    struct tid_map *tm = container_of(head, struct tid_map, rcu);
+    unsigned long flags;
+
+    spin_lock_irqsave(&tid_lock, flags);
+    tid_free[tid_free_count++] = tm - tid_nodes;
+    spin_unlock_irqrestore(&tid_lock, flags);
+}
+
+/* Unhash sub-slot @t, invalidate it and free it after a grace period.
+ * Caller must hold tid_lock.
+ */
+static void tid_reclaim_locked(int t)
+{
+    struct tid_slot_user *ts = &shared_mem->tids.entries[t];
+    u32 s;
+
+    hash_del_rcu(&tid_nodes[t].hnode);
+    WRITE_ONCE(tid_gen[t], tid_gen[t] + 1);
+
+    s = READ_ONCE(ts->seq);
+    WRITE_ONCE(ts->seq, s + 1);
+    smp_wmb();
+    WRITE_ONCE(ts->tid, 0);
+    WRITE_ONCE(ts->gen, tid_gen[t]);
+    smp_wmb();
+    WRITE_ONCE(ts->seq, s + 2);
+
+    shared_mem->tids.nr_used--;
+    atomic_dec(&nr_tids);
+    call_rcu(&tid_nodes[t].rcu, tid_node_free_rcu);
+}
+
+/* Find or create the sub-slot of @tid under PGID slot @slot_idx/@slot_gen.
+ * Called from sched_switch; returns -1 when the pool is exhausted.
+ */
+static int tid_get(pid_t tid, pid_t pgid, int slot_idx, u32 slot_gen, u32 *gen_out)
+{
+    struct tid_slot_user *ts;
+    struct tid_map *tm;
+    unsigned long flags;
+    int t = -1;
+    u32 s;
+
+    rcu_read_lock();
+    hash_for_each_possible_rcu(tid_hash, tm, hnode, tid) {
+        if (tm->tid == tid && tm->parent_slot == slot_idx && tm->parent_gen == slot_gen) {
+            t = tm - tid_nodes;
+            *gen_out = READ_ONCE(tid_gen[t]);
+            break;
+        }
+    }
+    rcu_read_unlock();
+    if (t >= 0)
+        return t;
+
+    spin_lock_irqsave(&tid_lock, flags);
+
+    /* Drop a stale entry of this tid (setpgid, or its PGID slot was reused) */
+    hash_for_each_possible(tid_hash, tm, hnode, tid) {
+        if (tm->tid == tid) {
+            tid_reclaim_locked(tm - tid_nodes);
+            break;
+        }
+    }
+
+    if (!tid_free_count) {
+        WRITE_ONCE(shared_mem->tids.dropped, shared_mem->tids.dropped + 1);
+        spin_unlock_irqrestore(&tid_lock, flags);
+        return -1;
+    }
+
+    t = tid_free[--tid_free_count];
+    tm = &tid_nodes[t];
+    tm->tid = tid;
+    tm->parent_slot = slot_idx;
+    tm->parent_gen = slot_gen;
+    WRITE_ONCE(tid_gen[t], tid_gen[t] + 1);
+    *gen_out = tid_gen[t];
+
+    ts = &shared_mem->tids.entries[t];
+    s = READ_ONCE(ts->seq);
+    WRITE_ONCE(ts->seq, s + 1);
+    smp_wmb();
+    ts->tid = tid;
+    ts->pgid = pgid;
+    ts->parent_slot = slot_idx;
+    ts->parent_gen = slot_gen;
+    ts->gen = tid_gen[t];
+    ts->cycles = 0;
+    ts->instructions = 0;
+    ts->run_ns = 0;
+    ts->switch_ins = 0;
+    smp_wmb();
+    WRITE_ONCE(ts->seq, s + 2);
+
+    hash_add_rcu(tid_hash, &tm->hnode, tid);
+    shared_mem->tids.nr_used++;
+    atomic_inc(&nr_tids);
+
+    spin_unlock_irqrestore(&tid_lock, flags);
+    return t;
+}
+
+/* Reclaim every sub-slot of PGID slot @slot_idx/@slot_gen (removal or tid mode off). */
+static void tid_reclaim_slot(int slot_idx, u32 slot_gen)
+{
+    struct tid_map *tm;
+    struct hlist_node *tmp;
+    unsigned long flags;
+    int bkt;
+
+    if (!atomic_read(&nr_tids))
+        return;
+
+    spin_lock_irqsave(&tid_lock, flags);
+    hash_for_each_safe(tid_hash, bkt, tmp, tm, hnode) {
+        if (tm->parent_slot == slot_idx && tm->parent_gen == slot_gen)
+            tid_reclaim_locked(tm - tid_nodes);
+    }
+    spin_unlock_irqrestore(&tid_lock, flags);
+}
+
+static void tracepoint_sched_exit_handler(void *data, struct task_struct *p)
+{
+    struct tid_map *tm;
+    unsigned long flags;
+
+    if (!atomic_read(&nr_tids))
+        return;
+
+    spin_lock_irqsave(&tid_lock, flags);
+    hash_for_each_possible(tid_hash, tm, hnode, p->pid) {
+        if (tm->tid == p->pid) {
+            tid_reclaim_locked(tm - tid_nodes);
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&tid_lock, flags);
+}
+
+/* Fold the delta since the last arm/fold point into the slot armed on @cpu.
+ * Must run on @cpu with IRQs disabled.
+ */
+static void fold_running_delta(int cpu, const struct pmu_sample *now)
+{
+    int idx = per_cpu(running_slot_idx, cpu);
+    u32 expected_gen = per_cpu(running_slot_gen, cpu);
+    struct slot_pcpu_acc __percpu *pacc;
+    struct pmu_delta d;
+    unsigned long flags;
+    u16 peer;
+    int i;
+
+    if (idx < 0)
+        return;
+
+    compute_delta(&per_cpu(running_start, cpu), now, &d);
+    d.switch_ins = per_cpu(running_switch_in, cpu);
+    per_cpu(running_switch_in, cpu) = 0;
+    peer = account_pair(cpu, idx, expected_gen, &d);
+    if (trace_mem)
+        trace_interval(cpu, idx, expected_gen, &per_cpu(running_start, cpu), now, &d, peer);
+    if (per_cpu(running_tid_idx, cpu) >= 0)
+        account_tid(per_cpu(running_tid_idx, cpu), per_cpu(running_tid_gen, cpu), &d);
+
+    /* Freed only after a grace period, and we run with IRQs disabled */
+    pacc = percpu_accum ? READ_ONCE(slot_acc[idx]) : NULL;
+    if (pacc) {
+        struct slot_pcpu_acc *acc = per_cpu_ptr(pacc, cpu);
+
+        /* Reject stale updates after slot reuse (lock-free; recheck in aggregation) */
+        if (READ_ONCE(kslots[idx].gen) != expected_gen)
+            return;
+
+        /* First touch of this slot incarnation on this CPU: zero before tagging */
+        if (acc->gen != expected_gen) {
+            WRITE_ONCE(acc->cycles, 0);
+            WRITE_ONCE(acc->instructions, 0);
+            for (i = 0; i < IPC_MAX_EVENTS; i++)
+                WRITE_ONCE(acc->events[i], 0);
+            WRITE_ONCE(acc->run_ns, 0);
+            WRITE_ONCE(acc->switch_ins, 0);
+            memset(&acc->smt, 0, sizeof(acc->smt));
+            smp_wmb();  /* Ensure zeroing is visible before the new gen */
+            WRITE_ONCE(acc->gen, expected_gen);
+        }
+
+        WRITE_ONCE(acc->cycles, acc->cycles + d.cycles);
+        WRITE_ONCE(acc->instructions, acc->instructions + d.insts);
+        for (i = 0; i < IPC_MAX_EVENTS; i++)
+            WRITE_ONCE(acc->events[i], acc->events[i] + d.ev[i]);
+        WRITE_ONCE(acc->run_ns, acc->run_ns + d.run_ns);
+        WRITE_ONCE(acc->switch_ins, acc->switch_ins + d.switch_ins);
+        smt_split_add(&acc->smt, peer, &d);
+        return;
+    }
+
+    spin_lock_irqsave(&kslots[idx].lock, flags);
+
+    /* Reject stale updates after slot reuse */
+    if (kslots[idx].gen == expected_gen) {
+        kslots[idx].cycles += d.cycles;
+        kslots[idx].instructions += d.insts;
+        for (i = 0; i < IPC_MAX_EVENTS; i++)
+            kslots[idx].events[i] += d.ev[i];
+        kslots[idx].run_ns += d.run_ns;
+        kslots[idx].switch_ins += d.switch_ins;
+        smt_split_add(&kslots[idx].smt, peer, &d);
+        update_rates_locked(idx, ktime_get_ns());
+        publish_snapshot_locked(idx);
+    }
+
+    spin_unlock_irqrestore(&kslots[idx].lock, flags);
+}
+
+/* Sum the per-CPU partials of slot @idx and publish them.
+ * Caller must hold kslots[idx].lock.
+ */
+static void aggregate_slot_locked(int idx)
+{
+    struct slot_pcpu_acc __percpu *pacc = slot_acc[idx];
+    u32 gen = kslots[idx].gen;
+    u64 sum_cycles = 0, sum_insts = 0, sum_run_ns = 0, sum_switch_ins = 0;
+    u64 sum_events[IPC_MAX_EVENTS] = { 0 };
+    struct slot_smt_user sum_smt = { 0 };
+    struct slot_smt_user *smt = &kslots[idx].smt;
+    int cpu, i;
+
+    if (kslots[idx].key_type == IPC_KEY_NONE)
+        return;
+
+    /* No partials (allocation failed): the slot is kept current under its lock */
+    if (!pacc) {
+        update_rates_locked(idx, ktime_get_ns());
+        publish_snapshot_locked(idx);
+        return;
+    }
+
+    /* Possible, not online: partials of an offlined CPU still count */
+    for_each_possible_cpu(cpu) {
+        struct slot_pcpu_acc *acc = per_cpu_ptr(pacc, cpu);
+
+        if (READ_ONCE(acc->gen) != gen)
+            continue;
+        smp_rmb();  /* Pairs with smp_wmb() in fold_running_delta() */
+        sum_cycles += READ_ONCE(acc->cycles);
+        sum_insts  += READ_ONCE(acc->instructions);
+        for (i = 0; i < IPC_MAX_EVENTS; i++)
+            sum_events[i] += READ_ONCE(acc->events[i]);
+        sum_run_ns += READ_ONCE(acc->run_ns);
+        sum_switch_ins += READ_ONCE(acc->switch_ins);
+        sum_smt.solo_cycles += READ_ONCE(acc->smt.solo_cycles);
+        sum_smt.solo_instructions += READ_ONCE(acc->smt.solo_instructions);
+        sum_smt.solo_ns += READ_ONCE(acc->smt.solo_ns);
+        sum_smt.corun_cycles += READ_ONCE(acc->smt.corun_cycles);
+        sum_smt.corun_instructions += READ_ONCE(acc->smt.corun_instructions);
+        sum_smt.corun_ns += READ_ONCE(acc->smt.corun_ns);
+    }
+
+    /* Never publish a smaller total */
+    if (sum_cycles > kslots[idx].cycles)
+        kslots[idx].cycles = sum_cycles;
+    if (sum_insts > kslots[idx].instructions)
+        kslots[idx].instructions = sum_insts;
+    if (sum_run_ns > kslots[idx].run_ns)
+        kslots[idx].run_ns = sum_run_ns;
+    if (sum_switch_ins > kslots[idx].switch_ins)
+        kslots[idx].switch_ins = sum_switch_ins;
+    smt->solo_cycles = max(smt->solo_cycles, sum_smt.solo_cycles);
+    smt->solo_instructions = max(smt->solo_instructions, sum_smt.solo_instructions);
+    smt->solo_ns = max(smt->solo_ns, sum_smt.solo_ns);
+    smt->corun_cycles = max(smt->corun_cycles, sum_smt.corun_cycles);
+    smt->corun_instructions = max(smt->corun_instructions, sum_smt.corun_instructions);
+    smt->corun_ns = max(smt->corun_ns, sum_smt.corun_ns);
+    for (i = 0; i < IPC_MAX_EVENTS; i++) {
+        if (sum_events[i] >= kslots[idx].base_events[i])
+            kslots[idx].events[i] = max(kslots[idx].events[i],
+                                        sum_events[i] - kslots[idx].base_events[i]);
+    }
+    update_rates_locked(idx, ktime_get_ns());
+    publish_snapshot_locked(idx);
+}
+
+/* Publish every active slot: sum per-CPU partials, or (locked mode) just let
+ * the EWMAs of slots that stopped running decay.
+ */
+static void aggregate_active_slots(void)
+{
+    int i;
+
+    for_each_set_bit(i, active_mask, MAX_SLOTS) {
+        unsigned long flags;
+
+        spin_lock_irqsave(&kslots[i].lock, flags);
+        if (percpu_accum) {
+            aggregate_slot_locked(i);
+        } else if (kslots[i].key_type != IPC_KEY_NONE) {
+            update_rates_locked(i, ktime_get_ns());
+            publish_snapshot_locked(i);
+        }
+        spin_unlock_irqrestore(&kslots[i].lock, flags);
+    }
+}
+
+static void aggregate_work_fn(struct work_struct *work)
+{
+    u64 period = READ_ONCE(publish_period_ns);
+
+    aggregate_active_slots();
+
+    if (period && !READ_ONCE(aggregate_stopping))
+        queue_delayed_work(system_unbound_wq, &aggregate_work,
+                           max_t(unsigned long, 1, nsecs_to_jiffies(period)));
+}
+
+/* ---------- periodic publish timer ---------- */
+
+static enum hrtimer_restart publish_timer_fn(struct hrtimer *timer)
+{
+    int cpu = smp_processor_id();
+    u64 period = READ_ONCE(publish_period_ns);
+    struct pmu_sample now;
+
+    if (!period)
+        return HRTIMER_NORESTART;
+
+    if (static_branch_unlikely(&ipcmon_active))
+        core_tick(cpu);
+
+    /* Fold the running delta and re-base the arm point; nothing to do when idle */
+    if (per_cpu(running_slot_idx, cpu) >= 0 && read_cpu_counters(cpu, &now)) {
+        fold_running_delta(cpu, &now);
+        per_cpu(running_start, cpu) = now;
+    }
+
+    hrtimer_forward_now(timer, ns_to_ktime(period));
+    return HRTIMER_RESTART;
+}
+
+/* Runs on each CPU via on_each_cpu() so the timer is pinned to its own CPU. */
+static void start_publish_timer_on_cpu(void *info)
+{
+    u64 period = READ_ONCE(publish_period_ns);
+
+    if (period)
+        hrtimer_start(this_cpu_ptr(&publish_timer), ns_to_ktime(period),
+                      HRTIMER_MODE_REL_PINNED);
+}
+
+static void stop_publish_timers(void)
+{
+    int cpu;
+
+    for_each_online_cpu(cpu)
+        hrtimer_cancel(&per_cpu(publish_timer, cpu));
+}
+
+static void stop_aggregation(void)
+{
+    WRITE_ONCE(aggregate_stopping, true);
+    cancel_delayed_work_sync(&aggregate_work);
+}
+
+/* Slots still holding partials at unload; callers wait for a grace period first */
+static void free_pcpu_accumulators(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_SLOTS; i++) {
+        free_percpu(slot_acc[i]);
+        slot_acc[i] = NULL;
+    }
+}
+
+/* Start the timers and the aggregation worker if a slot is active and a period
+ * is set. Caller must hold publish_period_lock.
+ */
+static void start_publishing_locked(void)
+{
+    if (!publish_armed || !READ_ONCE(publish_period_ns))
+        return;
+    on_each_cpu(start_publish_timer_on_cpu, NULL, 1);
+    if (!READ_ONCE(aggregate_stopping))
+        mod_delayed_work(system_unbound_wq, &aggregate_work, 0);
+}
+
+static void set_publish_period(unsigned int period_us)
+{
+    mutex_lock(&publish_period_lock);
+    WRITE_ONCE(publish_period_ns, 0);
+    stop_publish_timers();
+    WRITE_ONCE(publish_period_ns, (u64)period_us * NSEC_PER_USEC);
+    start_publishing_locked();
+    mutex_unlock(&publish_period_lock);
+}
+
+/* Run the periodic machinery only while some slot is active: with none, the
+ * timers would only wake idle CPUs and the worker would scan an empty bitmap.
+ */
+static void set_publish_armed(bool armed)
+{
+    mutex_lock(&publish_period_lock);
+    if (armed != publish_armed) {
+        publish_armed = armed;
+        if (armed) {
+            start_publishing_locked();
+        } else {
+            stop_publish_timers();
+            cancel_delayed_work_sync(&aggregate_work);
+        }
+    }
+    mutex_unlock(&publish_period_lock);
+}
+
+/* ---------- extra event configuration ---------- */
+
+static void release_extra_events(void)
+{
+    int cpu, i;
+
+    for_each_online_cpu(cpu) {
+        for (i = 0; i < IPC_MAX_EVENTS; i++) {
+            struct perf_event *ev = per_cpu(cpu_extra_events, cpu).ev[i];
+
+            if (!ev)
+                continue;
+            perf_event_disable(ev);
+            perf_event_release_kernel(ev);
+            per_cpu(cpu_extra_events, cpu).ev[i] = NULL;
+        }
+    }
+}
+
+/* Restart every active slot's event totals (their meaning changes with the set).
+ * No event deltas are produced while nr_extra_events == 0.
+ */
+static void rebase_event_totals(void)
+{
+    int i, e;
+
+    for_each_set_bit(i, active_mask, MAX_SLOTS) {
+        unsigned long flags;
+
+        spin_lock_irqsave(&kslots[i].lock, flags);
+        if (percpu_accum)
+            aggregate_slot_locked(i);
+        for (e = 0; e < IPC_MAX_EVENTS; e++) {
+            kslots[i].base_events[e] += kslots[i].events[e];
+            kslots[i].events[e] = 0;
+        }
+        publish_snapshot_locked(i);
+        spin_unlock_irqrestore(&kslots[i].lock, flags);
+    }
+}
+
+static void publish_event_set(const struct ipc_event_config *cfg, u32 nr)
+{
+    struct ipc_event_set_user *es = &shared_mem->event_set;
+    u32 s = READ_ONCE(es->seq);
+
+    WRITE_ONCE(es->seq, s + 1);
+    smp_wmb();
+    es->nr_events = nr;
+    es->config_gen = event_config_gen;
+    memset(es->events, 0, sizeof(es->events));
+    memcpy(es->events, cfg->events, nr * sizeof(struct ipc_event_spec));
+    smp_wmb();
+    WRITE_ONCE(es->seq, s + 2);
+}
+
+/* Replace the per-CPU extra event set. Process context only. */
+static int set_extra_events(const struct ipc_event_config *cfg)
+{
+    struct perf_event_attr attr;
+    int cpu, ret = 0;
+    u32 i;
+
+    mutex_lock(&event_config_lock);
+
+    /* Stop the hot path from touching the old events, then wait it out */
+    WRITE_ONCE(nr_extra_events, 0);
+    synchronize_rcu();
+    release_extra_events();
+    rebase_event_totals();
+
+    for_each_online_cpu(cpu) {
+        for (i = 0; i < cfg->nr_events; i++) {
+            struct perf_event *ev;
+
+            memset(&attr, 0, sizeof(attr));
+            attr.type = cfg->events[i].type;
+            attr.config = cfg->events[i].config;
+            attr.config1 = cfg->events[i].config1;
+            attr.size = sizeof(attr);
+            attr.disabled = 1;
+
+            ev = perf_event_create_kernel_counter(&attr, cpu, NULL, NULL, NULL);
+            if (IS_ERR(ev)) {
+                pr_err("IPC_monitor: Failed to create event %u (type=%u config=%#llx) on CPU %d (err=%ld)\n",
+                       i, attr.type, attr.config, cpu, PTR_ERR(ev));
+                ret = PTR_ERR(ev);
+                release_extra_events();
+                goto publish;
+            }
+            per_cpu(cpu_extra_events, cpu).ev[i] = ev;
+            perf_event_enable(ev);
+        }
+    }
+
+publish:
+    if (++event_config_gen == 0)
+        event_config_gen = 1;   /* 0 means "no events" in pmu_sample */
+    publish_event_set(cfg, ret ? 0 : cfg->nr_events);
+
+    if (!ret && cfg->nr_events) {
+        smp_wmb();  /* Event pointers and gen before the count (read_cpu_counters) */
+        WRITE_ONCE(nr_extra_events, cfg->nr_events);
+    }
+
+    mutex_unlock(&event_config_lock);
+    return ret;
+}
+
+/* ---------- PGID prefilter / active key ---------- */
+
+static inline u32 pgid_filter_bit(pid_t pgid)
+{
+    return hash_32((u32)pgid, PGID_FILTER_BITS);
+}
+
+/* Caller must hold pgid_hash_lock. */
+static void pgid_filter_get(pid_t pgid)
+{
+    u32 bit = pgid_filter_bit(pgid);
+
+    if (pgid_filter_ref[bit]++ == 0)
+        set_bit(bit, pgid_filter);
+}
+
+/* Caller must hold pgid_hash_lock. */
+static void pgid_filter_put(pid_t pgid)
+{
+    u32 bit = pgid_filter_bit(pgid);
+
+    if (pgid_filter_ref[bit] && --pgid_filter_ref[bit] == 0)
+        clear_bit(bit, pgid_filter);
+}
+
+static inline u32 cgroup_filter_bit(u64 cgid)
+{
+    return hash_64(cgid, PGID_FILTER_BITS);
+}
+
+/* Caller must hold pgid_hash_lock. */
+static void cgroup_filter_get(u64 cgid)
+{
+    u32 bit = cgroup_filter_bit(cgid);
+
+    if (cgroup_filter_ref[bit]++ == 0)
+        set_bit(bit, cgroup_filter);
+    WRITE_ONCE(nr_cgroup_keys, nr_cgroup_keys + 1);
+}
+
+/* Caller must hold pgid_hash_lock. */
+static void cgroup_filter_put(u64 cgid)
+{
+    u32 bit = cgroup_filter_bit(cgid);
+
+    if (cgroup_filter_ref[bit] && --cgroup_filter_ref[bit] == 0)
+        clear_bit(bit, cgroup_filter);
+    WRITE_ONCE(nr_cgroup_keys, nr_cgroup_keys - 1);
+}
+
+static void disarm_cpu(void *info)
+{
+    int cpu = smp_processor_id();
+
+    per_cpu(running_slot_idx, cpu) = -1;
+    per_cpu(running_slot_gen, cpu) = 0;
+    per_cpu(running_tid_idx, cpu) = -1;
+    flush_pair_pending(cpu);
+    update_occupant(cpu, PEER_OTHER, 0);
+    core_set_state(cpu, -1);
+}
+
+/* Sync the static key with the number of active slots. */
+static void active_key_work_fn(struct work_struct *work)
+{
+    bool want = atomic_read(&nr_active) > 0;
+
+    mutex_lock(&active_key_lock);
+    if (want && !static_key_enabled(&ipcmon_active)) {
+        static_branch_enable(&ipcmon_active);
+        set_publish_armed(true);
+    } else if (!want && static_key_enabled(&ipcmon_active)) {
+        static_branch_disable(&ipcmon_active);
+        set_publish_armed(false);
+        /* The hook no longer runs, so drop any CPU still armed for a removed slot */
+        on_each_cpu(disarm_cpu, NULL, 1);
+    }
+    mutex_unlock(&active_key_lock);
+}
+
 /* ---------- slot allocator ---------- */
 
 static int alloc_slot(void)
@@ -207,24 +1556,190 @@ static void push_free_idx(int idx)
 /* Clear kernel slot contents under lock; keep gen as-is (or bump separately). */
 static inline void clear_kslot_locked(int idx)
 {
+    kslots[idx].key_type = IPC_KEY_NONE;
+    kslots[idx].key = 0;
     kslots[idx].pgid = 0;
     kslots[idx].global_jobid = 0;
     kslots[idx].worker_num = 0;
-    kslots[idx].reset_flag = 0;
     kslots[idx].cycles = 0;
     kslots[idx].instructions = 0;
+    kslots[idx].run_ns = 0;
+    kslots[idx].switch_ins = 0;
+    kslots[idx].ewma_ipc = 0;
+    kslots[idx].ewma_util = 0;
+    kslots[idx].rate_ts = 0;
+    memset(kslots[idx].events, 0, sizeof(kslots[idx].events));
+    memset(kslots[idx].base_events, 0, sizeof(kslots[idx].base_events));
+    memset(&kslots[idx].smt, 0, sizeof(kslots[idx].smt));
 }
 
-/* ---------- exported API ---------- */
+/* ---------- active list ---------- */
 
-int ipcmon_add_pgid(pid_t pgid, int global_jobid, int worker_num)
+static void active_list_bump_begin(u32 *s)
+{
+    *s = READ_ONCE(shared_mem->active.seq);
+    WRITE_ONCE(shared_mem->active.seq, *s + 1);
+    smp_wmb();
+}
+
+/* Caller must hold pgid_hash_lock. Safe from atomic context. */
+static void epoch_bump_locked(void)
+{
+    WRITE_ONCE(shared_mem->hdr.epoch, shared_mem->hdr.epoch + 1);
+    wake_up_interruptible_all(&epoch_wq);
+}
+
+static void active_list_bump_end(u32 s)
+{
+    epoch_bump_locked();
+    smp_wmb();
+    WRITE_ONCE(shared_mem->active.seq, s + 2);
+}
+
+/* Caller must hold pgid_hash_lock. */
+static void active_list_add_locked(int idx)
+{
+    struct ipc_active_list *al = &shared_mem->active;
+    u32 pos = active_count;
+    u32 s;
+
+    active_idx[pos] = idx;
+    active_pos[idx] = pos;
+    active_count = pos + 1;
+
+    active_list_bump_begin(&s);
+    WRITE_ONCE(al->idx[pos], idx);
+    WRITE_ONCE(al->nr_active, active_count);
+    active_list_bump_end(s);
+
+    set_bit(idx, active_mask);
+}
+
+/* Caller must hold pgid_hash_lock. Moves the last entry into the hole. */
+static void active_list_remove_locked(int idx)
+{
+    struct ipc_active_list *al = &shared_mem->active;
+    u32 last = active_count - 1;
+    int pos = active_pos[idx];
+    int moved = active_idx[last];
+    u32 s;
+
+    clear_bit(idx, active_mask);
+
+    active_idx[pos] = moved;
+    active_pos[moved] = pos;
+    active_idx[last] = -1;
+    active_pos[idx] = -1;
+    active_count = last;
+
+    active_list_bump_begin(&s);
+    WRITE_ONCE(al->idx[pos], moved);
+    WRITE_ONCE(al->idx[last], -1);
+    WRITE_ONCE(al->nr_active, last);
+    active_list_bump_end(s);
+}
+
+/* ---------- key maps ---------- */
+
+static const char *key_name(u32 key_type)
+{
+    return key_type == IPC_KEY_CGROUP ? "cgroup" : "pgid";
+}
+
+/* Caller must hold pgid_hash_lock. */
+static struct pgid_map *find_map_locked(u32 key_type, u64 key)
+{
+    struct pgid_map *map;
+
+    if (key_type == IPC_KEY_CGROUP) {
+        hash_for_each_possible(cgroup_hash, map, hnode, key) {
+            if (map->cgid == key)
+                return map;
+        }
+    } else {
+        hash_for_each_possible(pgid_hash, map, hnode, (pid_t)key) {
+            if (map->pgid == (pid_t)key)
+                return map;
+        }
+    }
+    return NULL;
+}
+
+/* Caller must hold pgid_hash_lock. */
+static void map_link_locked(struct pgid_map *map)
+{
+    if (map->key_type == IPC_KEY_CGROUP) {
+        hash_add_rcu(cgroup_hash, &map->hnode, map->cgid);
+        cgroup_filter_get(map->cgid);
+    } else {
+        hash_add_rcu(pgid_hash, &map->hnode, map->pgid);
+        pgid_filter_get(map->pgid);
+    }
+}
+
+/* Caller must hold pgid_hash_lock. */
+static void map_unlink_locked(struct pgid_map *map)
+{
+    hash_del_rcu(&map->hnode);
+    if (map->key_type == IPC_KEY_CGROUP)
+        cgroup_filter_put(map->cgid);
+    else
+        pgid_filter_put(map->pgid);
+}
+
+#ifdef CONFIG_CGROUPS
+/* Find the slot of the closest registered cgroup of @p (its default-hierarchy
+ * cgroup or an ancestor). Called from sched_switch.
+ */
+static int lookup_cgroup_slot(struct task_struct *p, u32 *gen, bool *tid_mode_out)
+{
+    struct cgroup *cgrp;
+    struct pgid_map *map;
+    int idx = -1;
+
+    rcu_read_lock();
+    for (cgrp = task_dfl_cgroup(p); cgrp; cgrp = cgroup_parent(cgrp)) {
+        u64 cgid = cgroup_id(cgrp);
+
+        if (!test_bit(cgroup_filter_bit(cgid), cgroup_filter))
+            continue;
+        hash_for_each_possible_rcu(cgroup_hash, map, hnode, cgid) {
+            if (map->cgid == cgid) {
+                idx = map->slot_idx;
+                *gen = map->gen;
+                *tid_mode_out = READ_ONCE(map->tid_mode);
+                goto out;
+            }
+        }
+    }
+out:
+    rcu_read_unlock();
+    return idx;
+}
+#else
+static int lookup_cgroup_slot(struct task_struct *p, u32 *gen, bool *tid_mode_out)
+{
+    return -1;
+}
+#endif
+
+static void pgid_map_free_rcu(struct rcu_head *rcu)
+{
+    struct pgid_map *map = container_of(rcu, struct pgid_map, rcu);
+
+    free_percpu(map->acc);
+    kfree(map);
+}
+
+static int add_slot_key(u32 key_type, u64 key, int global_jobid, int worker_num)
 {
+    struct slot_pcpu_acc __percpu *acc = NULL;
     struct pgid_map *map;
     int slot_idx;
     unsigned long flags;
 
-    pr_info("IPC_monitor: Adding pgid=%d, global_jobid=%d, worker_num=%d\n",
-            pgid, global_jobid, worker_num);
+    pr_info("IPC_monitor: Adding %s=%llu, global_jobid=%d, worker_num=%d\n",
+            key_name(key_type), key, global_jobid, worker_num);
 
     slot_idx = alloc_slot();
     if (slot_idx < 0)
@@ -232,108 +1747,192 @@ int ipcmon_add_pgid(pid_t pgid, int global_jobid, int worker_num)
 
     map = kmalloc(sizeof(*map), GFP_KERNEL);
     if (!map) {
-        pr_info("IPC_monitor: Failed to allocate pgid_map for pgid=%d\n", pgid);
+        pr_info("IPC_monitor: Failed to allocate pgid_map for %s=%llu\n",
+                key_name(key_type), key);
         push_free_idx(slot_idx);
         return -ENOMEM;
     }
+    map->acc = NULL;
+
+    if (percpu_accum) {
+        acc = alloc_percpu(struct slot_pcpu_acc);
+        if (!acc)
+            pr_warn("IPC_monitor: no per-CPU accumulators for %s=%llu, using the locked path\n",
+                    key_name(key_type), key);
+    }
 
     /* Initialize kernel slot */
     spin_lock_irqsave(&kslots[slot_idx].lock, flags);
     kslots[slot_idx].gen++;
     map->gen = kslots[slot_idx].gen;
+    WRITE_ONCE(slot_acc[slot_idx], acc);
 
-    kslots[slot_idx].pgid = pgid;
+    kslots[slot_idx].key_type = key_type;
+    kslots[slot_idx].key = key;
+    kslots[slot_idx].pgid = key_type == IPC_KEY_PGID ? (pid_t)key : 0;
     kslots[slot_idx].global_jobid = global_jobid;
     kslots[slot_idx].worker_num = worker_num;
-    kslots[slot_idx].reset_flag = 0;
     kslots[slot_idx].cycles = 0;
     kslots[slot_idx].instructions = 0;
+    kslots[slot_idx].run_ns = 0;
+    kslots[slot_idx].switch_ins = 0;
+    kslots[slot_idx].ewma_ipc = 0;
+    kslots[slot_idx].ewma_util = 0;
+    kslots[slot_idx].rate_ts = 0;
+    memset(kslots[slot_idx].events, 0, sizeof(kslots[slot_idx].events));
+    memset(kslots[slot_idx].base_events, 0, sizeof(kslots[slot_idx].base_events));
+    memset(&kslots[slot_idx].smt, 0, sizeof(kslots[slot_idx].smt));
 
     /* Publish initial snapshot (0,0) */
     publish_snapshot_locked(slot_idx);
     spin_unlock_irqrestore(&kslots[slot_idx].lock, flags);
 
-    map->pgid = pgid;
+    map->pgid = key_type == IPC_KEY_PGID ? (pid_t)key : 0;
+    map->cgid = key_type == IPC_KEY_CGROUP ? key : 0;
+    map->key_type = key_type;
     map->slot_idx = slot_idx;
+    map->tid_mode = tid_mode;
 
     /* Publish map under hash lock with duplicate re-check */
     spin_lock(&pgid_hash_lock);
-    {
-        struct pgid_map *it;
-        hash_for_each_possible(pgid_hash, it, hnode, pgid) {
-            if (it->pgid == pgid) {
-                spin_unlock(&pgid_hash_lock);
-
-                /* Roll back slot */
-                spin_lock_irqsave(&kslots[slot_idx].lock, flags);
-                kslots[slot_idx].gen++;           /* invalidate */
-                clear_kslot_locked(slot_idx);
-                publish_snapshot_locked(slot_idx);
-                spin_unlock_irqrestore(&kslots[slot_idx].lock, flags);
-
-                push_free_idx(slot_idx);
-                kfree(map);
-                return -EEXIST;
-            }
-        }
-        hash_add_rcu(pgid_hash, &map->hnode, pgid);
+    if (find_map_locked(key_type, key)) {
+        spin_unlock(&pgid_hash_lock);
+
+        /* Roll back slot (never reachable through a map, so acc was unused) */
+        spin_lock_irqsave(&kslots[slot_idx].lock, flags);
+        kslots[slot_idx].gen++;           /* invalidate */
+        WRITE_ONCE(slot_acc[slot_idx], NULL);
+        clear_kslot_locked(slot_idx);
+        publish_snapshot_locked(slot_idx);
+        spin_unlock_irqrestore(&kslots[slot_idx].lock, flags);
+
+        push_free_idx(slot_idx);
+        free_percpu(acc);
+        kfree(map);
+        return -EEXIST;
+    }
+    map_link_locked(map);
+    active_list_add_locked(slot_idx);
+    spin_unlock(&pgid_hash_lock);
+
+    atomic_inc(&nr_active);
+    schedule_work(&active_key_work);
+
+    pr_info("IPC_monitor: Added %s=%llu (slot=%d, gen=%u)\n",
+            key_name(key_type), key, slot_idx, map->gen);
+    return 0;
+}
+
+static int remove_slot_key(u32 key_type, u64 key)
+{
+    struct pgid_map *map;
+    unsigned long flags;
+    int slot_idx;
+
+    spin_lock(&pgid_hash_lock);
+    map = find_map_locked(key_type, key);
+    if (!map) {
+        spin_unlock(&pgid_hash_lock);
+        return -ENOENT;
     }
+
+    slot_idx = map->slot_idx;
+    pr_info("IPC_monitor: Removing %s=%llu (slot=%d, gen=%u, slot[%d] = (%d, %d, %d))\n",
+            key_name(key_type), key, map->slot_idx, map->gen, map->slot_idx,
+            kslots[slot_idx].pgid, kslots[slot_idx].global_jobid,
+            kslots[slot_idx].worker_num);
+    pr_info("snapshot[0]: seq=%u pgid=%d cycles=%llu inst=%llu\n",
+            shared_mem->slots[slot_idx].seq,
+            shared_mem->slots[slot_idx].pgid,
+            shared_mem->slots[slot_idx].cycles,
+            shared_mem->slots[slot_idx].instructions);
+
+    /* Hide from userspace polling immediately */
+    active_list_remove_locked(slot_idx);
+
+    /* Remove lookup first */
+    map_unlink_locked(map);
     spin_unlock(&pgid_hash_lock);
 
-    set_bit(slot_idx, shared_mem->active_mask);
-    atomic_inc(&shared_mem->count);
+    /* Invalidate any stale per-CPU state and clear kernel slot */
+    spin_lock_irqsave(&kslots[slot_idx].lock, flags);
+    kslots[slot_idx].gen++;      /* invalidate stale expected_gen */
+    map->acc = slot_acc[slot_idx];
+    WRITE_ONCE(slot_acc[slot_idx], NULL);
+    clear_kslot_locked(slot_idx);
+    publish_snapshot_locked(slot_idx);
+    spin_unlock_irqrestore(&kslots[slot_idx].lock, flags);
+
+    tid_reclaim_slot(slot_idx, map->gen);
+    push_free_idx(slot_idx);
 
-    pr_info("IPC_monitor: Added pgid=%d (slot=%d, gen=%u)\n", pgid, slot_idx, map->gen);
+    /* A CPU may still be folding into map->acc: free both after a grace period */
+    call_rcu(&map->rcu, pgid_map_free_rcu);
+    atomic_dec(&nr_active);
+    schedule_work(&active_key_work);
+
+    pr_info("IPC_monitor: Removed %s=%llu (slot=%d)\n", key_name(key_type), key, slot_idx);
     return 0;
 }
+
+/* ---------- exported API ---------- */
+
+int ipcmon_add_pgid(pid_t pgid, int global_jobid, int worker_num)
+{
+    return add_slot_key(IPC_KEY_PGID, (u64)pgid, global_jobid, worker_num);
+}
 EXPORT_SYMBOL(ipcmon_add_pgid);
 
 int ipcmon_remove_pgid(pid_t pgid)
+{
+    return remove_slot_key(IPC_KEY_PGID, (u64)pgid);
+}
+EXPORT_SYMBOL(ipcmon_remove_pgid);
+
+int ipcmon_set_worker_num(pid_t pgid, int worker_num)
 {
     struct pgid_map *map;
     unsigned long flags;
+    bool changed = false;
+    int slot_idx;
 
     spin_lock(&pgid_hash_lock);
-    hash_for_each_possible(pgid_hash, map, hnode, pgid) {
-        int slot_idx = map->slot_idx;
-        if (map->pgid == pgid) {
-            pr_info("IPC_monitor: Removing pgid=%d (slot=%d, gen=%u, slot[%d] = (%d, %d, %d, %d))\n",
-                    pgid, map->slot_idx, map->gen, map->slot_idx,
-                    kslots[slot_idx].pgid, kslots[slot_idx].global_jobid,
-                    kslots[slot_idx].worker_num, kslots[slot_idx].reset_flag);
-            pr_info("snapshot[0]: seq=%u pgid=%d cycles=%llu inst=%llu\n",
-                    shared_mem->slots[slot_idx].seq,
-                    shared_mem->slots[slot_idx].pgid,
-                    shared_mem->slots[slot_idx].cycles,
-                    shared_mem->slots[slot_idx].instructions);    
-
-            /* Hide from userspace polling immediately */
-            clear_bit(slot_idx, shared_mem->active_mask);
-
-            /* Remove lookup first */
-            hash_del_rcu(&map->hnode);
-            spin_unlock(&pgid_hash_lock);
-
-            /* Invalidate any stale per-CPU state and clear kernel slot */
-            spin_lock_irqsave(&kslots[slot_idx].lock, flags);
-            kslots[slot_idx].gen++;      /* invalidate stale expected_gen */
-            clear_kslot_locked(slot_idx);
-            publish_snapshot_locked(slot_idx);
-            spin_unlock_irqrestore(&kslots[slot_idx].lock, flags);
-
-            push_free_idx(slot_idx);
-
-            kfree_rcu(map, rcu);
-            atomic_dec(&shared_mem->count);
-
-            pr_info("IPC_monitor: Removed pgid=%d (slot=%d)\n", pgid, slot_idx);
-            return 0;
-        }
+    map = find_map_locked(IPC_KEY_PGID, (u64)pgid);
+    if (!map) {
+        spin_unlock(&pgid_hash_lock);
+        return -ENOENT;
     }
+
+    slot_idx = map->slot_idx;
+    spin_lock_irqsave(&kslots[slot_idx].lock, flags);
+    if (kslots[slot_idx].gen == map->gen &&
+        kslots[slot_idx].worker_num != worker_num) {
+        kslots[slot_idx].worker_num = worker_num;
+        publish_snapshot_locked(slot_idx);
+        changed = true;
+    }
+    spin_unlock_irqrestore(&kslots[slot_idx].lock, flags);
+
+    if (changed)
+        epoch_bump_locked();
     spin_unlock(&pgid_hash_lock);
-    return -ENOENT;
+    return 0;
 }
-EXPORT_SYMBOL(ipcmon_remove_pgid);
+EXPORT_SYMBOL(ipcmon_set_worker_num);
+
+int ipcmon_add_cgroup(u64 cgid, int global_jobid, int worker_num)
+{
+    if (!cgid)
+        return -EINVAL;
+    return add_slot_key(IPC_KEY_CGROUP, cgid, global_jobid, worker_num);
+}
+EXPORT_SYMBOL(ipcmon_add_cgroup);
+
+int ipcmon_remove_cgroup(u64 cgid)
+{
+    return remove_slot_key(IPC_KEY_CGROUP, cgid);
+}
+EXPORT_SYMBOL(ipcmon_remove_cgroup);
 
 /* ---------- tracepoint handler ---------- */
 
@@ -343,26 +1942,44 @@ static void tracepoint_sched_switch_handler(void *data, bool preempt,
                                             unsigned int prev_state)
 {
     int cpu = smp_processor_id();
-
-    /* PREV state: only valid if previously armed for a monitored task */
-    int prev_slot_idx = per_cpu(running_slot_idx, cpu);
-    u32 prev_expected_gen = per_cpu(running_slot_gen, cpu);
-
-    /* Decide whether NEXT is monitored (RCU lookup) */
-    pid_t next_pgid = pid_nr(task_pgrp(next));
+    int prev_slot_idx;
+    pid_t next_pgid;
     struct pgid_map *map;
     int next_slot_idx = -1;
     u32 next_expected_gen = 0;
+    bool next_tid_mode = false;
 
-    rcu_read_lock();
-    hash_for_each_possible_rcu(pgid_hash, map, hnode, next_pgid) {
-        if (map->pgid == next_pgid) {
-            next_slot_idx = map->slot_idx;
-            next_expected_gen = map->gen;
-            break;
+    /* No active slot anywhere: patched out to a single NOP */
+    if (!static_branch_unlikely(&ipcmon_active))
+        return;
+
+    core_set_state(cpu, !is_idle_task(next));
+
+    /* PREV state: only valid if previously armed for a monitored task */
+    prev_slot_idx = per_cpu(running_slot_idx, cpu);
+
+    /* Decide whether NEXT is monitored: bitmap prefilter, then RCU lookup */
+    next_pgid = pid_nr(task_pgrp(next));
+    if (test_bit(pgid_filter_bit(next_pgid), pgid_filter)) {
+        rcu_read_lock();
+        hash_for_each_possible_rcu(pgid_hash, map, hnode, next_pgid) {
+            if (map->pgid == next_pgid) {
+                next_slot_idx = map->slot_idx;
+                next_expected_gen = map->gen;
+                next_tid_mode = READ_ONCE(map->tid_mode);
+                break;
+            }
         }
+        rcu_read_unlock();
     }
-    rcu_read_unlock();
+    if (next_slot_idx < 0 && READ_ONCE(nr_cgroup_keys))
+        next_slot_idx = lookup_cgroup_slot(next, &next_expected_gen, &next_tid_mode);
+
+    /* Tell the SMT sibling who runs here now */
+    if (next_slot_idx >= 0)
+        update_occupant(cpu, next_slot_idx, next_expected_gen);
+    else
+        update_occupant(cpu, is_idle_task(next) ? PEER_IDLE : PEER_OTHER, 0);
 
     /* If neither prev needs end nor next needs start, do nothing (no PMU read). */
     if (prev_slot_idx < 0 && next_slot_idx < 0)
@@ -370,52 +1987,30 @@ static void tracepoint_sched_switch_handler(void *data, bool preempt,
 
     /* Read PMU counters only when needed */
     {
-        struct perf_event *cycles = per_cpu(cpu_cycles_event, cpu);
-        struct perf_event *inst   = per_cpu(cpu_instructions_event, cpu);
-        u64 enabled, running;
-        u64 now_cycles, now_insts;
+        struct pmu_sample now;
 
-        if (!perf_event_is_valid(cycles) || !perf_event_is_valid(inst))
+        if (!read_cpu_counters(cpu, &now))
             goto disarm_and_out;
 
-        now_cycles = perf_event_read_value(cycles, &enabled, &running);
-        now_insts  = perf_event_read_value(inst,   &enabled, &running);
-
         /* 1) switch-out: accumulate for PREV if it was monitored */
-        if (prev_slot_idx >= 0) {
-            u64 start_cycles = per_cpu(running_start_cycles, cpu);
-            u64 start_insts  = per_cpu(running_start_insts, cpu);
-            u64 delta_cycles = delta_u64_wrap(now_cycles, start_cycles);
-            u64 delta_insts  = delta_u64_wrap(now_insts,  start_insts);
-            unsigned long flags;
-
-            spin_lock_irqsave(&kslots[prev_slot_idx].lock, flags);
-
-            /* Reject stale updates after slot reuse */
-            if (kslots[prev_slot_idx].gen == prev_expected_gen) {
-                if (kslots[prev_slot_idx].reset_flag) {
-                    kslots[prev_slot_idx].cycles = delta_cycles;
-                    kslots[prev_slot_idx].instructions = delta_insts;
-                    kslots[prev_slot_idx].reset_flag = 0;
-                } else {
-                    kslots[prev_slot_idx].cycles += delta_cycles;
-                    kslots[prev_slot_idx].instructions += delta_insts;
-                }
-                publish_snapshot_locked(prev_slot_idx);
-            }
-
-            spin_unlock_irqrestore(&kslots[prev_slot_idx].lock, flags);
-        }
+        if (prev_slot_idx >= 0)
+            fold_running_delta(cpu, &now);
 
         /* 2) switch-in: arm NEXT if it is monitored, else disarm */
         if (next_slot_idx >= 0) {
             per_cpu(running_slot_idx, cpu) = next_slot_idx;
             per_cpu(running_slot_gen, cpu) = next_expected_gen;
-            per_cpu(running_start_cycles, cpu) = now_cycles;
-            per_cpu(running_start_insts,  cpu) = now_insts;
+            per_cpu(running_start, cpu) = now;
+            per_cpu(running_switch_in, cpu) = 1;
+            per_cpu(running_peer_word, cpu) = read_sibling_occupant(cpu);
+            per_cpu(running_tid_idx, cpu) = next_tid_mode ?
+                tid_get(next->pid, next_pgid, next_slot_idx, next_expected_gen,
+                        &per_cpu(running_tid_gen, cpu)) : -1;
         } else {
             per_cpu(running_slot_idx, cpu) = -1;
             per_cpu(running_slot_gen, cpu) = 0;
+            per_cpu(running_tid_idx, cpu) = -1;
+            flush_pair_pending(cpu);
         }
 
         return;
@@ -426,6 +2021,8 @@ disarm_and_out:
     if (next_slot_idx < 0) {
         per_cpu(running_slot_idx, cpu) = -1;
         per_cpu(running_slot_gen, cpu) = 0;
+        per_cpu(running_tid_idx, cpu) = -1;
+        flush_pair_pending(cpu);
     }
 }
 
@@ -435,33 +2032,84 @@ static void find_sched_switch_tracepoint(struct tracepoint *tp, void *priv)
 {
     if (tp && tp->name && strcmp(tp->name, "sched_switch") == 0)
         sched_switch_tracepoint = tp;
+    if (tp && tp->name && strcmp(tp->name, "sched_process_exit") == 0)
+        sched_exit_tracepoint = tp;
 }
 
-/* ---------- mmap / ioctl ---------- */
+/* ---------- open / poll / read ---------- */
 
-static int ipc_mmap(struct file *filp, struct vm_area_struct *vma)
+static int ipc_open(struct inode *inode, struct file *filp)
 {
-    unsigned long vma_size = vma->vm_end - vma->vm_start;
-    unsigned long uaddr = vma->vm_start;
-    unsigned long offset = 0;
+    struct ipc_file *f = kzalloc(sizeof(*f), GFP_KERNEL);
 
-    if (vma_size != shared_mem_size) {
-        pr_err("IPC_monitor: mmap size mismatch (requested=%lu, expected=%zu)\n",
-               vma_size, shared_mem_size);
+    if (!f)
+        return -ENOMEM;
+    f->seen_epoch = READ_ONCE(shared_mem->hdr.epoch);
+    filp->private_data = f;
+    return 0;
+}
+
+static int ipc_release(struct inode *inode, struct file *filp)
+{
+    kfree(filp->private_data);
+    return 0;
+}
+
+/* Readable while hdr.epoch differs from the epoch this file last read */
+static __poll_t ipc_poll(struct file *filp, poll_table *wait)
+{
+    struct ipc_file *f = filp->private_data;
+
+    poll_wait(filp, &epoch_wq, wait);
+    if (READ_ONCE(shared_mem->hdr.epoch) != READ_ONCE(f->seen_epoch))
+        return EPOLLIN | EPOLLRDNORM;
+    return 0;
+}
+
+/* eventfd-style: returns the current epoch as a u64 once it has changed,
+ * blocking (or -EAGAIN with O_NONBLOCK) until then.
+ */
+static ssize_t ipc_read(struct file *filp, char __user *buf, size_t len, loff_t *ppos)
+{
+    struct ipc_file *f = filp->private_data;
+    u64 epoch;
+    int ret;
+
+    if (len < sizeof(epoch))
         return -EINVAL;
+
+    if (READ_ONCE(shared_mem->hdr.epoch) == READ_ONCE(f->seen_epoch)) {
+        if (filp->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(epoch_wq,
+                READ_ONCE(shared_mem->hdr.epoch) != READ_ONCE(f->seen_epoch));
+        if (ret)
+            return ret;
     }
 
-    vm_flags_set(vma, VM_IO | VM_DONTEXPAND | VM_DONTDUMP);
+    epoch = READ_ONCE(shared_mem->hdr.epoch);
+    WRITE_ONCE(f->seen_epoch, epoch);
+    if (copy_to_user(buf, &epoch, sizeof(epoch)))
+        return -EFAULT;
+    return sizeof(epoch);
+}
+
+/* ---------- mmap / ioctl ---------- */
+
+/* Map @size bytes of the vmalloc'd region @base page by page */
+static int remap_vmalloc_pages(struct vm_area_struct *vma, void *base, unsigned long size)
+{
+    unsigned long offset = 0;
 
-    while (offset < vma_size) {
-        struct page *page = vmalloc_to_page((void *)((char *)shared_mem + offset));
+    while (offset < size) {
+        struct page *page = vmalloc_to_page((char *)base + offset);
         if (!page) {
             pr_err("IPC_monitor: vmalloc_to_page failed at offset=%lu\n", offset);
             return -EFAULT;
         }
 
         if (remap_pfn_range(vma,
-                            uaddr + offset,
+                            vma->vm_start + offset,
                             page_to_pfn(page),
                             PAGE_SIZE,
                             vma->vm_page_prot)) {
@@ -475,25 +2123,155 @@ static int ipc_mmap(struct file *filp, struct vm_area_struct *vma)
     return 0;
 }
 
-static long ipc_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+static int ipc_mmap(struct file *filp, struct vm_area_struct *vma)
 {
-    int i;
+    unsigned long vma_size = vma->vm_end - vma->vm_start;
+
+    vm_flags_set(vma, VM_IO | VM_DONTEXPAND | VM_DONTDUMP);
+
+    /* Flight recorder reader tails: the only writable mapping */
+    if (vma->vm_pgoff == (IPC_TRACE_TAIL_MMAP_OFFSET >> PAGE_SHIFT)) {
+        if (!trace_tail_mem || vma_size != trace_tail_mem_size)
+            return -EINVAL;
+        return remap_vmalloc_pages(vma, trace_tail_mem, vma_size);
+    }
+
+    /* Everything else is read-only: the kernel indexes with what it publishes */
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    vm_flags_clear(vma, VM_MAYWRITE);
+
+    /* Flight recorder rings: the whole region at its own offset */
+    if (vma->vm_pgoff == (IPC_TRACE_MMAP_OFFSET >> PAGE_SHIFT)) {
+        if (!trace_mem || vma_size != trace_mem_size)
+            return -EINVAL;
+        return remap_vmalloc_pages(vma, trace_mem, vma_size);
+    }
+
+    /* Any page-aligned prefix is allowed: readers map the header page first to
+     * negotiate the ABI version, then remap hdr.total_size bytes.
+     */
+    if (vma_size > shared_mem_size || vma->vm_pgoff != 0) {
+        pr_err("IPC_monitor: mmap size mismatch (requested=%lu, max=%zu)\n",
+               vma_size, shared_mem_size);
+        return -EINVAL;
+    }
+
+    return remap_vmalloc_pages(vma, shared_mem, vma_size);
+}
 
+static long ipc_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
     switch (cmd) {
-    case IPC_IOC_RESET_COUNTERS:
-        /* Mark reset_flag in kernel slots; applied at next switch-out update */
-        for (i = 0; i < MAX_SLOTS; i++) {
-            unsigned long flags;
+    case IPC_IOC_SYNC_COUNTERS:
+        /* Reader-driven aggregation: publish per-CPU partials right now.
+         * Gated like the other controls: it walks every active slot and CPU.
+         */
+        if (!perfmon_capable())
+            return -EPERM;
+        if (percpu_accum)
+            aggregate_active_slots();
+        return 0;
 
-            if (!test_bit(i, shared_mem->active_mask))
-                continue;
+    case IPC_IOC_SET_EVENTS: {
+        struct ipc_event_config cfg;
+        u32 i;
+
+        if (!perfmon_capable())
+            return -EPERM;
+        if (copy_from_user(&cfg, (struct ipc_event_config __user *)arg, sizeof(cfg)))
+            return -EFAULT;
+        if (cfg.nr_events > IPC_MAX_EVENTS)
+            return -EINVAL;
+        for (i = 0; i < cfg.nr_events; i++) {
+            if (cfg.events[i].type != PERF_TYPE_HARDWARE &&
+                cfg.events[i].type != PERF_TYPE_HW_CACHE &&
+                cfg.events[i].type != PERF_TYPE_RAW)
+                return -EINVAL;
+        }
+
+        return set_extra_events(&cfg);
+    }
 
-            spin_lock_irqsave(&kslots[i].lock, flags);
-            if (kslots[i].pgid != 0)
-                kslots[i].reset_flag = 1;
-            spin_unlock_irqrestore(&kslots[i].lock, flags);
+    case IPC_IOC_ADD_CGROUP: {
+        struct ipc_cgroup_key req;
+
+        if (!perfmon_capable())
+            return -EPERM;
+        if (copy_from_user(&req, (struct ipc_cgroup_key __user *)arg, sizeof(req)))
+            return -EFAULT;
+        return ipcmon_add_cgroup(req.cgid, req.global_jobid, req.worker_num);
+    }
+
+    case IPC_IOC_REMOVE_CGROUP: {
+        __u64 cgid;
+
+        if (!perfmon_capable())
+            return -EPERM;
+        if (copy_from_user(&cgid, (__u64 __user *)arg, sizeof(cgid)))
+            return -EFAULT;
+        return ipcmon_remove_cgroup(cgid);
+    }
+
+    case IPC_IOC_SET_TID_MODE: {
+        struct ipc_tid_mode req;
+        struct pgid_map *map;
+        int slot_idx = -1;
+        u32 slot_gen = 0;
+
+        if (!perfmon_capable())
+            return -EPERM;
+        if (copy_from_user(&req, (struct ipc_tid_mode __user *)arg, sizeof(req)))
+            return -EFAULT;
+
+        spin_lock(&pgid_hash_lock);
+        map = find_map_locked(IPC_KEY_PGID, (u64)req.pgid);
+        if (map) {
+            WRITE_ONCE(map->tid_mode, !!req.enable);
+            slot_idx = map->slot_idx;
+            slot_gen = map->gen;
+        }
+        spin_unlock(&pgid_hash_lock);
+
+        if (slot_idx < 0)
+            return -ENOENT;
+        if (!req.enable) {
+            synchronize_rcu();  /* no CPU arms a new sub-slot for this PGID afterwards */
+            tid_reclaim_slot(slot_idx, slot_gen);
         }
         return 0;
+    }
+
+    case IPC_IOC_SET_EWMA_HALFLIFE: {
+        __u32 halflife_ms;
+
+        if (!perfmon_capable())
+            return -EPERM;
+        if (copy_from_user(&halflife_ms, (__u32 __user *)arg, sizeof(halflife_ms)))
+            return -EFAULT;
+        if (!halflife_ms || halflife_ms > MAX_EWMA_HALFLIFE_MS)
+            return -EINVAL;
+
+        WRITE_ONCE(ewma_halflife_ns, (u64)halflife_ms * NSEC_PER_MSEC);
+        WRITE_ONCE(shared_mem->hdr.ewma_halflife_ms, halflife_ms);
+        pr_info("IPC_monitor: EWMA half-life set to %u ms\n", halflife_ms);
+        return 0;
+    }
+
+    case IPC_IOC_SET_PUBLISH_PERIOD: {
+        __u32 period_us;
+
+        if (!perfmon_capable())
+            return -EPERM;
+        if (copy_from_user(&period_us, (__u32 __user *)arg, sizeof(period_us)))
+            return -EFAULT;
+        if (period_us && (period_us < MIN_PUBLISH_PERIOD_US || period_us > MAX_PUBLISH_PERIOD_US))
+            return -EINVAL;
+
+        set_publish_period(period_us);
+        pr_info("IPC_monitor: publish period set to %u us\n", period_us);
+        return 0;
+    }
 
     default:
         return -ENOTTY;
@@ -501,6 +2279,11 @@ static long ipc_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 }
 
 static const struct file_operations fops = {
+    .open           = ipc_open,
+    .release        = ipc_release,
+    .read           = ipc_read,
+    .poll           = ipc_poll,
+    .llseek         = noop_llseek,
     .mmap           = ipc_mmap,
     .unlocked_ioctl = ipc_ioctl,
     .owner          = THIS_MODULE,
@@ -518,34 +2301,134 @@ static int __init IPC_monitor_init(void)
     free_count = 0;
     sched_switch_tracepoint = NULL;
     sched_switch_registered = false;
+    sched_exit_tracepoint = NULL;
+    sched_exit_registered = false;
 
     /* init kernel slot locks once */
     for (i = 0; i < MAX_SLOTS; i++)
         spin_lock_init(&kslots[i].lock);
 
+    /* init publish timers up front so the failure path can always cancel them */
+    publish_period_ns = 0;
+    publish_armed = false;
+    aggregate_stopping = false;
+    INIT_DELAYED_WORK(&aggregate_work, aggregate_work_fn);
+    INIT_WORK(&active_key_work, active_key_work_fn);
+    for_each_online_cpu(cpu) {
+        hrtimer_init(&per_cpu(publish_timer, cpu), CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED);
+        per_cpu(publish_timer, cpu).function = publish_timer_fn;
+    }
+
     /* allocate userspace-visible shared memory (vmalloc space) */
     shared_mem_size = PAGE_ALIGN(sizeof(struct ipc_shared));
     shared_mem = vzalloc(shared_mem_size);
     if (!shared_mem)
         return -ENOMEM;
 
-    atomic_set(&shared_mem->count, 0);
-    bitmap_zero(shared_mem->active_mask, MAX_SLOTS);
+    /* flight recorder rings (optional) */
+    if (trace_records) {
+        size_t ring_size;
+
+        if (!is_power_of_2(trace_records) || trace_records > MAX_TRACE_RECORDS) {
+            pr_err("IPC_monitor: trace_records must be a power of two <= %u\n",
+                   MAX_TRACE_RECORDS);
+            goto fail_cleanup;
+        }
+        ring_size = ALIGN(sizeof(struct ipc_trace_ring) +
+                          (size_t)trace_records * sizeof(struct ipc_trace_record), 64);
+        trace_mem_size = PAGE_ALIGN(TRACE_RINGS_OFF + nr_cpu_ids * ring_size);
+        trace_mem = vzalloc(trace_mem_size);
+        if (!trace_mem) {
+            pr_err("IPC_monitor: Failed to allocate %zu bytes of trace rings\n",
+                   trace_mem_size);
+            goto fail_cleanup;
+        }
+        trace_tail_mem_size = PAGE_ALIGN(nr_cpu_ids * sizeof(struct ipc_trace_tail));
+        trace_tail_mem = vzalloc(trace_tail_mem_size);
+        if (!trace_tail_mem) {
+            pr_err("IPC_monitor: Failed to allocate trace ring tails\n");
+            goto fail_cleanup;
+        }
+        trace_ring_size = ring_size;
+        trace_mem->record_size = sizeof(struct ipc_trace_record);
+        trace_mem->nr_cpus = nr_cpu_ids;
+        trace_mem->nr_records = trace_records;
+        trace_mem->ring_size = ring_size;
+        trace_mem->rings_off = TRACE_RINGS_OFF;
+        trace_mem->magic = IPC_TRACE_MAGIC;
+    }
+
+    atomic_set(&nr_active, 0);
+    active_count = 0;
+    bitmap_zero(active_mask, MAX_SLOTS);
     for (i = 0; i < MAX_SLOTS; i++) {
         shared_mem->slots[i].seq = 0;
         shared_mem->slots[i].cycles = 0;
         shared_mem->slots[i].instructions = 0;
         shared_mem->slots[i].pgid = -1;
+        shared_mem->active.idx[i] = -1;
+        active_idx[i] = -1;
+        active_pos[i] = -1;
     }
-
-    pr_info("ipc_shared sizeof=%zu\n", sizeof(struct ipc_shared));
+    shared_mem->pairs.nr_entries = PAIR_TABLE_SIZE;
+
+    /* per-tid sub-slot pool */
+    shared_mem->tids.nr_entries = TID_POOL_SIZE;
+    atomic_set(&nr_tids, 0);
+    for (i = 0; i < TID_POOL_SIZE; i++)
+        tid_free[i] = TID_POOL_SIZE - 1 - i;
+    tid_free_count = TID_POOL_SIZE;
+
+    /* header last: readers treat a valid magic as "layout initialized" */
+    BUILD_BUG_ON(sizeof(struct ipc_shared_header) > IPC_HDR_SIZE);
+    BUILD_BUG_ON(sizeof(struct pgid_slot_user) != 64);
+    BUILD_BUG_ON(sizeof(struct tid_slot_user) != 64);
+    BUILD_BUG_ON(sizeof(struct core_smt_user) != 64);
+    BUILD_BUG_ON(sizeof(struct ipc_trace_record) != 48);
+    BUILD_BUG_ON(sizeof(struct ipc_trace_ring) != 128);
+    BUILD_BUG_ON(sizeof(struct ipc_trace_header) > 64);
+    BUILD_BUG_ON(sizeof(struct ipc_trace_tail) != 64);
+    shared_mem->hdr.abi_version = IPC_ABI_VERSION;
+    shared_mem->hdr.header_size = IPC_HDR_SIZE;
+    shared_mem->hdr.slot_size = sizeof(struct pgid_slot_user);
+    shared_mem->hdr.max_slots = MAX_SLOTS;
+    if (!ewma_halflife_ms || ewma_halflife_ms > MAX_EWMA_HALFLIFE_MS)
+        ewma_halflife_ms = 200;
+    ewma_halflife_ns = (u64)ewma_halflife_ms * NSEC_PER_MSEC;
+    shared_mem->hdr.ewma_halflife_ms = ewma_halflife_ms;
+    shared_mem->hdr.total_size = shared_mem_size;
+    shared_mem->hdr.epoch = 0;
+    shared_mem->hdr.active_off = offsetof(struct ipc_shared, active);
+    shared_mem->hdr.slots_off = offsetof(struct ipc_shared, slots);
+    shared_mem->hdr.event_set_off = offsetof(struct ipc_shared, event_set);
+    shared_mem->hdr.slot_events_off = offsetof(struct ipc_shared, slot_events);
+    shared_mem->hdr.pairs_off = offsetof(struct ipc_shared, pairs);
+    shared_mem->hdr.tids_off = offsetof(struct ipc_shared, tids);
+    shared_mem->hdr.keys_off = offsetof(struct ipc_shared, slot_keys);
+    shared_mem->hdr.slot_smt_off = offsetof(struct ipc_shared, slot_smt);
+    shared_mem->hdr.cores_off = offsetof(struct ipc_shared, cores);
+    shared_mem->hdr.trace_mmap_off = trace_mem ? IPC_TRACE_MMAP_OFFSET : 0;
+    shared_mem->hdr.trace_size = trace_mem_size;
+    shared_mem->hdr.trace_tail_mmap_off = trace_tail_mem ? IPC_TRACE_TAIL_MMAP_OFFSET : 0;
+    shared_mem->hdr.trace_tail_size = trace_tail_mem_size;
+    smp_wmb();
+    shared_mem->hdr.magic = IPC_ABI_MAGIC;
+
+    pr_info("ipc_shared sizeof=%zu abi=%u\n", sizeof(struct ipc_shared), IPC_ABI_VERSION);
     pr_info("slot sizeof=%zu align=%zu\n",
             sizeof(struct pgid_slot_user),
             __alignof__(struct pgid_slot_user));
-    pr_info("offset count=%zu active_mask=%zu slots=%zu\n",
-            offsetof(struct ipc_shared, count),
-            offsetof(struct ipc_shared, active_mask),
-            offsetof(struct ipc_shared, slots));
+    pr_info("offset active=%zu slots=%zu event_set=%zu slot_events=%zu pairs=%zu tids=%zu\n",
+            offsetof(struct ipc_shared, active),
+            offsetof(struct ipc_shared, slots),
+            offsetof(struct ipc_shared, event_set),
+            offsetof(struct ipc_shared, slot_events),
+            offsetof(struct ipc_shared, pairs),
+            offsetof(struct ipc_shared, tids));
+    pr_info("offset slot_keys=%zu slot_smt=%zu cores=%zu\n",
+            offsetof(struct ipc_shared, slot_keys),
+            offsetof(struct ipc_shared, slot_smt),
+            offsetof(struct ipc_shared, cores));
 
     /* perf attrs */
     memset(&cycles_attr, 0, sizeof(cycles_attr));
@@ -585,8 +2468,45 @@ static int __init IPC_monitor_init(void)
         /* per-cpu running state */
         per_cpu(running_slot_idx, cpu) = -1;
         per_cpu(running_slot_gen, cpu) = 0;
-        per_cpu(running_start_cycles, cpu) = 0;
-        per_cpu(running_start_insts, cpu) = 0;
+        per_cpu(running_switch_in, cpu) = 0;
+        per_cpu(running_tid_idx, cpu) = -1;
+        memset(&per_cpu(running_start, cpu), 0, sizeof(struct pmu_sample));
+
+        /* SMT sibling for co-runner attribution (none when SMT is off) */
+        per_cpu(sibling_cpu, cpu) = -1;
+        for_each_cpu(i, topology_sibling_cpumask(cpu)) {
+            if (i != cpu) {
+                per_cpu(sibling_cpu, cpu) = i;
+                break;
+            }
+        }
+        per_cpu(occupant_word, cpu) = PEER_OTHER;
+        memset(&per_cpu(pair_pending, cpu), 0, sizeof(struct pair_pending_set));
+        per_cpu(core_idx, cpu) = -1;
+        per_cpu(core_busy, cpu) = -1;
+    }
+
+    /* Physical cores for SMT occupancy (first IPC_CORE_THREADS threads of each) */
+    for_each_online_cpu(cpu) {
+        const struct cpumask *mask = topology_sibling_cpumask(cpu);
+        u32 c = shared_mem->cores.nr_cores;
+        int pos = 0;
+
+        if (cpu != cpumask_first(mask) || c >= IPC_MAX_CORES)
+            continue;
+
+        spin_lock_init(&core_states[c].lock);
+        for (i = 0; i < IPC_CORE_THREADS; i++)
+            shared_mem->cores.entries[c].cpus[i] = -1;
+        for_each_cpu(i, mask) {
+            if (pos == IPC_CORE_THREADS)
+                break;
+            per_cpu(core_idx, i) = c;
+            per_cpu(core_pos, i) = pos;
+            shared_mem->cores.entries[c].cpus[pos++] = i;
+        }
+        shared_mem->cores.entries[c].nr_cpus = pos;
+        shared_mem->cores.nr_cores = c + 1;
     }
 
     /* register sched_switch tracepoint */
@@ -604,6 +2524,26 @@ static int __init IPC_monitor_init(void)
     }
     sched_switch_registered = true;
 
+    /* sched_process_exit reclaims tid sub-slots */
+    if (!sched_exit_tracepoint) {
+        pr_err("IPC_monitor: sched_process_exit tracepoint not found\n");
+        goto fail_cleanup;
+    }
+    ret = tracepoint_probe_register(sched_exit_tracepoint,
+                                    tracepoint_sched_exit_handler, NULL);
+    if (ret < 0) {
+        pr_err("IPC_monitor: Failed to register exit tracepoint (err=%d)\n", ret);
+        goto fail_cleanup;
+    }
+    sched_exit_registered = true;
+
+    /* periodic publishing (timers are pinned, so start them on each CPU) */
+    if (publish_period_us && publish_period_us < MIN_PUBLISH_PERIOD_US)
+        publish_period_us = MIN_PUBLISH_PERIOD_US;
+    if (publish_period_us > MAX_PUBLISH_PERIOD_US)
+        publish_period_us = MAX_PUBLISH_PERIOD_US;
+    set_publish_period(publish_period_us);
+
     /* char device */
     ret = alloc_chrdev_region(&dev_no, 0, 1, "IPC_monitor");
     if (ret < 0) {
@@ -643,11 +2583,21 @@ static int __init IPC_monitor_init(void)
     return 0;
 
 fail_cleanup:
+    WRITE_ONCE(publish_period_ns, 0);
+    stop_publish_timers();
+    stop_aggregation();
+
+    if (sched_exit_registered && sched_exit_tracepoint) {
+        tracepoint_probe_unregister(sched_exit_tracepoint,
+                                    tracepoint_sched_exit_handler, NULL);
+        sched_exit_registered = false;
+    }
     if (sched_switch_registered && sched_switch_tracepoint) {
         tracepoint_probe_unregister(sched_switch_tracepoint,
                                     tracepoint_sched_switch_handler, NULL);
         sched_switch_registered = false;
     }
+    tracepoint_synchronize_unregister();
 
     for_each_online_cpu(cpu) {
         if (per_cpu(cpu_cycles_event, cpu)) {
@@ -661,6 +2611,7 @@ fail_cleanup:
             per_cpu(cpu_instructions_event, cpu) = NULL;
         }
     }
+    release_extra_events();
 
     if (ipc_device) {
         device_destroy(ipc_class, dev_no);
@@ -671,6 +2622,16 @@ fail_cleanup:
         ipc_class = NULL;
     }
 
+    free_pcpu_accumulators();
+
+    if (trace_mem) {
+        vfree(trace_mem);
+        trace_mem = NULL;
+    }
+    if (trace_tail_mem) {
+        vfree(trace_tail_mem);
+        trace_tail_mem = NULL;
+    }
     if (shared_mem) {
         vfree(shared_mem);
         shared_mem = NULL;
@@ -685,6 +2646,15 @@ static void __exit IPC_monitor_exit(void)
     struct pgid_map *map;
     struct hlist_node *tmp;
 
+    WRITE_ONCE(publish_period_ns, 0);
+    stop_publish_timers();
+    stop_aggregation();
+
+    if (sched_exit_registered && sched_exit_tracepoint) {
+        tracepoint_probe_unregister(sched_exit_tracepoint,
+                                    tracepoint_sched_exit_handler, NULL);
+        sched_exit_registered = false;
+    }
     if (sched_switch_registered && sched_switch_tracepoint) {
         tracepoint_probe_unregister(sched_switch_tracepoint,
                                     tracepoint_sched_switch_handler, NULL);
@@ -706,16 +2676,27 @@ static void __exit IPC_monitor_exit(void)
             per_cpu(cpu_instructions_event, cpu) = NULL;
         }
     }
+    release_extra_events();
 
     /* remove all maps */
     spin_lock(&pgid_hash_lock);
     hash_for_each_safe(pgid_hash, bkt, tmp, map, hnode) {
-        clear_bit(map->slot_idx, shared_mem->active_mask);
-        hash_del_rcu(&map->hnode);
+        active_list_remove_locked(map->slot_idx);
+        map_unlink_locked(map);
+        kfree_rcu(map, rcu);
+    }
+    hash_for_each_safe(cgroup_hash, bkt, tmp, map, hnode) {
+        active_list_remove_locked(map->slot_idx);
+        map_unlink_locked(map);
         kfree_rcu(map, rcu);
     }
     spin_unlock(&pgid_hash_lock);
     synchronize_rcu();
+    rcu_barrier();  /* pending tid_node_free_rcu() callbacks */
+
+    cancel_work_sync(&active_key_work);
+    if (static_key_enabled(&ipcmon_active))
+        static_branch_disable(&ipcmon_active);
 
     if (ipc_device) {
         device_destroy(ipc_class, dev_no);
@@ -729,6 +2710,16 @@ static void __exit IPC_monitor_exit(void)
     cdev_del(&ipc_cdev);
     unregister_chrdev_region(dev_no, 1);
 
+    free_pcpu_accumulators();
+
+    if (trace_mem) {
+        vfree(trace_mem);
+        trace_mem = NULL;
+    }
+    if (trace_tail_mem) {
+        vfree(trace_tail_mem);
+        trace_tail_mem = NULL;
+    }
     if (shared_mem) {
         vfree(shared_mem);
         shared_mem = NULL;
@@ -5,8 +5,42 @@
  * Implementation uses ACK-gated IPC registration:
  *  - When threshold is exceeded: send profiling request to userspace only
  *  - When userspace completes profiling and sends ACK via netlink: set profile_done=1
- *  - Timer callback checks (is_long_running && profile_done && !ipcmon_registered)
+ *  - The entry's work then sees (is_long_running && profile_done && !ipcmon_registered)
  *    and only then registers with IPC_monitor (ipcmon_add_pgid)
+ *
+ * There is no periodic scan. Each entry owns a delayed work item armed for its
+ * next deadline (threshold crossing, notification retry, worker sample), so the
+ * kernel timer wheel orders entries by expiry. The sched_process_exit
+ * tracepoint kicks the work of the exiting process's group, which removes the
+ * entry once no live process is left. ioctls and the netlink ACK kick it too.
+ *
+ * worker_num follows the process group's runnable thread count (sampled every
+ * INTERVAL_MS while registered, exponentially smoothed); changes are pushed to
+ * the IPC_monitor slot with ipcmon_set_worker_num(). auto_worker_num=0 keeps
+ * the ioctl value.
+ *
+ * Tiered profiling policy: after grace_period_sec a group is registered with
+ * IPC_monitor provisionally, and after a further signature_sec userspace gets
+ * RTMON_EV_PROVISIONAL to score it from the slot's early IPC and SMT split.
+ * The threshold crossing (the second RTMON_EV_LONG_RUNNING, after which the
+ * profile is ACKed and used) follows once the predicted remaining runtime
+ * reaches min_remaining_sec: right after the grace period for jobs whose
+ * learned runtime (per global_jobid, from past exits or RTMON_IOC_SET_JOB_RUNTIME)
+ * says they run long, otherwise at min_remaining_sec (a job is expected to
+ * run about as long again as it already has). long_running_threshold caps it.
+ *
+ * Match rules (RTMON_IOC_ADD_RULE) map a cgroup, comm or exe path to a
+ * global_jobid; the sched_process_exec tracepoint looks the new image up in a
+ * hash of rules and tracks the exec'ing task's process group, so launchers
+ * need no RTMON_IOC_ADD_PGID call.
+ *
+ * Userspace is notified with batched binary events (include/rtmon_netlink.h):
+ * events are queued in a fixed ring and a flush work sends up to
+ * RTMON_NL_BATCH_MAX per skb to data_loader_pid and the events multicast group.
+ *
+ * The per-entry state is mirrored into a read-only status table that
+ * /dev/runtime_monitor maps (include/rtmon_status.h), so consumers read
+ * pending profiling state and start times without bookkeeping of their own.
  */
 
 #include <linux/init.h>
@@ -28,13 +62,37 @@
 #include <linux/hashtable.h>
 #include <linux/list.h>
 #include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <linux/rcupdate.h>
+#include <linux/workqueue.h>
+#include <linux/tracepoint.h>
+#include <linux/atomic.h>
+#include <linux/binfmts.h>
+#include <linux/cgroup.h>
+#include <linux/dcache.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/bitmap.h>
 
 #include "IPC_monitor.h"
+#include "rtmon_netlink.h"
+#include "rtmon_status.h"
 
 #define INTERVAL_MS 1000
 #define DEVICE_NAME "runtime_monitor"
 #define CLASS_NAME  "rtmon"
-#define NETLINK_USER 31
+#define NETLINK_USER RTMON_NETLINK_PROTO
+
+/* Event queue (power of two) and flush limits */
+#define RTMON_NL_QUEUE      4096
+#define RTMON_NL_BATCH_MAX  256
+#define RTMON_NL_RETRY_MS   100
+
+/* Runnable thread count EWMA: Q8 fixed point, weight 2^-WORKER_EWMA_SHIFT per sample */
+#define WORKER_EWMA_FRAC    8
+#define WORKER_EWMA_SHIFT   2
 
 struct my_pair {
     int pgid;
@@ -42,6 +100,28 @@ struct my_pair {
     int worker_num;
 };
 
+/* Seed of the learned runtime of a job (e.g. from the profile database) */
+struct rtmon_job_runtime {
+    __s32 global_jobid;
+    __u32 nr_runs;          /* weight of the seed; 0 forgets the job */
+    __u64 runtime_sec;
+};
+
+/* Match rule kinds */
+#define RTMON_RULE_CGROUP       1   /* cgroup v2 ID or any descendant */
+#define RTMON_RULE_EXE          2   /* absolute path of the executed file */
+#define RTMON_RULE_COMM         3   /* task comm after exec */
+#define RTMON_RULE_PATTERN_MAX  256
+
+struct rtmon_rule {
+    __u32 kind;
+    __s32 global_jobid;
+    __s32 worker_num;       /* initial worker count, <= 0 means 1 */
+    __u32 _rsvd;
+    __u64 cgid;             /* RTMON_RULE_CGROUP */
+    char pattern[RTMON_RULE_PATTERN_MAX];   /* RTMON_RULE_EXE / RTMON_RULE_COMM */
+};
+
 /* ioctl command definitions */
 #define RTMON_IOC_MAGIC 'k'
 #define RTMON_IOC_ADD_PGID              _IOW(RTMON_IOC_MAGIC, 0, struct my_pair)
@@ -49,7 +129,10 @@ struct my_pair {
 #define RTMON_IOC_SET_THRESHOLD         _IOW(RTMON_IOC_MAGIC, 2, int)
 #define RTMON_IOC_SET_DATA_LOADER_PID   _IOW(RTMON_IOC_MAGIC, 3, int)
 #define RTMON_IOC_REQUEST_PROFILE       _IOW(RTMON_IOC_MAGIC, 4, int)
-#define RTMON_IOC_MAXNR 5
+#define RTMON_IOC_ADD_RULE              _IOW(RTMON_IOC_MAGIC, 5, struct rtmon_rule)
+#define RTMON_IOC_DEL_RULE              _IOW(RTMON_IOC_MAGIC, 6, struct rtmon_rule)
+#define RTMON_IOC_SET_JOB_RUNTIME       _IOW(RTMON_IOC_MAGIC, 7, struct rtmon_job_runtime)
+#define RTMON_IOC_MAXNR 7
 
 /**
  * struct pgid_entry - Hash table entry for tracked PGIDs
@@ -66,28 +149,123 @@ struct pgid_entry {
 
     int profile_done;       /* Userspace profiling ACK gate */
     int ipcmon_registered;  /* Actual IPC_monitor registration status */
+    int provisional;        /* 0: in grace, 1: registered early, 2: signature reported */
+    u32 threshold_sec;      /* when the full profiling request is due */
 
     int global_jobid;
-    int worker_num;
+    int worker_num;         /* published worker count */
+    u32 runnable_ewma;      /* smoothed runnable threads, Q8 */
+
+    int status_idx;         /* record in the status table, -1: none */
+    u64 request_ns;         /* last long-running event queued */
+    u64 ack_ns;             /* profiling ACK */
 
     struct pid *pgid_pid;
 
-    struct hlist_node hnode;
+    struct delayed_work work;   /* next deadline or event; see entry_work_fn() */
+    struct hlist_node hnode;    /* unhashed: removed, the remover frees it */
     struct list_head gc_node;
 };
 
-/* long-running threshold in seconds */
+/* long-running threshold in seconds (upper bound of the adaptive policy) */
 static int long_running_threshold = 3600;
 
+/* Tiered policy, see the file comment */
+static bool adaptive_threshold = true;
+module_param(adaptive_threshold, bool, 0644);
+MODULE_PARM_DESC(adaptive_threshold,
+                 "Request profiling from predicted remaining runtime (default: 1; 0: long_running_threshold only)");
+
+static uint grace_period_sec = 30;
+module_param(grace_period_sec, uint, 0644);
+MODULE_PARM_DESC(grace_period_sec,
+                 "Seconds before a group is registered provisionally (default: 30, 0: no provisional tier)");
+
+static uint signature_sec = 10;
+module_param(signature_sec, uint, 0644);
+MODULE_PARM_DESC(signature_sec,
+                 "Seconds of provisional monitoring before RTMON_EV_PROVISIONAL (default: 10)");
+
+static uint min_remaining_sec = 600;
+module_param(min_remaining_sec, uint, 0644);
+MODULE_PARM_DESC(min_remaining_sec,
+                 "Predicted remaining runtime that justifies full profiling (default: 600)");
+
+/* Learned runtimes per global_jobid: EWMA weight 1/4 after the first 4 runs */
+#define JOB_HISTORY_MAX         4096
+#define JOB_HISTORY_EWMA_SHIFT  2
+
+struct job_history {
+    int global_jobid;
+    u32 nr_runs;
+    u64 runtime_sec;
+    struct hlist_node hnode;
+};
+
+static DEFINE_HASHTABLE(job_history_table, 8);
+static DEFINE_SPINLOCK(job_history_lock);
+static int nr_job_history;
+
+/* Track worker_num from live runnable thread counts */
+static bool auto_worker_num = true;
+module_param(auto_worker_num, bool, 0644);
+MODULE_PARM_DESC(auto_worker_num,
+                 "Keep worker_num current from the smoothed runnable thread count (default: 1)");
+
 /* userspace PID for netlink notifications */
 static int data_loader_pid;
 
-/* periodic monitoring timer */
-static struct timer_list monitor_timer;
+/* runs the per-entry work items */
+static struct workqueue_struct *rtmon_wq;
 
 /* tracking table */
 DEFINE_HASHTABLE(pgid_table, 10);
 static DEFINE_SPINLOCK(pgid_table_lock);
+static atomic_t nr_entries = ATOMIC_INIT(0);
+
+/* Status table (read-only mmap); records are owned under pgid_table_lock */
+static struct rtmon_status *status_mem;
+static DECLARE_BITMAP(status_used, RTMON_STATUS_MAX);
+
+/* sched_process_exit kicks the exiting group's entry */
+static struct tracepoint *sched_exit_tracepoint;
+static bool sched_exit_registered;
+
+/* sched_process_exec matches new images against the rules */
+static struct tracepoint *sched_exec_tracepoint;
+static bool sched_exec_registered;
+
+/* Match rules: RCU hash keyed by cgroup ID or string hash, per-kind counts */
+struct match_rule {
+    struct hlist_node hnode;
+    struct rcu_head rcu;
+    u32 kind;
+    u64 key;
+    int global_jobid;
+    int worker_num;
+    char pattern[RTMON_RULE_PATTERN_MAX];
+};
+
+static DEFINE_HASHTABLE(rule_table, 8);
+static DEFINE_SPINLOCK(rule_lock);
+static atomic_t nr_rules[RTMON_RULE_COMM + 1];
+
+/* exe path scratch for the exec tracepoint */
+static DEFINE_PER_CPU(char [RTMON_RULE_PATTERN_MAX], exe_path_buf);
+
+/* Process groups matched on exec, registered from exec_reg_work */
+struct exec_match {
+    pid_t pgid;
+    int global_jobid;
+    int worker_num;
+    u32 kind;
+    struct list_head node;
+};
+
+static LIST_HEAD(exec_matches);
+static DEFINE_SPINLOCK(exec_match_lock);
+static void exec_reg_fn(struct work_struct *work);
+static DECLARE_WORK(exec_reg_work, exec_reg_fn);
 
 /* char device */
 static int major_number;
@@ -102,32 +280,163 @@ static bool is_valid_userspace_pid(int pid)
     return pid > 0;
 }
 
-static int send_to_user(const char *msg, int pid)
+/* ---------- netlink event queue ---------- */
+
+/*
+ * Producers append at nl_head; the flush work keeps one cursor per
+ * destination. A slot is reused only after both cursors passed it, so the
+ * unicast consumer can be retried without re-broadcasting.
+ */
+static struct rtmon_nl_event nl_queue[RTMON_NL_QUEUE];
+static u64 nl_head;
+static u64 nl_ucast_tail;
+static u64 nl_mcast_tail;
+static u64 nl_dropped;
+static DEFINE_SPINLOCK(nl_queue_lock);
+
+static void nl_flush_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(nl_flush_work, nl_flush_fn);
+
+/* Returns false when the queue is full (the event is counted as dropped). */
+static bool queue_event(u16 type, pid_t pgid, int global_jobid, int value, u64 arg)
 {
+    struct rtmon_nl_event *ev;
+    unsigned long flags;
+
+    spin_lock_irqsave(&nl_queue_lock, flags);
+    if (nl_head - min(nl_ucast_tail, nl_mcast_tail) >= RTMON_NL_QUEUE) {
+        nl_dropped++;
+        spin_unlock_irqrestore(&nl_queue_lock, flags);
+        return false;
+    }
+    ev = &nl_queue[nl_head & (RTMON_NL_QUEUE - 1)];
+    ev->type = type;
+    ev->_rsvd = 0;
+    ev->pgid = pgid;
+    ev->global_jobid = global_jobid;
+    ev->value = value;
+    ev->ts_ns = ktime_get_ns();
+    ev->arg = arg;
+    nl_head++;
+    spin_unlock_irqrestore(&nl_queue_lock, flags);
+
+    queue_delayed_work(rtmon_wq, &nl_flush_work, 0);
+    return true;
+}
+
+/* Build one RTMON_MSG_EVENTS skb from *tail; *nr = 0 when nothing is pending. */
+static struct sk_buff *build_batch(const u64 *tail, u32 *nr)
+{
+    struct rtmon_nl_batch *b;
     struct sk_buff *skb;
     struct nlmsghdr *nlh;
-    int msg_size;
+    unsigned long flags;
+    size_t size;
+    u64 seq;
+    u32 i, n;
 
-    if (!nl_sk)
-        return -ENOTCONN;
-    if (!is_valid_userspace_pid(pid))
-        return -EINVAL;
+    spin_lock_irqsave(&nl_queue_lock, flags);
+    n = min_t(u64, nl_head - *tail, RTMON_NL_BATCH_MAX);
+    spin_unlock_irqrestore(&nl_queue_lock, flags);
 
-    msg_size = strlen(msg) + 1;
+    *nr = n;
+    if (!n)
+        return NULL;
 
-    skb = nlmsg_new(msg_size, GFP_KERNEL);
+    size = sizeof(*b) + n * sizeof(struct rtmon_nl_event);
+    skb = nlmsg_new(size, GFP_KERNEL);
     if (!skb)
-        return -ENOMEM;
-
-    nlh = nlmsg_put(skb, 0, 0, NLMSG_DONE, msg_size, 0);
+        return NULL;
+    nlh = nlmsg_put(skb, 0, 0, RTMON_MSG_EVENTS, size, 0);
     if (!nlh) {
         kfree_skb(skb);
-        return -ENOMEM;
+        return NULL;
     }
 
-    memcpy(nlmsg_data(nlh), msg, msg_size);
+    b = nlmsg_data(nlh);
+    b->version = RTMON_NL_VERSION;
+    b->record_size = sizeof(struct rtmon_nl_event);
+    b->nr_events = n;
+
+    /* [*tail, *tail + n) stays put until this cursor advances */
+    spin_lock_irqsave(&nl_queue_lock, flags);
+    seq = *tail;
+    b->seq = seq;
+    b->dropped = nl_dropped;
+    for (i = 0; i < n; i++)
+        ((struct rtmon_nl_event *)(b + 1))[i] =
+            nl_queue[(seq + i) & (RTMON_NL_QUEUE - 1)];
+    spin_unlock_irqrestore(&nl_queue_lock, flags);
+
+    return skb;
+}
 
-    return netlink_unicast(nl_sk, skb, pid, MSG_DONTWAIT);
+static void advance_tail(u64 *tail, u32 n)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&nl_queue_lock, flags);
+    *tail += n;
+    spin_unlock_irqrestore(&nl_queue_lock, flags);
+}
+
+/*
+ * Multicast is best effort. Unicast to data_loader_pid keeps its events
+ * queued while the socket is full and retries after RTMON_NL_RETRY_MS; a
+ * missing or dead receiver just consumes them.
+ */
+static void nl_flush_fn(struct work_struct *work)
+{
+    int pid = READ_ONCE(data_loader_pid);
+    struct sk_buff *skb;
+    u32 n;
+    int ret;
+
+    unsigned long flags;
+
+    if (!nl_sk)
+        return;
+
+    for (;;) {
+        if (!netlink_has_listeners(nl_sk, RTMON_NL_GROUP_EVENTS)) {
+            spin_lock_irqsave(&nl_queue_lock, flags);
+            nl_mcast_tail = nl_head;
+            spin_unlock_irqrestore(&nl_queue_lock, flags);
+            break;
+        }
+        skb = build_batch(&nl_mcast_tail, &n);
+        if (!skb)
+            break;
+        /* the unicast receiver is excluded, it gets its own copy below */
+        netlink_broadcast(nl_sk, skb, is_valid_userspace_pid(pid) ? pid : 0,
+                          RTMON_NL_GROUP_EVENTS, GFP_KERNEL);
+        advance_tail(&nl_mcast_tail, n);
+    }
+
+    for (;;) {
+        skb = build_batch(&nl_ucast_tail, &n);
+        if (!n)
+            break;
+        if (!skb) {
+            queue_delayed_work(rtmon_wq, &nl_flush_work,
+                               msecs_to_jiffies(RTMON_NL_RETRY_MS));
+            break;
+        }
+        if (!is_valid_userspace_pid(pid)) {
+            kfree_skb(skb);
+            advance_tail(&nl_ucast_tail, n);
+            continue;
+        }
+        ret = netlink_unicast(nl_sk, skb, pid, MSG_DONTWAIT);
+        if (ret == -EAGAIN || ret == -ENOBUFS) {
+            queue_delayed_work(rtmon_wq, &nl_flush_work,
+                               msecs_to_jiffies(RTMON_NL_RETRY_MS));
+            break;
+        }
+        if (ret < 0)
+            pr_debug("rt_monitor: netlink send failed (err=%d)\n", ret);
+        advance_tail(&nl_ucast_tail, n);
+    }
 }
 
 static struct pgid_entry *lookup_entry_locked(pid_t pgid)
@@ -146,82 +455,712 @@ static struct pid *get_pgid_pidref(pid_t pgid)
     return find_get_pid(pgid);
 }
 
-static bool pgid_has_any_task(struct pid *pgid_pid)
+/* A process of the group that has not started exiting (zombies do not count) */
+static bool pgid_has_live_task(struct pid *pgid_pid)
 {
-    return pid_task(pgid_pid, PIDTYPE_PGID) != NULL;
+    struct task_struct *p;
+    bool alive = false;
+
+    rcu_read_lock();
+    do_each_pid_task(pgid_pid, PIDTYPE_PGID, p) {
+        if (atomic_read(&p->signal->live)) {
+            alive = true;
+            goto out;
+        }
+    } while_each_pid_task(pgid_pid, PIDTYPE_PGID, p);
+out:
+    rcu_read_unlock();
+
+    return alive;
 }
 
-/* ---------- ioctl handling ---------- */
+/* Threads of the process group that are running or waiting on a runqueue */
+static int pgid_runnable_threads(struct pid *pgid_pid)
+{
+    struct task_struct *p, *t;
+    int n = 0;
+
+    rcu_read_lock();
+    do_each_pid_task(pgid_pid, PIDTYPE_PGID, p) {
+        for_each_thread(p, t) {
+            if (task_is_running(t))
+                n++;
+        }
+    } while_each_pid_task(pgid_pid, PIDTYPE_PGID, p);
+    rcu_read_unlock();
 
-static long device_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+    return n;
+}
+
+/* Fold one runnable sample into the entry's EWMA. Returns true when the
+ * rounded value (at least 1) differs from the published worker_num, which
+ * is then updated. Caller holds pgid_table_lock.
+ */
+static bool update_worker_num_locked(struct pgid_entry *entry)
 {
-    struct my_pair pair;
-    pid_t pgid;
-    int pid;
+    s64 sample = (s64)pgid_runnable_threads(entry->pgid_pid) << WORKER_EWMA_FRAC;
+    s64 ewma = entry->runnable_ewma;
+    int workers;
+
+    ewma += (sample - ewma) >> WORKER_EWMA_SHIFT;
+    entry->runnable_ewma = (u32)ewma;
+
+    workers = max_t(int, 1, (ewma + (1 << (WORKER_EWMA_FRAC - 1))) >> WORKER_EWMA_FRAC);
+    if (workers == entry->worker_num)
+        return false;
+
+    entry->worker_num = workers;
+    return true;
+}
+
+/* ---------- status table ---------- */
+
+static u32 entry_status_flags(const struct pgid_entry *entry)
+{
+    u32 flags = 0;
+
+    if (entry->is_long_running)
+        flags |= RTMON_ST_LONG_RUNNING;
+    if (entry->profile_done)
+        flags |= RTMON_ST_PROFILE_DONE;
+    if (entry->ipcmon_registered)
+        flags |= RTMON_ST_IPCMON_REGISTERED;
+    if (entry->provisional && !entry->profile_done)
+        flags |= RTMON_ST_PROVISIONAL;
+    if (entry->provisional == 2)
+        flags |= RTMON_ST_SIGNATURE_SENT;
+    if (entry->need_send_request)
+        flags |= RTMON_ST_REQUEST_PENDING;
+    return flags;
+}
+
+/* Write @idx with the seq protocol; @entry NULL frees the record. Caller holds
+ * pgid_table_lock.
+ */
+static void write_status_locked(int idx, const struct pgid_entry *entry)
+{
+    struct rtmon_status_entry *st = &status_mem->entries[idx];
+    u32 s = READ_ONCE(st->seq);
+
+    WRITE_ONCE(st->seq, s + 1);
+    smp_wmb();
+
+    WRITE_ONCE(st->flags, entry ? entry_status_flags(entry) : 0);
+    WRITE_ONCE(st->pgid, entry ? entry->pgid : 0);
+    WRITE_ONCE(st->global_jobid, entry ? entry->global_jobid : 0);
+    WRITE_ONCE(st->worker_num, entry ? entry->worker_num : 0);
+    WRITE_ONCE(st->threshold_sec, entry ? entry->threshold_sec : 0);
+    WRITE_ONCE(st->start_time_ns, entry ? entry->start_time_ns : 0);
+    WRITE_ONCE(st->request_ns, entry ? entry->request_ns : 0);
+    WRITE_ONCE(st->ack_ns, entry ? entry->ack_ns : 0);
+
+    smp_wmb();
+    WRITE_ONCE(st->seq, s + 2);
+    WRITE_ONCE(status_mem->hdr.epoch, status_mem->hdr.epoch + 1);
+}
+
+/* Mirror the entry into its record, taking one on first use. Caller holds
+ * pgid_table_lock.
+ */
+static void publish_status_locked(struct pgid_entry *entry)
+{
+    if (entry->status_idx < 0) {
+        int idx = find_first_zero_bit(status_used, RTMON_STATUS_MAX);
+
+        if (idx >= RTMON_STATUS_MAX) {
+            WRITE_ONCE(status_mem->hdr.overflow, status_mem->hdr.overflow + 1);
+            return;
+        }
+        __set_bit(idx, status_used);
+        entry->status_idx = idx;
+        if (idx >= status_mem->hdr.nr_used)
+            WRITE_ONCE(status_mem->hdr.nr_used, idx + 1);
+    }
+    write_status_locked(entry->status_idx, entry);
+}
+
+/* Free the entry's record when it leaves the hash. Caller holds pgid_table_lock. */
+static void release_status_locked(struct pgid_entry *entry)
+{
+    if (entry->status_idx < 0)
+        return;
+    write_status_locked(entry->status_idx, NULL);
+    __clear_bit(entry->status_idx, status_used);
+    entry->status_idx = -1;
+}
+
+/* ---------- learned runtimes ---------- */
+
+/* Caller holds job_history_lock. */
+static struct job_history *find_job_history_locked(int global_jobid)
+{
+    struct job_history *h;
+
+    hash_for_each_possible(job_history_table, h, hnode, global_jobid) {
+        if (h->global_jobid == global_jobid)
+            return h;
+    }
+    return NULL;
+}
+
+/* Fold one run (or a seed with weight nr_runs) into the job's runtime. */
+static void record_job_runtime(int global_jobid, u64 runtime_sec, u32 nr_runs)
+{
+    struct job_history *h, *fresh;
     unsigned long flags;
+    u32 n;
 
-    if (_IOC_TYPE(cmd) != RTMON_IOC_MAGIC)
-        return -ENOTTY;
-    if (_IOC_NR(cmd) > RTMON_IOC_MAXNR)
-        return -ENOTTY;
+    fresh = kzalloc(sizeof(*fresh), GFP_KERNEL);
 
-    switch (cmd) {
-    case RTMON_IOC_ADD_PGID: {
-        struct pgid_entry *entry;
-        struct pid *pgid_pid;
+    spin_lock_irqsave(&job_history_lock, flags);
+    h = find_job_history_locked(global_jobid);
+    if (!h) {
+        if (!fresh || nr_job_history >= JOB_HISTORY_MAX) {
+            spin_unlock_irqrestore(&job_history_lock, flags);
+            kfree(fresh);
+            return;
+        }
+        h = fresh;
+        fresh = NULL;
+        h->global_jobid = global_jobid;
+        hash_add(job_history_table, &h->hnode, global_jobid);
+        nr_job_history++;
+    }
 
-        if (copy_from_user(&pair, (struct my_pair __user *)arg, sizeof(pair)))
-            return -EFAULT;
+    /* running mean while young, then an EWMA that follows drifting inputs */
+    n = min_t(u32, h->nr_runs, 1U << JOB_HISTORY_EWMA_SHIFT);
+    h->runtime_sec = div_u64(h->runtime_sec * n + runtime_sec * nr_runs, n + nr_runs);
+    h->nr_runs += nr_runs;
+    spin_unlock_irqrestore(&job_history_lock, flags);
 
-        if (pair.pgid <= 0)
-            return -EINVAL;
+    kfree(fresh);
+}
 
-        pgid = (pid_t)pair.pgid;
+static void forget_job_runtime(int global_jobid)
+{
+    struct job_history *h;
+    unsigned long flags;
 
-        pgid_pid = get_pgid_pidref(pgid);
-        if (!pgid_pid)
-            return -ESRCH;
+    spin_lock_irqsave(&job_history_lock, flags);
+    h = find_job_history_locked(global_jobid);
+    if (h) {
+        hash_del(&h->hnode);
+        nr_job_history--;
+    }
+    spin_unlock_irqrestore(&job_history_lock, flags);
+    kfree(h);
+}
 
-        entry = kzalloc(sizeof(*entry), GFP_KERNEL);
-        if (!entry) {
-            put_pid(pgid_pid);
-            return -ENOMEM;
+/*
+ * Elapsed seconds at which the full profiling request is due. The remaining
+ * runtime is predicted as max(learned - elapsed, elapsed); the earliest time
+ * after the grace period where it reaches min_remaining_sec is the grace
+ * period itself for jobs learned to run long, min_remaining_sec otherwise.
+ */
+static u32 request_after_sec(int global_jobid)
+{
+    u32 cap = READ_ONCE(long_running_threshold);
+    u32 grace = READ_ONCE(grace_period_sec);
+    u32 min_rem = READ_ONCE(min_remaining_sec);
+    struct job_history *h;
+    unsigned long flags;
+    u32 t = max(min_rem, grace);
+
+    if (!READ_ONCE(adaptive_threshold))
+        return cap;
+
+    spin_lock_irqsave(&job_history_lock, flags);
+    h = find_job_history_locked(global_jobid);
+    if (h && h->runtime_sec >= (u64)grace + min_rem)
+        t = grace;
+    spin_unlock_irqrestore(&job_history_lock, flags);
+
+    return min(t, cap);
+}
+
+/* ---------- per-entry work ---------- */
+
+static void free_entry(struct pgid_entry *entry)
+{
+    if (entry->pgid_pid)
+        put_pid(entry->pgid_pid);
+    kfree(entry);
+}
+
+/* Run the entry's work after @delay, pulling in a later deadline. Caller holds
+ * pgid_table_lock and has found the entry hashed.
+ */
+static void kick_entry_locked(struct pgid_entry *entry, unsigned long delay)
+{
+    mod_delayed_work(rtmon_wq, &entry->work, delay);
+}
+
+/* Arm the work for the entry's next deadline unless an event already queued
+ * it. Entries waiting only for the ACK or an exit stay idle. Caller holds
+ * pgid_table_lock.
+ */
+static void schedule_entry_locked(struct pgid_entry *entry, u64 now_ns)
+{
+    u64 next_ns = U64_MAX;
+    u32 grace = READ_ONCE(grace_period_sec);
+
+    if (!entry->is_long_running)
+        next_ns = entry->start_time_ns + (u64)entry->threshold_sec * NSEC_PER_SEC;
+    /* provisional registration, then the signature report */
+    if (grace && entry->provisional == 0 && !entry->ipcmon_registered)
+        next_ns = min(next_ns, entry->start_time_ns + (u64)grace * NSEC_PER_SEC);
+    if (entry->provisional == 1 && entry->ipcmon_registered)
+        next_ns = min(next_ns, entry->start_time_ns +
+                               (u64)(grace + READ_ONCE(signature_sec)) * NSEC_PER_SEC);
+    /* notification retry, registration retry, worker sampling */
+    if (entry->need_send_request ||
+        (entry->profile_done && !entry->ipcmon_registered) ||
+        (entry->ipcmon_registered && READ_ONCE(auto_worker_num)))
+        next_ns = min(next_ns, now_ns + (u64)INTERVAL_MS * NSEC_PER_MSEC);
+
+    if (next_ns == U64_MAX)
+        return;
+
+    queue_delayed_work(rtmon_wq, &entry->work,
+                       next_ns > now_ns ? nsecs_to_jiffies(next_ns - now_ns) : 0);
+}
+
+/*
+ * Two phases like the ioctl paths: update state under pgid_table_lock, then
+ * call into IPC_monitor and netlink outside it. An entry that was unhashed by
+ * RTMON_IOC_REMOVE_PGID or module exit is left to that path, which cancels
+ * this work synchronously before freeing it.
+ */
+static void entry_work_fn(struct work_struct *work)
+{
+    struct pgid_entry *entry = container_of(to_delayed_work(work),
+                                            struct pgid_entry, work);
+    bool do_add = false, do_workers = false, do_notify = false, do_signature = false;
+    bool add_failed = false, retry = false;
+    u32 threshold_sec = request_after_sec(entry->global_jobid);
+    u32 grace = READ_ONCE(grace_period_sec);
+    int global_jobid, worker_num, ret;
+    u64 now_ns = ktime_get_ns();
+    u64 elapsed_sec;
+    unsigned long flags;
+    pid_t pgid;
+
+    spin_lock_irqsave(&pgid_table_lock, flags);
+    if (hash_unhashed(&entry->hnode)) {
+        spin_unlock_irqrestore(&pgid_table_lock, flags);
+        return;
+    }
+
+    pgid = entry->pgid;
+
+    if (!entry->pgid_pid || !pgid_has_live_task(entry->pgid_pid)) {
+        bool registered = entry->ipcmon_registered;
+
+        hash_del(&entry->hnode);
+        /*
+         * A kick since this run started may have requeued us; drop it while
+         * the lock still keeps new kicks out (they only reach hashed entries)
+         */
+        cancel_delayed_work(&entry->work);
+        atomic_dec(&nr_entries);
+        release_status_locked(entry);
+        spin_unlock_irqrestore(&pgid_table_lock, flags);
+
+        elapsed_sec = (now_ns - entry->start_time_ns) / NSEC_PER_SEC;
+        pr_info("rt_monitor: Auto-removed PGID %d (no tasks)\n", pgid);
+        queue_event(RTMON_EV_EXITED, pgid, entry->global_jobid, entry->worker_num,
+                    elapsed_sec);
+        record_job_runtime(entry->global_jobid, elapsed_sec, 1);
+        if (registered) {
+            ret = ipcmon_remove_pgid(pgid);
+            if (ret < 0)
+                pr_warn("rt_monitor: ipcmon_remove_pgid(%d) failed (err=%d)\n",
+                        pgid, ret);
         }
+        free_entry(entry);
+        return;
+    }
 
-        INIT_LIST_HEAD(&entry->gc_node);
-        entry->pgid = pgid;
-        entry->pgid_pid = pgid_pid;
-        entry->start_time_ns = ktime_get_ns();
+    elapsed_sec = (now_ns - entry->start_time_ns) / NSEC_PER_SEC;
+    entry->threshold_sec = threshold_sec;
 
+    /* threshold exceeded: only send request (no IPC registration yet) */
+    if (!entry->is_long_running && elapsed_sec >= threshold_sec) {
+        entry->is_long_running = 1;
         entry->need_send_request = 1;
-        entry->is_long_running = 0;
+    }
+
+    /*
+     * ACK-gated registration: Only register with IPC_monitor after
+     * userspace sends ACK (profile_done=1), or provisionally once the
+     * grace period is over.
+     */
+    if (!entry->ipcmon_registered &&
+        ((entry->is_long_running && entry->profile_done) ||
+         (grace && entry->provisional == 0 && elapsed_sec >= grace))) {
+        do_add = true;
+        if (!entry->profile_done)
+            entry->provisional = 1;
+        /* optimistic mark; rolled back below on add failure */
+        entry->ipcmon_registered = 1;
+    } else if (entry->provisional == 1 && entry->ipcmon_registered &&
+               elapsed_sec >= (u64)grace + READ_ONCE(signature_sec)) {
+        do_signature = true;
+        entry->provisional = 2;
+    } else if (entry->ipcmon_registered && READ_ONCE(auto_worker_num)) {
+        /* Keep worker_num current while the group has a slot */
+        do_workers = update_worker_num_locked(entry);
+    }
 
-        entry->profile_done = 0;        /* not yet profiled */
-        entry->ipcmon_registered = 0;   /* not registered yet */
+    if (entry->need_send_request) {
+        do_notify = true;
+        entry->need_send_request = 0;
+    }
 
-        entry->global_jobid = pair.global_jobid;
-        entry->worker_num = pair.worker_num;
+    global_jobid = entry->global_jobid;
+    worker_num = entry->worker_num;
+    spin_unlock_irqrestore(&pgid_table_lock, flags);
 
-        spin_lock_irqsave(&pgid_table_lock, flags);
-        if (lookup_entry_locked(pgid)) {
-            spin_unlock_irqrestore(&pgid_table_lock, flags);
-            put_pid(pgid_pid);
-            kfree(entry);
-            return -EEXIST;
+    if (do_add) {
+        ret = ipcmon_add_pgid(pgid, global_jobid, worker_num);
+        if (ret < 0 && ret != -EEXIST) {
+            pr_warn("rt_monitor: ipcmon_add_pgid(%d) failed (err=%d)\n", pgid, ret);
+            add_failed = true;
         }
-        hash_add(pgid_table, &entry->hnode, entry->pgid);
+        /* -EEXIST: already registered, keep ipcmon_registered=1 */
+    } else if (do_workers) {
+        ret = ipcmon_set_worker_num(pgid, worker_num);
+        if (ret < 0)
+            pr_debug("rt_monitor: ipcmon_set_worker_num(%d, %d) failed (err=%d)\n",
+                     pgid, worker_num, ret);
+    }
+
+    /* Netlink notifications (profiling request, worker count) */
+    if (do_notify)
+        retry = !queue_event(RTMON_EV_LONG_RUNNING, pgid, global_jobid,
+                             worker_num, elapsed_sec);
+    if (do_workers)
+        queue_event(RTMON_EV_WORKERS, pgid, global_jobid, worker_num, 0);
+    if (do_signature)
+        queue_event(RTMON_EV_PROVISIONAL, pgid, global_jobid, worker_num, elapsed_sec);
+
+    spin_lock_irqsave(&pgid_table_lock, flags);
+    if (!hash_unhashed(&entry->hnode)) {
+        if (add_failed)
+            entry->ipcmon_registered = 0;
+        if (retry)
+            entry->need_send_request = 1;
+        else if (do_notify)
+            entry->request_ns = now_ns;
+        publish_status_locked(entry);
+        schedule_entry_locked(entry, ktime_get_ns());
+    }
+    spin_unlock_irqrestore(&pgid_table_lock, flags);
+}
+
+/* ---------- tracking ---------- */
+
+static int track_pgid(pid_t pgid, int global_jobid, int worker_num, const char *how)
+{
+    struct pgid_entry *entry;
+    struct pid *pgid_pid;
+    unsigned long flags;
+
+    pgid_pid = get_pgid_pidref(pgid);
+    if (!pgid_pid)
+        return -ESRCH;
+
+    entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+    if (!entry) {
+        put_pid(pgid_pid);
+        return -ENOMEM;
+    }
+
+    INIT_LIST_HEAD(&entry->gc_node);
+    INIT_DELAYED_WORK(&entry->work, entry_work_fn);
+    entry->pgid = pgid;
+    entry->pgid_pid = pgid_pid;
+    entry->start_time_ns = ktime_get_ns();
+
+    entry->need_send_request = 1;
+    entry->is_long_running = 0;
+
+    entry->profile_done = 0;        /* not yet profiled */
+    entry->ipcmon_registered = 0;   /* not registered yet */
+    entry->provisional = 0;
+    entry->threshold_sec = request_after_sec(global_jobid);
+
+    entry->global_jobid = global_jobid;
+    entry->worker_num = worker_num;
+    entry->runnable_ewma = (u32)max(worker_num, 0) << WORKER_EWMA_FRAC;
+    entry->status_idx = -1;
+
+    spin_lock_irqsave(&pgid_table_lock, flags);
+    if (lookup_entry_locked(pgid)) {
         spin_unlock_irqrestore(&pgid_table_lock, flags);
+        put_pid(pgid_pid);
+        kfree(entry);
+        return -EEXIST;
+    }
+    hash_add(pgid_table, &entry->hnode, entry->pgid);
+    atomic_inc(&nr_entries);
+    publish_status_locked(entry);
+    schedule_entry_locked(entry, entry->start_time_ns);
+    spin_unlock_irqrestore(&pgid_table_lock, flags);
 
-        pr_info("rt_monitor: Added PGID %d via ioctl (job=%d worker=%d)\n",
-                pgid, entry->global_jobid, entry->worker_num);
-        return 0;
+    pr_info("rt_monitor: Added PGID %d via %s (job=%d worker=%d)\n",
+            pgid, how, global_jobid, worker_num);
+    return 0;
+}
+
+/* ---------- match rules ---------- */
+
+static const char *rule_kind_name(u32 kind)
+{
+    switch (kind) {
+    case RTMON_RULE_CGROUP: return "cgroup";
+    case RTMON_RULE_EXE:    return "exe";
+    default:                return "comm";
     }
+}
+
+static u64 rule_key(u32 kind, u64 cgid, const char *pattern)
+{
+    if (kind == RTMON_RULE_CGROUP)
+        return cgid;
+    return jhash(pattern, strlen(pattern), kind);
+}
+
+/* Caller holds rule_lock or rcu_read_lock(). */
+static struct match_rule *find_rule(u32 kind, u64 key, const char *pattern)
+{
+    struct match_rule *r;
+
+    hash_for_each_possible_rcu(rule_table, r, hnode, key) {
+        if (r->kind == kind && r->key == key &&
+            (kind == RTMON_RULE_CGROUP || strcmp(r->pattern, pattern) == 0))
+            return r;
+    }
+    return NULL;
+}
+
+static int check_rule(struct rtmon_rule *u)
+{
+    size_t len;
+
+    u->pattern[RTMON_RULE_PATTERN_MAX - 1] = '\0';
+    len = strlen(u->pattern);
+
+    switch (u->kind) {
+    case RTMON_RULE_CGROUP:
+        return u->cgid ? 0 : -EINVAL;
+    case RTMON_RULE_EXE:
+        return (len && u->pattern[0] == '/') ? 0 : -EINVAL;
+    case RTMON_RULE_COMM:
+        return (len && len < TASK_COMM_LEN) ? 0 : -EINVAL;
+    default:
+        return -EINVAL;
+    }
+}
+
+static int add_rule(const struct rtmon_rule *u)
+{
+    struct match_rule *r;
+    unsigned long flags;
+
+    r = kzalloc(sizeof(*r), GFP_KERNEL);
+    if (!r)
+        return -ENOMEM;
+
+    r->kind = u->kind;
+    r->global_jobid = u->global_jobid;
+    r->worker_num = u->worker_num > 0 ? u->worker_num : 1;
+    if (u->kind != RTMON_RULE_CGROUP)
+        strscpy(r->pattern, u->pattern, sizeof(r->pattern));
+    r->key = rule_key(r->kind, u->cgid, r->pattern);
+
+    spin_lock_irqsave(&rule_lock, flags);
+    if (find_rule(r->kind, r->key, r->pattern)) {
+        spin_unlock_irqrestore(&rule_lock, flags);
+        kfree(r);
+        return -EEXIST;
+    }
+    hash_add_rcu(rule_table, &r->hnode, r->key);
+    atomic_inc(&nr_rules[r->kind]);
+    atomic_inc(&nr_rules[0]);
+    spin_unlock_irqrestore(&rule_lock, flags);
+
+    if (r->kind == RTMON_RULE_CGROUP)
+        pr_info("rt_monitor: rule cgroup %llu -> job %d\n",
+                (unsigned long long)r->key, r->global_jobid);
+    else
+        pr_info("rt_monitor: rule %s '%s' -> job %d\n",
+                rule_kind_name(r->kind), r->pattern, r->global_jobid);
+    return 0;
+}
+
+static int del_rule(const struct rtmon_rule *u)
+{
+    struct match_rule *r;
+    unsigned long flags;
+    u64 key = rule_key(u->kind, u->cgid, u->pattern);
+
+    spin_lock_irqsave(&rule_lock, flags);
+    r = find_rule(u->kind, key, u->pattern);
+    if (r) {
+        hash_del_rcu(&r->hnode);
+        atomic_dec(&nr_rules[r->kind]);
+        atomic_dec(&nr_rules[0]);
+    }
+    spin_unlock_irqrestore(&rule_lock, flags);
+
+    if (!r)
+        return -ENOENT;
+    kfree_rcu(r, rcu);
+    return 0;
+}
+
+/*
+ * Closest cgroup rule first (the task's cgroup, then its ancestors), then the
+ * exe path, then comm. Runs in the exec tracepoint under rcu_read_lock().
+ */
+static struct match_rule *match_exec(struct task_struct *p, struct linux_binprm *bprm)
+{
+    struct match_rule *r = NULL;
+
+#ifdef CONFIG_CGROUPS
+    if (atomic_read(&nr_rules[RTMON_RULE_CGROUP])) {
+        struct cgroup *cgrp;
+
+        for (cgrp = task_dfl_cgroup(p); cgrp; cgrp = cgroup_parent(cgrp)) {
+            r = find_rule(RTMON_RULE_CGROUP, cgroup_id(cgrp), NULL);
+            if (r)
+                return r;
+        }
+    }
+#endif
+
+    if (atomic_read(&nr_rules[RTMON_RULE_EXE]) && bprm && bprm->file) {
+        char *path = d_path(&bprm->file->f_path, get_cpu_var(exe_path_buf),
+                            RTMON_RULE_PATTERN_MAX);
+
+        if (!IS_ERR(path))
+            r = find_rule(RTMON_RULE_EXE, rule_key(RTMON_RULE_EXE, 0, path), path);
+        put_cpu_var(exe_path_buf);
+        if (r)
+            return r;
+    }
+
+    if (atomic_read(&nr_rules[RTMON_RULE_COMM])) {
+        char comm[TASK_COMM_LEN];
+
+        get_task_comm(comm, p);
+        r = find_rule(RTMON_RULE_COMM, rule_key(RTMON_RULE_COMM, 0, comm), comm);
+    }
+    return r;
+}
+
+static void tracepoint_sched_exec_handler(void *data, struct task_struct *p,
+                                          pid_t old_pid, struct linux_binprm *bprm)
+{
+    struct exec_match *m;
+    struct match_rule *r;
+    int global_jobid = 0, worker_num = 0;
+    unsigned long flags;
+    bool tracked;
+    u32 kind = 0;
+    pid_t pgid;
+
+    if (!atomic_read(&nr_rules[0]))
+        return;
+
+    rcu_read_lock();
+    pgid = pid_nr(task_pgrp(p));
+    rcu_read_unlock();
+    if (pgid <= 0)
+        return;
+
+    spin_lock_irqsave(&pgid_table_lock, flags);
+    tracked = lookup_entry_locked(pgid) != NULL;
+    spin_unlock_irqrestore(&pgid_table_lock, flags);
+    if (tracked)
+        return;
+
+    rcu_read_lock();
+    r = match_exec(p, bprm);
+    if (r) {
+        global_jobid = r->global_jobid;
+        worker_num = r->worker_num;
+        kind = r->kind;
+    }
+    rcu_read_unlock();
+    if (!r)
+        return;
+
+    m = kmalloc(sizeof(*m), GFP_ATOMIC);
+    if (!m)
+        return;
+    m->pgid = pgid;
+    m->global_jobid = global_jobid;
+    m->worker_num = worker_num;
+    m->kind = kind;
+
+    spin_lock_irqsave(&exec_match_lock, flags);
+    list_add_tail(&m->node, &exec_matches);
+    spin_unlock_irqrestore(&exec_match_lock, flags);
+    queue_work(rtmon_wq, &exec_reg_work);
+}
+
+static void exec_reg_fn(struct work_struct *work)
+{
+    struct exec_match *m, *tmp;
+    unsigned long flags;
+    LIST_HEAD(batch);
+
+    spin_lock_irqsave(&exec_match_lock, flags);
+    list_splice_init(&exec_matches, &batch);
+    spin_unlock_irqrestore(&exec_match_lock, flags);
+
+    list_for_each_entry_safe(m, tmp, &batch, node) {
+        char how[16];
+        int ret;
+
+        snprintf(how, sizeof(how), "%s rule", rule_kind_name(m->kind));
+        ret = track_pgid(m->pgid, m->global_jobid, m->worker_num, how);
+        if (ret < 0 && ret != -EEXIST)
+            pr_debug("rt_monitor: auto-registration of PGID %d failed (err=%d)\n",
+                     m->pgid, ret);
+        list_del(&m->node);
+        kfree(m);
+    }
+}
+
+/* ---------- ioctl handling ---------- */
+
+static long device_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct my_pair pair;
+    pid_t pgid;
+    int pid;
+    unsigned long flags;
+
+    if (_IOC_TYPE(cmd) != RTMON_IOC_MAGIC)
+        return -ENOTTY;
+    if (_IOC_NR(cmd) > RTMON_IOC_MAXNR)
+        return -ENOTTY;
+
+    switch (cmd) {
+    case RTMON_IOC_ADD_PGID:
+        if (copy_from_user(&pair, (struct my_pair __user *)arg, sizeof(pair)))
+            return -EFAULT;
+
+        if (pair.pgid <= 0)
+            return -EINVAL;
+
+        return track_pgid((pid_t)pair.pgid, pair.global_jobid, pair.worker_num, "ioctl");
 
     case RTMON_IOC_REMOVE_PGID: {
         struct pgid_entry *entry;
-        int ipcmon_registered;
-        int worker_pgid;
-        LIST_HEAD(to_free);
 
         if (copy_from_user(&pgid, (int __user *)arg, sizeof(pgid)))
             return -EFAULT;
@@ -234,35 +1173,29 @@ static long device_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
             spin_unlock_irqrestore(&pgid_table_lock, flags);
             return -ENOENT;
         }
-
-        ipcmon_registered = entry->ipcmon_registered;
-        worker_pgid = entry->pgid;
-
         hash_del(&entry->hnode);
-        list_add(&entry->gc_node, &to_free);
+        atomic_dec(&nr_entries);
+        release_status_locked(entry);
         spin_unlock_irqrestore(&pgid_table_lock, flags);
 
-        if (ipcmon_registered) {
-            int ret = ipcmon_remove_pgid(worker_pgid);
+        /* Unhashed: a running work returns without re-arming, so ipcmon_registered is final */
+        cancel_delayed_work_sync(&entry->work);
+
+        if (entry->ipcmon_registered) {
+            int ret = ipcmon_remove_pgid(entry->pgid);
             if (ret < 0)
                 pr_warn("rt_monitor: ipcmon_remove_pgid(%d) failed (err=%d)\n",
-                        worker_pgid, ret);
-        }
-
-        while (!list_empty(&to_free)) {
-            entry = list_first_entry(&to_free, struct pgid_entry, gc_node);
-            list_del(&entry->gc_node);
-            if (entry->pgid_pid)
-                put_pid(entry->pgid_pid);
-            kfree(entry);
+                        entry->pgid, ret);
         }
+        free_entry(entry);
 
         pr_info("rt_monitor: Removed PGID %d via ioctl\n", pgid);
         return 0;
     }
 
     case RTMON_IOC_SET_THRESHOLD: {
-        int new_thresh;
+        struct pgid_entry *entry;
+        int new_thresh, bkt;
 
         if (copy_from_user(&new_thresh, (int __user *)arg, sizeof(new_thresh)))
             return -EFAULT;
@@ -273,6 +1206,15 @@ static long device_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
         pr_info("rt_monitor: threshold %d sec -> %d sec\n",
                 READ_ONCE(long_running_threshold), new_thresh);
         WRITE_ONCE(long_running_threshold, new_thresh);
+        WRITE_ONCE(status_mem->hdr.long_running_threshold, new_thresh);
+
+        /* Re-key pending threshold deadlines; each work re-arms itself */
+        spin_lock_irqsave(&pgid_table_lock, flags);
+        hash_for_each(pgid_table, bkt, entry, hnode) {
+            if (!entry->is_long_running)
+                kick_entry_locked(entry, 0);
+        }
+        spin_unlock_irqrestore(&pgid_table_lock, flags);
         return 0;
     }
 
@@ -307,246 +1249,172 @@ static long device_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 
         spin_lock_irqsave(&pgid_table_lock, flags);
         entry = lookup_entry_locked(pgid);
-        if (entry)
+        if (entry) {
             entry->need_send_request = 1;
+            publish_status_locked(entry);
+            kick_entry_locked(entry, 0);
+        }
         spin_unlock_irqrestore(&pgid_table_lock, flags);
 
         return entry ? 0 : -ENOENT;
     }
 
-    default:
-        return -ENOTTY;
-    }
-}
+    case RTMON_IOC_ADD_RULE:
+    case RTMON_IOC_DEL_RULE: {
+        struct rtmon_rule *rule;
+        int ret;
 
-static const struct file_operations fops = {
-    .owner          = THIS_MODULE,
-    .unlocked_ioctl = device_ioctl,
-};
+        rule = memdup_user((void __user *)arg, sizeof(*rule));
+        if (IS_ERR(rule))
+            return PTR_ERR(rule);
 
-/* ---------- timer callback (two-phase) ---------- */
+        ret = check_rule(rule);
+        if (!ret)
+            ret = cmd == RTMON_IOC_ADD_RULE ? add_rule(rule) : del_rule(rule);
+        kfree(rule);
+        return ret;
+    }
 
-struct pending_notify {
-    pid_t pgid;
-    u64 elapsed_sec;
-    int global_jobid;
-    struct list_head node;
-};
+    case RTMON_IOC_SET_JOB_RUNTIME: {
+        struct rtmon_job_runtime jr;
 
-struct pending_ipc {
-    pid_t pgid;
-    int global_jobid;
-    int worker_num;
-    bool do_add; /* true: add, false: remove */
-    struct list_head node;
-};
+        if (copy_from_user(&jr, (void __user *)arg, sizeof(jr)))
+            return -EFAULT;
 
-static void free_entry_list(struct list_head *to_free)
-{
-    struct pgid_entry *entry;
+        if (jr.nr_runs)
+            record_job_runtime(jr.global_jobid, jr.runtime_sec, jr.nr_runs);
+        else
+            forget_job_runtime(jr.global_jobid);
+        return 0;
+    }
 
-    while (!list_empty(to_free)) {
-        entry = list_first_entry(to_free, struct pgid_entry, gc_node);
-        list_del(&entry->gc_node);
-        if (entry->pgid_pid)
-            put_pid(entry->pgid_pid);
-        kfree(entry);
+    default:
+        return -ENOTTY;
     }
 }
 
-static void monitor_callback(struct timer_list *t)
+/* Read-only: any page-aligned prefix of the status table, like IPC_monitor */
+static int device_mmap(struct file *file, struct vm_area_struct *vma)
 {
-    unsigned long flags;
-    int bkt;
-    struct pgid_entry *entry;
-    struct hlist_node *tmp;
-
-    LIST_HEAD(to_free);
-    LIST_HEAD(to_notify);
-    LIST_HEAD(to_ipc);
+    unsigned long vma_size = vma->vm_end - vma->vm_start;
 
-    u64 now_ns = ktime_get_ns();
-
-    /* Phase 1: scan/update state under lock and build action lists. */
-    spin_lock_irqsave(&pgid_table_lock, flags);
-
-    hash_for_each_safe(pgid_table, bkt, tmp, entry, hnode) {
-        u64 elapsed_sec;
-        bool alive;
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    if (vma->vm_pgoff != 0 || vma_size > PAGE_ALIGN(sizeof(*status_mem)))
+        return -EINVAL;
 
-        if (!entry->pgid_pid) {
-            hash_del(&entry->hnode);
-            list_add(&entry->gc_node, &to_free);
-            continue;
-        }
+    vm_flags_clear(vma, VM_MAYWRITE);
+    vm_flags_set(vma, VM_DONTEXPAND | VM_DONTDUMP);
+    return remap_vmalloc_range(vma, status_mem, 0);
+}
 
-        alive = pgid_has_any_task(entry->pgid_pid);
-        if (!alive) {
-            pr_info("rt_monitor: Auto-removed PGID %d (no tasks)\n", entry->pgid);
-
-            /* If registered in IPC_monitor, remove it (defer to phase2). */
-            if (entry->ipcmon_registered) {
-                struct pending_ipc *p = kzalloc(sizeof(*p), GFP_ATOMIC);
-                if (p) {
-                    p->pgid = entry->pgid;
-                    p->do_add = false;
-                    list_add(&p->node, &to_ipc);
-                }
-            }
-
-            hash_del(&entry->hnode);
-            list_add(&entry->gc_node, &to_free);
-            continue;
-        }
+static const struct file_operations fops = {
+    .owner          = THIS_MODULE,
+    .unlocked_ioctl = device_ioctl,
+    .mmap           = device_mmap,
+};
 
-        elapsed_sec = (now_ns - entry->start_time_ns) / NSEC_PER_SEC;
+/* ---------- process exit events ---------- */
 
-        /* threshold exceeded: only send request (no IPC registration yet) */
-        if (!entry->is_long_running && elapsed_sec >= (u64)READ_ONCE(long_running_threshold)) {
-            entry->is_long_running = 1;
-            entry->need_send_request = 1;
-        }
+/*
+ * sched_process_exit runs after the exiting thread dropped signal->live, so a
+ * zero count means the whole process is gone. Kick its group's entry; the work
+ * decides whether another live process still holds the group.
+ */
+static void tracepoint_sched_exit_handler(void *data, struct task_struct *p)
+{
+    struct pgid_entry *entry;
+    unsigned long flags;
+    pid_t pgid;
 
-        /*
-         * ACK-gated registration: Only register with IPC_monitor after
-         * userspace sends ACK (profile_done=1). Actual registration
-         * happens in phase 2.
-         */
-        if (entry->is_long_running && entry->profile_done && !entry->ipcmon_registered) {
-            struct pending_ipc *p = kzalloc(sizeof(*p), GFP_ATOMIC);
-            if (p) {
-                p->pgid = entry->pgid;
-                p->global_jobid = entry->global_jobid;
-                p->worker_num = entry->worker_num;
-                p->do_add = true;
-                list_add(&p->node, &to_ipc);
-
-                /* optimistic mark; rollback in phase2 on add failure */
-                entry->ipcmon_registered = 1;
-            }
-        }
+    if (!atomic_read(&nr_entries))
+        return;
+    if (atomic_read(&p->signal->live))
+        return;
 
-        if (entry->need_send_request) {
-            struct pending_notify *n = kzalloc(sizeof(*n), GFP_ATOMIC);
-            if (n) {
-                n->pgid = entry->pgid;
-                n->elapsed_sec = elapsed_sec;
-                n->global_jobid = entry->global_jobid;
-                list_add(&n->node, &to_notify);
-                entry->need_send_request = 0;
-            }
-        }
-    }
+    rcu_read_lock();
+    pgid = pid_nr(task_pgrp(p));
+    rcu_read_unlock();
+    if (pgid <= 0)
+        return;
 
+    spin_lock_irqsave(&pgid_table_lock, flags);
+    entry = lookup_entry_locked(pgid);
+    if (entry)
+        kick_entry_locked(entry, 0);
     spin_unlock_irqrestore(&pgid_table_lock, flags);
+}
 
-    /* Phase 2: perform actions outside lock. */
-
-    /* IPC_monitor actions */
-    while (!list_empty(&to_ipc)) {
-        struct pending_ipc *p = list_first_entry(&to_ipc, struct pending_ipc, node);
-        int ret;
-
-        list_del(&p->node);
-
-        if (p->do_add) {
-            ret = ipcmon_add_pgid(p->pgid, p->global_jobid, p->worker_num);
-            if (ret < 0 && ret != -EEXIST) {
-                pr_warn("rt_monitor: ipcmon_add_pgid(%d) failed (err=%d)\n",
-                        p->pgid, ret);
-
-                /* Roll back optimistic mark */
-                spin_lock_irqsave(&pgid_table_lock, flags);
-                entry = lookup_entry_locked(p->pgid);
-                if (entry)
-                    entry->ipcmon_registered = 0;
-                spin_unlock_irqrestore(&pgid_table_lock, flags);
-            }
-            /* -EEXIST: already registered, keep ipcmon_registered=1 */
-        } else {
-            ret = ipcmon_remove_pgid(p->pgid);
-            if (ret < 0)
-                pr_warn("rt_monitor: ipcmon_remove_pgid(%d) failed (err=%d)\n",
-                        p->pgid, ret);
-        }
-
-        kfree(p);
-    }
-
-    /* Netlink notifications (profiling request) */
-    while (!list_empty(&to_notify)) {
-        struct pending_notify *n = list_first_entry(&to_notify, struct pending_notify, node);
-        char buf[128];
-        int ret;
-
-        list_del(&n->node);
-
-        snprintf(buf, sizeof(buf), "%d,%llu,%d",
-                 n->pgid, (unsigned long long)n->elapsed_sec, n->global_jobid);
-
-        ret = send_to_user(buf, READ_ONCE(data_loader_pid));
-        if (ret < 0) {
-            pr_debug("rt_monitor: netlink send failed (err=%d)\n", ret);
-
-            if (ret == -EAGAIN || ret == -ENOBUFS) {
-                spin_lock_irqsave(&pgid_table_lock, flags);
-                entry = lookup_entry_locked(n->pgid);
-                if (entry)
-                    entry->need_send_request = 1;
-                spin_unlock_irqrestore(&pgid_table_lock, flags);
-            }
-        }
-
-        kfree(n);
-    }
-
-    /* Free removed entries */
-    free_entry_list(&to_free);
-
-    /* Reschedule timer */
-    mod_timer(&monitor_timer, jiffies + msecs_to_jiffies(INTERVAL_MS));
+static void find_tracepoints(struct tracepoint *tp, void *priv)
+{
+    if (tp && tp->name && strcmp(tp->name, "sched_process_exit") == 0)
+        sched_exit_tracepoint = tp;
+    if (tp && tp->name && strcmp(tp->name, "sched_process_exec") == 0)
+        sched_exec_tracepoint = tp;
 }
 
 /* ---------- netlink receive: userspace ACK (profiling done) ---------- */
 
-static void nl_recv_msg(struct sk_buff *skb)
+static void profile_ack(pid_t pgid)
 {
-    struct nlmsghdr *nlh;
-    pid_t pgid;
-    unsigned long flags;
     struct pgid_entry *entry;
+    unsigned long flags;
+    int global_jobid = 0, worker_num = 0;
 
-    pr_info("rt_monitor: nl_recv_msg called\n");
-
-    if (!skb)
-        return;
-
-    nlh = (struct nlmsghdr *)skb->data;
-    if (!nlh)
-        return;
-
-    if (nlmsg_len(nlh) < sizeof(int))
-        return;
-
-    pgid = *(int *)nlmsg_data(nlh);
     if (pgid <= 0)
         return;
 
     /*
      * ACK-gated registration: This is the profiling completion ACK.
      * We don't call ipcmon_add directly here.
-     * The timer callback will see profile_done=1 and register in phase 2.
+     * The entry's work will see profile_done=1 and register.
      */
     spin_lock_irqsave(&pgid_table_lock, flags);
     entry = lookup_entry_locked(pgid);
     if (entry) {
         entry->profile_done = 1;
         entry->is_long_running = 1;
-
-        /* Debug log (can be removed if not needed) */
-        pr_info("rt_monitor: profiling done ACK received for PGID %d\n", pgid);
+        entry->ack_ns = ktime_get_ns();
+        publish_status_locked(entry);
+        kick_entry_locked(entry, 0);
+        global_jobid = entry->global_jobid;
+        worker_num = entry->worker_num;
     }
     spin_unlock_irqrestore(&pgid_table_lock, flags);
+
+    if (entry) {
+        pr_debug("rt_monitor: profiling done ACK received for PGID %d\n", pgid);
+        queue_event(RTMON_EV_PROFILE_ACK, pgid, global_jobid, worker_num, 0);
+    }
+}
+
+/* RTMON_MSG_ACK batches, or a bare pgid from older senders; see rtmon_netlink.h */
+static void nl_recv_msg(struct sk_buff *skb)
+{
+    struct nlmsghdr *nlh;
+    int remaining;
+
+    if (!skb)
+        return;
+
+    remaining = skb->len;
+    for (nlh = nlmsg_hdr(skb); nlmsg_ok(nlh, remaining); nlh = nlmsg_next(nlh, &remaining)) {
+        if (nlh->nlmsg_type == RTMON_MSG_ACK) {
+            const struct rtmon_nl_batch *b = nlmsg_data(nlh);
+            const u8 *rec = (const u8 *)(b + 1);
+            u32 i, nr;
+
+            if (nlmsg_len(nlh) < (int)sizeof(*b) || b->version != RTMON_NL_VERSION ||
+                b->record_size < sizeof(__s32))
+                continue;
+            nr = min_t(u32, b->nr_events,
+                       (nlmsg_len(nlh) - sizeof(*b)) / b->record_size);
+            for (i = 0; i < nr; i++, rec += b->record_size)
+                profile_ack(*(const __s32 *)rec);
+        } else if (nlmsg_len(nlh) >= (int)sizeof(int)) {
+            profile_ack(*(int *)nlmsg_data(nlh));
+        }
+    }
 }
 
 /* ---------- module init/exit ---------- */
@@ -554,12 +1422,36 @@ static void nl_recv_msg(struct sk_buff *skb)
 static int __init monitor_init(void)
 {
     struct netlink_kernel_cfg cfg = {
+        .groups = RTMON_NL_GROUPS,
         .input = nl_recv_msg,
     };
+    int ret;
+
+    BUILD_BUG_ON(sizeof(struct rtmon_status_header) > RTMON_STATUS_HDR_SIZE);
+    BUILD_BUG_ON(sizeof(struct rtmon_status_entry) != 64);
+    status_mem = vmalloc_user(sizeof(*status_mem));
+    if (!status_mem)
+        return -ENOMEM;
+    status_mem->hdr.magic = RTMON_STATUS_MAGIC;
+    status_mem->hdr.version = RTMON_STATUS_VERSION;
+    status_mem->hdr.header_size = RTMON_STATUS_HDR_SIZE;
+    status_mem->hdr.entry_size = sizeof(struct rtmon_status_entry);
+    status_mem->hdr.max_entries = RTMON_STATUS_MAX;
+    status_mem->hdr.total_size = sizeof(*status_mem);
+    status_mem->hdr.entries_off = offsetof(struct rtmon_status, entries);
+    status_mem->hdr.long_running_threshold = long_running_threshold;
+
+    rtmon_wq = alloc_workqueue("rtmon", WQ_UNBOUND, 0);
+    if (!rtmon_wq) {
+        vfree(status_mem);
+        return -ENOMEM;
+    }
 
     major_number = register_chrdev(0, DEVICE_NAME, &fops);
     if (major_number < 0) {
         pr_err("rt_monitor: failed to register chrdev\n");
+        destroy_workqueue(rtmon_wq);
+        vfree(status_mem);
         return major_number;
     }
 
@@ -567,6 +1459,8 @@ static int __init monitor_init(void)
     if (IS_ERR(rtmon_class)) {
         pr_err("rt_monitor: failed to create class\n");
         unregister_chrdev(major_number, DEVICE_NAME);
+        destroy_workqueue(rtmon_wq);
+        vfree(status_mem);
         return PTR_ERR(rtmon_class);
     }
 
@@ -575,6 +1469,8 @@ static int __init monitor_init(void)
         pr_err("rt_monitor: failed to create device\n");
         class_destroy(rtmon_class);
         unregister_chrdev(major_number, DEVICE_NAME);
+        destroy_workqueue(rtmon_wq);
+        vfree(status_mem);
         return PTR_ERR(rtmon_device);
     }
 
@@ -584,15 +1480,58 @@ static int __init monitor_init(void)
         device_destroy(rtmon_class, MKDEV(major_number, 0));
         class_destroy(rtmon_class);
         unregister_chrdev(major_number, DEVICE_NAME);
+        destroy_workqueue(rtmon_wq);
+        vfree(status_mem);
         return -ENOMEM;
     }
 
-    timer_setup(&monitor_timer, monitor_callback, 0);
-    mod_timer(&monitor_timer, jiffies + msecs_to_jiffies(INTERVAL_MS));
+    /* sched_process_exit removes dead groups */
+    for_each_kernel_tracepoint(find_tracepoints, NULL);
+    if (!sched_exit_tracepoint) {
+        pr_err("rt_monitor: sched_process_exit tracepoint not found\n");
+        ret = -ENOENT;
+        goto fail_netlink;
+    }
+    ret = tracepoint_probe_register(sched_exit_tracepoint,
+                                    tracepoint_sched_exit_handler, NULL);
+    if (ret < 0) {
+        pr_err("rt_monitor: Failed to register exit tracepoint (err=%d)\n", ret);
+        goto fail_netlink;
+    }
+    sched_exit_registered = true;
+
+    /* sched_process_exec applies the match rules */
+    if (!sched_exec_tracepoint) {
+        pr_err("rt_monitor: sched_process_exec tracepoint not found\n");
+        ret = -ENOENT;
+        goto fail_tracepoints;
+    }
+    ret = tracepoint_probe_register(sched_exec_tracepoint,
+                                    tracepoint_sched_exec_handler, NULL);
+    if (ret < 0) {
+        pr_err("rt_monitor: Failed to register exec tracepoint (err=%d)\n", ret);
+        goto fail_tracepoints;
+    }
+    sched_exec_registered = true;
 
     pr_info("rt_monitor: loaded (/dev/%s), threshold=%d sec\n",
             DEVICE_NAME, long_running_threshold);
     return 0;
+
+fail_tracepoints:
+    tracepoint_probe_unregister(sched_exit_tracepoint,
+                                tracepoint_sched_exit_handler, NULL);
+    tracepoint_synchronize_unregister();
+    sched_exit_registered = false;
+fail_netlink:
+    netlink_kernel_release(nl_sk);
+    nl_sk = NULL;
+    device_destroy(rtmon_class, MKDEV(major_number, 0));
+    class_destroy(rtmon_class);
+    unregister_chrdev(major_number, DEVICE_NAME);
+    destroy_workqueue(rtmon_wq);
+    vfree(status_mem);
+    return ret;
 }
 
 static void __exit monitor_exit(void)
@@ -600,51 +1539,78 @@ static void __exit monitor_exit(void)
     unsigned long flags;
     int bkt;
     struct pgid_entry *entry;
+    struct exec_match *m, *mtmp;
+    struct match_rule *r;
+    struct job_history *h;
     struct hlist_node *tmp;
     LIST_HEAD(to_free);
-    LIST_HEAD(to_ipc);
 
-    del_timer_sync(&monitor_timer);
+    if (sched_exec_registered) {
+        tracepoint_probe_unregister(sched_exec_tracepoint,
+                                    tracepoint_sched_exec_handler, NULL);
+        sched_exec_registered = false;
+    }
+    if (sched_exit_registered) {
+        tracepoint_probe_unregister(sched_exit_tracepoint,
+                                    tracepoint_sched_exit_handler, NULL);
+        sched_exit_registered = false;
+    }
+    tracepoint_synchronize_unregister();
 
-    if (nl_sk) {
-        netlink_kernel_release(nl_sk);
-        nl_sk = NULL;
+    /* No new matches; drop the rules and whatever was not registered yet */
+    cancel_work_sync(&exec_reg_work);
+    list_for_each_entry_safe(m, mtmp, &exec_matches, node) {
+        list_del(&m->node);
+        kfree(m);
+    }
+    hash_for_each_safe(rule_table, bkt, tmp, r, hnode) {
+        hash_del(&r->hnode);
+        kfree(r);
+    }
+    hash_for_each_safe(job_history_table, bkt, tmp, h, hnode) {
+        hash_del(&h->hnode);
+        kfree(h);
     }
 
-    /* Unlink all entries under lock, build removal/free lists. */
+    /* Unlink all entries under lock; their work items no longer re-arm. */
     spin_lock_irqsave(&pgid_table_lock, flags);
     hash_for_each_safe(pgid_table, bkt, tmp, entry, hnode) {
-        if (entry->ipcmon_registered) {
-            struct pending_ipc *p = kzalloc(sizeof(*p), GFP_ATOMIC);
-            if (p) {
-                p->pgid = entry->pgid;
-                p->do_add = false;
-                list_add(&p->node, &to_ipc);
-            }
-        }
-
         hash_del(&entry->hnode);
+        atomic_dec(&nr_entries);
         list_add(&entry->gc_node, &to_free);
     }
     spin_unlock_irqrestore(&pgid_table_lock, flags);
 
     /* Remove from IPC_monitor outside lock. */
-    while (!list_empty(&to_ipc)) {
-        struct pending_ipc *p = list_first_entry(&to_ipc, struct pending_ipc, node);
-        list_del(&p->node);
+    while (!list_empty(&to_free)) {
+        entry = list_first_entry(&to_free, struct pgid_entry, gc_node);
+        list_del(&entry->gc_node);
 
-        if (ipcmon_remove_pgid(p->pgid) < 0)
-            pr_debug("rt_monitor: ipcmon_remove_pgid(%d) failed during exit\n", p->pgid);
+        cancel_delayed_work_sync(&entry->work);
+        if (entry->ipcmon_registered && ipcmon_remove_pgid(entry->pgid) < 0)
+            pr_debug("rt_monitor: ipcmon_remove_pgid(%d) failed during exit\n", entry->pgid);
 
-        kfree(p);
+        free_entry(entry);
     }
 
-    free_entry_list(&to_free);
+    /* Auto-removals still in flight, then their events */
+    flush_workqueue(rtmon_wq);
+    cancel_delayed_work_sync(&nl_flush_work);
+    destroy_workqueue(rtmon_wq);
+
+    if (nl_sk) {
+        netlink_kernel_release(nl_sk);
+        nl_sk = NULL;
+    }
 
     device_destroy(rtmon_class, MKDEV(major_number, 0));
     class_destroy(rtmon_class);
     unregister_chrdev(major_number, DEVICE_NAME);
 
+    /* A mapping pins the file and so the module: none are left */
+    vfree(status_mem);
+    status_mem = NULL;
+
     pr_info("rt_monitor: unloaded\n");
 }
 
@@ -0,0 +1,223 @@
+"""
+IPC_monitor Context-Switch Overhead Benchmark
+
+This script measures how much IPC_monitor adds to the cost of a context switch
+of a monitored task. Each selected CPU runs a pipe ping-pong pair pinned to that
+CPU, so every round trip forces two sched_switch events. All pairs belong to one
+process group, which reproduces the "many workers of one PGID on many CPUs" case
+where the locked design contends on a single slot.
+
+Usage:
+    sudo python bench_ipcmon_overhead.py --cpus 0,2,4,6 --iterations 200000
+    sudo python bench_ipcmon_overhead.py --cpus 0,2,4,6 --unmonitored
+
+Comparing the two accumulation designs:
+    sudo insmod module/IPC_monitor.ko percpu_accum=0   # locked shared slot
+    sudo python bench_ipcmon_overhead.py --cpus ...
+    sudo insmod module/IPC_monitor.ko percpu_accum=1   # per-CPU partials
+    sudo python bench_ipcmon_overhead.py --cpus ...
+
+Comparing with the eBPF backend (module unloaded):
+    sudo kernel/bpf/ipcmon_loader run &
+    sudo python bench_ipcmon_overhead.py --cpus ... --backend ebpf
+
+Behavior:
+    - Forks a process group leader and one ping-pong pair per CPU
+    - Registers the group with runtime_monitor and sends the profiling ACK
+      itself (or with ipcmon_loader for the eBPF backend), then waits until the
+      group shows up in the shared memory
+    - Releases all pairs at once and reports ns per context switch per CPU
+"""
+
+import os, sys
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), ".."))
+if ROOT not in sys.path:
+    sys.path.insert(0, ROOT)
+
+import argparse
+import fcntl
+import signal
+import socket
+import struct
+import subprocess
+import time
+from userlevel.python.smtcheck.c_struct import *
+
+NETLINK_USER = 31
+PARAM_PATH = "/sys/module/IPC_monitor/parameters/percpu_accum"
+DEFAULT_LOADER = os.path.join(ROOT, "kernel", "bpf", "ipcmon_loader")
+
+
+def read_accum_mode():
+    """Return the accumulation design of the loaded IPC_monitor module."""
+    try:
+        with open(PARAM_PATH) as f:
+            return "per-CPU" if f.read().strip() in ("Y", "1") else "locked"
+    except OSError:
+        return "unknown"
+
+
+def ping_pong(cpu, iterations, start_fd, result_fd):
+    """Run a pinned pipe ping-pong pair and write the elapsed time to result_fd."""
+    ping_r, ping_w = os.pipe()
+    pong_r, pong_w = os.pipe()
+
+    os.sched_setaffinity(0, {cpu})
+    partner = os.fork()
+    if partner == 0:
+        # Responder: echo every byte back
+        for _ in range(iterations):
+            os.read(ping_r, 1)
+            os.write(pong_w, b"x")
+        os._exit(0)
+
+    # Wait for the common start signal so all CPUs run concurrently
+    os.read(start_fd, 1)
+
+    begin = time.perf_counter_ns()
+    for _ in range(iterations):
+        os.write(ping_w, b"x")
+        os.read(pong_r, 1)
+    elapsed = time.perf_counter_ns() - begin
+
+    os.waitpid(partner, 0)
+    os.write(result_fd, struct.pack("iQ", cpu, elapsed))
+    os._exit(0)
+
+
+def spawn_group(cpus, iterations):
+    """Fork a new process group running one ping-pong pair per CPU.
+
+    Returns:
+        Tuple of (leader_pid, start_write_fd, result_read_fd)
+    """
+    start_r, start_w = os.pipe()
+    result_r, result_w = os.pipe()
+
+    leader = os.fork()
+    if leader == 0:
+        os.setsid()  # New session: leader pid becomes the PGID
+        os.close(start_w)
+        os.close(result_r)
+        children = []
+        for cpu in cpus:
+            pid = os.fork()
+            if pid == 0:
+                ping_pong(cpu, iterations, start_r, result_w)
+            children.append(pid)
+        for pid in children:
+            os.waitpid(pid, 0)
+        os._exit(0)
+
+    os.close(start_r)
+    os.close(result_w)
+    return leader, start_w, result_r
+
+
+def register_group(pgid, worker_num, timeout_sec=15):
+    """Register pgid with runtime_monitor and wait until IPC_monitor tracks it."""
+    fd = os.open("/dev/runtime_monitor", os.O_RDWR)
+    fcntl.ioctl(fd, RTMON_IOC_SET_THRESHOLD, struct.pack("i", 1))
+    fcntl.ioctl(fd, RTMON_IOC_ADD_PGID, struct.pack("iii", pgid, 0, worker_num))
+
+    # Profiling-done ACK, as profile_data_loader would send it
+    sock = socket.socket(socket.AF_NETLINK, socket.SOCK_RAW, NETLINK_USER)
+    sock.bind((0, 0))
+    ack = make_rtmon_ack([pgid])
+
+    shm = SharedMemoryManager()
+    shm.map()
+    deadline = time.time() + timeout_sec
+    try:
+        while time.time() < deadline:
+            sock.sendto(ack, (0, 0))
+            if any(slot.pgid == pgid for slot in shm.active_slots):
+                return fd
+            time.sleep(0.5)
+    finally:
+        sock.close()
+        shm.close()
+
+    os.close(fd)
+    raise RuntimeError(f"PGID {pgid} was not registered with IPC_monitor in time")
+
+
+def register_group_ebpf(loader, pgid, worker_num, timeout_sec=15):
+    """Register pgid with the eBPF backend and wait until it has a slot."""
+    subprocess.run([loader, "add", str(pgid), "0", str(worker_num)], check=True)
+
+    shm = SharedMemoryManager()
+    shm.map()
+    deadline = time.time() + timeout_sec
+    try:
+        while time.time() < deadline:
+            if any(slot.pgid == pgid for slot in shm.active_slots):
+                return
+            time.sleep(0.1)
+    finally:
+        shm.close()
+    raise RuntimeError(f"PGID {pgid} did not appear in the eBPF backend's shared memory")
+
+
+if __name__ == "__main__":
+    arg_parser = argparse.ArgumentParser(
+        description="Measure IPC_monitor overhead on monitored context switches."
+    )
+    arg_parser.add_argument("--cpus", type=str, default="0",
+                            help="Comma-separated CPUs, one ping-pong pair per CPU.")
+    arg_parser.add_argument("--iterations", type=int, default=200000,
+                            help="Round trips per CPU (two context switches each).")
+    arg_parser.add_argument("--unmonitored", action="store_true",
+                            help="Do not register the group (baseline).")
+    arg_parser.add_argument("--backend", choices=["module", "ebpf"], default="module",
+                            help="Monitor to register with: the kernel module or the eBPF backend.")
+    arg_parser.add_argument("--loader", type=str, default=DEFAULT_LOADER,
+                            help="Path of ipcmon_loader (eBPF backend).")
+    args = arg_parser.parse_args()
+
+    cpus = [int(c) for c in args.cpus.split(",") if c.strip()]
+    leader, start_w, result_r = spawn_group(cpus, args.iterations)
+
+    fd_runtime_monitor = None
+    ebpf_registered = False
+    try:
+        if not args.unmonitored and args.backend == "ebpf":
+            register_group_ebpf(args.loader, leader, 2 * len(cpus))
+            ebpf_registered = True
+        elif not args.unmonitored:
+            fd_runtime_monitor = register_group(leader, 2 * len(cpus))
+
+        os.write(start_w, b"x" * len(cpus))
+
+        results = {}
+        record_size = struct.calcsize("iQ")
+        for _ in cpus:
+            cpu, elapsed = struct.unpack("iQ", os.read(result_r, record_size))
+            results[cpu] = elapsed
+        os.waitpid(leader, 0)
+    finally:
+        if fd_runtime_monitor is not None:
+            try:
+                fcntl.ioctl(fd_runtime_monitor, RTMON_IOC_REMOVE_PGID, struct.pack("i", leader))
+            except OSError:
+                pass
+            os.close(fd_runtime_monitor)
+        if ebpf_registered:
+            subprocess.run([args.loader, "remove", str(leader)])
+        try:
+            os.killpg(leader, signal.SIGTERM)
+        except ProcessLookupError:
+            pass
+
+    if args.unmonitored:
+        mode = "unmonitored"
+    elif args.backend == "ebpf":
+        mode = "ebpf"
+    else:
+        mode = read_accum_mode()
+    switches = 2 * args.iterations
+    print(f"mode={mode} cpus={len(cpus)} iterations={args.iterations}")
+    for cpu in sorted(results):
+        print(f"  cpu {cpu}: {results[cpu] / switches:.1f} ns/switch")
+    mean = sum(results.values()) / len(results) / switches
+    print(f"  mean: {mean:.1f} ns/switch")
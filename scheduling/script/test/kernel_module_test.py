@@ -48,6 +48,9 @@ dummy_process_list: list[mp.Process] = []
 # CPU core to pin dummy processes to
 pinned_cpu_core = 0
 
+# Per-reader counter baseline (slot index -> snapshot), see test_ipc_monitor()
+ipc_baseline = {}
+
 def dummy_worker():
     """Worker function that runs in a separate process group and spins forever."""
     os.setsid()   # Create new session to separate from parent process group
@@ -92,49 +95,31 @@ def test_runtime_monitor(num_processes=1, sleep_duration=10):
         print(f"Added PGID {pid} to runtime_monitor, ioctl result: {result}")
     time.sleep(sleep_duration)
 
-def read_slot_with_seqlock(slot):
-    """Read slot data using seqlock protocol to ensure consistency.
-    
-    The kernel writes slots using a sequence counter that is odd during writes.
-    We spin until we get a consistent read (same even sequence before and after).
-    
-    Args:
-        slot: The shared memory slot to read
-        
-    Returns:
-        tuple: (pgid, cycles, instructions)
-    """
-    while True:
-        seq_before = slot.seq
-        if seq_before & 1:
-            continue  # Writer in progress, retry
-        pgid = slot.pgid
-        cycles = slot.cycles
-        instructions = slot.instructions
-        seq_after = slot.seq
-        if seq_before == seq_after and not (seq_after & 1):
-            return pgid, cycles, instructions
-
 def test_ipc_monitor(target_pgid=None):
     """Test the IPC_monitor kernel module by reading active slots.
     
-    Reads all active slots from shared memory and prints IPC data.
+    Reads the counter deltas of all active slots since the previous call and
+    prints IPC data. Counters are monotonic, so the test keeps its own baseline
+    instead of resetting them.
     If target_pgid is specified, only shows data for that PGID.
     
     Args:
         target_pgid: Optional PGID to filter results (None = show all)
     """
+    global ipc_baseline
     slots_found = 0
 
-    for slot in shared_memory_manager.active_slots:
-        pgid, cycles, instructions = read_slot_with_seqlock(slot)
+    # Publish per-CPU partial counters before reading the snapshot
+    fcntl.ioctl(fd_ipc_monitor, IPC_IOC_SYNC_COUNTERS)
+
+    for pgid, _, cycles, instructions in shared_memory_manager.deltas_since(ipc_baseline):
         print(f"Read slot PGID={pgid}, Cycles={cycles}, Instructions={instructions}")
 
-        # Skip slots with invalid PGID (may occur due to timing during updates)
-        if pgid <= 0:
-            continue
         if target_pgid is not None and pgid != target_pgid:
             continue
+        if cycles < 0 or instructions < 0:
+            print(f"[Slot PGID={pgid}] ERROR: counters went backwards")
+            continue
 
         ipc = (instructions / cycles) if cycles > 0 else 0.0
         print(f"[Slot PGID={pgid}] Cycles={cycles}, Instructions={instructions}, IPC={ipc:.3f}")
@@ -142,9 +127,9 @@ def test_ipc_monitor(target_pgid=None):
 
     if slots_found == 0:
         print("No matching active slots found.")
-    else:
-        # Reset counters after reading (using _IO ioctl with dummy argument)
-        fcntl.ioctl(fd_ipc_monitor, IPC_IOC_RESET_COUNTERS, struct.pack("i", 0))
+
+    # Next call reports deltas from here
+    ipc_baseline = shared_memory_manager.snapshot()
     
 # =============================================================================
 # Main Test Execution
@@ -56,9 +56,10 @@ fd_runtime_monitor = os.open("/dev/runtime_monitor", os.O_RDWR)
 # Pending Request Management
 # =============================================================================
 
-# Dictionary tracking pending profiling requests by job ID
-# Maps: job_id -> list of PGIDs waiting for profiling
-pending_profile_requests: dict[int, list[int]] = dict()
+# Which PGIDs wait for a profiling ACK is read from runtime_monitor's status
+# table; only the jobs already submitted for profiling are tracked here.
+rtmon_status = RtmonStatus()
+requested_jobs: set[int] = set()
 pending_requests_lock = threading.Lock()
 
 # Queue for completed profiling requests (job_id, exception or None)
@@ -105,27 +106,27 @@ def submit_profiling_request(job_id: int):
         completed_requests_queue.put((job_id, e))
 
 def register_pending_request(job_id: int, pgid: int) -> bool:
-    """Register a PGID as pending profiling for a job ID.
+    """Note a profiling request for a job ID.
     
     Args:
         job_id: The global job ID
-        pgid: The process group ID to register
+        pgid: The process group ID that triggered the request
         
     Returns:
-        True if this is a new job (first registration), False if already pending
+        True if this is a new job (first request), False if already requested
     """
     with pending_requests_lock:
-        if job_id in pending_profile_requests:
-            pending_profile_requests[job_id].append(pgid)
+        if job_id in requested_jobs:
             return False
-        pending_profile_requests[job_id] = [pgid]
+        requested_jobs.add(job_id)
         return True
 
 def notify_kernel_profiling_complete(job_id: int):
     """Notify the kernel that profiling is complete for all PGIDs of a job.
     
-    Sends netlink messages to the kernel for each PGID associated with the job,
-    allowing the kernel to proceed with IPC monitoring registration.
+    Sends netlink messages to the kernel for each PGID of the job that crossed
+    the threshold and has no ACK yet (from the status table), allowing the
+    kernel to proceed with IPC monitoring registration.
     
     Note: Only sends ACK on second touch (counter > 1) because:
     - First touch: Process just became long-running, profiling not yet complete
@@ -137,25 +138,20 @@ def notify_kernel_profiling_complete(job_id: int):
     print(f"[Notify Kernel] Profiling complete for job_id={job_id}", flush=True)
     
     with pending_requests_lock:
-        if job_id not in pending_profile_requests:
-            print(f"[Warning] notify_kernel_profiling_complete: job_id={job_id} not found in pending requests.")
+        if job_id not in requested_jobs:
+            print(f"[Warning] notify_kernel_profiling_complete: job_id={job_id} was never requested.")
             return
-            
         touch_count = first_touch_counter.get(job_id, 0)
-        pgid_list = pending_profile_requests[job_id]
-        
-        if touch_count > 1:
-            # Second touch or later: Send ACK to kernel for IPC registration
-            for pgid in pgid_list:
-                msg = profile_data_loader.make_msg(pgid)
-                profile_data_loader.kernel_sock.sendto(msg, (0, 0))
-                print(f"[Profiling Complete] Notified kernel for PGID: {pgid} (job_id={job_id})", flush=True)
-        else:
-            # First touch: Just log, no ACK sent
-            print(f"[First Touch] job_id={job_id} - clearing {len(pgid_list)} PGIDs from pending (no ACK)", flush=True)
-        
-        # Always clear pending list after processing (both first touch and later)
-        pending_profile_requests[job_id] = []
+
+    if touch_count > 1:
+        # Second touch or later: Send ACK to kernel for IPC registration
+        for pgid in rtmon_status.awaiting_ack(job_id):
+            msg = profile_data_loader.make_msg(pgid)
+            profile_data_loader.kernel_sock.sendto(msg, (0, 0))
+            print(f"[Profiling Complete] Notified kernel for PGID: {pgid} (job_id={job_id})", flush=True)
+    else:
+        # First touch: Just log, no ACK sent
+        print(f"[First Touch] job_id={job_id} - no ACK yet", flush=True)
 
 def process_completed_requests_thread():
     """Background thread that processes completed profiling requests.
@@ -219,6 +215,15 @@ def process_completed_requests_thread():
         print(f"[Score Update] Done. Triggering reschedule.")
         smtcheck_native.schedule()
 
+def handle_kernel_event(ev):
+    """Score a job provisionally once runtime_monitor reports its early signature."""
+    if ev.type != RTMON_EV_PROVISIONAL or ev.global_jobid < 0:
+        return
+    solo_ipc, corun_ipc = ipc_shm.job_signature(ev.global_jobid)
+    print(f"[Provisional] PGID={ev.pgid}, job_id={ev.global_jobid} "
+          f"after {ev.arg}s: solo IPC={solo_ipc}, co-run IPC={corun_ipc}", flush=True)
+    score_updater.set_provisional_score(ev.global_jobid, solo_ipc, corun_ipc)
+
 def set_long_running_threshold(threshold_seconds: int = 10):
     """Set the kernel's long-running process detection threshold.
     
@@ -243,6 +248,8 @@ if __name__ == "__main__":
     # Open shared memory for IPC monitoring
     smtcheck_native.open_mmap()
     smtcheck_native.set_sibling_core_map(profile_data_loader.sibling_core_dict)
+    ipc_shm = SharedMemoryManager()
+    ipc_shm.map()
 
     # Start background thread for processing completed profiling requests
     completed_requests_thread = threading.Thread(target=process_completed_requests_thread, daemon=True)
@@ -256,7 +263,7 @@ if __name__ == "__main__":
         while True:
             try:
                 # Block until kernel sends a netlink message about a process
-                pgid, global_job_id = profile_data_loader.netlink_listener()
+                pgid, global_job_id = profile_data_loader.netlink_listener(handle_kernel_event)
                 print(f"[Kernel Event] PGID={pgid}, job_id={global_job_id}")
 
                 if global_job_id is not None and global_job_id >= 0:
@@ -0,0 +1,8 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <pybind11/pybind11.h>
+
+void bind_flight_recorder(pybind11::module& m);
+
+#endif
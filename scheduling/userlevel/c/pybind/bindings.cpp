@@ -1,5 +1,6 @@
 #include <pybind11/pybind11.h>
 #include "job_mapper.h"
+#include "flight_recorder.h"
 
 namespace py = pybind11;
 
@@ -9,4 +10,5 @@ PYBIND11_MODULE(smtcheck_native, m) {
 
     // Delegate binding registration to each module
     bind_job_mapper(m);
+    bind_flight_recorder(m);
 }
\ No newline at end of file
@@ -0,0 +1,340 @@
+// =============================================================================
+// Flight Recorder - drains the IPC_monitor per-CPU interval rings into a
+// bounded in-memory history that can be dumped around an incident
+// =============================================================================
+
+// =============================================================================
+// Standard Library Headers
+// =============================================================================
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// =============================================================================
+// Third-party Headers
+// =============================================================================
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+// =============================================================================
+// Local Headers
+// =============================================================================
+#include "flight_recorder.h"
+#include "ipcmon_abi.h"
+
+// =============================================================================
+// Namespace Aliases
+// =============================================================================
+namespace py = pybind11;
+
+// =============================================================================
+// Constants and Structures (ring layout in ipcmon_abi.h)
+// =============================================================================
+#define TRACE_FILE_VERSION  1
+#define DEFAULT_MAX_RECORDS (1u << 20)     // history cap: 48 MiB of records
+
+static_assert(sizeof(ipc_trace_record) == 48, "ipc_trace_record layout");
+static_assert(sizeof(ipc_trace_ring) == 128, "ipc_trace_ring layout");
+
+// Dump file header, followed by nr_records ipc_trace_record
+struct trace_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t nr_cpus;
+    uint64_t nr_records;
+    uint64_t kernel_dropped;    // records the kernel could not queue
+    uint64_t history_evicted;   // records aged out of the in-memory history
+};
+
+// =============================================================================
+// Global State
+// =============================================================================
+// recorder_lock serializes start/stop/dump/stats and guards the mapping below;
+// the drain thread runs between start and stop and only takes history_lock
+static std::mutex recorder_lock;
+static int trace_fd = -1;
+static void* trace_base = nullptr;
+static size_t trace_size = 0;
+static const ipc_trace_header* trace_hdr = nullptr;
+static ipc_trace_tail* trace_tails = nullptr;   // writable: one reader tail per ring
+static size_t trace_tail_size = 0;
+
+static std::thread drain_thread;
+static std::atomic<bool> draining{false};
+
+static std::mutex history_lock;
+static std::deque<ipc_trace_record> history;   // drain order (per poll, per CPU)
+static uint64_t history_ns = 0;
+static size_t history_max = DEFAULT_MAX_RECORDS;
+static uint64_t newest_end_ns = 0;
+static uint64_t drained_total = 0;
+static uint64_t evicted_total = 0;
+
+// =============================================================================
+// Ring Access
+// =============================================================================
+
+static inline const ipc_trace_ring* ring_of(uint32_t cpu) {
+    return reinterpret_cast<const ipc_trace_ring*>(static_cast<const uint8_t*>(trace_base) +
+                                                   trace_hdr->rings_off +
+                                                   cpu * trace_hdr->ring_size);
+}
+
+static inline const ipc_trace_record* records_of(const ipc_trace_ring* ring) {
+    return reinterpret_cast<const ipc_trace_record*>(ring + 1);
+}
+
+static uint64_t kernel_dropped() {
+    uint64_t total = 0;
+    for (uint32_t cpu = 0; cpu < trace_hdr->nr_cpus; cpu++)
+        total += __atomic_load_n(&ring_of(cpu)->dropped, __ATOMIC_RELAXED);
+    return total;
+}
+
+// Consume [tail, head) of every ring and append it to the history
+static void drain_once(std::vector<ipc_trace_record>& batch) {
+    const uint64_t mask = trace_hdr->nr_records - 1;
+
+    batch.clear();
+    for (uint32_t cpu = 0; cpu < trace_hdr->nr_cpus; cpu++) {
+        const ipc_trace_ring* ring = ring_of(cpu);
+        const ipc_trace_record* recs = records_of(ring);
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = trace_tails[cpu].tail;
+
+        for (; tail != head; tail++)
+            batch.push_back(recs[tail & mask]);
+        __atomic_store_n(&trace_tails[cpu].tail, tail, __ATOMIC_RELEASE);
+    }
+    if (batch.empty())
+        return;
+
+    std::lock_guard<std::mutex> guard(history_lock);
+    for (const auto& r : batch) {
+        history.push_back(r);
+        newest_end_ns = std::max<uint64_t>(newest_end_ns, r.end_ns);
+    }
+    drained_total += batch.size();
+
+    while (!history.empty() && (history.size() > history_max ||
+                                history.front().end_ns + history_ns < newest_end_ns)) {
+        history.pop_front();
+        evicted_total++;
+    }
+}
+
+static void drain_loop(int poll_ms) {
+    std::vector<ipc_trace_record> batch;
+
+    while (draining.load(std::memory_order_relaxed)) {
+        drain_once(batch);
+        std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms));
+    }
+    drain_once(batch);
+}
+
+// =============================================================================
+// Recorder Control
+// =============================================================================
+
+static void trace_stop_locked() {
+    if (draining.exchange(false) && drain_thread.joinable())
+        drain_thread.join();
+    if (trace_tails) {
+        munmap(trace_tails, trace_tail_size);
+        trace_tails = nullptr;
+    }
+    if (trace_base) {
+        munmap(trace_base, trace_size);
+        trace_base = nullptr;
+        trace_hdr = nullptr;
+    }
+    if (trace_fd >= 0) {
+        close(trace_fd);
+        trace_fd = -1;
+    }
+}
+
+void trace_stop() {
+    std::lock_guard<std::mutex> guard(recorder_lock);
+    trace_stop_locked();
+}
+
+// Map the flight recorder of /dev/IPC_monitor and keep the last history_sec
+// seconds of intervals, at most max_records of them, draining the rings every
+// poll_ms. Returns 0 on success.
+int trace_start(double history_sec, int poll_ms, size_t max_records) {
+    std::lock_guard<std::mutex> recorder_guard(recorder_lock);
+
+    if (draining.load())
+        return 0;
+    if (history_sec <= 0 || poll_ms <= 0 || max_records == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    trace_fd = open("/dev/IPC_monitor", O_RDWR);
+    if (trace_fd < 0) {
+        perror("open /dev/IPC_monitor");
+        return -1;
+    }
+
+    void* hdr_map = mmap(NULL, IPC_HDR_SIZE, PROT_READ, MAP_SHARED, trace_fd, 0);
+    if (hdr_map == MAP_FAILED) {
+        perror("mmap header");
+        trace_stop_locked();
+        return -1;
+    }
+    ipc_shared_header hdr = *static_cast<const ipc_shared_header*>(hdr_map);
+    munmap(hdr_map, IPC_HDR_SIZE);
+
+    if (hdr.magic != IPC_ABI_MAGIC || hdr.abi_version != IPC_ABI_VERSION) {
+        fprintf(stderr, "IPC_monitor ABI mismatch (magic=%#x version=%u)\n",
+                hdr.magic, hdr.abi_version);
+        trace_stop_locked();
+        return -1;
+    }
+    if (!hdr.trace_mmap_off) {
+        fprintf(stderr, "IPC_monitor flight recorder disabled (load with trace_records=N)\n");
+        trace_stop_locked();
+        return -1;
+    }
+
+    trace_size = hdr.trace_size;
+    trace_base = mmap(NULL, trace_size, PROT_READ, MAP_SHARED, trace_fd,
+                      static_cast<off_t>(hdr.trace_mmap_off));
+    if (trace_base == MAP_FAILED) {
+        perror("mmap trace rings");
+        trace_base = nullptr;
+        trace_stop_locked();
+        return -1;
+    }
+    trace_hdr = static_cast<const ipc_trace_header*>(trace_base);
+    if (trace_hdr->magic != IPC_TRACE_MAGIC ||
+        trace_hdr->record_size != sizeof(ipc_trace_record)) {
+        fprintf(stderr, "IPC_monitor trace layout mismatch (magic=%#x record_size=%u)\n",
+                trace_hdr->magic, trace_hdr->record_size);
+        trace_stop_locked();
+        return -1;
+    }
+
+    // Reader tails are the only writable part of the recorder
+    trace_tail_size = hdr.trace_tail_size;
+    void* tails = mmap(NULL, trace_tail_size, PROT_READ | PROT_WRITE, MAP_SHARED, trace_fd,
+                       static_cast<off_t>(hdr.trace_tail_mmap_off));
+    if (tails == MAP_FAILED) {
+        perror("mmap trace tails");
+        trace_stop_locked();
+        return -1;
+    }
+    trace_tails = static_cast<ipc_trace_tail*>(tails);
+
+    {
+        std::lock_guard<std::mutex> guard(history_lock);
+        history.clear();
+        history_ns = static_cast<uint64_t>(history_sec * 1e9);
+        history_max = max_records;
+        newest_end_ns = 0;
+        drained_total = 0;
+        evicted_total = 0;
+    }
+
+    draining.store(true);
+    drain_thread = std::thread(drain_loop, poll_ms);
+    return 0;
+}
+
+// Write the intervals that ended in the last `seconds` (0 = whole history),
+// sorted by start time, to `path`. Returns the number of records written.
+int64_t trace_dump(const std::string& path, double seconds) {
+    std::lock_guard<std::mutex> recorder_guard(recorder_lock);
+    std::vector<ipc_trace_record> out;
+    trace_file_header fh = {};
+
+    {
+        std::lock_guard<std::mutex> guard(history_lock);
+        uint64_t since = 0;
+        if (seconds > 0 && newest_end_ns > static_cast<uint64_t>(seconds * 1e9))
+            since = newest_end_ns - static_cast<uint64_t>(seconds * 1e9);
+        for (const auto& r : history)
+            if (r.end_ns >= since)
+                out.push_back(r);
+        fh.history_evicted = evicted_total;
+    }
+    std::sort(out.begin(), out.end(), [](const ipc_trace_record& a, const ipc_trace_record& b) {
+        return a.start_ns < b.start_ns;
+    });
+
+    fh.magic = IPC_TRACE_MAGIC;
+    fh.version = TRACE_FILE_VERSION;
+    fh.record_size = sizeof(ipc_trace_record);
+    fh.nr_cpus = trace_hdr ? trace_hdr->nr_cpus : 0;
+    fh.nr_records = out.size();
+    fh.kernel_dropped = trace_hdr ? kernel_dropped() : 0;
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        perror(path.c_str());
+        return -1;
+    }
+    bool ok = fwrite(&fh, sizeof(fh), 1, f) == 1 &&
+              fwrite(out.data(), sizeof(ipc_trace_record), out.size(), f) == out.size();
+    ok = (fclose(f) == 0) && ok;
+    return ok ? static_cast<int64_t>(out.size()) : -1;
+}
+
+// Recorder counters as a Python dict
+py::dict trace_stats() {
+    bool running;
+    size_t buffered;
+    uint64_t drained, evicted, dropped;
+
+    {
+        // Wait without the GIL: trace_stop() may hold recorder_lock while joining
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> recorder_guard(recorder_lock);
+        std::lock_guard<std::mutex> guard(history_lock);
+
+        running = draining.load();
+        buffered = history.size();
+        drained = drained_total;
+        evicted = evicted_total;
+        dropped = trace_hdr ? kernel_dropped() : 0;
+    }
+
+    py::dict d;
+    d["running"] = running;
+    d["buffered"] = buffered;
+    d["drained"] = drained;
+    d["evicted"] = evicted;
+    d["kernel_dropped"] = dropped;
+    return d;
+}
+
+// =============================================================================
+// Python Bindings
+// =============================================================================
+
+void bind_flight_recorder(py::module& m) {
+    m.def("trace_start", &trace_start, py::arg("history_sec") = 300.0, py::arg("poll_ms") = 50,
+          py::arg("max_records") = DEFAULT_MAX_RECORDS, py::call_guard<py::gil_scoped_release>(),
+          "Start draining the IPC_monitor flight recorder into an in-memory history");
+    m.def("trace_stop", &trace_stop, py::call_guard<py::gil_scoped_release>(),
+          "Stop the flight recorder drain and unmap the rings");
+    m.def("trace_dump", &trace_dump, py::arg("path"), py::arg("seconds") = 0.0,
+          py::call_guard<py::gil_scoped_release>(),
+          "Dump recorded intervals (last `seconds`, 0 = all) to a binary file");
+    m.def("trace_stats", &trace_stats, "Flight recorder counters");
+}
@@ -13,17 +13,20 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <deque>
 #include <errno.h>
 #include <fcntl.h>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <poll.h>
 #include <queue>
 #include <random>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <thread>
 #include <unistd.h>
@@ -34,6 +37,7 @@
 // =============================================================================
 // Third-party Headers
 // =============================================================================
+#include <linux/bpf.h>
 #include <linux/types.h>
 #include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
@@ -42,6 +46,7 @@
 // =============================================================================
 // Local Headers
 // =============================================================================
+#include "ipcmon_abi.h"
 #include "job_mapper.h"
 
 // =============================================================================
@@ -53,15 +58,14 @@ namespace fs = std::filesystem;
 // =============================================================================
 // Constants and Macros
 // =============================================================================
-#define MAX_SLOTS 4096
+#define MAX_SLOTS IPC_MAX_SLOTS
 #define PAGE_SIZE 4096
 #define LOCKUP_LENGTH 5
-#define BITS_PER_LONG (sizeof(long) * CHAR_BIT)
-#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
-#define BITS_TO_LONGS(nr) DIV_ROUND_UP(nr, BITS_PER_LONG)
 
-#define IPC_IOC_MAGIC 'I'
-#define IPC_IOC_RESET_COUNTERS _IO(IPC_IOC_MAGIC, 0)
+#define CGROUP2_ROOT "/sys/fs/cgroup"
+
+// Shared region of the eBPF backend (pinned by kernel/bpf/ipcmon_loader)
+#define IPCMON_BPF_SHARED "/sys/fs/bpf/ipcmon/shared"
 
 #ifndef LOGICAL_CORE_NUM
     #define LOGICAL_CORE_NUM 16
@@ -148,40 +152,48 @@ struct CpuSet {
     CpuSet() { CPU_ZERO(&set); }
 };
 
-// Shared memory slot for IPC monitoring
-struct pgid_slot {
-    uint32_t seq;
-    int32_t pgid;
-    int32_t global_jobid;
-    int32_t worker_num;
+// Shared-memory ABI v2 (ipc_shared_header, ipc_active_list, pgid_slot_user) comes
+// from kernel/include/ipcmon_abi.h; cgroup-keyed slots publish pgid = 0.
+
+static constexpr double EWMA_ONE = 65536.0;
+
+// Reader-side baseline of one slot
+struct SlotBaseline {
+    uint32_t gen;
     uint64_t cycles;
     uint64_t instructions;
-} __attribute__((aligned(16)));
-
-// Shared memory structure for IPC (Instructions Per Cycle) monitoring
-struct ipc_shared {
-    int32_t count;
-    unsigned long active_mask[BITS_TO_LONGS(MAX_SLOTS)];
-    struct pgid_slot slots[MAX_SLOTS];
 };
 
 // =============================================================================
 // Global Variables
 // =============================================================================
 
-// Shared memory state
-static struct ipc_shared *shared = NULL;
+// Shared memory state (regions located through the header)
+static void *shared_base = NULL;
+static const struct ipc_shared_header *shared_hdr = NULL;
+static const struct ipc_active_list *active_list = NULL;
+static const struct pgid_slot_user *slots = NULL;
+static const uint64_t *slot_keys = NULL;       // PGID or cgroup ID per slot
 static size_t mmap_size = 0;
-static size_t base_size = 0;
 static int fd_ipc = -1;
 
-static constexpr int ACTIVE_MASK_SIZE = (MAX_SLOTS + BITS_PER_LONG - 1) / BITS_PER_LONG;
+// Which monitor provides the shared region; both publish the same ABI
+enum class IpcBackend { None, Module, Bpf };
+static IpcBackend ipc_backend = IpcBackend::None;
+static uint64_t bpf_seen_epoch = 0;            // eBPF backend: last epoch reported
+static constexpr int EPOCH_POLL_MS = 10;       // eBPF backend: hdr.epoch recheck interval
 
 // Core topology and scoring maps
 static std::unordered_map<int, std::pair<int, int>> sibling_core_map;
 static std::unordered_map<uint64_t, double> score_map;
 static std::unordered_map<int, double> single_IPC_map;
 
+// Cgroup-keyed slots are scheduled as one entity each. The pair/affinity code
+// identifies entities by an int, so they get negative handles (see
+// cgroup_entity()) that map back to the cgroup ID here.
+static std::unordered_map<int, uint64_t> cgroup_entities;
+static std::unordered_map<uint64_t, fs::path> cgroup_paths;
+
 // Placeholder pair for empty slots
 static Pair holder = {{-1, -1}, {-1, -1}, 0};
 
@@ -197,28 +209,79 @@ inline static uint64_t make_key(uint32_t i, uint32_t j) noexcept {
     return (static_cast<uint64_t>(i) << 32) | static_cast<uint64_t>(j);
 }
 
+// Score of a job pair. A pair with no entry yet (a slot admitted before
+// score_updater has scored its job) counts as one job next to an idle sibling,
+// so the mapper prefers scored partners without failing the whole schedule.
+static constexpr double UNSCORED_PAIR_SCORE = 1.0;
+
+static inline double pair_score(int jobid1, int jobid2) {
+    auto it = score_map.find(make_key(jobid1, jobid2));
+    return it != score_map.end() ? it->second : UNSCORED_PAIR_SCORE;
+}
+
 // Compare two floating-point numbers with epsilon tolerance
 bool nearly_equal(double a, double b, double eps = 1e-8) {
     return std::fabs(a - b) < eps;
 }
 
-static inline int ctz_ulong(unsigned long x) {
-#if defined(__GNUC__) || defined(__clang__)
-    return __builtin_ctzl(x);
-#else
-    // fallback: slower but safe
-    int n = 0;
-    while ((x & 1UL) == 0) { x >>= 1; n++; }
-    return n;
-#endif
+// Copy the dense active slot list (seq-consistent)
+static std::vector<int> read_active_slots() {
+    std::vector<int> idx;
+    uint32_t s1, s2;
+
+    do {
+        s1 = __atomic_load_n(&active_list->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1)
+            continue;
+
+        uint32_t n = std::min<uint32_t>(active_list->nr_active, MAX_SLOTS);
+        idx.assign(active_list->idx, active_list->idx + n);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        s2 = active_list->seq;
+    } while (s1 != s2 || (s2 & 1));
+
+    return idx;
 }
 
-int reset_ipc_counters() {
+// Ask the kernel to aggregate per-CPU partial counters into the snapshot.
+// The eBPF loader aggregates on its own interval, so there is nothing to ask.
+int sync_ipc_counters() {
     if (fd_ipc < 0) {
         errno = EBADF;
         return -1;
     }
-    return ioctl(fd_ipc, IPC_IOC_RESET_COUNTERS);
+    if (ipc_backend == IpcBackend::Bpf)
+        return 0;
+    return ioctl(fd_ipc, IPC_IOC_SYNC_COUNTERS);
+}
+
+// Open a pinned BPF object (BPF_OBJ_GET) without depending on libbpf
+static int bpf_obj_get_fd(const char* path) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.pathname = reinterpret_cast<uint64_t>(path);
+    return static_cast<int>(syscall(__NR_bpf, BPF_OBJ_GET, &attr, sizeof(attr)));
+}
+
+// Open the shared region of whichever backend is present, module first
+static int open_ipc_backend() {
+    int fd = open("/dev/IPC_monitor", O_RDWR);
+    if (fd >= 0) {
+        ipc_backend = IpcBackend::Module;
+        return fd;
+    }
+    int module_errno = errno;
+
+    fd = bpf_obj_get_fd(IPCMON_BPF_SHARED);
+    if (fd >= 0) {
+        ipc_backend = IpcBackend::Bpf;
+        return fd;
+    }
+
+    fprintf(stderr, "open /dev/IPC_monitor: %s; eBPF backend %s: %s\n",
+            strerror(module_errno), IPCMON_BPF_SHARED, strerror(errno));
+    return -1;
 }
 
 // =============================================================================
@@ -255,6 +318,59 @@ std::vector<int> get_children(int pid) {
     return children;
 }
 
+// Entity handle of a cgroup-keyed slot (-1 is the empty placeholder)
+static inline int cgroup_entity(int slot_idx) {
+    return -(slot_idx + 2);
+}
+
+// Find the cgroup v2 directory whose inode number is the cgroup ID
+static bool find_cgroup_path(uint64_t cgid, fs::path& path) {
+    auto cached = cgroup_paths.find(cgid);
+    if (cached != cgroup_paths.end() && fs::exists(cached->second)) {
+        path = cached->second;
+        return true;
+    }
+
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(CGROUP2_ROOT, ec), end; !ec && it != end; it.increment(ec)) {
+        struct stat st;
+        if (!it->is_directory(ec) || stat(it->path().c_str(), &st) != 0)
+            continue;
+        if (static_cast<uint64_t>(st.st_ino) == cgid) {
+            cgroup_paths[cgid] = it->path();
+            path = it->path();
+            return true;
+        }
+    }
+    return false;
+}
+
+// Set CPU affinity for every thread in a cgroup and its descendants
+void set_cgroup_affinity(uint64_t cgid, cpu_set_t cpu_set) {
+    fs::path root;
+    if (!find_cgroup_path(cgid, root)) {
+        std::cerr << "Cgroup " << cgid << " not found under " << CGROUP2_ROOT << "\n";
+        return;
+    }
+
+    std::error_code ec;
+    std::vector<fs::path> dirs = {root};
+    for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_directory(ec))
+            dirs.push_back(it->path());
+    }
+
+    for (const auto& dir : dirs) {
+        std::ifstream f(dir / "cgroup.threads");
+        int tid;
+        while (f >> tid) {
+            if (sched_setaffinity(tid, sizeof(cpu_set_t), &cpu_set) == -1) {
+                std::cerr << "Failed to set CPU affinity for TID " << tid << "\n";
+            }
+        }
+    }
+}
+
 // Recursively set CPU affinity for a process group and all its children
 void set_pgid_affinity(int pgid, cpu_set_t cpu_set) {
     auto tids = get_threads(pgid);
@@ -270,6 +386,15 @@ void set_pgid_affinity(int pgid, cpu_set_t cpu_set) {
     }
 }
 
+// Set CPU affinity for a scheduling entity: a PGID or a cgroup handle
+void set_entity_affinity(int entity, cpu_set_t cpu_set) {
+    auto cg = cgroup_entities.find(entity);
+    if (cg != cgroup_entities.end())
+        set_cgroup_affinity(cg->second, cpu_set);
+    else if (entity > 0)
+        set_pgid_affinity(entity, cpu_set);
+}
+
 // =============================================================================
 // Pair Selection Algorithm
 // =============================================================================
@@ -396,16 +521,16 @@ static std::vector<Pair> get_best_combinations(const std::deque<Pair>& pairs,
                 }
 
                 // Calculate alternative pairing scores
-                double pair1_score = score_map.at(make_key(old_pair1.first.global_jobid, 
-                                                            old_pair2.first.global_jobid));
-                double pair2_score = score_map.at(make_key(old_pair1.second.global_jobid, 
-                                                            old_pair2.second.global_jobid));
+                double pair1_score = pair_score(old_pair1.first.global_jobid,
+                                                old_pair2.first.global_jobid);
+                double pair2_score = pair_score(old_pair1.second.global_jobid,
+                                                old_pair2.second.global_jobid);
                 double new_score1 = pair1_score + pair2_score;
 
-                double pair3_score = score_map.at(make_key(old_pair1.first.global_jobid, 
-                                                            old_pair2.second.global_jobid));
-                double pair4_score = score_map.at(make_key(old_pair1.second.global_jobid, 
-                                                            old_pair2.first.global_jobid));
+                double pair3_score = pair_score(old_pair1.first.global_jobid,
+                                                old_pair2.second.global_jobid);
+                double pair4_score = pair_score(old_pair1.second.global_jobid,
+                                                old_pair2.first.global_jobid);
                 double new_score2 = pair3_score + pair4_score;
 
                 int max_index = argmax3(old_score, new_score1, new_score2);
@@ -472,26 +597,24 @@ static std::vector<struct PgidStruct> get_target_pgids(int& thread_num, int& rem
     std::vector<struct PgidStruct> target_pgids;
     int n = 0;
 
-    // Scan only active slot indices based on active_mask
-    for (int word = 0; word < ACTIVE_MASK_SIZE; word++) {
-        volatile unsigned long bits = shared->active_mask[word];
-        DEBUG_PRINT_INLINE("Word " << word << ": bits = " << std::hex << bits << std::dec << "\n");
-        while (bits) {
-            int bit = ctz_ulong(bits);               // rightmost set bit index [0..BITS_PER_LONG-1]
-            int idx = word * BITS_PER_LONG + bit;    // slot index
+    cgroup_entities.clear();
 
-            // Move to next set bit
-            bits &= (bits - 1);
+    // Visit only active slots, from the dense active list
+    for (int idx : read_active_slots()) {
+        if (idx < 0 || idx >= MAX_SLOTS) continue;
 
-            if (idx >= MAX_SLOTS) continue;
+        const auto& s = slots[idx];
 
-            const auto& s = shared->slots[idx];
+        if (s.worker_num <= 0) continue;
 
-            if (s.worker_num <= 0) continue;
-
-            n += s.worker_num;
-            target_pgids.push_back({ s.pgid, s.global_jobid, s.worker_num });
+        int entity = s.pgid;
+        if (s.key_type == IPC_KEY_CGROUP) {
+            entity = cgroup_entity(idx);
+            cgroup_entities[entity] = slot_keys[idx];
         }
+
+        n += s.worker_num;
+        target_pgids.push_back({ entity, s.global_jobid, s.worker_num });
     }
 
     remain = (LOGICAL_CORE_NUM - (n % LOGICAL_CORE_NUM)) % LOGICAL_CORE_NUM;
@@ -535,7 +658,7 @@ static double evaluate_runqueue(const std::vector<PgidTuple>& runqueue,
     int count = 0;
     static constexpr int MAX_EVAL_COUNT = 5;
     for (const auto& pgid : runqueue) {
-        score += score_map.at(make_key(new_jobid, pgid.global_jobid));
+        score += pair_score(new_jobid, pgid.global_jobid);
         count++;
         if(count >= MAX_EVAL_COUNT) {
             break;
@@ -637,9 +760,10 @@ static std::unordered_map<int, CpuSet> set_cpu_mask(const std::vector<Pair>& pai
 }
 
 static inline bool read_slot_consistent(
-    const pgid_slot& slot,
+    const pgid_slot_user& slot,
     int& pgid,
     int& global_jobid,
+    uint32_t& gen,
     uint64_t& cycles,
     uint64_t& insts
 ) {
@@ -654,6 +778,7 @@ static inline bool read_slot_consistent(
 
         pgid = slot.pgid;
         global_jobid = slot.global_jobid;
+        gen = slot.gen;
         cycles = slot.cycles;
         insts = slot.instructions;
 
@@ -664,6 +789,22 @@ static inline bool read_slot_consistent(
     return true;
 }
 
+// Snapshot every active slot as a baseline for window deltas
+static std::unordered_map<int, SlotBaseline> snapshot_baselines() {
+    std::unordered_map<int, SlotBaseline> baseline;
+
+    for (int idx : read_active_slots()) {
+        if (idx < 0 || idx >= MAX_SLOTS) continue;
+
+        int pgid, global_jobid;
+        SlotBaseline b;
+        read_slot_consistent(slots[idx], pgid, global_jobid, b.gen, b.cycles, b.instructions);
+        if (slots[idx].key_type != IPC_KEY_NONE)
+            baseline[idx] = b;
+    }
+    return baseline;
+}
+
 // =============================================================================
 // Scheduling Functions
 // =============================================================================
@@ -706,14 +847,14 @@ static void schedule() {
         // Include worker_num in PgidTuple for per-pgid tracking in get_best_combinations
         struct PgidTuple workload0 = {pgid_struct0.pgid, pgid_struct0.global_jobid, pgid_struct0.worker_num};
         if(pgid_struct0.worker_num >= 2) {
-            const double score = score_map.at(make_key(workload0.global_jobid, workload0.global_jobid));
+            const double score = pair_score(workload0.global_jobid, workload0.global_jobid);
             pairs.push_back(Pair{workload0, workload0, score});
         }
             
         for(int j=i+1; j < (int)target_pgids.size(); ++j) {
             const struct PgidStruct& pgid_struct1 = target_pgids[j];
             struct PgidTuple workload1 = {pgid_struct1.pgid, pgid_struct1.global_jobid, pgid_struct1.worker_num};
-            const double score = score_map.at(make_key(workload0.global_jobid, workload1.global_jobid));
+            const double score = pair_score(workload0.global_jobid, workload1.global_jobid);
             pairs.push_back(Pair{workload0, workload1, score});
         }
     }
@@ -853,47 +994,50 @@ static void schedule() {
 
     for (int i = 0; i <= max_entries; ++i) {
         for (auto& [pgid, cpu_set] : try_cpu_masks[i]) {
-            set_pgid_affinity(pgid, cpu_set.set);
+            set_entity_affinity(pgid, cpu_set.set);
         }
         std::cout << "Evaluating configuration " << i << "..." << "sleeping for " << sleep_time_sec << " seconds" << std::endl;
-        reset_ipc_counters();
+        // Baseline of the monotonic counters at the start of the window
+        sync_ipc_counters();
+        std::unordered_map<int, SlotBaseline> baseline = snapshot_baselines();
         std::this_thread::sleep_for(std::chrono::seconds(sleep_time_sec));
+        sync_ipc_counters();
 
         // Calculate System Throughput (STP)
         double STP = 0.0;
 
-        for (int word = 0; word < ACTIVE_MASK_SIZE; ++word) {
-            unsigned long bits = shared->active_mask[word];
-            while (bits) {
-                int bit = ctz_ulong(bits);
-                int idx = word * BITS_PER_LONG + bit;
-                bits &= (bits - 1);            // clear lowest set bit
-
-                if (idx >= MAX_SLOTS) continue;
-
-                int pgid, global_jobid;
-                uint64_t cycles, insts;
-
-                read_slot_consistent(shared->slots[idx],
-                                    pgid, global_jobid,
-                                    cycles, insts);
-
-                // (optional) Guard against stale/cleared slots
-                if (global_jobid < 0 || pgid <= 0) continue;
-                if (cycles == 0) {
-                    DEBUG_PRINT("Warning: cycles is zero for pgid " << pgid
-                                << ", global_jobid " << global_jobid
-                                << " (slot=" << idx << ")");
-                    continue;
-                }
-
-                auto it = single_IPC_map.find(global_jobid);
-                if (it == single_IPC_map.end() || it->second == 0.0) continue;
-                
-                double ipc = static_cast<double>(insts) / static_cast<double>(cycles);
-                STP += ipc / it->second;
-                DEBUG_PRINT("IPC: " << ipc << ", Normalized IPC: " << ipc / it->second);
+        for (int idx : read_active_slots()) {
+            if (idx < 0 || idx >= MAX_SLOTS) continue;
+
+            int pgid, global_jobid;
+            uint32_t gen;
+            uint64_t cycles, insts;
+
+            read_slot_consistent(slots[idx],
+                                pgid, global_jobid, gen,
+                                cycles, insts);
+
+            // (optional) Guard against stale/cleared slots
+            if (global_jobid < 0 || slots[idx].key_type == IPC_KEY_NONE) continue;
+
+            // Window delta; a slot (re)assigned during the window has no baseline
+            auto base = baseline.find(idx);
+            if (base == baseline.end() || base->second.gen != gen) continue;
+            cycles -= base->second.cycles;
+            insts -= base->second.instructions;
+            if (cycles == 0) {
+                DEBUG_PRINT("Warning: cycles is zero for pgid " << pgid
+                            << ", global_jobid " << global_jobid
+                            << " (slot=" << idx << ")");
+                continue;
             }
+
+            auto it = single_IPC_map.find(global_jobid);
+            if (it == single_IPC_map.end() || it->second == 0.0) continue;
+            
+            double ipc = static_cast<double>(insts) / static_cast<double>(cycles);
+            STP += ipc / it->second;
+            DEBUG_PRINT("IPC: " << ipc << ", Normalized IPC: " << ipc / it->second);
         }
 
         DEBUG_PRINT("Configuration " << i << ": STP = " << STP);
@@ -908,7 +1052,7 @@ static void schedule() {
     // Apply the best configuration
     if (max_index != -1) {
         for (auto& [pgid, cpu_set] : try_cpu_masks[max_index]) {
-            set_pgid_affinity(pgid, cpu_set.set);
+            set_entity_affinity(pgid, cpu_set.set);
         }
     }
     DEBUG_PRINT("Scheduling complete.");
@@ -929,29 +1073,90 @@ void set_sibling_core_map(py::dict py_map) {
     }
 }
 
-// Open and map shared memory for IPC monitoring
+// Open and map shared memory for IPC monitoring.
+// The header page is mapped first to check the ABI version and learn the full size.
 int open_mmap() {
-    fd_ipc = open("/dev/IPC_monitor", O_RDWR);
-    if (fd_ipc < 0) {
-        perror("open /dev/IPC_monitor");
+    fd_ipc = open_ipc_backend();
+    if (fd_ipc < 0)
+        return 1;
+
+    void* hdr_map = mmap(NULL, IPC_HDR_SIZE, PROT_READ, MAP_SHARED, fd_ipc, 0);
+    if (hdr_map == MAP_FAILED) {
+        perror("mmap header");
+        close(fd_ipc);
         return 1;
     }
 
-    base_size = sizeof(struct ipc_shared);
-    mmap_size = ((base_size + PAGE_SIZE - 1) / PAGE_SIZE) * PAGE_SIZE;
-    printf("base size: %zu bytes\n", base_size);
+    struct ipc_shared_header hdr = *(const struct ipc_shared_header*)hdr_map;
+    munmap(hdr_map, IPC_HDR_SIZE);
+
+    if (hdr.magic != IPC_ABI_MAGIC || hdr.abi_version != IPC_ABI_VERSION ||
+        hdr.slot_size != sizeof(struct pgid_slot_user) || hdr.max_slots != MAX_SLOTS) {
+        fprintf(stderr, "IPC_monitor ABI mismatch (magic=%#x version=%u slot_size=%u max_slots=%u, "
+                        "expected version %d)\n",
+                hdr.magic, hdr.abi_version, hdr.slot_size, hdr.max_slots, IPC_ABI_VERSION);
+        close(fd_ipc);
+        return 1;
+    }
+
+    mmap_size = hdr.total_size;
+    printf("backend: %s, abi version: %u\n",
+           ipc_backend == IpcBackend::Bpf ? "ebpf" : "module", hdr.abi_version);
     printf("mmap size: %zu bytes\n", mmap_size);
 
-    shared = (struct ipc_shared*)mmap(NULL, mmap_size, PROT_READ | PROT_WRITE, 
-                                       MAP_SHARED, fd_ipc, 0);
-    if (shared == MAP_FAILED) {
+    shared_base = mmap(NULL, mmap_size, PROT_READ, MAP_SHARED, fd_ipc, 0);
+    if (shared_base == MAP_FAILED) {
         perror("mmap");
+        shared_base = NULL;
         close(fd_ipc);
         return 1;
     }
+
+    auto* base = static_cast<const uint8_t*>(shared_base);
+    shared_hdr = reinterpret_cast<const struct ipc_shared_header*>(base);
+    active_list = reinterpret_cast<const struct ipc_active_list*>(base + hdr.active_off);
+    slots = reinterpret_cast<const struct pgid_slot_user*>(base + hdr.slots_off);
+    slot_keys = reinterpret_cast<const uint64_t*>(base + hdr.keys_off);
+    bpf_seen_epoch = __atomic_load_n(&shared_hdr->epoch, __ATOMIC_ACQUIRE);
     return 0;
 }
 
+// Sleep until a slot is added or removed or a worker count changes, at most
+// timeout_ms (-1 = forever). Returns the new hdr.epoch, or -1 on timeout/error.
+// The module wakes poll() on the device; a pinned BPF map cannot be polled, so
+// the eBPF backend rechecks hdr.epoch every EPOCH_POLL_MS.
+int64_t wait_slot_change(int timeout_ms) {
+    if (fd_ipc < 0 || !shared_hdr)
+        return -1;
+
+    if (ipc_backend == IpcBackend::Module) {
+        struct pollfd pfd = {fd_ipc, POLLIN, 0};
+        int ret;
+        do {
+            ret = poll(&pfd, 1, timeout_ms);
+        } while (ret < 0 && errno == EINTR);
+        if (ret <= 0)
+            return -1;
+
+        uint64_t epoch;
+        if (read(fd_ipc, &epoch, sizeof(epoch)) != sizeof(epoch))
+            return -1;
+        return static_cast<int64_t>(epoch);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (;;) {
+        uint64_t epoch = __atomic_load_n(&shared_hdr->epoch, __ATOMIC_ACQUIRE);
+        if (epoch != bpf_seen_epoch) {
+            bpf_seen_epoch = epoch;
+            return static_cast<int64_t>(epoch);
+        }
+        if (timeout_ms >= 0 && std::chrono::steady_clock::now() >= deadline)
+            return -1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(EPOCH_POLL_MS));
+    }
+}
+
 // =============================================================================
 // Score Map Management
 // =============================================================================
@@ -984,6 +1189,42 @@ py::dict get_score_map_py() {
     return d;
 }
 
+// Return {pgid: (ewma_ipc, ewma_util, run_ns, switch_ins)} for all active slots.
+// One snapshot is enough: the kernel maintains the rates.
+py::dict get_slot_rates_py() {
+    py::dict d;
+
+    if (!slots)
+        return d;
+
+    for (int idx : read_active_slots()) {
+        if (idx < 0 || idx >= MAX_SLOTS) continue;
+
+        const auto& slot = slots[idx];
+        uint32_t s1, s2;
+        int32_t pgid;
+        uint32_t ewma_ipc, ewma_util;
+        uint64_t run_ns, switch_ins;
+        do {
+            s1 = __atomic_load_n(&slot.seq, __ATOMIC_ACQUIRE);
+            if (s1 & 1)
+                continue;
+            pgid = slot.pgid;
+            ewma_ipc = slot.ewma_ipc;
+            ewma_util = slot.ewma_util;
+            run_ns = slot.run_ns;
+            switch_ins = slot.switch_ins;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            s2 = slot.seq;
+        } while (s1 != s2 || (s2 & 1));
+
+        if (pgid <= 0) continue;  // cgroup-keyed slots have no PGID
+        d[py::int_(pgid)] = py::make_tuple(ewma_ipc / EWMA_ONE, ewma_util / EWMA_ONE,
+                                           run_ns, switch_ins);
+    }
+    return d;
+}
+
 // =============================================================================
 // Python Bindings
 // =============================================================================
@@ -993,7 +1234,11 @@ void bind_job_mapper(py::module& m) {
     m.def("schedule_test", &schedule_test, "Run the greedy scheduler test");
     m.def("set_sibling_core_map", &set_sibling_core_map, "Generate sibling core map");
     m.def("open_mmap", &open_mmap, "Open memory map");
+    m.def("wait_slot_change", &wait_slot_change, py::arg("timeout_ms") = -1,
+          py::call_guard<py::gil_scoped_release>(),
+          "Block until the set of monitored slots changes; returns the new epoch or -1 on timeout");
     m.def("update_score_map", &update_score_map, "Update score map");
     m.def("update_single_IPC_map", &update_single_IPC_map, "Update single IPC map");
     m.def("get_score_map_py", &get_score_map_py, "Get score map as Python dict");
+    m.def("get_slot_rates_py", &get_slot_rates_py, "Get per-PGID EWMA IPC/utilisation as Python dict");
 }
\ No newline at end of file
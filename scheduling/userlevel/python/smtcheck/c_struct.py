@@ -6,23 +6,56 @@ data structures, enabling Python to read from shared memory mapped
 from the kernel IPC_monitor module.
 
 Structures:
-    - PgidSlot: Per-process group performance counter slot
-    - IpcShared: Main shared memory structure with active slots
+    - IpcSharedHeader: ABI header (magic, version, slot count, epoch, region offsets)
+    - ActiveList: Dense, seq-protected list of active slot indexes
+    - PgidSlot: Per-process group performance counter slot (one cacheline)
+    - EventSpec / EventConfig: Extra PMU event set (IPC_IOC_SET_EVENTS)
+    - PairEntry / PairTable: Co-run pair accumulator (own slot x SMT sibling occupant)
+    - SlotSmt / CoreSmt / CoreTable: Solo vs co-run split per slot, SMT occupancy per core
+    - TraceRecord / TraceFileHeader: Flight recorder interval and dump file header
+    - RtmonBatch / RtmonEvent: runtime_monitor netlink event batch (rtmon_netlink.h)
+    - IpcShared: Main shared memory structure with active slots, event totals and pairs
     - SharedMemoryManager: Manages mmap and provides slot iteration
+
+The same layout is published by the eBPF backend (kernel/bpf), which pins it
+at IPCMON_BPF_SHARED; SharedMemoryManager falls back to it when the module's
+device is absent.
 """
 
 import ctypes
 import os
 import mmap
+import platform
 import fcntl
+import select
+import socket
 import struct
+import time
 
 # =============================================================================
 # Constants
 # =============================================================================
 MAX_SLOTS = 4096
-BITS_PER_LONG = ctypes.sizeof(ctypes.c_ulong) * 8
-ACTIVE_MASK_SIZE = (MAX_SLOTS + BITS_PER_LONG - 1) // BITS_PER_LONG
+IPC_MAX_EVENTS = 4
+PAIR_TABLE_SIZE = 8192
+TID_POOL_SIZE = 8192
+IPC_MAX_CORES = 1024
+IPC_CORE_THREADS = 2
+
+# Shared-memory ABI understood by this reader (mirrors kernel/include/ipcmon_abi.h)
+IPC_ABI_MAGIC = 0x4D435049  # "IPCM"
+IPC_ABI_VERSION = 2
+IPC_HDR_SIZE = 4096
+
+# eBPF backend: shared region pinned by kernel/bpf/ipcmon_loader
+IPCMON_BPF_SHARED = "/sys/fs/bpf/ipcmon/shared"
+BPF_OBJ_GET = 7
+_NR_BPF = {"x86_64": 321, "aarch64": 280}
+
+# Peer codes in PairEntry.peer_slot besides slot indexes
+PEER_IDLE = 0xFFFF    # sibling idle (or no SMT sibling)
+PEER_OTHER = 0xFFFE   # sibling ran an unmonitored task
+PEER_MIXED = 0xFFFD   # sibling occupant changed within the interval
 
 # =============================================================================
 # IOCTL Command Definitions
@@ -51,6 +84,19 @@ _IOC_READ  = 2
 _NLMSG_HDR_FMT = "IHHII"
 _NLMSG_HDR_LEN = struct.calcsize(_NLMSG_HDR_FMT)
 
+# runtime_monitor netlink protocol (kernel/include/rtmon_netlink.h)
+NETLINK_USER = 31
+RTMON_NL_VERSION = 1
+RTMON_MSG_EVENTS = 0x10
+RTMON_MSG_ACK = 0x11
+RTMON_NL_GROUP_EVENTS = 1
+
+RTMON_EV_LONG_RUNNING = 1   # arg = elapsed seconds
+RTMON_EV_EXITED = 2         # entry removed, no live process left
+RTMON_EV_WORKERS = 3        # value = new worker_num
+RTMON_EV_PROFILE_ACK = 4
+RTMON_EV_PROVISIONAL = 5    # early signature ready in the IPC_monitor slot; arg = elapsed seconds
+
 def _IOC(direction, type_code, number, size):
     """Build an ioctl command number from components."""
     return ((direction << _IOC_DIRSHIFT) | 
@@ -75,41 +121,533 @@ RTMON_IOC_SET_THRESHOLD   = _IOW(RTMON_IOC_MAGIC, 2, struct.calcsize("i"))
 RTMON_IOC_SET_DATA_LOADER = _IOW(RTMON_IOC_MAGIC, 3, struct.calcsize("i"))
 RTMON_IOC_REQUEST_PROFILE = _IOW(RTMON_IOC_MAGIC, 4, struct.calcsize("i"))
 
+# Auto-registration rules (struct rtmon_rule in runtime_monitor.c)
+RTMON_RULE_CGROUP = 1       # cgroup v2 directory or any descendant
+RTMON_RULE_EXE = 2          # absolute path of the executed file
+RTMON_RULE_COMM = 3         # task comm after exec (up to 15 chars)
+RTMON_RULE_PATTERN_MAX = 256
+_RTMON_RULE_FMT = f"IiiIQ{RTMON_RULE_PATTERN_MAX}s"
+RTMON_IOC_ADD_RULE = _IOW(RTMON_IOC_MAGIC, 5, struct.calcsize(_RTMON_RULE_FMT))
+RTMON_IOC_DEL_RULE = _IOW(RTMON_IOC_MAGIC, 6, struct.calcsize(_RTMON_RULE_FMT))
+
+def _rtmon_rule(kind, match, global_jobid, worker_num):
+    if kind == RTMON_RULE_CGROUP:
+        cgid = match if isinstance(match, int) else os.stat(match).st_ino
+        return struct.pack(_RTMON_RULE_FMT, kind, global_jobid, worker_num, 0, cgid, b"")
+    return struct.pack(_RTMON_RULE_FMT, kind, global_jobid, worker_num, 0, 0,
+                       os.fsencode(match))
+
+def add_rtmon_rule(fd, kind, match, global_jobid, worker_num=1):
+    """
+    Auto-register process groups whose exec matches a rule (fd: /dev/runtime_monitor).
+
+    match is a cgroup v2 directory (or its ID) for RTMON_RULE_CGROUP, an
+    absolute executable path for RTMON_RULE_EXE and a comm for RTMON_RULE_COMM.
+    The exec'ing task's process group is tracked with global_jobid; worker_num
+    is the starting worker count.
+    """
+    fcntl.ioctl(fd, RTMON_IOC_ADD_RULE, _rtmon_rule(kind, match, global_jobid, worker_num))
+
+def remove_rtmon_rule(fd, kind, match):
+    """Remove a rule added with add_rtmon_rule()."""
+    fcntl.ioctl(fd, RTMON_IOC_DEL_RULE, _rtmon_rule(kind, match, 0, 0))
+
+# struct rtmon_job_runtime {global_jobid, nr_runs, runtime_sec}
+_RTMON_JOB_RUNTIME_FMT = "iIQ"
+RTMON_IOC_SET_JOB_RUNTIME = _IOW(RTMON_IOC_MAGIC, 7, struct.calcsize(_RTMON_JOB_RUNTIME_FMT))
+
+def seed_job_runtime(fd, global_jobid, runtime_sec, nr_runs=1):
+    """
+    Seed the learned runtime of a job (fd: /dev/runtime_monitor).
+
+    runtime_monitor requests full profiling right after the grace period for
+    jobs learned to run long. The seed counts as nr_runs past runs; 0 forgets
+    the job.
+    """
+    fcntl.ioctl(fd, RTMON_IOC_SET_JOB_RUNTIME,
+                struct.pack(_RTMON_JOB_RUNTIME_FMT, global_jobid, nr_runs, int(runtime_sec)))
+
 # IPC monitor ioctl commands
-IPC_IOC_RESET_COUNTERS = 18688  # _IO('I', 0)
+# nr 0 was IPC_IOC_RESET_COUNTERS: counters are monotonic, readers keep baselines
+IPC_IOC_SET_PUBLISH_PERIOD = _IOW('I', 1, struct.calcsize("I"))  # period in microseconds
+IPC_IOC_SYNC_COUNTERS      = _IOC(_IOC_NONE, ord('I'), 2, 0)      # _IO('I', 2)
+IPC_IOC_SET_EWMA_HALFLIFE  = _IOW('I', 4, struct.calcsize("I"))  # half-life in milliseconds
+IPC_IOC_SET_TID_MODE       = _IOW('I', 5, struct.calcsize("iI")) # struct ipc_tid_mode {pgid, enable}
+IPC_IOC_ADD_CGROUP         = _IOW('I', 6, struct.calcsize("Qii")) # struct ipc_cgroup_key {cgid, jobid, workers}
+IPC_IOC_REMOVE_CGROUP      = _IOW('I', 7, struct.calcsize("Q"))
+
+# PgidSlot.key_type values; the key itself is IpcShared.slot_keys[index]
+IPC_KEY_NONE = 0
+IPC_KEY_PGID = 1
+IPC_KEY_CGROUP = 2
+
+# EWMA rates in PgidSlot are Q16 fixed point
+EWMA_ONE = 1 << 16
+
+# perf_event_attr.type values accepted by IPC_IOC_SET_EVENTS
+PERF_TYPE_HARDWARE = 0
+PERF_TYPE_HW_CACHE = 3
+PERF_TYPE_RAW      = 4
+
+def _hw_cache_config(cache_id, op_id, result_id):
+    """Encode a PERF_TYPE_HW_CACHE config (cache | op << 8 | result << 16)."""
+    return cache_id | (op_id << 8) | (result_id << 16)
+
+# Generic events usable as-is; model-specific ones (uop-cache misses, resource
+# stalls) are passed as (PERF_TYPE_RAW, <event|umask encoding>)
+PERF_EVENT_PRESETS = {
+    "llc_misses":             (PERF_TYPE_HARDWARE, 3),                        # PERF_COUNT_HW_CACHE_MISSES
+    "branch_misses":          (PERF_TYPE_HARDWARE, 5),                        # PERF_COUNT_HW_BRANCH_MISSES
+    "stalled_cycles_backend": (PERF_TYPE_HARDWARE, 8),                        # PERF_COUNT_HW_STALLED_CYCLES_BACKEND
+    "l1d_read_misses":        (PERF_TYPE_HW_CACHE, _hw_cache_config(0, 0, 1)),
+    "dtlb_read_misses":       (PERF_TYPE_HW_CACHE, _hw_cache_config(3, 0, 1)),
+}
+
+# ---- struct ipc_shared_header (first page of the mapping) ----
+class IpcSharedHeader(ctypes.Structure):
+    _fields_ = [
+        ("magic", ctypes.c_uint32),
+        ("abi_version", ctypes.c_uint32),
+        ("header_size", ctypes.c_uint32),
+        ("slot_size", ctypes.c_uint32),
+        ("max_slots", ctypes.c_uint32),
+        ("ewma_halflife_ms", ctypes.c_uint32),
+        ("total_size", ctypes.c_uint64),
+        ("epoch", ctypes.c_uint64),       # bumped on slot add/remove and worker count change
+        ("active_off", ctypes.c_uint64),
+        ("slots_off", ctypes.c_uint64),
+        ("event_set_off", ctypes.c_uint64),
+        ("slot_events_off", ctypes.c_uint64),
+        ("pairs_off", ctypes.c_uint64),
+        ("tids_off", ctypes.c_uint64),
+        ("keys_off", ctypes.c_uint64),
+        ("slot_smt_off", ctypes.c_uint64),
+        ("cores_off", ctypes.c_uint64),
+        ("trace_mmap_off", ctypes.c_uint64),   # flight recorder mapping, 0 if disabled
+        ("trace_size", ctypes.c_uint64),
+        ("trace_tail_mmap_off", ctypes.c_uint64),  # writable reader tails, 0 if disabled
+        ("trace_tail_size", ctypes.c_uint64),
+    ]
+
+# ---- struct ipc_active_list (aligned(64), seq-protected) ----
+class ActiveList(ctypes.Structure):
+    _fields_ = [
+        ("seq", ctypes.c_uint32),
+        ("nr_active", ctypes.c_uint32),
+        ("idx", ctypes.c_int32 * MAX_SLOTS),
+        ("_pad", ctypes.c_uint8 * 56),    # aligned(64) tail padding
+    ]
 
-# ---- struct pgid_slot_only_counter (aligned(16)) ----
+# ---- struct pgid_slot_user (aligned(64): one cacheline per slot) ----
 class PgidSlot(ctypes.Structure):
-    _align_ = 16
     _fields_ = [
         ("seq", ctypes.c_uint32),
-        ("pgid", ctypes.c_int32),
+        ("pgid", ctypes.c_int32),           # 0 for cgroup-keyed slots
         ("global_jobid", ctypes.c_int32),
         ("worker_num", ctypes.c_int32),
+        ("cycles", ctypes.c_uint64),        # monotonic while gen is unchanged
+        ("instructions", ctypes.c_uint64),
+        ("gen", ctypes.c_uint32),           # bumped whenever the slot is (re)assigned
+        ("ewma_ipc", ctypes.c_uint32),      # Q16 IPC
+        ("run_ns", ctypes.c_uint64),        # monotonic on-CPU time
+        ("switch_ins", ctypes.c_uint64),    # monotonic switch-in count
+        ("ewma_util", ctypes.c_uint32),     # Q16 CPUs busy
+        ("key_type", ctypes.c_uint32),      # IPC_KEY_*
+    ]
+
+# ---- struct ipc_event_spec / ipc_event_config (IPC_IOC_SET_EVENTS argument) ----
+class EventSpec(ctypes.Structure):
+    _fields_ = [
+        ("type", ctypes.c_uint32),
+        ("_rsvd", ctypes.c_uint32),
+        ("config", ctypes.c_uint64),
+        ("config1", ctypes.c_uint64),
+    ]
+
+class EventConfig(ctypes.Structure):
+    _fields_ = [
+        ("nr_events", ctypes.c_uint32),
+        ("_rsvd", ctypes.c_uint32),
+        ("events", EventSpec * IPC_MAX_EVENTS),
+    ]
+
+IPC_IOC_SET_EVENTS = _IOW('I', 3, ctypes.sizeof(EventConfig))
+
+# ---- struct ipc_event_set_user (currently configured events, seq-protected) ----
+class EventSetUser(ctypes.Structure):
+    _fields_ = [
+        ("seq", ctypes.c_uint32),
+        ("nr_events", ctypes.c_uint32),
+        ("config_gen", ctypes.c_uint32),
+        ("_rsvd", ctypes.c_uint32),
+        ("events", EventSpec * IPC_MAX_EVENTS),
+    ]
+
+# ---- struct pgid_events_user (per-slot event totals, covered by slots[i].seq) ----
+class PgidEvents(ctypes.Structure):
+    _fields_ = [
+        ("counts", ctypes.c_uint64 * IPC_MAX_EVENTS),
+    ]
+
+# ---- struct pair_entry_user (co-run accumulator entry, seq-protected) ----
+# cycles/instructions are the own slot's counts while the sibling ran peer_slot.
+class PairEntry(ctypes.Structure):
+    _fields_ = [
+        ("seq", ctypes.c_uint32),
+        ("own_slot", ctypes.c_uint16),
+        ("peer_slot", ctypes.c_uint16),
+        ("own_gen", ctypes.c_uint32),
+        ("peer_gen", ctypes.c_uint32),
+        ("own_jobid", ctypes.c_int32),
+        ("peer_jobid", ctypes.c_int32),
         ("cycles", ctypes.c_uint64),
         ("instructions", ctypes.c_uint64),
-        # aligned(16) attribute matches the kernel struct layout
     ]
 
-# ---- struct ipc_shared ----
+# ---- struct ipc_pair_table_user ----
+class PairTable(ctypes.Structure):
+    _fields_ = [
+        ("nr_entries", ctypes.c_uint32),
+        ("_rsvd", ctypes.c_uint32),
+        ("dropped", ctypes.c_uint64),
+        ("entries", PairEntry * PAIR_TABLE_SIZE),
+    ]
+
+# ---- struct tid_slot_user (aligned(64), seq-protected; tid == 0 means free) ----
+class TidSlot(ctypes.Structure):
+    _fields_ = [
+        ("seq", ctypes.c_uint32),
+        ("tid", ctypes.c_int32),
+        ("pgid", ctypes.c_int32),
+        ("parent_slot", ctypes.c_uint16),
+        ("_rsvd", ctypes.c_uint16),
+        ("parent_gen", ctypes.c_uint32),
+        ("gen", ctypes.c_uint32),
+        ("cycles", ctypes.c_uint64),
+        ("instructions", ctypes.c_uint64),
+        ("run_ns", ctypes.c_uint64),
+        ("switch_ins", ctypes.c_uint64),
+        ("_pad", ctypes.c_uint8 * 8),     # aligned(64) tail padding
+    ]
+
+# ---- struct ipc_tid_table_user ----
+class TidTable(ctypes.Structure):
+    _fields_ = [
+        ("nr_entries", ctypes.c_uint32),
+        ("nr_used", ctypes.c_uint32),
+        ("dropped", ctypes.c_uint64),
+        ("_pad", ctypes.c_uint8 * 48),    # entries are aligned(64)
+        ("entries", TidSlot * TID_POOL_SIZE),
+    ]
+
+# ---- struct slot_smt_user (per-slot SMT split, covered by slots[i].seq) ----
+# solo: sibling idle (or none); corun: sibling ran a task. Intervals in which
+# the sibling changed occupant are in neither (cycles - solo - corun = mixed).
+class SlotSmt(ctypes.Structure):
+    _fields_ = [
+        ("solo_cycles", ctypes.c_uint64),
+        ("solo_instructions", ctypes.c_uint64),
+        ("solo_ns", ctypes.c_uint64),
+        ("corun_cycles", ctypes.c_uint64),
+        ("corun_instructions", ctypes.c_uint64),
+        ("corun_ns", ctypes.c_uint64),
+    ]
+
+# ---- struct core_smt_user (aligned(64), seq-protected) ----
+# busy_ns[n] = time with n of the core's threads running a task
+class CoreSmt(ctypes.Structure):
+    _fields_ = [
+        ("seq", ctypes.c_uint32),
+        ("nr_cpus", ctypes.c_uint32),
+        ("cpus", ctypes.c_int32 * IPC_CORE_THREADS),
+        ("busy_ns", ctypes.c_uint64 * (IPC_CORE_THREADS + 1)),
+        ("_pad", ctypes.c_uint8 * 24),    # aligned(64) tail padding
+    ]
+
+# ---- struct ipc_core_table_user ----
+class CoreTable(ctypes.Structure):
+    _fields_ = [
+        ("nr_cores", ctypes.c_uint32),
+        ("_rsvd", ctypes.c_uint32),
+        ("_pad", ctypes.c_uint8 * 56),    # entries are aligned(64)
+        ("entries", CoreSmt * IPC_MAX_CORES),
+    ]
+
+# ---- struct ipc_trace_record (flight recorder interval, 48 bytes) ----
+# Timestamps are kernel local_clock() ns; peer_slot is a slot index or PEER_*.
+IPC_TRACE_MAGIC = 0x54435049  # "IPCT"
+IPC_TRACE_SWITCH_IN = 0x1     # interval began with a switch-in
+
+class TraceRecord(ctypes.Structure):
+    _fields_ = [
+        ("start_ns", ctypes.c_uint64),
+        ("end_ns", ctypes.c_uint64),
+        ("cycles", ctypes.c_uint64),
+        ("instructions", ctypes.c_uint64),
+        ("gen", ctypes.c_uint32),
+        ("peer_gen", ctypes.c_uint32),
+        ("cpu", ctypes.c_uint16),
+        ("slot", ctypes.c_uint16),
+        ("peer_slot", ctypes.c_uint16),
+        ("flags", ctypes.c_uint16),
+    ]
+
+# ---- header of a smtcheck_native.trace_dump() file, followed by the records ----
+class TraceFileHeader(ctypes.Structure):
+    _fields_ = [
+        ("magic", ctypes.c_uint32),
+        ("version", ctypes.c_uint32),
+        ("record_size", ctypes.c_uint32),
+        ("nr_cpus", ctypes.c_uint32),
+        ("nr_records", ctypes.c_uint64),
+        ("kernel_dropped", ctypes.c_uint64),
+        ("history_evicted", ctypes.c_uint64),
+    ]
+
+def read_trace(path):
+    """Load a flight recorder dump; returns (TraceFileHeader, [TraceRecord])."""
+    with open(path, "rb") as f:
+        data = f.read()
+    hdr = TraceFileHeader.from_buffer_copy(data)
+    if hdr.magic != IPC_TRACE_MAGIC or hdr.record_size != ctypes.sizeof(TraceRecord):
+        raise RuntimeError(f"{path}: not a flight recorder dump "
+                           f"(magic={hdr.magic:#x} record_size={hdr.record_size})")
+    records = (TraceRecord * hdr.nr_records).from_buffer_copy(data, ctypes.sizeof(hdr))
+    return hdr, list(records)
+
+# ---- runtime_monitor netlink batch: RtmonBatch followed by nr_events records ----
+class RtmonBatch(ctypes.Structure):
+    _fields_ = [
+        ("version", ctypes.c_uint16),
+        ("record_size", ctypes.c_uint16),
+        ("nr_events", ctypes.c_uint32),
+        ("seq", ctypes.c_uint64),       # sequence number of the first event
+        ("dropped", ctypes.c_uint64),   # events lost to a full kernel queue
+    ]
+
+class RtmonEvent(ctypes.Structure):
+    _fields_ = [
+        ("type", ctypes.c_uint16),
+        ("_rsvd", ctypes.c_uint16),
+        ("pgid", ctypes.c_int32),
+        ("global_jobid", ctypes.c_int32),
+        ("value", ctypes.c_int32),
+        ("ts_ns", ctypes.c_uint64),
+        ("arg", ctypes.c_uint64),
+    ]
+
+def decode_rtmon_events(data):
+    """Decode one recv() from the runtime_monitor socket.
+
+    Returns (events, dropped): the RtmonEvent records of every RTMON_MSG_EVENTS
+    message in the buffer, and the kernel's dropped-event count (None if the
+    buffer held no batch).
+    """
+    events, dropped = [], None
+    off = 0
+    while off + _NLMSG_HDR_LEN <= len(data):
+        nlmsg_len, nlmsg_type = struct.unpack_from("IH", data, off)
+        if nlmsg_len < _NLMSG_HDR_LEN or off + nlmsg_len > len(data):
+            break
+        body = off + _NLMSG_HDR_LEN
+        if (nlmsg_type == RTMON_MSG_EVENTS and
+                nlmsg_len >= _NLMSG_HDR_LEN + ctypes.sizeof(RtmonBatch)):
+            batch = RtmonBatch.from_buffer_copy(data, body)
+            rec = body + ctypes.sizeof(RtmonBatch)
+            nr = min(batch.nr_events, (off + nlmsg_len - rec) // max(batch.record_size, 1))
+            if batch.version == RTMON_NL_VERSION and batch.record_size >= ctypes.sizeof(RtmonEvent):
+                if batch.record_size == ctypes.sizeof(RtmonEvent):
+                    events.extend((RtmonEvent * nr).from_buffer_copy(data, rec))
+                else:
+                    events.extend(RtmonEvent.from_buffer_copy(data, rec + i * batch.record_size)
+                                  for i in range(nr))
+                dropped = batch.dropped
+        off += (nlmsg_len + 3) & ~3
+    return events, dropped
+
+def make_rtmon_ack(pgids, sender_pid=None):
+    """RTMON_MSG_ACK message reporting that profiling finished for pgids."""
+    pgids = [int(p) for p in pgids]
+    batch = RtmonBatch(RTMON_NL_VERSION, struct.calcsize("i"), len(pgids), 0, 0)
+    payload = bytes(batch) + struct.pack(f"{len(pgids)}i", *pgids)
+    hdr = struct.pack(_NLMSG_HDR_FMT, _NLMSG_HDR_LEN + len(payload), RTMON_MSG_ACK, 0, 0,
+                      os.getpid() if sender_pid is None else sender_pid)
+    return hdr + payload
+
+def open_rtmon_socket(subscribe=True):
+    """Netlink socket for runtime_monitor events.
+
+    With subscribe=True the socket joins the events multicast group, so any
+    number of consumers can listen next to the data loader (which receives its
+    events by unicast after RTMON_IOC_SET_DATA_LOADER_PID). Needs root.
+    """
+    sock = socket.socket(socket.AF_NETLINK, socket.SOCK_RAW, NETLINK_USER)
+    sock.bind((0, (1 << (RTMON_NL_GROUP_EVENTS - 1)) if subscribe else 0))
+    return sock
+
+# ---- runtime_monitor status table (kernel/include/rtmon_status.h) ----
+RTMON_STATUS_MAGIC = 0x4E4D5452     # "RTMN"
+RTMON_STATUS_VERSION = 1
+RTMON_STATUS_HDR_SIZE = 4096
+RTMON_STATUS_MAX = 4096
+
+RTMON_ST_LONG_RUNNING = 0x01        # threshold crossed (or ACK received)
+RTMON_ST_PROFILE_DONE = 0x02        # profiling ACK received
+RTMON_ST_IPCMON_REGISTERED = 0x04   # has an IPC_monitor slot
+RTMON_ST_PROVISIONAL = 0x08         # registered before the ACK
+RTMON_ST_SIGNATURE_SENT = 0x10      # RTMON_EV_PROVISIONAL emitted
+RTMON_ST_REQUEST_PENDING = 0x20     # a long-running event is waiting to be queued
+
+class RtmonStatusHeader(ctypes.Structure):
+    _fields_ = [
+        ("magic", ctypes.c_uint32),
+        ("version", ctypes.c_uint32),
+        ("header_size", ctypes.c_uint32),
+        ("entry_size", ctypes.c_uint32),
+        ("max_entries", ctypes.c_uint32),
+        ("nr_used", ctypes.c_uint32),       # high-water mark of live records
+        ("total_size", ctypes.c_uint64),
+        ("entries_off", ctypes.c_uint64),
+        ("epoch", ctypes.c_uint64),
+        ("overflow", ctypes.c_uint64),      # groups tracked without a record
+        ("long_running_threshold", ctypes.c_uint32),
+        ("_rsvd", ctypes.c_uint32),
+    ]
+
+class RtmonStatusEntry(ctypes.Structure):
+    _fields_ = [
+        ("seq", ctypes.c_uint32),
+        ("flags", ctypes.c_uint32),
+        ("pgid", ctypes.c_int32),           # 0: free record
+        ("global_jobid", ctypes.c_int32),
+        ("worker_num", ctypes.c_int32),
+        ("threshold_sec", ctypes.c_uint32),
+        ("start_time_ns", ctypes.c_uint64), # CLOCK_MONOTONIC
+        ("request_ns", ctypes.c_uint64),    # last long-running event, 0: none
+        ("ack_ns", ctypes.c_uint64),        # profiling ACK, 0: none
+        ("_rsvd", ctypes.c_uint64),
+        ("_pad", ctypes.c_uint8 * 8),       # __attribute__((aligned(64)))
+    ]
+
+class RtmonStatusTable(ctypes.Structure):
+    _fields_ = [
+        ("hdr", RtmonStatusHeader),
+        ("_hdr_pad", ctypes.c_uint8 * (RTMON_STATUS_HDR_SIZE - ctypes.sizeof(RtmonStatusHeader))),
+        ("entries", RtmonStatusEntry * RTMON_STATUS_MAX),
+    ]
+
+_libc = ctypes.CDLL(None, use_errno=True)
+_libc.mmap.restype = ctypes.c_void_p
+_libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+                       ctypes.c_int, ctypes.c_long]
+_libc.munmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+
+class RtmonStatus:
+    """
+    Read-only view of runtime_monitor's per-pgid state (/dev/runtime_monitor mmap).
+
+    Usage:
+        status = RtmonStatus()
+        for e in status.entries():
+            print(e["pgid"], e["global_jobid"], status.elapsed_sec(e))
+    """
+
+    def __init__(self, device_path="/dev/runtime_monitor"):
+        self.fd = os.open(device_path, os.O_RDONLY)
+        try:
+            with mmap.mmap(self.fd, RTMON_STATUS_HDR_SIZE, flags=mmap.MAP_SHARED,
+                           prot=mmap.PROT_READ) as hdr_mm:
+                hdr = RtmonStatusHeader.from_buffer_copy(hdr_mm)
+            if hdr.magic != RTMON_STATUS_MAGIC or hdr.version != RTMON_STATUS_VERSION:
+                raise RuntimeError(f"runtime_monitor status ABI mismatch: magic={hdr.magic:#x} "
+                                   f"version={hdr.version} (expected {RTMON_STATUS_VERSION})")
+            if (hdr.entry_size != ctypes.sizeof(RtmonStatusEntry) or
+                    hdr.entries_off != RtmonStatusTable.entries.offset or
+                    hdr.total_size < ctypes.sizeof(RtmonStatusTable)):
+                raise RuntimeError("runtime_monitor status layout mismatch")
+            # PROT_READ only (the kernel refuses writable maps), which from_buffer()
+            # cannot wrap, so map through libc and view the table by address
+            self._size = ctypes.sizeof(RtmonStatusTable)
+            self._addr = _libc.mmap(None, self._size, mmap.PROT_READ, mmap.MAP_SHARED, self.fd, 0)
+            if self._addr in (None, ctypes.c_void_p(-1).value):
+                err = ctypes.get_errno()
+                raise OSError(err, f"mmap {device_path}: {os.strerror(err)}")
+        except Exception:
+            os.close(self.fd)
+            raise
+        self.data = RtmonStatusTable.from_address(self._addr)
+
+    def close(self):
+        """Unmap the table and close the device."""
+        self.data = None
+        _libc.munmap(self._addr, self._size)
+        os.close(self.fd)
+
+    @property
+    def epoch(self):
+        """Grows on every record update; poll it to skip unchanged scans."""
+        return self.data.hdr.epoch
+
+    def read_entry(self, index):
+        """Return a seq-consistent dict of one record, or None if it is free."""
+        e = self.data.entries[index]
+        while True:
+            seq_before = e.seq
+            if seq_before & 1:
+                continue
+            values = {
+                "pgid": e.pgid, "global_jobid": e.global_jobid, "worker_num": e.worker_num,
+                "flags": e.flags, "threshold_sec": e.threshold_sec,
+                "start_time_ns": e.start_time_ns, "request_ns": e.request_ns, "ack_ns": e.ack_ns,
+            }
+            if e.seq == seq_before:
+                return values if values["pgid"] else None
+
+    def entries(self):
+        """Generator over the live records."""
+        for index in range(min(self.data.hdr.nr_used, RTMON_STATUS_MAX)):
+            entry = self.read_entry(index)
+            if entry is not None:
+                yield entry
+
+    @staticmethod
+    def elapsed_sec(entry):
+        """Seconds since the group started being tracked."""
+        return (time.monotonic_ns() - entry["start_time_ns"]) / 1e9
+
+    def awaiting_ack(self, global_jobid=None):
+        """
+        PGIDs past the threshold whose profiling ACK is still missing,
+        optionally only those of one job.
+        """
+        return [e["pgid"] for e in self.entries()
+                if e["flags"] & RTMON_ST_LONG_RUNNING and not e["flags"] & RTMON_ST_PROFILE_DONE
+                and (global_jobid is None or e["global_jobid"] == global_jobid)]
+
+# ---- struct ipc_shared (ABI v2) ----
 #
 # struct ipc_shared {
-#     atomic_t count;   // effectively 4 bytes on x86_64
-#     unsigned long active_mask[64]; // 8*64 = 512 bytes
-#     struct pgid_slot_only_counter slots[4096]; // 16*4096 = 65536 bytes
+#     struct ipc_shared_header hdr;       // padded to one 4 KiB page
+#     struct ipc_active_list active;      // dense active slot list
+#     struct pgid_slot_user slots[4096];  // 64 bytes each
+#     ...
 # };
 #
-# Important: alignment after atomic_t
-# - atomic_t is 4 bytes, so the next field (unsigned long, 8-byte aligned)
-#   will introduce 4 bytes implicit padding in C on x86_64.
+# map() checks that the offsets published in the header match this layout.
 #
 class IpcShared(ctypes.Structure):
     _fields_ = [
-        ("count", ctypes.c_int32),
-        ("_pad0", ctypes.c_int32),
-        ("active_mask", ctypes.c_ulong * ACTIVE_MASK_SIZE),
-        ("_pad_to_slots", ctypes.c_uint8 * 8),
+        ("hdr", IpcSharedHeader),
+        ("_hdr_pad", ctypes.c_uint8 * (IPC_HDR_SIZE - ctypes.sizeof(IpcSharedHeader))),
+        ("active", ActiveList),
         ("slots", PgidSlot * MAX_SLOTS),
+        ("event_set", EventSetUser),
+        ("slot_events", PgidEvents * MAX_SLOTS),
+        ("pairs", PairTable),
+        ("tids", TidTable),
+        ("slot_keys", ctypes.c_uint64 * MAX_SLOTS),   # PGID or cgroup ID per slot
+        ("slot_smt", SlotSmt * MAX_SLOTS),
+        ("cores", CoreTable),
     ]
 
 class SharedMemoryManager:
@@ -131,41 +669,94 @@ class SharedMemoryManager:
     def __init__(self, device_path="/dev/IPC_monitor"):
         self.device_path = device_path
         self.fd = -1
-        self.mm = None
+        self._addr = None
+        self._size = 0
         self.data = None  # Will hold the IpcShared structure
         self.is_mapped = False
+        self.backend = None  # "module" or "ebpf" once mapped
+        self._seen_epoch = 0  # eBPF backend: last epoch returned by wait_for_change
 
-        # Build ioctl command for resetting counters: _IO('I', 0)
-        self.IPC_IOC_MAGIC = ord('I')
-        self.IPC_IOC_RESET_COUNTERS = (
-            (0 << 30) | (self.IPC_IOC_MAGIC << 8) | (0 << 0) | (0 << 16)
-        )
+    def _open_backend(self):
+        """Open the module device, or the eBPF backend's pinned region if it is absent."""
+        try:
+            self.backend = "module"
+            return os.open(self.device_path, os.O_RDWR)
+        except FileNotFoundError:
+            pass
+
+        nr_bpf = _NR_BPF.get(platform.machine())
+        if nr_bpf is None:
+            raise FileNotFoundError(f"{self.device_path} not found and no eBPF backend support on "
+                                    f"{platform.machine()}")
+
+        # union bpf_attr for BPF_OBJ_GET: pathname, bpf_fd, file_flags
+        path = ctypes.create_string_buffer(IPCMON_BPF_SHARED.encode())
+        attr = ctypes.create_string_buffer(struct.pack("QII", ctypes.addressof(path), 0, 0), 64)
+        libc = ctypes.CDLL(None, use_errno=True)
+        fd = libc.syscall(nr_bpf, BPF_OBJ_GET, attr, ctypes.sizeof(attr))
+        if fd < 0:
+            err = ctypes.get_errno()
+            raise FileNotFoundError(err, f"{self.device_path} not found and eBPF backend "
+                                         f"unavailable: {os.strerror(err)}", IPCMON_BPF_SHARED)
+        self.backend = "ebpf"
+        return fd
+
+    def _negotiate(self):
+        """Map the header page, check the ABI and return the full mapping size."""
+        with mmap.mmap(self.fd, IPC_HDR_SIZE, flags=mmap.MAP_SHARED, prot=mmap.PROT_READ) as hdr_mm:
+            hdr = IpcSharedHeader.from_buffer_copy(hdr_mm)
+
+        if hdr.magic != IPC_ABI_MAGIC or hdr.abi_version != IPC_ABI_VERSION:
+            raise RuntimeError(f"IPC_monitor ABI mismatch: magic={hdr.magic:#x} "
+                               f"version={hdr.abi_version} (expected {IPC_ABI_VERSION})")
+
+        expected = {
+            "slot_size": ctypes.sizeof(PgidSlot),
+            "max_slots": MAX_SLOTS,
+            "active_off": IpcShared.active.offset,
+            "slots_off": IpcShared.slots.offset,
+            "event_set_off": IpcShared.event_set.offset,
+            "slot_events_off": IpcShared.slot_events.offset,
+            "pairs_off": IpcShared.pairs.offset,
+            "tids_off": IpcShared.tids.offset,
+            "keys_off": IpcShared.slot_keys.offset,
+            "slot_smt_off": IpcShared.slot_smt.offset,
+            "cores_off": IpcShared.cores.offset,
+        }
+        for name, value in expected.items():
+            if getattr(hdr, name) != value:
+                raise RuntimeError(f"IPC_monitor layout mismatch: {name}="
+                                   f"{getattr(hdr, name)} (expected {value})")
+        if hdr.total_size < ctypes.sizeof(IpcShared):
+            raise RuntimeError(f"IPC_monitor region too small: {hdr.total_size}")
+        return hdr.total_size
 
     def map(self):
         """Map the shared memory from kernel into userspace.
-        
-        Opens the device file and creates an mmap with PAGE_ALIGN size
-        to match the kernel's allocation.
+
+        Maps the header page first to negotiate the ABI version, then maps
+        the full region size published by the kernel.
         """
         if self.is_mapped:
             print("Warning: Memory is already mapped.")
             return
 
         try:
-            self.fd = os.open(self.device_path, os.O_RDWR)
-            
-            # Calculate PAGE_ALIGN size (same as kernel's calculation)
-            base_size = ctypes.sizeof(IpcShared)
-            page_size = os.sysconf("SC_PAGESIZE")
-            mmap_size = ((base_size + page_size - 1) // page_size) * page_size
-            
-            print(f"Base size: {base_size}, Page size: {page_size}, Aligned mmap_size: {mmap_size}")
-            
-            self.mm = mmap.mmap(self.fd, mmap_size, 
-                                   flags=mmap.MAP_SHARED, 
-                                   prot=mmap.PROT_READ | mmap.PROT_WRITE)
-            
-            self.data = IpcShared.from_buffer(self.mm)
+            self.fd = self._open_backend()
+
+            mmap_size = self._negotiate()
+            print(f"Backend: {self.backend}, ABI version: {IPC_ABI_VERSION}, mmap_size: {mmap_size}")
+
+            # PROT_READ only (the module refuses writable maps), which from_buffer()
+            # cannot wrap, so map through libc and view the region by address
+            addr = _libc.mmap(None, mmap_size, mmap.PROT_READ, mmap.MAP_SHARED, self.fd, 0)
+            if addr in (None, ctypes.c_void_p(-1).value):
+                err = ctypes.get_errno()
+                raise OSError(err, f"mmap {self.device_path}: {os.strerror(err)}")
+            self._addr, self._size = addr, mmap_size
+
+            self.data = IpcShared.from_address(self._addr)
+            self._seen_epoch = self.data.hdr.epoch
             self.is_mapped = True
             print("Shared memory mapped successfully.")
             
@@ -173,50 +764,360 @@ class SharedMemoryManager:
             self.close()
             raise e
     
-    def reset_counters(self):
-        """Send ioctl to kernel to reset performance counters."""
+    def read_slot(self, index):
+        """Return (gen, pgid, global_jobid, cycles, instructions) for a slot, seq-consistent."""
+        slot = self.data.slots[index]
+        while True:
+            seq_before = slot.seq
+            if seq_before & 1:
+                continue
+            values = (slot.gen, slot.pgid, slot.global_jobid, slot.cycles, slot.instructions)
+            if slot.seq == seq_before:
+                return values
+
+    def slot_key(self, index):
+        """Return (key_type, key) for a slot: a PGID or a cgroup v2 ID, seq-consistent."""
+        slot = self.data.slots[index]
+        while True:
+            seq_before = slot.seq
+            if seq_before & 1:
+                continue
+            values = (slot.key_type, self.data.slot_keys[index])
+            if slot.seq == seq_before:
+                return values
+
+    def add_cgroup(self, cgroup_path, global_jobid, worker_num):
+        """
+        Track every task under a cgroup v2 directory (e.g. a container) as one slot.
+
+        Args:
+            cgroup_path: Path under the cgroup2 mount, e.g. /sys/fs/cgroup/system.slice/x.scope
+            global_jobid: Job ID published in the slot
+            worker_num: Number of workers published in the slot
+
+        Returns:
+            The cgroup ID (inode number of the directory) used as the slot key
+        """
+        cgid = os.stat(cgroup_path).st_ino
+        fcntl.ioctl(self.fd, IPC_IOC_ADD_CGROUP, struct.pack("Qii", cgid, global_jobid, worker_num))
+        return cgid
+
+    def remove_cgroup(self, cgid):
+        """Stop tracking a cgroup added with add_cgroup()."""
+        fcntl.ioctl(self.fd, IPC_IOC_REMOVE_CGROUP, struct.pack("Q", cgid))
+
+    def slot_rates(self, index):
+        """
+        Return (ewma_ipc, ewma_util, run_ns, switch_ins) for a slot, seq-consistent.
+
+        ewma_ipc and ewma_util (average CPUs busy) are maintained by the kernel
+        with a half-life of hdr.ewma_halflife_ms, so one read gives current rates.
+        """
+        slot = self.data.slots[index]
+        while True:
+            seq_before = slot.seq
+            if seq_before & 1:
+                continue
+            values = (slot.ewma_ipc / EWMA_ONE, slot.ewma_util / EWMA_ONE,
+                      slot.run_ns, slot.switch_ins)
+            if slot.seq == seq_before:
+                return values
+
+    def set_ewma_halflife(self, halflife_ms):
+        """Set the half-life of the kernel-side EWMA rates (1..60000 ms)."""
+        fcntl.ioctl(self.fd, IPC_IOC_SET_EWMA_HALFLIFE, struct.pack("I", halflife_ms))
+
+    def snapshot(self):
+        """
+        Take a baseline of every active slot.
+
+        Counters are never reset by the kernel, so each reader keeps its own
+        baseline and computes deltas with deltas_since().
+
+        Returns:
+            Dict of slot index -> (gen, pgid, global_jobid, cycles, instructions)
+        """
+        return {index: self.read_slot(index) for index in self.active_indices()}
+
+    def deltas_since(self, baseline):
+        """
+        Generator over counter deltas since a snapshot() baseline.
+
+        Slots (re)assigned after the baseline (new gen) are reported from zero.
+
+        Yields:
+            Tuples of (pgid, global_jobid, delta_cycles, delta_instructions)
+        """
+        for index in self.active_indices():
+            gen, pgid, global_jobid, cycles, instructions = self.read_slot(index)
+            if self.data.slots[index].key_type == IPC_KEY_NONE:
+                continue
+            base = baseline.get(index)
+            if base is not None and base[0] == gen:
+                cycles -= base[3]
+                instructions -= base[4]
+            yield pgid, global_jobid, cycles, instructions
+
+    def set_events(self, events):
+        """Configure the extra PMU events counted for every slot.
+
+        Args:
+            events: Up to IPC_MAX_EVENTS entries, each a PERF_EVENT_PRESETS key
+                    or a (type, config) / (type, config, config1) tuple.
+                    An empty list clears the set.
+        """
+        if len(events) > IPC_MAX_EVENTS:
+            raise ValueError(f"at most {IPC_MAX_EVENTS} extra events are supported")
+
+        cfg = EventConfig()
+        cfg.nr_events = len(events)
+        for i, event in enumerate(events):
+            if isinstance(event, str):
+                event = PERF_EVENT_PRESETS[event]
+            cfg.events[i].type = event[0]
+            cfg.events[i].config = event[1]
+            cfg.events[i].config1 = event[2] if len(event) > 2 else 0
+
+        fcntl.ioctl(self.fd, IPC_IOC_SET_EVENTS, bytes(cfg))
+
+    def slot_event_counts(self, index):
+        """Return (pgid, cycles, instructions, [event totals]) for a slot, seq-consistent."""
+        slot = self.data.slots[index]
+        events = self.data.slot_events[index]
+        while True:
+            seq_before = slot.seq
+            if seq_before & 1:
+                continue
+            values = (slot.pgid, slot.cycles, slot.instructions,
+                      list(events.counts[:self.data.event_set.nr_events]))
+            if slot.seq == seq_before:
+                return values
+
+    def corun_pairs(self):
+        """
+        Generator over live co-run pair entries, seq-consistent.
+
+        Yields:
+            Tuples of (own_jobid, peer_jobid, cycles, instructions). peer_jobid is
+            the sibling's global_jobid, or "idle" / "other" / "mixed".
+        """
+        peer_names = {PEER_IDLE: "idle", PEER_OTHER: "other", PEER_MIXED: "mixed"}
+        slots = self.data.slots
+
+        for entry in self.data.pairs.entries:
+            while True:
+                seq_before = entry.seq
+                if seq_before & 1:
+                    continue
+                values = (entry.own_slot, entry.own_gen, entry.peer_slot, entry.peer_gen,
+                          entry.own_jobid, entry.peer_jobid,
+                          entry.cycles, entry.instructions)
+                if entry.seq == seq_before:
+                    break
+
+            own_slot, own_gen, peer_slot, peer_gen, own_jobid, peer_jobid, cycles, instructions = values
+            if own_gen == 0 or slots[own_slot].gen != own_gen:
+                continue  # never used, or the own slot was removed
+            if peer_slot < MAX_SLOTS:
+                if slots[peer_slot].gen != peer_gen:
+                    continue
+            else:
+                peer_jobid = peer_names.get(peer_slot, "other")
+            yield own_jobid, peer_jobid, cycles, instructions
+
+    def corun_ipc(self):
+        """Return {(own_jobid, peer_jobid): IPC} summed over all observed co-runs."""
+        totals = {}
+        for own_jobid, peer_jobid, cycles, instructions in self.corun_pairs():
+            c, i = totals.get((own_jobid, peer_jobid), (0, 0))
+            totals[(own_jobid, peer_jobid)] = (c + cycles, i + instructions)
+        return {key: i / c for key, (c, i) in totals.items() if c > 0}
+
+    def slot_smt(self, index):
+        """
+        Return (solo_cycles, solo_instructions, solo_ns, corun_cycles,
+        corun_instructions, corun_ns) for a slot, seq-consistent.
+
+        Solo counts were taken while the SMT sibling was idle, co-run counts
+        while it ran any task. Like the slot counters they are monotonic per gen.
+        """
+        slot = self.data.slots[index]
+        smt = self.data.slot_smt[index]
+        while True:
+            seq_before = slot.seq
+            if seq_before & 1:
+                continue
+            values = (smt.solo_cycles, smt.solo_instructions, smt.solo_ns,
+                      smt.corun_cycles, smt.corun_instructions, smt.corun_ns)
+            if slot.seq == seq_before:
+                return values
+
+    def solo_ipc(self, min_cycles=1_000_000):
+        """
+        Measured solo IPC per global job ID: instructions/cycles accumulated
+        while the SMT sibling was idle, over every active slot of the job.
+
+        Jobs with fewer than min_cycles solo cycles are left out. Usable to
+        refresh the profiled single-IPC table in production.
+        """
+        totals = {}
+        for index in self.active_indices():
+            slot = self.data.slots[index]
+            if slot.key_type == IPC_KEY_NONE:
+                continue
+            solo_cycles, solo_insts = self.slot_smt(index)[:2]
+            cycles, insts = totals.get(slot.global_jobid, (0, 0))
+            totals[slot.global_jobid] = (cycles + solo_cycles, insts + solo_insts)
+        return {jobid: insts / cycles for jobid, (cycles, insts) in totals.items()
+                if cycles >= min_cycles}
+
+    def job_signature(self, global_jobid, min_cycles=1_000_000):
+        """
+        Early (solo_ipc, corun_ipc) of a job from the SMT split of its slots.
+
+        Either value is None while fewer than min_cycles were observed in that
+        state. This is the in-situ signature behind RTMON_EV_PROVISIONAL.
+        """
+        solo_c = solo_i = corun_c = corun_i = 0
+        for index in self.active_indices():
+            slot = self.data.slots[index]
+            if slot.key_type == IPC_KEY_NONE or slot.global_jobid != global_jobid:
+                continue
+            sc, si, _, cc, ci, _ = self.slot_smt(index)
+            solo_c += sc
+            solo_i += si
+            corun_c += cc
+            corun_i += ci
+        return (solo_i / solo_c if solo_c >= min_cycles else None,
+                corun_i / corun_c if corun_c >= min_cycles else None)
+
+    def core_occupancy(self):
+        """
+        Per-core SMT occupancy.
+
+        Returns:
+            List of (cpus, busy_ns) per physical core, where busy_ns[n] is the
+            time with n of its threads running a task (seq-consistent).
+        """
+        cores = self.data.cores
+        result = []
+        for i in range(min(cores.nr_cores, IPC_MAX_CORES)):
+            core = cores.entries[i]
+            while True:
+                seq_before = core.seq
+                if seq_before & 1:
+                    continue
+                entry = (tuple(core.cpus[:core.nr_cpus]), list(core.busy_ns[:core.nr_cpus + 1]))
+                if core.seq == seq_before:
+                    result.append(entry)
+                    break
+        return result
+
+    def set_tid_mode(self, pgid, enable=True):
+        """Enable or disable per-tid sub-slots for a registered PGID."""
+        fcntl.ioctl(self.fd, IPC_IOC_SET_TID_MODE, struct.pack("iI", pgid, int(enable)))
+
+    def tid_slots(self, pgid=None):
+        """
+        Generator over live per-tid sub-slots, seq-consistent.
+
+        Args:
+            pgid: Only yield threads of this PGID (all PGIDs if None)
+
+        Yields:
+            Tuples of (pgid, tid, cycles, instructions, run_ns, switch_ins).
+            Sub-slots only count while tid mode is on, so they need not add up
+            to the PGID aggregate.
+        """
+        slots = self.data.slots
+        for entry in self.data.tids.entries:
+            if entry.tid == 0:
+                continue
+            while True:
+                seq_before = entry.seq
+                if seq_before & 1:
+                    continue
+                values = (entry.tid, entry.pgid, entry.parent_slot, entry.parent_gen,
+                          entry.cycles, entry.instructions, entry.run_ns, entry.switch_ins)
+                if entry.seq == seq_before:
+                    break
+
+            tid, tid_pgid, parent_slot, parent_gen, cycles, instructions, run_ns, switch_ins = values
+            if tid == 0 or (pgid is not None and tid_pgid != pgid):
+                continue
+            if slots[parent_slot].gen != parent_gen:
+                continue  # parent PGID was removed; reclaimed on the thread's next switch or exit
+            yield tid_pgid, tid, cycles, instructions, run_ns, switch_ins
+
+    def sync_counters(self):
+        """Send ioctl to kernel to aggregate per-CPU partial counters into the snapshot."""
         if not self.is_mapped:
             print("Error: Memory not mapped.")
             return
+        if self.backend == "ebpf":
+            return  # ipcmon_loader aggregates on its own interval
 
         try:
-            fcntl.ioctl(self.fd, self.IPC_IOC_RESET_COUNTERS)
-            print("ioctl: IPC_IOC_RESET_COUNTERS command sent.")
+            fcntl.ioctl(self.fd, IPC_IOC_SYNC_COUNTERS)
         except OSError as e:
             print(f"ioctl failed: {e}")
 
     def close(self):
         """Release mapped memory and file descriptor."""
-        if self.mm:
-            self.mm.close()
-            self.mm = None
+        self.data = None
+        if self._addr is not None:
+            _libc.munmap(self._addr, self._size)
+            self._addr = None
         if self.fd != -1:
             os.close(self.fd)
             self.fd = -1
         self.is_mapped = False
         print("Shared memory resources cleaned up.")
 
-    def _scan_bitmask(self):
-        """
-        Generator that scans the active_mask bitmask and yields active slot indices.
-        
-        Uses bit manipulation to efficiently find set bits in the mask.
-        """
-        if not self.is_mapped or self.data.count == 0:
-            print("No active slots to scan.")
-            return
+    def active_indices(self):
+        """Return a seq-consistent copy of the dense active slot index list."""
+        if not self.is_mapped:
+            return []
 
-        for i, bits_chunk in enumerate(self.data.active_mask):
-            if bits_chunk == 0:
+        active = self.data.active
+        while True:
+            seq_before = active.seq
+            if seq_before & 1:
                 continue
-            
-            temp_chunk = bits_chunk
-            while temp_chunk > 0:
-                # Find rightmost set bit using two's complement trick
-                rightmost_one = temp_chunk & -temp_chunk
-                bit_position = rightmost_one.bit_length() - 1
-                yield i * BITS_PER_LONG + bit_position
-                temp_chunk &= ~rightmost_one  # Clear the rightmost bit
+            indices = list(active.idx[:min(active.nr_active, MAX_SLOTS)])
+            if active.seq == seq_before:
+                return indices
+
+    @property
+    def epoch(self):
+        """Slot epoch; changes whenever a slot is added or removed or a worker count changes."""
+        return self.data.hdr.epoch
+
+    def wait_for_change(self, timeout=None, poll_interval=0.01):
+        """Sleep until the epoch changes; return the new epoch, or None on timeout.
+
+        The module device is readable (poll/read) once the epoch changed since
+        this file last read it. The eBPF backend's pinned map cannot be polled,
+        so it is rechecked every poll_interval seconds.
+        """
+        if not self.is_mapped:
+            return None
+
+        if self.backend == "module":
+            ready, _, _ = select.select([self.fd], [], [], timeout)
+            if not ready:
+                return None
+            return struct.unpack("Q", os.read(self.fd, 8))[0]
+
+        deadline = None if timeout is None else time.monotonic() + timeout
+        while True:
+            epoch = self.data.hdr.epoch
+            if epoch != self._seen_epoch:
+                self._seen_epoch = epoch
+                return epoch
+            if deadline is not None and time.monotonic() >= deadline:
+                return None
+            time.sleep(poll_interval)
 
     @property
     def active_slots(self):
@@ -230,7 +1131,7 @@ class SharedMemoryManager:
             for slot in manager.active_slots:
                 print(f"PGID={slot.pgid}, Cycles={slot.cycles}")
         """
-        for index in self._scan_bitmask():
+        for index in self.active_indices():
             print(f"Active slot index found: {index}")
             yield self.data.slots[index]
 
@@ -239,5 +1140,12 @@ if __name__ == "__main__":
     print("sizeof(PgidSlot) =", ctypes.sizeof(PgidSlot))
     print("alignof(PgidSlot) =", ctypes.alignment(PgidSlot))
     print("sizeof(IpcShared) =", ctypes.sizeof(IpcShared))
-    print("offset(active_mask) =", IpcShared.active_mask.offset)
+    print("offset(active) =", IpcShared.active.offset)
     print("offset(slots) =", IpcShared.slots.offset)
+    print("offset(event_set) =", IpcShared.event_set.offset)
+    print("offset(slot_events) =", IpcShared.slot_events.offset)
+    print("offset(pairs) =", IpcShared.pairs.offset)
+    print("offset(tids) =", IpcShared.tids.offset)
+    print("offset(slot_keys) =", IpcShared.slot_keys.offset)
+    print("offset(slot_smt) =", IpcShared.slot_smt.offset)
+    print("offset(cores) =", IpcShared.cores.offset)
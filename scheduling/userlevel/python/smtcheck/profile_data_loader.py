@@ -8,16 +8,19 @@ This module handles communication between the scheduling system and:
 
 Key Functions:
     initialize(): Set up connections to kernel and database
-    netlink_listener(): Block waiting for kernel events
+    netlink_listener(): Block waiting for the next long-running process
+    netlink_events(): Block for the next batch of kernel events
     read_profile_data(): Fetch profile data from MongoDB
     send_profiling_request(): Request profiling from server
 """
 
 import os, fcntl, struct, socket
 import threading, time
+from collections import deque
 from pymongo import MongoClient
 import numpy as np
-from .c_struct import RTMON_IOC_SET_DATA_LOADER_PID, _NLMSG_HDR_LEN, _NLMSG_HDR_FMT
+from .c_struct import (RTMON_IOC_SET_DATA_LOADER_PID, NETLINK_USER, RTMON_EV_LONG_RUNNING,
+                       decode_rtmon_events, make_rtmon_ack)
 from .machine_data import *
 from .global_variable_generator import *
 
@@ -27,6 +30,9 @@ db_handler = None
 kernel_sock = None
 fd = None
 
+# Long-running events decoded but not yet returned by netlink_listener()
+pending_long_running = deque()
+
 lookup_history_table = dict()
 lookup_history_table_lock = threading.Lock()
 
@@ -110,24 +116,16 @@ def send_profiling_request(global_jobid):
 # Netlink Message Helpers
 # =============================================================================
 
-def make_msg(pgid: int, nlmsg_type: int = 0, nlmsg_flags: int = 0):
-    """Build a netlink message to send to the kernel.
+def make_msg(pgid: int):
+    """Build the profiling-done ACK for one PGID (RTMON_MSG_ACK, see rtmon_netlink.h).
     
     Args:
-        pgid: Process group ID to include in payload
-        nlmsg_type: Netlink message type (default 0)
-        nlmsg_flags: Netlink message flags (default 0)
+        pgid: Process group ID whose profiling finished
         
     Returns:
         Bytes object containing the complete netlink message
     """
-    payload = struct.pack("i", int(pgid))
-    nlmsg_len = _NLMSG_HDR_LEN + len(payload)
-    nlmsg_seq = 0
-    nlmsg_pid = os.getpid()  # Sender PID
-    hdr = struct.pack(_NLMSG_HDR_FMT, nlmsg_len, nlmsg_type, nlmsg_flags, nlmsg_seq, nlmsg_pid)
-    msg = hdr + payload
-    return msg
+    return make_rtmon_ack([pgid])
 
 
 def read_profile_data(global_jobid, pgid):
@@ -166,29 +164,37 @@ def read_profile_data(global_jobid, pgid):
 # Netlink Listener
 # =============================================================================
 
-def netlink_listener():
-    """Block waiting for a netlink message from the kernel.
-    
-    The kernel sends messages when a long-running process is detected.
-    Message format: "pgid,elapsed_seconds,global_jobid"
+def netlink_events():
+    """Block for the next message batch from the kernel.
     
     Returns:
-        Tuple of (pgid, global_jobid) as integers
+        List of RtmonEvent (type, pgid, global_jobid, value, ts_ns, arg)
     """
-    data, addr = kernel_sock.recvfrom(65535)
-    pgid, global_jobid = 0, 0
+    data = kernel_sock.recv(1 << 16)
+    events, dropped = decode_rtmon_events(data)
+    if dropped:
+        print(f"[Netlink] Kernel dropped {dropped} events so far", flush=True)
+    return events
+
+def netlink_listener(on_event=None):
+    """Block until the kernel reports a long-running process group.
     
-    if len(data) > 16:
-        # Skip 16-byte netlink header
-        payload = data[16:]
-        msg = payload.split(b'\x00', 1)[0]
-        decoded = msg.decode(errors="ignore").strip()
-        pgid, _, global_jobid = decoded.split(",")
-        print(f"[Netlink] Event received: job_id={global_jobid}", flush=True)
-    else:
-        print(f"[Netlink] Short message: {data}")
+    Other event types (exit, worker count, ACK echo, provisional signature)
+    are passed to on_event(ev) if given and skipped otherwise; use
+    netlink_events() to see them all.
     
-    return map(int, (pgid, global_jobid))
+    Returns:
+        Tuple of (pgid, global_jobid) as integers
+    """
+    while not pending_long_running:
+        for ev in netlink_events():
+            if ev.type == RTMON_EV_LONG_RUNNING:
+                pending_long_running.append((ev.pgid, ev.global_jobid))
+            elif on_event is not None:
+                on_event(ev)
+    pgid, global_jobid = pending_long_running.popleft()
+    print(f"[Netlink] Event received: job_id={global_jobid}", flush=True)
+    return pgid, global_jobid
 
 def initialize():
     """Initialize the profile data loader.
@@ -213,10 +219,10 @@ def initialize():
     fcntl.ioctl(fd, RTMON_IOC_SET_DATA_LOADER_PID, buf)
     print(f"Registered PID with kernel: {pid}", flush=True)
 
-    # Create netlink socket for receiving kernel events
-    NETLINK_USER = 31
+    # Create netlink socket for receiving kernel events (unicast to our PID)
     kernel_sock = socket.socket(socket.AF_NETLINK, socket.SOCK_RAW, NETLINK_USER)
     kernel_sock.bind((os.getpid(), 0))  # Bind with our PID
+    kernel_sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
 
     print("[Netlink] Listening for kernel events...", flush=True)
 
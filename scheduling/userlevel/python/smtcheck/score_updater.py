@@ -21,6 +21,7 @@ import glob
 import json
 import os
 import sys
+import threading
 
 # =============================================================================
 # Constants & Enums
@@ -92,6 +93,10 @@ scale_factor_table = dict()
 single_ipc_table = dict()
 characteristics_dict: dict[int, list[WorkloadCharacteristics]] = dict()
 stale_target = set()
+provisional_ratio = dict()     # job_id -> corun/solo IPC from the in-situ signature
+# Serializes the profiling drain thread (add/update) against the netlink thread
+# (provisional scores, expiry); both rewrite the tables above and score_map
+score_table_lock = threading.Lock()
 
 # =============================================================================
 # Utility Functions
@@ -473,8 +478,10 @@ def add_workload(job_id):
     global profile_ipc_data, stale_target
     
     raw_data = profile_data_loader.db_handler.fetch_profile_data(job_id)
-    profile_ipc_data[job_id] = parse_profile_documents(raw_data)
-    stale_target.add(job_id)
+    documents = parse_profile_documents(raw_data)
+    with score_table_lock:
+        profile_ipc_data[job_id] = documents
+        stale_target.add(job_id)
 
 def calculate_all_characteristics():
     """
@@ -539,12 +546,14 @@ def expire_workload(job_id):
         job_id: Global job ID to remove
     """
     global profile_data_table, target_global_jobids, characteristics_dict
-    target_global_jobids.discard(job_id)
-    if job_id in profile_data_table:
-        del profile_data_table[job_id]
-    
-    if job_id in characteristics_dict:
-        del characteristics_dict[job_id]
+    with score_table_lock:
+        target_global_jobids.discard(job_id)
+        provisional_ratio.pop(job_id, None)
+        if job_id in profile_data_table:
+            del profile_data_table[job_id]
+
+        if job_id in characteristics_dict:
+            del characteristics_dict[job_id]
 
 def calculate_compatibility_score(base_jobid, col_jobid):
     global model_coef, model_intercept, characteristics_dict
@@ -568,27 +577,61 @@ def calculate_compatibility_score(base_jobid, col_jobid):
 
 def update_score_table():
     global target_global_jobids, stale_target
-    print(f"[INFO] Stale targets to update scores: {stale_target}", flush=True)
-    calculate_all_characteristics()
+    with score_table_lock:
+        print(f"[INFO] Stale targets to update scores: {stale_target}", flush=True)
+        calculate_all_characteristics()
 
-    for jobid in stale_target:
-        smtcheck_native.update_single_IPC_map(jobid, single_ipc_table[jobid])
-        smtcheck_native.update_score_map(jobid, -1, 1.0)
+        for jobid in stale_target:
+            provisional_ratio.pop(jobid, None)
+            smtcheck_native.update_single_IPC_map(jobid, single_ipc_table[jobid])
+            smtcheck_native.update_score_map(jobid, -1, 1.0)
 
-    for base_jobid, col_jobid in list(itertools.combinations(target_global_jobids, 2)) + list(zip(target_global_jobids, target_global_jobids)):
-            if base_jobid not in stale_target and col_jobid not in stale_target:
-                continue
+        for base_jobid, col_jobid in list(itertools.combinations(target_global_jobids, 2)) + list(zip(target_global_jobids, target_global_jobids)):
+                if base_jobid not in stale_target and col_jobid not in stale_target:
+                    continue
 
-            base_compat_score = calculate_compatibility_score(base_jobid, col_jobid)
-            if base_jobid == col_jobid:
-                col_compat_score = base_compat_score
-            else:
-                col_compat_score = calculate_compatibility_score(col_jobid, base_jobid)
-            
-            symbiotic_score = (base_compat_score + col_compat_score) 
-            smtcheck_native.update_score_map(base_jobid, col_jobid, symbiotic_score)
-    
-    stale_target = set() # Clear stale targets after updating scores
+                base_compat_score = calculate_compatibility_score(base_jobid, col_jobid)
+                if base_jobid == col_jobid:
+                    col_compat_score = base_compat_score
+                else:
+                    col_compat_score = calculate_compatibility_score(col_jobid, base_jobid)
+
+                symbiotic_score = (base_compat_score + col_compat_score) 
+                smtcheck_native.update_score_map(base_jobid, col_jobid, symbiotic_score)
+
+        stale_target = set() # Clear stale targets after updating scores
+
+def set_provisional_score(job_id, solo_ipc, corun_ipc):
+    """
+    Score a job that has not been profiled yet from its in-situ signature.
+
+    The co-run/solo IPC ratio measured by IPC_monitor during the grace period
+    stands in for the job's compatibility score against any sibling; a pair
+    score is the sum of both jobs' stand-ins, with a profiled job's own
+    self-pairing score as its stand-in. update_score_table() overwrites these
+    once the job is profiled.
+
+    Args:
+        job_id: Global job ID
+        solo_ipc: IPC while the SMT sibling was idle
+        corun_ipc: IPC while the SMT sibling was busy
+    """
+    with score_table_lock:
+        if job_id in target_global_jobids or not solo_ipc or corun_ipc is None:
+            return
+
+        ratio = clamp(corun_ipc / solo_ipc, 0.0, 1.0)
+        provisional_ratio[job_id] = ratio
+        smtcheck_native.update_single_IPC_map(job_id, solo_ipc)
+        smtcheck_native.update_score_map(job_id, -1, 1.0)
+
+        for col_jobid in target_global_jobids:
+            col_ratio = calculate_compatibility_score(col_jobid, col_jobid)
+            smtcheck_native.update_score_map(job_id, col_jobid, ratio + col_ratio)
+        for col_jobid, col_ratio in provisional_ratio.items():
+            smtcheck_native.update_score_map(job_id, col_jobid, ratio + col_ratio)
+        print(f"[INFO] Provisional score for job_id={job_id}: ratio={ratio:.4f} "
+              f"(solo IPC {solo_ipc:.4f}, co-run IPC {corun_ipc:.4f})", flush=True)
 
 def print_score_board():
     global target_global_jobids